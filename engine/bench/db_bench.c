@@ -132,6 +132,9 @@ static int FLAGS_bloom_bits = -1;
 /* Common key prefix length. */
 static int FLAGS_key_prefix = 0;
 
+/* Values of at least this size are kept in blob files (0 = never). */
+static int FLAGS_min_blob_size = 0;
+
 /* If true, do not destroy the existing database. If you set this
    flag and also specify a benchmark that wants a fresh database, that
    benchmark will fail. */
@@ -146,6 +149,21 @@ static int FLAGS_compression = 1;
 /* If true, use memory-mapped reads. */
 static int FLAGS_use_mmap = 1;
 
+/* Memtable representation (see enum ldb_memtable). */
+static int FLAGS_memtable = 0;
+
+/* Size of memtable arena blocks (0 for the default). */
+static int FLAGS_arena_block_size = 0;
+
+/* If true, back memtable arena blocks with huge pages. */
+static int FLAGS_huge_pages = 0;
+
+/* Compaction style (see enum ldb_compaction). */
+static int FLAGS_compaction_style = 0;
+
+/* If true, size levels from the size of the last level. */
+static int FLAGS_dynamic_level_bytes = 0;
+
 /* Use the db with the following name. */
 static const char *FLAGS_db = NULL;
 
@@ -593,6 +611,14 @@ bench_open(bench_t *bench) {
   options.reuse_logs = FLAGS_reuse_logs;
   options.compression = (enum ldb_compression)FLAGS_compression;
   options.use_mmap = FLAGS_use_mmap;
+  options.memtable_type = (enum ldb_memtable)FLAGS_memtable;
+  options.memtable_huge_pages = FLAGS_huge_pages;
+  options.min_blob_size = FLAGS_min_blob_size;
+  options.compaction_style = (enum ldb_compaction)FLAGS_compaction_style;
+  options.dynamic_level_bytes = FLAGS_dynamic_level_bytes;
+
+  if (FLAGS_arena_block_size > 0)
+    options.arena_block_size = FLAGS_arena_block_size;
 
   rc = ldb_open(FLAGS_db, &options, &bench->db);
 
@@ -1298,6 +1324,37 @@ bench_print_stats(bench_t *bench, const char *key) {
   }
 }
 
+static uint64_t
+bench_bytes_written(bench_t *bench) {
+  char *value = NULL;
+  uint64_t bytes = 0;
+
+  if (ldb_property(bench->db, "leveldb.bytes-written", &value)) {
+    const char *xp = value;
+
+    ldb_decode_int(&bytes, &xp);
+
+    free(value);
+  }
+
+  return bytes;
+}
+
+/* Report the bytes written to tables and blob files by flushes and
+   compactions during a write benchmark, against the bytes written by
+   the user. Compactions may still be running. */
+static void
+bench_report_writes(bench_t *bench, uint64_t before) {
+  double user = (double)bench->num * (FLAGS_key_prefix + 16 +
+                                      bench->value_size);
+  double bytes = (double)(bench_bytes_written(bench) - before);
+
+  fprintf(stdout, "Bytes written: %.1f MB (write amplification %.2f)\n",
+                  bytes / 1048576.0, user > 0 ? bytes / user : 0.0);
+
+  fflush(stdout);
+}
+
 static void
 bench_run(bench_t *bench) {
   const char *benchmarks = FLAGS_benchmarks;
@@ -1428,8 +1485,14 @@ bench_run(bench_t *bench) {
       }
     }
 
-    if (method != NULL)
+    if (method != NULL) {
+      uint64_t written = bench_bytes_written(bench);
+
       run_benchmark(bench, num_threads, name, method);
+
+      if (method == &bench_write_random || method == &bench_write_sequential)
+        bench_report_writes(bench, written);
+    }
   }
 }
 
@@ -1471,6 +1534,20 @@ main(int argc, char **argv) {
     } else if (sscanf(argv[i], "--use_mmap=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_use_mmap = n;
+    } else if (sscanf(argv[i], "--memtable=%d%c", &n, &junk) == 1 &&
+               (n >= 0 && n <= 2)) {
+      FLAGS_memtable = n;
+    } else if (sscanf(argv[i], "--arena_block_size=%d%c", &n, &junk) == 1) {
+      FLAGS_arena_block_size = n;
+    } else if (sscanf(argv[i], "--compaction_style=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_compaction_style = n;
+    } else if (sscanf(argv[i], "--dynamic_level_bytes=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_dynamic_level_bytes = n;
+    } else if (sscanf(argv[i], "--huge_pages=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_huge_pages = n;
     } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
       FLAGS_num = n;
     } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
@@ -1487,6 +1564,8 @@ main(int argc, char **argv) {
       FLAGS_block_size = n;
     } else if (sscanf(argv[i], "--key_prefix=%d%c", &n, &junk) == 1) {
       FLAGS_key_prefix = n < 0 ? 0 : LDB_MIN(n, 1000);
+    } else if (sscanf(argv[i], "--min_blob_size=%d%c", &n, &junk) == 1) {
+      FLAGS_min_blob_size = n < 0 ? 0 : n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
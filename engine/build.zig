@@ -118,6 +118,7 @@ pub fn build(b: *std.build.Builder) void {
     "src/table/table.c",
     "src/table/table_builder.c",
     "src/table/two_level_iterator.c",
+    "src/blob_file.c",
     "src/builder.c",
     "src/c.c",
     "src/db_impl.c",
@@ -128,8 +129,11 @@ pub fn build(b: *std.build.Builder) void {
     "src/log_reader.c",
     "src/log_writer.c",
     "src/memtable.c",
+    "src/merge.c",
+    "src/range_del.c",
     "src/repair.c",
     "src/skiplist.c",
+    "src/sst_writer.c",
     "src/table_cache.c",
     "src/version_edit.c",
     "src/version_set.c",
@@ -168,6 +172,10 @@ pub fn build(b: *std.build.Builder) void {
   if (!enable_portable) {
     defines.append("LDB_HAVE_FDATASYNC") catch unreachable;
     defines.append("LDB_HAVE_PREAD") catch unreachable;
+
+    if (target.getOsTag() == .linux) {
+      defines.append("LDB_HAVE_FALLOCATE") catch unreachable;
+    }
   }
 
   //
@@ -280,22 +288,33 @@ pub fn build(b: *std.build.Builder) void {
   const tests = [_][]const u8{
     "arena",
     "autocompact",
+    "blob",
     "bloom",
     "c",
     "cache",
     "coding",
+    "compaction_filter",
+    "compaction_trigger",
     "corruption",
     "crc32c",
     "db",
     "dbformat",
     "env",
+    "family",
     "filename",
     "filter_block",
+    "get_pinned",
     "hash",
+    "ingest",
     "issue178",
     "issue200",
     "issue320",
+    "iter_bounds",
+    "level0_compaction",
+    "level_sizing",
     "log",
+    "merge",
+    "range_del",
     "rbt",
     "recovery",
     "simple",
@@ -307,7 +326,8 @@ pub fn build(b: *std.build.Builder) void {
     "util",
     "version_edit",
     "version_set",
-    "write_batch"
+    "write_batch",
+    "write_stall"
   };
 
   for (tests) |name| {
@@ -56,6 +56,23 @@ enum ldb_compression {
   LDB_SNAPPY_COMPRESSION = 1
 };
 
+enum ldb_memtable {
+  LDB_SKIPLIST_MEMTABLE = 0,
+  LDB_VECTOR_MEMTABLE = 1,
+  LDB_HASH_MEMTABLE = 2
+};
+
+enum ldb_compaction {
+  LDB_LEVEL_COMPACTION = 0,
+  LDB_UNIVERSAL_COMPACTION = 1
+};
+
+enum ldb_decision {
+  LDB_FILTER_KEEP = 0,
+  LDB_FILTER_REMOVE = 1,
+  LDB_FILTER_CHANGE = 2
+};
+
 /*
  * Types
  */
@@ -63,16 +80,21 @@ enum ldb_compression {
 typedef struct ldb_s ldb_t;
 typedef struct ldb_batch_s ldb_batch_t;
 typedef struct ldb_bloom_s ldb_bloom_t;
+typedef struct ldb_cfilter_s ldb_cfilter_t;
 typedef struct ldb_comparator_s ldb_comparator_t;
 typedef struct ldb_dbopt_s ldb_dbopt_t;
+typedef struct ldb_family_s ldb_family_t;
 typedef struct ldb_handler_s ldb_handler_t;
 typedef struct ldb_iter_s ldb_iter_t;
 typedef struct ldb_logger_s ldb_logger_t;
 typedef struct ldb_lru_s ldb_lru_t;
+typedef struct ldb_merger_s ldb_merger_t;
+typedef struct ldb_pinned_s ldb_pinned_t;
 typedef struct ldb_range_s ldb_range_t;
 typedef struct ldb_readopt_s ldb_readopt_t;
 typedef struct ldb_slice_s ldb_slice_t;
 typedef struct ldb_snapshot_s ldb_snapshot_t;
+typedef struct ldb_sstwriter_s ldb_sstwriter_t;
 typedef struct ldb_writeopt_s ldb_writeopt_t;
 
 struct ldb_slice_s {
@@ -98,6 +120,26 @@ struct ldb_comparator_s {
   void *state;
 };
 
+struct ldb_cfilter_s {
+  const char *name;
+  enum ldb_decision (*filter)(const ldb_cfilter_t *cf,
+                              int level,
+                              const ldb_slice_t *key,
+                              const ldb_slice_t *value,
+                              ldb_slice_t *new_value);
+  void *state;
+};
+
+struct ldb_merger_s {
+  const char *name;
+  int (*merge)(const ldb_merger_t *op,
+               const ldb_slice_t *key,
+               const ldb_slice_t *existing,
+               const ldb_slice_t *value,
+               ldb_slice_t *result);
+  void *state;
+};
+
 struct ldb_dbopt_s {
   const ldb_comparator_t *comparator;
   int create_if_missing;
@@ -114,6 +156,31 @@ struct ldb_dbopt_s {
   int reuse_logs;
   const ldb_bloom_t *filter_policy;
   int use_mmap;
+  int use_mmap_logs;
+  int recycle_logs;
+  int warmup_threads;
+  enum ldb_memtable memtable_type;
+  size_t memtable_prefix;
+  size_t arena_block_size;
+  int memtable_huge_pages;
+  const ldb_cfilter_t *compaction_filter;
+  const ldb_merger_t *merge_operator;
+  size_t min_blob_size;
+  size_t blob_file_size;
+  int blob_gc_percent;
+  enum ldb_compaction compaction_style;
+  int universal_size_ratio;
+  int universal_min_merge_width;
+  int universal_max_size_amplification;
+  int dynamic_level_bytes;
+  int level0_compaction_trigger;
+  int level0_slowdown_writes_trigger;
+  int level0_stop_writes_trigger;
+  ldb_uint64_t soft_pending_compaction_bytes;
+  ldb_uint64_t hard_pending_compaction_bytes;
+  size_t delayed_write_rate;
+  int deletion_compaction_percent;
+  int max_file_age;
 };
 
 struct ldb_handler_s {
@@ -126,6 +193,16 @@ struct ldb_handler_s {
 
   void (*del)(ldb_handler_t *handler,
               const ldb_slice_t *key);
+
+  void (*del_range)(ldb_handler_t *handler,
+                    const ldb_slice_t *start,
+                    const ldb_slice_t *limit);
+
+  void (*merge)(ldb_handler_t *handler,
+                const ldb_slice_t *key,
+                const ldb_slice_t *value);
+
+  ldb_uint64_t family;
 };
 
 struct ldb_range_s {
@@ -137,6 +214,9 @@ struct ldb_readopt_s {
   int verify_checksums;
   int fill_cache;
   const ldb_snapshot_t *snapshot;
+  size_t readahead_size;
+  const ldb_slice_t *iterate_lower_bound;
+  const ldb_slice_t *iterate_upper_bound;
 };
 
 struct ldb_writeopt_s {
@@ -193,9 +273,42 @@ ldb_batch_put(ldb_batch_t *batch,
               const ldb_slice_t *key,
               const ldb_slice_t *value);
 
+void
+ldb_batch_put_cf(ldb_batch_t *batch,
+                 ldb_family_t *family,
+                 const ldb_slice_t *key,
+                 const ldb_slice_t *value);
+
 void
 ldb_batch_del(ldb_batch_t *batch, const ldb_slice_t *key);
 
+void
+ldb_batch_del_cf(ldb_batch_t *batch,
+                 ldb_family_t *family,
+                 const ldb_slice_t *key);
+
+void
+ldb_batch_del_range(ldb_batch_t *batch,
+                    const ldb_slice_t *start,
+                    const ldb_slice_t *limit);
+
+void
+ldb_batch_del_range_cf(ldb_batch_t *batch,
+                       ldb_family_t *family,
+                       const ldb_slice_t *start,
+                       const ldb_slice_t *limit);
+
+void
+ldb_batch_merge(ldb_batch_t *batch,
+                const ldb_slice_t *key,
+                const ldb_slice_t *value);
+
+void
+ldb_batch_merge_cf(ldb_batch_t *batch,
+                   ldb_family_t *family,
+                   const ldb_slice_t *key,
+                   const ldb_slice_t *value);
+
 int
 ldb_batch_iterate(const ldb_batch_t *batch, ldb_handler_t *handler);
 
@@ -260,6 +373,15 @@ ldb_lru_destroy(ldb_lru_t *lru);
 int
 ldb_open(const char *dbname, const ldb_dbopt_t *options, ldb_t **dbptr);
 
+int
+ldb_open_families(const char *dbname,
+                  const ldb_dbopt_t *options,
+                  const char *const *names,
+                  const ldb_dbopt_t *const *family_options,
+                  size_t length,
+                  ldb_family_t **families,
+                  ldb_t **dbptr);
+
 void
 ldb_close(ldb_t *db);
 
@@ -268,17 +390,79 @@ ldb_get(ldb_t *db, const ldb_slice_t *key,
                    ldb_slice_t *value,
                    const ldb_readopt_t *options);
 
+int
+ldb_get_cf(ldb_t *db, ldb_family_t *family,
+                      const ldb_slice_t *key,
+                      ldb_slice_t *value,
+                      const ldb_readopt_t *options);
+
+int
+ldb_get_pinned(ldb_t *db, const ldb_slice_t *key,
+                          ldb_slice_t *value,
+                          ldb_pinned_t **pin,
+                          const ldb_readopt_t *options);
+
+int
+ldb_get_pinned_cf(ldb_t *db, ldb_family_t *family,
+                             const ldb_slice_t *key,
+                             ldb_slice_t *value,
+                             ldb_pinned_t **pin,
+                             const ldb_readopt_t *options);
+
+void
+ldb_unpin(ldb_pinned_t *pin);
+
 int
 ldb_has(ldb_t *db, const ldb_slice_t *key, const ldb_readopt_t *options);
 
+int
+ldb_has_cf(ldb_t *db, ldb_family_t *family,
+                      const ldb_slice_t *key,
+                      const ldb_readopt_t *options);
+
 int
 ldb_put(ldb_t *db, const ldb_slice_t *key,
                    const ldb_slice_t *value,
                    const ldb_writeopt_t *options);
 
+int
+ldb_put_cf(ldb_t *db, ldb_family_t *family,
+                      const ldb_slice_t *key,
+                      const ldb_slice_t *value,
+                      const ldb_writeopt_t *options);
+
 int
 ldb_del(ldb_t *db, const ldb_slice_t *key, const ldb_writeopt_t *options);
 
+int
+ldb_del_cf(ldb_t *db, ldb_family_t *family,
+                      const ldb_slice_t *key,
+                      const ldb_writeopt_t *options);
+
+int
+ldb_del_range(ldb_t *db,
+              const ldb_slice_t *start,
+              const ldb_slice_t *limit,
+              const ldb_writeopt_t *options);
+
+int
+ldb_del_range_cf(ldb_t *db,
+                 ldb_family_t *family,
+                 const ldb_slice_t *start,
+                 const ldb_slice_t *limit,
+                 const ldb_writeopt_t *options);
+
+int
+ldb_merge(ldb_t *db, const ldb_slice_t *key,
+                     const ldb_slice_t *value,
+                     const ldb_writeopt_t *options);
+
+int
+ldb_merge_cf(ldb_t *db, ldb_family_t *family,
+                        const ldb_slice_t *key,
+                        const ldb_slice_t *value,
+                        const ldb_writeopt_t *options);
+
 int
 ldb_write(ldb_t *db, ldb_batch_t *updates, const ldb_writeopt_t *options);
 
@@ -291,20 +475,59 @@ ldb_release(ldb_t *db, const ldb_snapshot_t *snapshot);
 int
 ldb_property(ldb_t *db, const char *property, char **value);
 
+int
+ldb_property_cf(ldb_t *db, ldb_family_t *family,
+                           const char *property,
+                           char **value);
+
 void
 ldb_approximate_sizes(ldb_t *db, const ldb_range_t *range,
                                  size_t length,
                                  ldb_uint64_t *sizes);
 
+void
+ldb_approximate_sizes_cf(ldb_t *db, ldb_family_t *family,
+                                    const ldb_range_t *range,
+                                    size_t length,
+                                    ldb_uint64_t *sizes);
+
 void
 ldb_compact(ldb_t *db, const ldb_slice_t *begin, const ldb_slice_t *end);
 
+void
+ldb_compact_cf(ldb_t *db, ldb_family_t *family,
+                          const ldb_slice_t *begin,
+                          const ldb_slice_t *end);
+
+int
+ldb_ingest_files(ldb_t *db, const char *const *paths, size_t length);
+
+int
+ldb_ingest_files_cf(ldb_t *db, ldb_family_t *family,
+                               const char *const *paths,
+                               size_t length);
+
 int
 ldb_backup(ldb_t *db, const char *name);
 
 int
 ldb_compare(const ldb_t *db, const ldb_slice_t *x, const ldb_slice_t *y);
 
+/*
+ * Column Family
+ */
+
+int
+ldb_family_create(ldb_t *db, const char *name,
+                             const ldb_dbopt_t *options,
+                             ldb_family_t **family);
+
+int
+ldb_family_drop(ldb_t *db, ldb_family_t *family);
+
+const char *
+ldb_family_name(const ldb_family_t *family);
+
 /*
  * Static
  */
@@ -342,6 +565,10 @@ ldb_free(void *ptr);
 ldb_iter_t *
 ldb_iterator(ldb_t *db, const ldb_readopt_t *options);
 
+ldb_iter_t *
+ldb_iterator_cf(ldb_t *db, ldb_family_t *family,
+                           const ldb_readopt_t *options);
+
 void
 ldb_iter_destroy(ldb_iter_t *iter);
 
@@ -478,6 +705,13 @@ ldb_logger_create(void (*logv)(void *, const char *, va_list), void *state);
 void
 ldb_logger_destroy(ldb_logger_t *logger);
 
+/*
+ * Merge
+ */
+
+void
+ldb_merge_append(ldb_slice_t *result, const void *data, size_t size);
+
 /*
  * Slice
  */
@@ -501,6 +735,32 @@ ldb_string(const char *xp);
 })
 #endif
 
+/*
+ * SST Writer
+ */
+
+int
+ldb_sstwriter_open(const char *filename,
+                   const ldb_dbopt_t *options,
+                   ldb_sstwriter_t **writer);
+
+void
+ldb_sstwriter_close(ldb_sstwriter_t *writer);
+
+int
+ldb_sstwriter_put(ldb_sstwriter_t *writer,
+                  const ldb_slice_t *key,
+                  const ldb_slice_t *value);
+
+int
+ldb_sstwriter_del(ldb_sstwriter_t *writer, const ldb_slice_t *key);
+
+int
+ldb_sstwriter_finish(ldb_sstwriter_t *writer);
+
+ldb_uint64_t
+ldb_sstwriter_size(const ldb_sstwriter_t *writer);
+
 /*
  * Status
  */
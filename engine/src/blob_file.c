@@ -0,0 +1,500 @@
+/*!
+ * blob_file.c - blob files for lcdb
+ * Copyright (c) 2022, Christopher Jeffrey (MIT License).
+ * https://github.com/chjj/lcdb
+ *
+ * See LICENSE for more information.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/buffer.h"
+#include "util/cache.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/env.h"
+#include "util/internal.h"
+#include "util/options.h"
+#include "util/slice.h"
+#include "util/status.h"
+
+#include "blob_file.h"
+#include "filename.h"
+
+/*
+ * BlobRef
+ */
+
+void
+ldb_blobref_export(ldb_buffer_t *z, const ldb_blobref_t *x) {
+  ldb_buffer_varint64(z, x->number);
+  ldb_buffer_varint64(z, x->offset);
+  ldb_buffer_varint64(z, x->size);
+}
+
+int
+ldb_blobref_import(ldb_blobref_t *z, const ldb_slice_t *x) {
+  ldb_slice_t s = *x;
+
+  if (!ldb_varint64_slurp(&z->number, &s))
+    return 0;
+
+  if (!ldb_varint64_slurp(&z->offset, &s))
+    return 0;
+
+  if (!ldb_varint64_slurp(&z->size, &s))
+    return 0;
+
+  return s.size == 0 && z->number > 0;
+}
+
+int
+ldb_blob_decode(ldb_slice_t *key,
+                ldb_slice_t *value,
+                const ldb_slice_t *record,
+                int verify) {
+  ldb_slice_t x = *record;
+  ldb_slice_t k;
+  uint32_t crc;
+
+  if (x.size < LDB_BLOB_HEADER)
+    return LDB_CORRUPTION; /* "truncated blob record" */
+
+  crc = ldb_crc32c_unmask(ldb_fixed32_decode(x.data));
+
+  ldb_slice_eat(&x, 4);
+
+  if (verify && ldb_crc32c_value(x.data, x.size) != crc)
+    return LDB_CORRUPTION; /* "blob record checksum mismatch" */
+
+  if (ldb_fixed32_decode(x.data) != x.size - 4)
+    return LDB_CORRUPTION; /* "bad blob record length" */
+
+  ldb_slice_eat(&x, 4);
+
+  if (!ldb_slice_slurp(&k, &x))
+    return LDB_CORRUPTION; /* "bad blob record key" */
+
+  if (key != NULL)
+    *key = k;
+
+  *value = x;
+
+  return LDB_OK;
+}
+
+int
+ldb_blob_scan(const char *fname,
+              uint64_t number,
+              void *arg,
+              void (*func)(void *arg,
+                           const ldb_blobref_t *ref,
+                           const ldb_slice_t *key,
+                           const ldb_slice_t *value)) {
+  ldb_slice_t record, key, value;
+  ldb_rfile_t *file;
+  ldb_buffer_t buf;
+  ldb_blobref_t ref;
+  uint64_t size;
+  int rc;
+
+  rc = ldb_file_size(fname, &size);
+
+  if (rc != LDB_OK)
+    return rc;
+
+  rc = ldb_randfile_create(fname, &file, 0);
+
+  if (rc != LDB_OK)
+    return rc;
+
+  ldb_buffer_init(&buf);
+
+  ref.number = number;
+  ref.offset = 0;
+
+  while (ref.offset < size) {
+    ldb_buffer_grow(&buf, LDB_BLOB_HEADER);
+
+    rc = ldb_rfile_pread(file, &record, buf.data, LDB_BLOB_HEADER,
+                                                  ref.offset);
+
+    if (rc != LDB_OK)
+      break;
+
+    if (record.size < LDB_BLOB_HEADER) {
+      rc = LDB_CORRUPTION; /* "truncated blob record" */
+      break;
+    }
+
+    ref.size = LDB_BLOB_HEADER + (uint64_t)ldb_fixed32_decode(record.data + 4);
+
+    if (ref.size > size - ref.offset) {
+      rc = LDB_CORRUPTION; /* "truncated blob record" */
+      break;
+    }
+
+    ldb_buffer_grow(&buf, ref.size);
+
+    rc = ldb_rfile_pread(file, &record, buf.data, ref.size, ref.offset);
+
+    if (rc == LDB_OK && record.size != ref.size)
+      rc = LDB_CORRUPTION; /* "truncated blob record" */
+
+    if (rc == LDB_OK)
+      rc = ldb_blob_decode(&key, &value, &record, 1);
+
+    if (rc != LDB_OK)
+      break;
+
+    func(arg, &ref, &key, &value);
+
+    ref.offset += ref.size;
+  }
+
+  ldb_buffer_clear(&buf);
+  ldb_rfile_destroy(file);
+
+  return rc;
+}
+
+/*
+ * BlobBuilder
+ */
+
+struct ldb_blobgen_s {
+  ldb_wfile_t *file;
+  uint64_t number;
+  uint64_t offset;
+  uint64_t count;
+  ldb_buffer_t header;
+  int status;
+  int closed; /* finish() has been called. */
+};
+
+ldb_blobgen_t *
+ldb_blobgen_create(ldb_wfile_t *file, uint64_t number) {
+  ldb_blobgen_t *bg = ldb_malloc(sizeof(ldb_blobgen_t));
+
+  bg->file = file;
+  bg->number = number;
+  bg->offset = 0;
+  bg->count = 0;
+  bg->status = LDB_OK;
+  bg->closed = 0;
+
+  ldb_buffer_init(&bg->header);
+
+  return bg;
+}
+
+void
+ldb_blobgen_destroy(ldb_blobgen_t *bg) {
+  ldb_buffer_clear(&bg->header);
+  ldb_free(bg);
+}
+
+int
+ldb_blobgen_add(ldb_blobgen_t *bg,
+                const ldb_slice_t *key,
+                const ldb_slice_t *value,
+                ldb_blobref_t *ref) {
+  ldb_buffer_t *header = &bg->header;
+  uint32_t crc;
+
+  assert(!bg->closed);
+
+  if (bg->status != LDB_OK)
+    return bg->status;
+
+  ldb_buffer_resize(header, LDB_BLOB_HEADER);
+  ldb_slice_export(header, key);
+
+  if (header->size - 8 + (uint64_t)value->size > UINT32_MAX)
+    return LDB_INVALID; /* "value too large" */
+
+  ldb_fixed32_write(header->data + 4, header->size - 8 + value->size);
+
+  crc = ldb_crc32c_value(header->data + 4, header->size - 4);
+  crc = ldb_crc32c_extend(crc, value->data, value->size);
+
+  ldb_fixed32_write(header->data, ldb_crc32c_mask(crc));
+
+  bg->status = ldb_wfile_append(bg->file, header);
+
+  if (bg->status == LDB_OK)
+    bg->status = ldb_wfile_append(bg->file, value);
+
+  if (bg->status == LDB_OK) {
+    ref->number = bg->number;
+    ref->offset = bg->offset;
+    ref->size = header->size + value->size;
+
+    bg->offset += ref->size;
+    bg->count += 1;
+  }
+
+  return bg->status;
+}
+
+int
+ldb_blobgen_finish(ldb_blobgen_t *bg) {
+  assert(!bg->closed);
+
+  bg->closed = 1;
+
+  return bg->status;
+}
+
+int
+ldb_blobgen_status(const ldb_blobgen_t *bg) {
+  return bg->status;
+}
+
+uint64_t
+ldb_blobgen_count(const ldb_blobgen_t *bg) {
+  return bg->count;
+}
+
+uint64_t
+ldb_blobgen_size(const ldb_blobgen_t *bg) {
+  return bg->offset;
+}
+
+/*
+ * BlobCache
+ */
+
+struct ldb_blobs_s {
+  const char *dbname;
+  const ldb_dbopt_t *options;
+  ldb_lru_t *lru;
+};
+
+/* Blob files are never modified once they are in use. */
+typedef struct blob_file_s {
+  ldb_rfile_t *file;
+  uint64_t size;
+} blob_file_t;
+
+static void
+delete_entry(const ldb_slice_t *key, void *value) {
+  blob_file_t *bf = value;
+
+  (void)key;
+
+  ldb_rfile_destroy(bf->file);
+  ldb_free(bf);
+}
+
+ldb_blobs_t *
+ldb_blobs_create(const char *dbname, const ldb_dbopt_t *options, int entries) {
+  ldb_blobs_t *cache = ldb_malloc(sizeof(ldb_blobs_t));
+
+  cache->dbname = dbname;
+  cache->options = options;
+  cache->lru = ldb_lru_create(entries);
+
+  return cache;
+}
+
+void
+ldb_blobs_destroy(ldb_blobs_t *cache) {
+  ldb_lru_destroy(cache->lru);
+  ldb_free(cache);
+}
+
+static int
+find_file(ldb_blobs_t *cache, uint64_t number, ldb_entry_t **handle) {
+  ldb_slice_t key;
+  int rc = LDB_OK;
+  uint8_t buf[8];
+
+  ldb_fixed64_write(buf, number);
+
+  ldb_slice_set(&key, buf, sizeof(buf));
+
+  *handle = ldb_lru_lookup(cache->lru, &key);
+
+  if (*handle == NULL) {
+    char fname[LDB_PATH_MAX];
+    ldb_rfile_t *file = NULL;
+    uint64_t size = 0;
+
+    if (!ldb_blob_filename(fname, sizeof(fname), cache->dbname, number))
+      return LDB_INVALID;
+
+    rc = ldb_file_size(fname, &size);
+
+    if (rc == LDB_OK)
+      rc = ldb_randfile_create(fname, &file, cache->options->use_mmap);
+
+    /* We do not cache error results so that if the error is transient,
+       or somebody repairs the file, we recover automatically. */
+    if (rc == LDB_OK) {
+      blob_file_t *bf = ldb_malloc(sizeof(blob_file_t));
+
+      bf->file = file;
+      bf->size = size;
+
+      *handle = ldb_lru_insert(cache->lru, &key, bf, 1, &delete_entry);
+    }
+  }
+
+  return rc;
+}
+
+/* Read "count" bytes at "offset" into *buf. Fewer bytes are
+   read if the file ends first. */
+static int
+ldb_blobs_pread(ldb_blobs_t *cache,
+                uint64_t number,
+                uint64_t offset,
+                size_t count,
+                ldb_buffer_t *buf) {
+  ldb_entry_t *handle = NULL;
+  ldb_slice_t result;
+  blob_file_t *bf;
+  int rc;
+
+  rc = find_file(cache, number, &handle);
+
+  if (rc != LDB_OK)
+    return rc;
+
+  bf = ldb_lru_value(handle);
+
+  if (offset >= bf->size)
+    count = 0;
+  else if (count > bf->size - offset)
+    count = bf->size - offset;
+
+  ldb_buffer_grow(buf, count);
+
+  rc = ldb_rfile_pread(bf->file, &result, buf->data, count, offset);
+
+  if (rc == LDB_OK) {
+    if (result.size > 0 && result.data != buf->data)
+      memcpy(buf->data, result.data, result.size);
+
+    buf->size = result.size;
+  }
+
+  ldb_lru_release(cache->lru, handle);
+
+  return rc;
+}
+
+int
+ldb_blobs_get(ldb_blobs_t *cache,
+              const ldb_readopt_t *options,
+              const ldb_blobref_t *ref,
+              ldb_buffer_t *value) {
+  size_t size = ref->size;
+  ldb_slice_t record, val;
+  int rc;
+
+  if (size != ref->size)
+    return LDB_CORRUPTION;
+
+  rc = ldb_blobs_pread(cache, ref->number, ref->offset, size, value);
+
+  if (rc != LDB_OK)
+    return rc;
+
+  if (value->size != size)
+    return LDB_CORRUPTION; /* "truncated blob record" */
+
+  ldb_slice_set(&record, value->data, value->size);
+
+  rc = ldb_blob_decode(NULL, &val, &record, options->verify_checksums);
+
+  if (rc != LDB_OK)
+    return rc;
+
+  memmove(value->data, val.data, val.size);
+
+  value->size = val.size;
+
+  return LDB_OK;
+}
+
+void
+ldb_blobs_evict(ldb_blobs_t *cache, uint64_t number) {
+  ldb_slice_t key;
+  uint8_t buf[8];
+
+  ldb_fixed64_write(buf, number);
+
+  ldb_slice_set(&key, buf, sizeof(buf));
+
+  ldb_lru_erase(cache->lru, &key);
+}
+
+/*
+ * BlobReader
+ */
+
+void
+ldb_blobreader_init(ldb_blobreader_t *br, ldb_blobs_t *cache, size_t readahead) {
+  br->cache = cache;
+  br->readahead = readahead;
+  br->number = 0;
+  br->offset = 0;
+
+  ldb_buffer_init(&br->data);
+}
+
+void
+ldb_blobreader_clear(ldb_blobreader_t *br) {
+  ldb_buffer_clear(&br->data);
+}
+
+int
+ldb_blobreader_read(ldb_blobreader_t *br,
+                    const ldb_readopt_t *options,
+                    const ldb_blobref_t *ref,
+                    ldb_slice_t *value) {
+  uint64_t end = ref->offset + ref->size;
+  ldb_slice_t record;
+
+  if ((size_t)ref->size != ref->size || end < ref->offset)
+    return LDB_CORRUPTION;
+
+  if (ref->number != br->number
+      || ref->offset < br->offset
+      || end > br->offset + br->data.size) {
+    uint64_t offset = ref->offset;
+    size_t count = ref->size;
+    int rc;
+
+    if (count < br->readahead) {
+      count = br->readahead;
+
+      /* Read behind the record when iterating in reverse. */
+      if (ref->number == br->number && ref->offset < br->offset)
+        offset = end > count ? end - count : 0;
+    }
+
+    br->number = 0;
+
+    rc = ldb_blobs_pread(br->cache, ref->number, offset, count, &br->data);
+
+    if (rc != LDB_OK)
+      return rc;
+
+    if (end > offset + br->data.size)
+      return LDB_CORRUPTION; /* "truncated blob record" */
+
+    br->number = ref->number;
+    br->offset = offset;
+  }
+
+  ldb_slice_set(&record, br->data.data + (ref->offset - br->offset),
+                         ref->size);
+
+  return ldb_blob_decode(NULL, value, &record, options->verify_checksums);
+}
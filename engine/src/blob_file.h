@@ -0,0 +1,181 @@
+/*!
+ * blob_file.h - blob files for lcdb
+ * Copyright (c) 2022, Christopher Jeffrey (MIT License).
+ * https://github.com/chjj/lcdb
+ *
+ * See LICENSE for more information.
+ */
+
+#ifndef LDB_BLOB_FILE_H
+#define LDB_BLOB_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/types.h"
+
+/* A blob file is an append-only sequence of records, each holding
+ * a value which was too large to keep in the tables:
+ *
+ *    checksum: fixed32 (masked crc32c of the rest of the record)
+ *    length: fixed32 (size of the rest of the record)
+ *    key: varstring (user key the value was written under)
+ *    value: uint8[] (rest of the record)
+ *
+ * Tables store an entry of type LDB_TYPE_BLOB in place of the value,
+ * holding a reference to its record (see ldb_blobref_t). The file has
+ * no index: the keys are only kept so that it can be inspected.
+ */
+
+/*
+ * Constants
+ */
+
+/* Size of the checksum and length of a record. */
+#define LDB_BLOB_HEADER 8
+
+/* Bytes read ahead of a record by iterators. */
+#define LDB_BLOB_READAHEAD (256 << 10)
+
+/*
+ * Types
+ */
+
+struct ldb_dbopt_s;
+struct ldb_readopt_s;
+struct ldb_wfile_s;
+
+/* The location of a record:
+ *
+ *    number: varint64
+ *    offset: varint64
+ *    size: varint64
+ */
+typedef struct ldb_blobref_s {
+  uint64_t number; /* Blob file number. */
+  uint64_t offset; /* Offset of the record. */
+  uint64_t size;   /* Size of the record. */
+} ldb_blobref_t;
+
+typedef struct ldb_blobgen_s ldb_blobgen_t;
+typedef struct ldb_blobs_s ldb_blobs_t;
+
+/* Reads records while buffering the bytes around them, so that
+   iterating over values written in key order reads sequentially. */
+typedef struct ldb_blobreader_s {
+  ldb_blobs_t *cache;
+  size_t readahead;
+  uint64_t number; /* File of the buffered bytes. */
+  uint64_t offset; /* Offset of the buffered bytes. */
+  ldb_buffer_t data;
+} ldb_blobreader_t;
+
+/*
+ * BlobRef
+ */
+
+void
+ldb_blobref_export(ldb_buffer_t *z, const ldb_blobref_t *x);
+
+int
+ldb_blobref_import(ldb_blobref_t *z, const ldb_slice_t *x);
+
+/* Parse a record read from "ref", verifying its checksum
+   if "verify" is true, and point "value" into it. */
+int
+ldb_blob_decode(ldb_slice_t *key,
+                ldb_slice_t *value,
+                const ldb_slice_t *record,
+                int verify);
+
+/* Call func(arg, ref, key, value) for every record of the named blob
+   file, in order. Stops at the first corrupt record. */
+int
+ldb_blob_scan(const char *fname,
+              uint64_t number,
+              void *arg,
+              void (*func)(void *arg,
+                           const ldb_blobref_t *ref,
+                           const ldb_slice_t *key,
+                           const ldb_slice_t *value));
+
+/*
+ * BlobBuilder
+ */
+
+/* Create a builder that will append records to *file. Does not
+   close the file. It is up to the caller to sync and close the
+   file after calling finish(). */
+ldb_blobgen_t *
+ldb_blobgen_create(struct ldb_wfile_s *file, uint64_t number);
+
+void
+ldb_blobgen_destroy(ldb_blobgen_t *bg);
+
+/* Append a record and store its location in *ref. */
+int
+ldb_blobgen_add(ldb_blobgen_t *bg,
+                const ldb_slice_t *key,
+                const ldb_slice_t *value,
+                ldb_blobref_t *ref);
+
+/* Finish writing the file. Returns non-ok if any error occurred. */
+int
+ldb_blobgen_finish(ldb_blobgen_t *bg);
+
+/* Return non-ok iff some error has been detected. */
+int
+ldb_blobgen_status(const ldb_blobgen_t *bg);
+
+/* Number of records added so far. */
+uint64_t
+ldb_blobgen_count(const ldb_blobgen_t *bg);
+
+/* Size of the file generated so far. */
+uint64_t
+ldb_blobgen_size(const ldb_blobgen_t *bg);
+
+/*
+ * BlobCache
+ */
+
+/* A cache of open blob files, to be shared by all readers of a
+   column family. Provides its own synchronization. */
+ldb_blobs_t *
+ldb_blobs_create(const char *dbname,
+                 const struct ldb_dbopt_s *options,
+                 int entries);
+
+void
+ldb_blobs_destroy(ldb_blobs_t *cache);
+
+/* Read the value of the record at "ref" into *value. */
+int
+ldb_blobs_get(ldb_blobs_t *cache,
+              const struct ldb_readopt_s *options,
+              const ldb_blobref_t *ref,
+              ldb_buffer_t *value);
+
+/* Evict any entry for the specified file number. */
+void
+ldb_blobs_evict(ldb_blobs_t *cache, uint64_t number);
+
+/*
+ * BlobReader
+ */
+
+void
+ldb_blobreader_init(ldb_blobreader_t *br, ldb_blobs_t *cache, size_t readahead);
+
+void
+ldb_blobreader_clear(ldb_blobreader_t *br);
+
+/* Point *value at the value of the record at "ref". The value remains
+   valid until the next read. */
+int
+ldb_blobreader_read(ldb_blobreader_t *br,
+                    const struct ldb_readopt_s *options,
+                    const ldb_blobref_t *ref,
+                    ldb_slice_t *value);
+
+#endif /* LDB_BLOB_FILE_H */
@@ -16,17 +16,166 @@
 #include "table/iterator.h"
 #include "table/table_builder.h"
 
+#include "util/buffer.h"
+#include "util/comparator.h"
 #include "util/env.h"
 #include "util/internal.h"
 #include "util/options.h"
 #include "util/status.h"
 
+#include "blob_file.h"
 #include "builder.h"
 #include "dbformat.h"
 #include "filename.h"
+#include "range_del.h"
 #include "table_cache.h"
 #include "version_edit.h"
 
+/*
+ * Tombstones
+ */
+
+void
+ldb_build_tombstones(ldb_tablegen_t *builder,
+                     const ldb_comparator_t *icmp,
+                     const ldb_rangedel_t *tombstones,
+                     ldb_ikey_t *smallest,
+                     ldb_ikey_t *largest) {
+  ldb_buffer_t key, last;
+  size_t i;
+
+  assert(tombstones->finished);
+
+  ldb_buffer_init(&key);
+  ldb_buffer_init(&last);
+
+  for (i = 0; i < ldb_rangedel_length(tombstones); i++) {
+    const ldb_tombstone_t *ts = ldb_rangedel_get(tombstones, i);
+
+    ldb_buffer_reset(&key);
+    ldb_tombstone_export(&key, ts);
+
+    /* Duplicates are ordered by decreasing limit. Keep the first. */
+    if (last.size > 0 && ldb_buffer_equal(&key, &last))
+      continue;
+
+    ldb_tablegen_add_tombstone(builder, &key, &ts->limit);
+
+    ldb_buffer_swap(&last, &key);
+  }
+
+  ldb_rangedel_bounds(tombstones, icmp, smallest, largest);
+
+  ldb_buffer_clear(&key);
+  ldb_buffer_clear(&last);
+}
+
+/*
+ * BlobOutput
+ */
+
+typedef struct blob_output_s {
+  const char *dbname;
+  ldb_blobmeta_t *meta;
+  ldb_wfile_t *file;
+  ldb_blobgen_t *gen;
+  ldb_buffer_t key;
+  ldb_buffer_t index;
+} blob_output_t;
+
+static void
+blob_output_init(blob_output_t *out, const char *dbname, ldb_blobmeta_t *meta) {
+  out->dbname = dbname;
+  out->meta = meta;
+  out->file = NULL;
+  out->gen = NULL;
+
+  ldb_buffer_init(&out->key);
+  ldb_buffer_init(&out->index);
+}
+
+/* Write a value to the blob file, and point *key and *val
+   to an entry referencing it. Other entries are left alone. */
+static int
+blob_output_add(blob_output_t *out, ldb_slice_t *key, ldb_slice_t *val) {
+  ldb_blobref_t ref;
+  ldb_pkey_t pkey;
+  int rc;
+
+  if (!ldb_pkey_import(&pkey, key) || pkey.type != LDB_TYPE_VALUE)
+    return LDB_OK;
+
+  if (out->gen == NULL) {
+    char fname[LDB_PATH_MAX];
+
+    if (!ldb_blob_filename(fname, sizeof(fname), out->dbname,
+                                                 out->meta->number)) {
+      return LDB_INVALID;
+    }
+
+    rc = ldb_truncfile_create(fname, &out->file);
+
+    if (rc != LDB_OK)
+      return rc;
+
+    out->gen = ldb_blobgen_create(out->file, out->meta->number);
+  }
+
+  rc = ldb_blobgen_add(out->gen, &pkey.user_key, val, &ref);
+
+  if (rc != LDB_OK)
+    return rc;
+
+  pkey.type = LDB_TYPE_BLOB;
+
+  ldb_buffer_reset(&out->key);
+  ldb_pkey_export(&out->key, &pkey);
+
+  ldb_buffer_reset(&out->index);
+  ldb_blobref_export(&out->index, &ref);
+
+  *key = out->key;
+  *val = out->index;
+
+  return LDB_OK;
+}
+
+/* Finish the blob file (if any), removing it unless "rc" is OK. */
+static int
+blob_output_finish(blob_output_t *out, int rc) {
+  char fname[LDB_PATH_MAX];
+
+  if (out->gen != NULL) {
+    if (rc == LDB_OK)
+      rc = ldb_blobgen_finish(out->gen);
+
+    out->meta->count = ldb_blobgen_count(out->gen);
+    out->meta->bytes = ldb_blobgen_size(out->gen);
+
+    ldb_blobgen_destroy(out->gen);
+
+    if (rc == LDB_OK)
+      rc = ldb_wfile_sync(out->file);
+
+    if (rc == LDB_OK)
+      rc = ldb_wfile_close(out->file);
+
+    ldb_wfile_destroy(out->file);
+
+    if (rc != LDB_OK) {
+      if (ldb_blob_filename(fname, sizeof(fname), out->dbname,
+                                                  out->meta->number)) {
+        ldb_remove_file(fname);
+      }
+    }
+  }
+
+  ldb_buffer_clear(&out->key);
+  ldb_buffer_clear(&out->index);
+
+  return rc;
+}
+
 /*
  * BuildTable
  */
@@ -36,18 +185,34 @@ ldb_build_table(const char *dbname,
                 const ldb_dbopt_t *options,
                 ldb_tables_t *table_cache,
                 ldb_iter_t *iter,
-                ldb_filemeta_t *meta) {
+                const ldb_rangedel_t *tombstones,
+                ldb_filemeta_t *meta,
+                ldb_blobmeta_t *blob) {
+  size_t min_blob_size = blob != NULL ? options->min_blob_size : 0;
   char fname[LDB_PATH_MAX];
+  blob_output_t blobs;
   int rc = LDB_OK;
 
   meta->file_size = 0;
+  meta->tombstones = 0;
+  meta->oldest_blob = 0;
+  meta->entries = 0;
+  meta->deletions = 0;
+  meta->created = ldb_now_usec() / 1000000;
+
+  if (blob != NULL) {
+    blob->count = 0;
+    blob->bytes = 0;
+  }
+
+  blob_output_init(&blobs, dbname, blob);
 
   ldb_iter_first(iter);
 
   if (!ldb_table_filename(fname, sizeof(fname), dbname, meta->number))
     return LDB_INVALID;
 
-  if (ldb_iter_valid(iter)) {
+  if (ldb_iter_valid(iter) || ldb_rangedel_length(tombstones) > 0) {
     ldb_tablegen_t *builder;
     ldb_slice_t key, val;
     ldb_wfile_t *file;
@@ -60,21 +225,49 @@ ldb_build_table(const char *dbname,
 
     builder = ldb_tablegen_create(options, file);
 
-    key = ldb_iter_key(iter);
-
-    ldb_ikey_copy(&meta->smallest, &key);
+    ldb_buffer_reset(&meta->smallest);
+    ldb_buffer_reset(&meta->largest);
 
-    for (; ldb_iter_valid(iter); ldb_iter_next(iter)) {
+    if (ldb_iter_valid(iter)) {
       key = ldb_iter_key(iter);
-      val = ldb_iter_value(iter);
 
-      ldb_tablegen_add(builder, &key, &val);
+      ldb_ikey_copy(&meta->smallest, &key);
+
+      for (; ldb_iter_valid(iter); ldb_iter_next(iter)) {
+        key = ldb_iter_key(iter);
+        val = ldb_iter_value(iter);
+
+        if (min_blob_size > 0 && val.size >= min_blob_size) {
+          rc = blob_output_add(&blobs, &key, &val);
+
+          if (rc != LDB_OK)
+            break;
+        }
+
+        if (ldb_extract_type(&key) == LDB_TYPE_DELETION)
+          meta->deletions++;
+
+        ldb_tablegen_add(builder, &key, &val);
+      }
+
+      meta->entries = ldb_tablegen_entries(builder);
+
+      ldb_ikey_copy(&meta->largest, &key);
+
+      if (blobs.gen != NULL)
+        meta->oldest_blob = blob->number;
     }
 
-    ldb_ikey_copy(&meta->largest, &key);
+    ldb_build_tombstones(builder, options->comparator, tombstones,
+                         &meta->smallest, &meta->largest);
+
+    meta->tombstones = ldb_tablegen_tombstones(builder);
 
     /* Finish and check for builder errors. */
-    rc = ldb_tablegen_finish(builder);
+    if (rc == LDB_OK)
+      rc = ldb_tablegen_finish(builder);
+    else
+      ldb_tablegen_abandon(builder);
 
     if (rc == LDB_OK) {
       meta->file_size = ldb_tablegen_size(builder);
@@ -100,6 +293,7 @@ ldb_build_table(const char *dbname,
                               ldb_readopt_default,
                               meta->number,
                               meta->file_size,
+                              0,
                               NULL);
 
       rc = ldb_iter_status(it);
@@ -112,6 +306,8 @@ ldb_build_table(const char *dbname,
   if (ldb_iter_status(iter) != LDB_OK)
     rc = ldb_iter_status(iter);
 
+  rc = blob_output_finish(&blobs, rc);
+
   if (rc == LDB_OK && meta->file_size > 0)
     ; /* Keep it. */
   else
@@ -13,29 +13,53 @@
 #ifndef LDB_BUILDER_H
 #define LDB_BUILDER_H
 
+#include "util/types.h"
+
 /*
  * Types
  */
 
+struct ldb_blobmeta_s;
 struct ldb_dbopt_s;
 struct ldb_filemeta_s;
+struct ldb_comparator_s;
 struct ldb_iter_s;
+struct ldb_rangedel_s;
+struct ldb_tablegen_s;
 struct ldb_tables_s;
 
 /*
  * BuildTable
  */
 
-/* Build a Table file from the contents of *iter. The generated file
-   will be named according to meta->number. On success, the rest of
-   *meta will be filled with metadata about the generated table.
-   If no data is present in *iter, meta->file_size will be set to
-   zero, and no Table file will be produced. */
+/* Add the (finished) range tombstones to a table being built and
+   widen [*smallest, *largest] to cover them. Both keys are empty if
+   the table has no point entries. */
+void
+ldb_build_tombstones(struct ldb_tablegen_s *builder,
+                     const struct ldb_comparator_s *icmp,
+                     const struct ldb_rangedel_s *tombstones,
+                     ldb_slice_t *smallest,
+                     ldb_slice_t *largest);
+
+/* Build a Table file from the contents of *iter and the range
+   tombstones in *tombstones (which must be finished). The generated
+   file will be named according to meta->number. On success, the rest
+   of *meta will be filled with metadata about the generated table.
+   If no data is present, meta->file_size will be set to zero, and no
+   Table file will be produced.
+
+   If "blob" is non-null and options->min_blob_size is non-zero, large
+   values are written to the blob file named according to blob->number
+   instead, and its size is stored in the rest of *blob. If there are
+   none, blob->count is set to zero, and no blob file is produced. */
 int
 ldb_build_table(const char *dbname,
                 const struct ldb_dbopt_s *options,
                 struct ldb_tables_s *table_cache,
                 struct ldb_iter_s *iter,
-                struct ldb_filemeta_s *meta);
+                const struct ldb_rangedel_s *tombstones,
+                struct ldb_filemeta_s *meta,
+                struct ldb_blobmeta_s *blob);
 
 #endif /* LDB_BUILDER_H */
@@ -365,6 +365,8 @@ leveldb_writebatch_iterate(const leveldb_writebatch_t *b, void *state,
   handler.state = &opt;
   handler.put = handle_put;
   handler.del = handle_del;
+  handler.del_range = NULL;
+  handler.merge = NULL;
 
   if (ldb_batch_iterate(b, &handler) != LDB_OK)
     abort(); /* LCOV_EXCL_LINE */
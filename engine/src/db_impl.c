@@ -11,6 +11,7 @@
  */
 
 #include <assert.h>
+#include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -39,6 +40,7 @@
 #include "util/thread_pool.h"
 #include "util/vector.h"
 
+#include "blob_file.h"
 #include "builder.h"
 #include "db_impl.h"
 #include "db_iter.h"
@@ -48,6 +50,8 @@
 #include "log_reader.h"
 #include "log_writer.h"
 #include "memtable.h"
+#include "merge.h"
+#include "range_del.h"
 #include "snapshot.h"
 #include "table_cache.h"
 #include "version_edit.h"
@@ -60,6 +64,7 @@
 
 /* Information for a manual compaction. */
 typedef struct ldb_manual_s {
+  ldb_family_t *family;
   int level;
   int done;
   const ldb_ikey_t *begin; /* null means beginning of key range. */
@@ -68,7 +73,8 @@ typedef struct ldb_manual_s {
 } ldb_manual_t;
 
 static void
-ldb_manual_init(ldb_manual_t *m, int level) {
+ldb_manual_init(ldb_manual_t *m, ldb_family_t *family, int level) {
+  m->family = family;
   m->level = level;
   m->done = 0;
   m->begin = NULL;
@@ -92,6 +98,7 @@ typedef struct ldb_stats_s {
   int64_t micros;
   int64_t bytes_read;
   int64_t bytes_written;
+  int64_t dropped; /* Entries removed by the compaction filter. */
 } ldb_stats_t;
 
 static void
@@ -99,6 +106,7 @@ ldb_stats_init(ldb_stats_t *c) {
   c->micros = 0;
   c->bytes_read = 0;
   c->bytes_written = 0;
+  c->dropped = 0;
 }
 
 static void
@@ -106,8 +114,31 @@ ldb_stats_add(ldb_stats_t *z, const ldb_stats_t *x) {
   z->micros += x->micros;
   z->bytes_read += x->bytes_read;
   z->bytes_written += x->bytes_written;
+  z->dropped += x->dropped;
 }
 
+/*
+ * Write Stalls
+ */
+
+/* Reasons for which writes are held up. */
+enum ldb_stall {
+  LDB_STALL_LEVEL0_SLOWDOWN,
+  LDB_STALL_PENDING_SLOWDOWN,
+  LDB_STALL_MEMTABLE,
+  LDB_STALL_LEVEL0_STOP,
+  LDB_STALL_PENDING_STOP,
+  LDB_STALL_MAX
+};
+
+static const char *ldb_stall_names[LDB_STALL_MAX] = {
+  "level0-slowdown",
+  "pending-compaction-slowdown",
+  "memtable-full",
+  "level0-stop",
+  "pending-compaction-stop"
+};
+
 /*
  * DBImpl::Writer
  */
@@ -117,6 +148,7 @@ typedef struct ldb_waiter_s {
   int status;
   ldb_batch_t *batch;
   int sync;
+  int exclusive; /* Must not be grouped with other writers. */
   int done;
   ldb_cond_t cv;
   struct ldb_waiter_s *next;
@@ -127,6 +159,7 @@ ldb_waiter_init(ldb_waiter_t *w) {
   w->status = LDB_OK;
   w->batch = NULL;
   w->sync = 0;
+  w->exclusive = 0;
   w->done = 0;
   w->next = NULL;
 
@@ -194,6 +227,11 @@ ldb_queue_shift(ldb_queue_t *queue) {
 typedef struct ldb_output_s {
   uint64_t number;
   uint64_t file_size;
+  uint64_t tombstones;
+  uint64_t oldest_blob;
+  uint64_t entries;
+  uint64_t deletions;
+  uint64_t created;
   ldb_ikey_t smallest, largest;
 } ldb_output_t;
 
@@ -203,6 +241,11 @@ ldb_output_create(uint64_t number) {
 
   out->number = number;
   out->file_size = 0;
+  out->tombstones = 0;
+  out->oldest_blob = 0;
+  out->entries = 0;
+  out->deletions = 0;
+  out->created = ldb_now_usec() / 1000000;
 
   ldb_ikey_init(&out->smallest);
   ldb_ikey_init(&out->largest);
@@ -223,6 +266,7 @@ ldb_output_destroy(ldb_output_t *out) {
 
 typedef struct ldb_cstate_s {
   ldb_compaction_t *compaction;
+  ldb_family_t *family;
 
   /* Sequence numbers < smallest_snapshot are not significant since we
      will never have to service a snapshot below smallest_snapshot.
@@ -230,26 +274,76 @@ typedef struct ldb_cstate_s {
      we can drop all entries for the same key with sequence numbers < S. */
   ldb_seqnum_t smallest_snapshot;
 
+  /* Entries newer than every snapshot may be passed to the
+     compaction filter. Zero if there are no snapshots. */
+  ldb_seqnum_t newest_snapshot;
+
+  /* Sequence numbers of all live snapshots, oldest first. Between two
+     consecutive snapshots, only the newest entry for a key is visible
+     to anyone: the rest of the stripe can be dropped. */
+  ldb_seqnum_t *snapshots;
+  size_t num_snapshots;
+
   ldb_vector_t outputs; /* ldb_output_t */
 
+  /* Range tombstones of the inputs. Those which cannot be dropped
+     are also in "kept", and are split between the outputs: each
+     output receives the part of them falling in [lower, upper),
+     where upper is the first user key of the next output. */
+  ldb_rangedel_t tombstones;
+  ldb_vector_t kept; /* ldb_tombstone_t */
+  ldb_buffer_t lower;
+  int has_lower;
+
   /* State kept for output being generated. */
   ldb_wfile_t *outfile;
   ldb_tablegen_t *builder;
 
+  /* Blob files produced by compaction (see blob_file.h), and the
+     state kept for the one being generated. */
+  ldb_vector_t blobs; /* ldb_blobmeta_t */
+  ldb_wfile_t *blobfile;
+  ldb_blobgen_t *blobgen;
+
+  /* Blob files holding enough garbage that their
+     live values are rewritten into new ones. */
+  rb_set64_t relocate;
+  ldb_blobreader_t reader;
+  ldb_buffer_t blob_key;
+  ldb_buffer_t blob_index;
+
   uint64_t total_bytes;
 } ldb_cstate_t;
 
 static ldb_cstate_t *
-ldb_cstate_create(ldb_compaction_t *c) {
+ldb_cstate_create(ldb_compaction_t *c,
+                  ldb_family_t *family,
+                  const ldb_comparator_t *ucmp,
+                  ldb_blobs_t *blob_cache) {
   ldb_cstate_t *state = ldb_malloc(sizeof(ldb_cstate_t));
 
   state->compaction = c;
+  state->family = family;
   state->smallest_snapshot = 0;
+  state->newest_snapshot = 0;
+  state->snapshots = NULL;
+  state->num_snapshots = 0;
+  state->has_lower = 0;
   state->outfile = NULL;
   state->builder = NULL;
+  state->blobfile = NULL;
+  state->blobgen = NULL;
   state->total_bytes = 0;
 
   ldb_vector_init(&state->outputs);
+  ldb_rangedel_init(&state->tombstones, ucmp);
+  ldb_vector_init(&state->kept);
+  ldb_buffer_init(&state->lower);
+  ldb_vector_init(&state->blobs);
+  rb_set64_init(&state->relocate);
+  ldb_blobreader_init(&state->reader, blob_cache, LDB_BLOB_READAHEAD);
+  ldb_buffer_init(&state->blob_key);
+  ldb_buffer_init(&state->blob_index);
 
   return state;
 }
@@ -261,7 +355,22 @@ ldb_cstate_destroy(ldb_cstate_t *state) {
   for (i = 0; i < state->outputs.length; i++)
     ldb_output_destroy(state->outputs.items[i]);
 
+  for (i = 0; i < state->blobs.length; i++)
+    ldb_free(state->blobs.items[i]);
+
   ldb_vector_clear(&state->outputs);
+  ldb_rangedel_clear(&state->tombstones);
+  ldb_vector_clear(&state->kept);
+  ldb_buffer_clear(&state->lower);
+  ldb_vector_clear(&state->blobs);
+  rb_set64_clear(&state->relocate);
+  ldb_blobreader_clear(&state->reader);
+  ldb_buffer_clear(&state->blob_key);
+  ldb_buffer_clear(&state->blob_index);
+
+  if (state->snapshots != NULL)
+    ldb_free(state->snapshots);
+
   ldb_free(state);
 }
 
@@ -274,22 +383,31 @@ ldb_cstate_top(ldb_cstate_t *state) {
  * IterState
  */
 
+static void
+ldb_family_unref(struct ldb_s *db, ldb_family_t *fam);
+
 typedef struct ldb_istate_s {
+  struct ldb_s *db;
   ldb_mutex_t *mu;
   /* All guarded by mu. */
+  ldb_family_t *family;
   ldb_version_t *version;
   ldb_memtable_t *mem;
   ldb_memtable_t *imm;
 } ldb_istate_t;
 
 static ldb_istate_t *
-ldb_istate_create(ldb_mutex_t *mutex,
+ldb_istate_create(struct ldb_s *db,
+                  ldb_mutex_t *mutex,
+                  ldb_family_t *family,
                   ldb_memtable_t *mem,
                   ldb_memtable_t *imm,
                   ldb_version_t *version) {
   ldb_istate_t *state = ldb_malloc(sizeof(ldb_istate_t));
 
+  state->db = db;
   state->mu = mutex;
+  state->family = family;
   state->version = version;
   state->mem = mem;
   state->imm = imm;
@@ -307,18 +425,172 @@ ldb_istate_destroy(ldb_istate_t *state) {
     ldb_memtable_unref(state->imm);
 
   ldb_version_unref(state->version);
+  ldb_family_unref(state->db, state->family);
 
   ldb_mutex_unlock(state->mu);
 
   ldb_free(state);
 }
 
+/*
+ * DBImpl::Warmup
+ */
+
+/* Tables being opened in the background after ldb_open. */
+typedef struct ldb_warmup_s {
+  ldb_pool_t *pool;
+  ldb_vector_t versions; /* ldb_version_t (keep the files below alive) */
+  ldb_vector_t families; /* ldb_family_t (keep the table caches alive) */
+  ldb_vector_t files; /* ldb_filemeta_t (owned by versions) */
+  ldb_vector_t tables; /* ldb_tables_t (table cache of each file) */
+  ldb_atomic(int) next;
+  ldb_atomic(int) done;
+  ldb_atomic(int) workers;
+} ldb_warmup_t;
+
+static void
+ldb_warmup_init(ldb_warmup_t *w) {
+  w->pool = NULL;
+
+  ldb_vector_init(&w->versions);
+  ldb_vector_init(&w->families);
+  ldb_vector_init(&w->files);
+  ldb_vector_init(&w->tables);
+  ldb_atomic_init(&w->next, 0);
+  ldb_atomic_init(&w->done, 0);
+  ldb_atomic_init(&w->workers, 0);
+}
+
+/*
+ * RecoveryState
+ */
+
+/* Log records are read and checksummed ahead of the
+   memtable inserter in chunks of roughly this size. */
+#define LDB_REPLAY_CHUNK (1 << 20)
+
+/* Maximum number of memtables being flushed at once during recovery.
+   Bounds the memory used by recovery to roughly this many times
+   write_buffer_size. */
+#define LDB_REPLAY_FLUSHES 4
+
+/* A run of log records which have passed checksum verification. */
+typedef struct ldb_chunk_s {
+  ldb_buffer_t data; /* Concatenated records. */
+  ldb_array_t sizes; /* Size of each record in data. */
+  int last; /* No more records follow this chunk. */
+} ldb_chunk_t;
+
+/* Read-ahead state for a single log file. */
+typedef struct ldb_replay_s {
+  ldb_reader_t reader;
+  ldb_reporter_t reporter;
+  int status; /* Read errors (paranoid_checks only). */
+  uint64_t end; /* Offset past the last record read. */
+  ldb_buffer_t scratch;
+  ldb_chunk_t chunks[2];
+  ldb_chunk_t *next; /* Chunk being filled by the reader. */
+} ldb_replay_t;
+
+/* A recovered memtable being written to a level-0 table. */
+typedef struct ldb_flush_s {
+  ldb_family_t *family;
+  ldb_memtable_t *mem;
+  ldb_filemeta_t meta;
+  ldb_blobmeta_t *blob; /* Blob file for large values (or NULL). */
+  int64_t micros;
+  int status;
+} ldb_flush_t;
+
+typedef struct ldb_rstate_s {
+  struct ldb_s *db;
+  uint64_t log_number; /* Log being replayed. */
+  ldb_pool_t *readahead;
+  ldb_pool_t *flushers;
+  ldb_vector_t flushes; /* ldb_flush_t, in file number order */
+} ldb_rstate_t;
+
+static void
+ldb_chunk_init(ldb_chunk_t *chunk) {
+  ldb_buffer_init(&chunk->data);
+  ldb_array_init(&chunk->sizes);
+  chunk->last = 0;
+}
+
+static void
+ldb_chunk_clear(ldb_chunk_t *chunk) {
+  ldb_buffer_clear(&chunk->data);
+  ldb_array_clear(&chunk->sizes);
+}
+
+static ldb_flush_t *
+ldb_flush_create(ldb_family_t *family, ldb_memtable_t *mem, uint64_t number) {
+  ldb_flush_t *job = ldb_malloc(sizeof(ldb_flush_t));
+
+  job->family = family;
+  job->mem = mem;
+  job->blob = NULL;
+  job->micros = 0;
+  job->status = LDB_OK;
+
+  ldb_filemeta_init(&job->meta);
+
+  job->meta.number = number;
+
+  return job;
+}
+
+static void
+ldb_flush_destroy(ldb_flush_t *job) {
+  ldb_memtable_unref(job->mem);
+  ldb_filemeta_clear(&job->meta);
+
+  if (job->blob != NULL)
+    ldb_free(job->blob);
+
+  ldb_free(job);
+}
+
+static void
+ldb_abandon_level0_table(ldb_flush_t *job);
+
+static void
+ldb_rstate_init(ldb_rstate_t *state, struct ldb_s *db) {
+  state->db = db;
+  state->log_number = 0;
+  state->readahead = ldb_pool_create(1);
+  state->flushers = ldb_pool_create(LDB_REPLAY_FLUSHES);
+
+  ldb_vector_init(&state->flushes);
+}
+
+static void
+ldb_rstate_clear(ldb_rstate_t *state) {
+  size_t i;
+
+  ldb_pool_wait(state->readahead);
+  ldb_pool_wait(state->flushers);
+
+  /* Flushes left over after a failed recovery. */
+  for (i = 0; i < state->flushes.length; i++)
+    ldb_abandon_level0_table(state->flushes.items[i]);
+
+  ldb_vector_clear(&state->flushes);
+
+  ldb_pool_destroy(state->readahead);
+  ldb_pool_destroy(state->flushers);
+}
+
 /*
  * Helpers
  */
 
 static const int non_table_cache_files = 10;
 
+/* Blob files kept open by each column family. These are not
+   counted against max_open_files. */
+static const int blob_cache_files = 64;
+
 /* Fix user-supplied options to be reasonable. */
 #define clip_to_range(val, min, max) do { \
   if ((val) > (max)) (val) = (max);       \
@@ -340,6 +612,28 @@ ldb_sanitize_options(const char *dbname,
   clip_to_range(result.write_buffer_size, 64 << 10, 1 << 30);
   clip_to_range(result.max_file_size, 1 << 20, 1 << 30);
   clip_to_range(result.block_size, 1 << 10, 4 << 20);
+  clip_to_range(result.warmup_threads, 0, 32);
+  clip_to_range(result.recycle_logs, 0, 16);
+  clip_to_range(result.arena_block_size, 4 << 10, 64 << 20);
+  clip_to_range(result.blob_file_size, 1 << 20, 1 << 30);
+  clip_to_range(result.blob_gc_percent, 1, 100);
+  clip_to_range(result.universal_size_ratio, 0, 1000);
+  clip_to_range(result.universal_min_merge_width, 2, 64);
+  clip_to_range(result.universal_max_size_amplification, 1, 100000);
+  clip_to_range(result.level0_compaction_trigger, 2, 1000);
+  clip_to_range(result.level0_slowdown_writes_trigger,
+                result.level0_compaction_trigger, 1000);
+  clip_to_range(result.level0_stop_writes_trigger,
+                result.level0_slowdown_writes_trigger, 1000);
+  clip_to_range(result.delayed_write_rate, 16 << 10, 1 << 30);
+  clip_to_range(result.deletion_compaction_percent, 0, 100);
+  clip_to_range(result.max_file_age, 0, INT_MAX);
+
+  if (result.hard_pending_compaction_bytes > 0 &&
+      result.soft_pending_compaction_bytes >
+      result.hard_pending_compaction_bytes) {
+    result.soft_pending_compaction_bytes = result.hard_pending_compaction_bytes;
+  }
 
   if (result.info_log == NULL) {
     char info[LDB_PATH_MAX];
@@ -378,23 +672,56 @@ table_cache_size(const ldb_dbopt_t *sanitized_options) {
 }
 
 /*
- * DBImpl
+ * ColumnFamily
  */
 
-struct ldb_s {
+struct ldb_family_s {
+  uint64_t number; /* Zero for the default column family. */
+  char *name; /* NULL for the default column family. */
+  char dirname[LDB_PATH_MAX];
+  int refs;
+  int dropped;
+  int busy; /* Jobs of the background thread using this family. */
+
   /* Constant after construction. */
   ldb_comparator_t user_comparator;
   ldb_bloom_t user_filter_policy;
   ldb_comparator_t internal_comparator;
   ldb_bloom_t internal_filter_policy;
   ldb_dbopt_t options; /* options.comparator == &internal_comparator */
+
+  /* table_cache and blob_cache provide their own synchronization. */
+  ldb_tables_t *table_cache;
+  ldb_blobs_t *blob_cache;
+
+  /* State below is protected by the database mutex. */
+  ldb_versions_t *versions;
+  ldb_memtable_t *mem;
+  ldb_memtable_t *imm; /* Memtable being compacted. */
+  uint64_t imm_log_number; /* Log created when imm was sealed. */
+  ldb_atomic(int) has_entries; /* Has mem been written to? */
+
+  /* Set of table files to protect from deletion because they are
+     part of ongoing compactions. */
+  rb_set64_t pending_outputs;
+
+  /* Changes made during recovery. */
+  ldb_edit_t edit;
+
+  ldb_stats_t stats[LDB_NUM_LEVELS];
+};
+
+/*
+ * DBImpl
+ */
+
+struct ldb_s {
+  /* Constant after construction. */
+  ldb_dbopt_t options; /* Options of the default column family. */
   int owns_info_log;
   int owns_cache;
   char dbname[LDB_PATH_MAX];
 
-  /* table_cache provides its own synchronization. */
-  ldb_tables_t *table_cache;
-
   /* Lock over the persistent DB state. Non-null iff successfully acquired. */
   ldb_filelock_t *db_lock;
 
@@ -402,23 +729,27 @@ struct ldb_s {
   ldb_mutex_t mutex;
   ldb_atomic(int) shutting_down;
   ldb_cond_t background_work_finished_signal;
-  ldb_memtable_t *mem;
-  ldb_memtable_t *imm; /* Memtable being compacted. */
-  ldb_atomic(int) has_imm; /* So bg thread can detect non-null imm. */
+  ldb_atomic(int) has_imm; /* So bg thread can detect a non-null imm. */
   ldb_wfile_t *logfile;
   uint64_t logfile_number;
   ldb_writer_t *log;
   uint32_t seed; /* For sampling. */
 
+  /* Obsolete logs kept for reuse (options.recycle_logs). Only logs
+     numbered recycle_start or above were written in the recyclable
+     format, so only those may be overwritten. */
+  ldb_array_t recycled;
+  uint64_t recycle_start;
+
   /* Queue of writers. */
   ldb_queue_t writers;
   ldb_batch_t *tmp_batch;
 
   ldb_snaplist_t snapshots;
 
-  /* Set of table files to protect from deletion because they are
-     part of ongoing compactions. */
-  rb_set64_t pending_outputs;
+  /* Column families, the default first. Modified only by the
+     writer at the front of the queue. */
+  ldb_vector_t families; /* ldb_family_t */
 
   /* Thread pool. */
   ldb_pool_t *pool;
@@ -428,51 +759,262 @@ struct ldb_s {
 
   ldb_manual_t *manual_compaction;
 
+  /* Background table cache warmup (options.warmup_threads). */
+  ldb_warmup_t warmup;
+
+  /* Versions of the default column family. Also allocates the
+     numbers of logs and column families, and holds the last
+     sequence number of the database. */
   ldb_versions_t *versions;
 
   /* Have we encountered a background error in paranoid mode? */
   int bg_error;
 
-  ldb_stats_t stats[LDB_NUM_LEVELS];
+  /* Time until which the writes slowed down so far have been paid
+     for (see ldb_delay_write). */
+  int64_t delay_until;
+
+  /* Time writes have spent held up, per enum ldb_stall. */
+  int64_t stall_micros[LDB_STALL_MAX];
 };
 
-static ldb_t *
-ldb_create(const char *dbname, const ldb_dbopt_t *options) {
-  ldb_t *db = ldb_malloc(sizeof(ldb_t));
-  size_t len = strlen(dbname);
+static ldb_family_t *
+ldb_family_new(ldb_t *db, uint64_t number,
+                          const char *name,
+                          const char *dirname,
+                          const ldb_dbopt_t *options) {
+  ldb_family_t *fam = ldb_malloc(sizeof(ldb_family_t));
+  size_t len = strlen(dirname);
+  ldb_dbopt_t opt = *options;
   int i;
 
-  assert(len + 1 <= sizeof(db->dbname));
+  assert(len + 1 <= sizeof(fam->dirname));
 
-  memcpy(db->dbname, dbname, len + 1);
+  memcpy(fam->dirname, dirname, len + 1);
+
+  fam->number = number;
+  fam->name = NULL;
+  fam->refs = 1;
+  fam->dropped = 0;
+  fam->busy = 0;
+
+  if (name != NULL) {
+    len = strlen(name);
+
+    fam->name = ldb_malloc(len + 1);
+
+    memcpy(fam->name, name, len + 1);
+  }
 
   if (options->comparator != NULL) {
-    db->user_comparator = *options->comparator;
-    ldb_ikc_init(&db->internal_comparator, &db->user_comparator);
+    fam->user_comparator = *options->comparator;
+    ldb_ikc_init(&fam->internal_comparator, &fam->user_comparator);
   } else {
-    ldb_ikc_init(&db->internal_comparator, ldb_bytewise_comparator);
+    ldb_ikc_init(&fam->internal_comparator, ldb_bytewise_comparator);
   }
 
   if (options->filter_policy != NULL) {
-    db->user_filter_policy = *options->filter_policy;
-    ldb_ifp_init(&db->internal_filter_policy, &db->user_filter_policy);
+    fam->user_filter_policy = *options->filter_policy;
+    ldb_ifp_init(&fam->internal_filter_policy, &fam->user_filter_policy);
   } else {
-    ldb_ifp_init(&db->internal_filter_policy, ldb_bloom_default);
+    ldb_ifp_init(&fam->internal_filter_policy, ldb_bloom_default);
   }
 
-  db->options = ldb_sanitize_options(db->dbname,
-                                     &db->internal_comparator,
-                                     &db->internal_filter_policy,
-                                     options);
+  if (number != 0) {
+    /* Column families share the info log of the database, along
+       with its block cache unless they were given their own. */
+    opt.info_log = db->options.info_log;
 
-  db->owns_info_log = (db->options.info_log != options->info_log);
-  db->owns_cache = (db->options.block_cache != options->block_cache);
+    if (opt.block_cache == NULL)
+      opt.block_cache = db->options.block_cache;
+  }
+
+  fam->options = ldb_sanitize_options(fam->dirname,
+                                      &fam->internal_comparator,
+                                      &fam->internal_filter_policy,
+                                      &opt);
+
+  fam->table_cache = ldb_tables_create(fam->dirname,
+                                       &fam->options,
+                                       table_cache_size(&fam->options));
+
+  fam->versions = ldb_versions_create(fam->dirname,
+                                      &fam->options,
+                                      fam->table_cache,
+                                      &fam->internal_comparator);
+
+  fam->blob_cache = ldb_blobs_create(fam->dirname,
+                                     &fam->options,
+                                     blob_cache_files);
+
+  fam->versions->family = fam->name;
+  fam->versions->blob_cache = fam->blob_cache;
+
+  fam->mem = NULL;
+  fam->imm = NULL;
+  fam->imm_log_number = 0;
+
+  ldb_atomic_init(&fam->has_entries, 0);
 
-  (void)db->dbname;
+  rb_set64_init(&fam->pending_outputs);
 
-  db->table_cache = ldb_tables_create(db->dbname,
-                                      &db->options,
-                                      table_cache_size(&db->options));
+  ldb_edit_init(&fam->edit);
+
+  for (i = 0; i < LDB_NUM_LEVELS; i++)
+    ldb_stats_init(&fam->stats[i]);
+
+  return fam;
+}
+
+static void
+ldb_family_destroy(ldb_family_t *fam) {
+  ldb_versions_destroy(fam->versions);
+
+  if (fam->mem != NULL)
+    ldb_memtable_unref(fam->mem);
+
+  if (fam->imm != NULL)
+    ldb_memtable_unref(fam->imm);
+
+  ldb_tables_destroy(fam->table_cache);
+  ldb_blobs_destroy(fam->blob_cache);
+
+  rb_set64_clear(&fam->pending_outputs);
+
+  ldb_edit_clear(&fam->edit);
+
+  if (fam->name != NULL)
+    ldb_free(fam->name);
+
+  ldb_free(fam);
+}
+
+static void
+ldb_family_ref(ldb_t *db, ldb_family_t *fam) {
+  ldb_mutex_assert_held(&db->mutex);
+
+  fam->refs++;
+}
+
+static void
+ldb_family_unref(ldb_t *db, ldb_family_t *fam) {
+  ldb_mutex_assert_held(&db->mutex);
+
+  assert(fam->refs > 0);
+
+  if (--fam->refs == 0) {
+    char dirname[LDB_PATH_MAX];
+
+    /* Only dropped column families lose their last reference
+       while the database is open. */
+    assert(fam->dropped);
+
+    memcpy(dirname, fam->dirname, sizeof(dirname));
+
+    ldb_family_destroy(fam);
+
+    ldb_log(db->options.info_log, "Deleting column family %s", dirname);
+
+    ldb_destroy(dirname, NULL);
+  }
+}
+
+static ldb_family_t *
+ldb_default_family(const ldb_t *db) {
+  return db->families.items[0];
+}
+
+static ldb_family_t *
+ldb_family_get(const ldb_t *db, ldb_family_t *family) {
+  return family != NULL ? family : ldb_default_family(db);
+}
+
+static ldb_family_t *
+ldb_family_find(const ldb_t *db, uint64_t number) {
+  size_t i;
+
+  for (i = 0; i < db->families.length; i++) {
+    ldb_family_t *fam = db->families.items[i];
+
+    if (fam->number == number)
+      return fam;
+  }
+
+  return NULL;
+}
+
+static ldb_family_t *
+ldb_family_lookup_name(const ldb_t *db, const char *name) {
+  size_t i;
+
+  for (i = 1; i < db->families.length; i++) {
+    ldb_family_t *fam = db->families.items[i];
+
+    if (strcmp(fam->name, name) == 0)
+      return fam;
+  }
+
+  return NULL;
+}
+
+static void
+ldb_family_remove(ldb_t *db, ldb_family_t *fam) {
+  size_t i, j = 0;
+
+  for (i = 0; i < db->families.length; i++) {
+    if (db->families.items[i] != fam)
+      db->families.items[j++] = db->families.items[i];
+  }
+
+  db->families.length = j;
+}
+
+/* Record whether any column family has a memtable being compacted. */
+static void
+ldb_update_has_imm(ldb_t *db) {
+  int has_imm = 0;
+  size_t i;
+
+  for (i = 0; i < db->families.length; i++) {
+    ldb_family_t *fam = db->families.items[i];
+
+    if (fam->imm != NULL)
+      has_imm = 1;
+  }
+
+  ldb_atomic_store(&db->has_imm, has_imm, ldb_order_release);
+}
+
+/* Apply an edit to the versions of a column family. Edits of
+   dropped column families are discarded. */
+static int
+ldb_family_apply(ldb_t *db, ldb_family_t *fam, ldb_edit_t *edit) {
+  ldb_mutex_assert_held(&db->mutex);
+
+  if (fam->dropped)
+    return LDB_OK;
+
+  if (fam->number != 0) {
+    /* Sequence and log numbers are those of the database. */
+    fam->versions->last_sequence = db->versions->last_sequence;
+
+    if (edit->has_log_number)
+      ldb_versions_mark_file_number(fam->versions, edit->log_number);
+  }
+
+  return ldb_versions_apply(fam->versions, edit, &db->mutex);
+}
+
+static ldb_t *
+ldb_create(const char *dbname, const ldb_dbopt_t *options) {
+  ldb_t *db = ldb_malloc(sizeof(ldb_t));
+  size_t len = strlen(dbname);
+  ldb_family_t *fam;
+  int i;
+
+  assert(len + 1 <= sizeof(db->dbname));
+
+  memcpy(db->dbname, dbname, len + 1);
 
   db->db_lock = NULL;
 
@@ -482,9 +1024,6 @@ ldb_create(const char *dbname, const ldb_dbopt_t *options) {
 
   ldb_cond_init(&db->background_work_finished_signal);
 
-  db->mem = NULL;
-  db->imm = NULL;
-
   ldb_atomic_init(&db->has_imm, 0);
 
   db->logfile = NULL;
@@ -492,32 +1031,44 @@ ldb_create(const char *dbname, const ldb_dbopt_t *options) {
   db->log = NULL;
   db->seed = 0;
 
+  ldb_array_init(&db->recycled);
+
+  db->recycle_start = 0;
+
   ldb_queue_init(&db->writers);
 
   db->tmp_batch = ldb_batch_create();
 
   ldb_snaplist_init(&db->snapshots);
-  rb_set64_init(&db->pending_outputs);
+  ldb_vector_init(&db->families);
 
   db->pool = ldb_pool_create(1);
   db->background_compaction_scheduled = 0;
   db->manual_compaction = NULL;
+  db->delay_until = 0;
 
-  db->versions = ldb_versions_create(db->dbname,
-                                     &db->options,
-                                     db->table_cache,
-                                     &db->internal_comparator);
+  for (i = 0; i < LDB_STALL_MAX; i++)
+    db->stall_micros[i] = 0;
 
-  db->bg_error = LDB_OK;
+  ldb_warmup_init(&db->warmup);
 
-  for (i = 0; i < LDB_NUM_LEVELS; i++)
-    ldb_stats_init(&db->stats[i]);
+  fam = ldb_family_new(db, 0, NULL, db->dbname, options);
+
+  ldb_vector_push(&db->families, fam);
+
+  db->options = fam->options;
+  db->owns_info_log = (db->options.info_log != options->info_log);
+  db->owns_cache = (db->options.block_cache != options->block_cache);
+  db->versions = fam->versions;
+  db->bg_error = LDB_OK;
 
   return db;
 }
 
 static void
 ldb_destroy_internal(ldb_t *db) {
+  size_t i;
+
   /* Wait for background work to finish. */
   ldb_mutex_lock(&db->mutex);
 
@@ -530,16 +1081,32 @@ ldb_destroy_internal(ldb_t *db) {
 
   ldb_pool_destroy(db->pool);
 
+  if (db->warmup.pool != NULL)
+    ldb_pool_destroy(db->warmup.pool);
+
+  /* Warmup workers which never ran did not release the versions. */
+  ldb_mutex_lock(&db->mutex);
+
+  for (i = 0; i < db->warmup.versions.length; i++)
+    ldb_version_unref(db->warmup.versions.items[i]);
+
+  for (i = 0; i < db->warmup.families.length; i++)
+    ldb_family_unref(db, db->warmup.families.items[i]);
+
+  ldb_mutex_unlock(&db->mutex);
+
+  ldb_vector_clear(&db->warmup.versions);
+  ldb_vector_clear(&db->warmup.families);
+  ldb_vector_clear(&db->warmup.files);
+  ldb_vector_clear(&db->warmup.tables);
+
   if (db->db_lock != NULL)
     ldb_unlock_file(db->db_lock);
 
-  ldb_versions_destroy(db->versions);
+  for (i = 0; i < db->families.length; i++)
+    ldb_family_destroy(db->families.items[i]);
 
-  if (db->mem != NULL)
-    ldb_memtable_unref(db->mem);
-
-  if (db->imm != NULL)
-    ldb_memtable_unref(db->imm);
+  ldb_vector_clear(&db->families);
 
   ldb_batch_destroy(db->tmp_batch);
 
@@ -549,7 +1116,7 @@ ldb_destroy_internal(ldb_t *db) {
   if (db->logfile != NULL)
     ldb_wfile_destroy(db->logfile);
 
-  ldb_tables_destroy(db->table_cache);
+  ldb_array_clear(&db->recycled);
 
   if (db->owns_info_log)
     ldb_logger_destroy(db->options.info_log);
@@ -560,8 +1127,6 @@ ldb_destroy_internal(ldb_t *db) {
   assert(db->writers.length == 0);
   assert(ldb_snaplist_empty(&db->snapshots));
 
-  rb_set64_clear(&db->pending_outputs);
-
   ldb_mutex_destroy(&db->mutex);
   ldb_cond_destroy(&db->background_work_finished_signal);
 
@@ -569,18 +1134,22 @@ ldb_destroy_internal(ldb_t *db) {
 }
 
 static const ldb_comparator_t *
-ldb_user_comparator(const ldb_t *db) {
-  return db->internal_comparator.user_comparator;
+ldb_user_comparator(const ldb_family_t *fam) {
+  return fam->internal_comparator.user_comparator;
 }
 
+/* Create the descriptor of a new database or column family. Logs
+   older than log_number hold no records for it. */
 static int
-ldb_new_db(ldb_t *db) {
+ldb_new_db(const char *dbname, const char *comparator,
+                               const char *family,
+                               uint64_t log_number) {
   char manifest[LDB_PATH_MAX];
   ldb_edit_t new_db;
   ldb_wfile_t *file;
   int rc;
 
-  if (!ldb_desc_filename(manifest, sizeof(manifest), db->dbname, 1))
+  if (!ldb_desc_filename(manifest, sizeof(manifest), dbname, 1))
     return LDB_INVALID;
 
   rc = ldb_truncfile_create(manifest, &file);
@@ -589,8 +1158,12 @@ ldb_new_db(ldb_t *db) {
     return rc;
 
   ldb_edit_init(&new_db);
-  ldb_edit_set_comparator_name(&new_db, ldb_user_comparator(db)->name);
-  ldb_edit_set_log_number(&new_db, 0);
+  ldb_edit_set_comparator_name(&new_db, comparator);
+
+  if (family != NULL)
+    ldb_edit_set_family_name(&new_db, family);
+
+  ldb_edit_set_log_number(&new_db, log_number);
   ldb_edit_set_next_file(&new_db, 2);
   ldb_edit_set_last_sequence(&new_db, 0);
 
@@ -618,7 +1191,7 @@ ldb_new_db(ldb_t *db) {
 
   if (rc == LDB_OK) {
     /* Make "CURRENT" file that points to the new manifest file. */
-    rc = ldb_set_current_file(db->dbname, 1);
+    rc = ldb_set_current_file(dbname, 1);
   } else {
     ldb_remove_file(manifest);
   }
@@ -639,34 +1212,98 @@ ldb_maybe_ignore_error(const ldb_t *db, int *status) {
   }
 }
 
-/* Delete any unneeded files and stale in-memory entries. */
-static void
-ldb_remove_obsolete_files(ldb_t *db) {
-  char path[LDB_PATH_MAX];
-  char **filenames = NULL;
-  ldb_vector_t to_delete;
-  ldb_filetype_t type;
-  rb_set64_t live;
-  uint64_t number;
-  int i, len;
+/* Create the write-ahead log for a new memtable. */
+static int
+ldb_create_logfile(ldb_t *db, uint64_t number, ldb_wfile_t **file) {
+  char fname[LDB_PATH_MAX];
 
-  ldb_mutex_assert_held(&db->mutex);
+  if (!ldb_log_filename(fname, sizeof(fname), db->dbname, number))
+    abort(); /* LCOV_EXCL_LINE */
 
-  if (db->bg_error != LDB_OK) {
-    /* After a background error, we don't know whether a new version may
-       or may not have been committed, so we cannot safely garbage collect. */
-    return;
-  }
+  if (db->options.recycle_logs > 0) {
+    if (db->recycle_start == 0)
+      db->recycle_start = number;
 
-  rb_set64_init(&live);
-  ldb_vector_init(&to_delete);
+    /* Overwrite an old log rather than growing a new one. The file's
+       blocks are already allocated, so syncs only flush data. */
+    if (db->recycled.length > 0) {
+      uint64_t old_number = ldb_array_pop(&db->recycled);
+      char oldname[LDB_PATH_MAX];
 
-  /* Make a set of all of the live files. */
-  rb_set64_copy(&live, &db->pending_outputs);
+      if (!ldb_log_filename(oldname, sizeof(oldname), db->dbname, old_number))
+        abort(); /* LCOV_EXCL_LINE */
+
+      if (ldb_rename_file(oldname, fname) == LDB_OK) {
+        if (ldb_reusefile_create(fname, file) == LDB_OK) {
+          ldb_log(db->options.info_log, "Recycling log #%lu as #%lu",
+                                        (unsigned long)old_number,
+                                        (unsigned long)number);
+          return LDB_OK;
+        }
+      }
+    }
+  }
+
+  if (db->options.use_mmap_logs) {
+    /* Preallocate enough for a full memtable. */
+    return ldb_mmapfile_create(fname, db->options.write_buffer_size, file);
+  }
+
+  return ldb_truncfile_create(fname, file);
+}
+
+/* Create the writer for a log made by ldb_create_logfile(). */
+static ldb_writer_t *
+ldb_create_logwriter(ldb_t *db, uint64_t number, ldb_wfile_t *file) {
+  ldb_writer_t *log = ldb_writer_create(file, 0);
+
+  if (db->options.recycle_logs > 0)
+    ldb_writer_set_log_number(log, number);
+
+  return log;
+}
+
+/* Hold on to an obsolete log for ldb_create_logfile() to reuse. */
+static int
+ldb_recycle_log(ldb_t *db, uint64_t number) {
+  size_t i;
+
+  if (db->recycle_start == 0 || number < db->recycle_start)
+    return 0;
+
+  for (i = 0; i < db->recycled.length; i++) {
+    if (db->recycled.items[i] == number)
+      return 1;
+  }
+
+  if (db->recycled.length >= (size_t)db->options.recycle_logs)
+    return 0;
+
+  ldb_array_push(&db->recycled, number);
+
+  return 1;
+}
+
+/* Collect the unneeded files of a column family. */
+static void
+ldb_obsolete_files(ldb_t *db, ldb_family_t *fam,
+                              uint64_t min_log,
+                              ldb_vector_t *to_delete) {
+  char path[LDB_PATH_MAX];
+  char **filenames = NULL;
+  ldb_filetype_t type;
+  rb_set64_t live;
+  uint64_t number;
+  int i, len;
+
+  rb_set64_init(&live);
 
-  ldb_versions_add_files(db->versions, &live);
+  /* Make a set of all of the live files. */
+  rb_set64_copy(&live, &fam->pending_outputs);
+
+  ldb_versions_add_files(fam->versions, &live);
 
-  len = ldb_get_children(db->dbname, &filenames); /* Ignoring errors. */
+  len = ldb_get_children(fam->dirname, &filenames); /* Ignoring errors. */
 
   for (i = 0; i < len; i++) {
     const char *filename = filenames[i];
@@ -676,15 +1313,19 @@ ldb_remove_obsolete_files(ldb_t *db) {
 
       switch (type) {
         case LDB_FILE_LOG:
-          keep = ((number >= db->versions->log_number) ||
-                  (number == db->versions->prev_log_number));
+          /* The logs are shared by all column families. */
+          keep = ((fam->number != 0) ||
+                  (number >= min_log) ||
+                  (number == db->versions->prev_log_number) ||
+                  ldb_recycle_log(db, number));
           break;
         case LDB_FILE_DESC:
           /* Keep my manifest file, and any newer incarnations'
              (in case there is a race that allows other incarnations). */
-          keep = (number >= db->versions->manifest_file_number);
+          keep = (number >= fam->versions->manifest_file_number);
           break;
         case LDB_FILE_TABLE:
+        case LDB_FILE_BLOB:
           keep = rb_set64_has(&live, number);
           break;
         case LDB_FILE_TEMP:
@@ -695,15 +1336,24 @@ ldb_remove_obsolete_files(ldb_t *db) {
         case LDB_FILE_CURRENT:
         case LDB_FILE_LOCK:
         case LDB_FILE_INFO:
+        case LDB_FILE_FAMILY:
           keep = 1;
           break;
       }
 
-      if (!keep) {
-        ldb_vector_push(&to_delete, filename);
+      if (!keep && ldb_join(path, sizeof(path), fam->dirname, filename)) {
+        size_t size = strlen(path) + 1;
+        char *item = ldb_malloc(size);
+
+        memcpy(item, path, size);
+
+        ldb_vector_push(to_delete, item);
 
         if (type == LDB_FILE_TABLE)
-          ldb_tables_evict(db->table_cache, number);
+          ldb_tables_evict(fam->table_cache, number);
+
+        if (type == LDB_FILE_BLOB)
+          ldb_blobs_evict(fam->blob_cache, number);
 
         ldb_log(db->options.info_log, "Delete type=%d #%lu",
                                       (signed int)type,
@@ -712,37 +1362,112 @@ ldb_remove_obsolete_files(ldb_t *db) {
     }
   }
 
+  rb_set64_clear(&live);
+
+  if (filenames != NULL)
+    ldb_free_children(filenames, len);
+}
+
+/* Delete any unneeded files and stale in-memory entries. */
+static void
+ldb_remove_obsolete_files(ldb_t *db) {
+  uint64_t min_log = db->logfile_number;
+  ldb_vector_t to_delete;
+  size_t i;
+
+  ldb_mutex_assert_held(&db->mutex);
+
+  if (db->bg_error != LDB_OK) {
+    /* After a background error, we don't know whether a new version may
+       or may not have been committed, so we cannot safely garbage collect. */
+    return;
+  }
+
+  ldb_vector_init(&to_delete);
+
+  /* Logs are needed from the oldest one holding entries which some
+     column family has not yet written to a table. */
+  for (i = 0; i < db->families.length; i++) {
+    ldb_family_t *fam = db->families.items[i];
+
+    if (fam->imm != NULL ||
+        ldb_atomic_load(&fam->has_entries, ldb_order_relaxed)) {
+      if (fam->versions->log_number < min_log)
+        min_log = fam->versions->log_number;
+    }
+  }
+
+  for (i = 0; i < db->families.length; i++)
+    ldb_obsolete_files(db, db->families.items[i], min_log, &to_delete);
+
   /* While deleting all files unblock other threads. All files being deleted
      have unique names which will not collide with newly created files and
      are therefore safe to delete while allowing other threads to proceed. */
   ldb_mutex_unlock(&db->mutex);
 
-  for (i = 0; i < (int)to_delete.length; i++) {
-    const char *filename = to_delete.items[i];
-
-    if (!ldb_join(path, sizeof(path), db->dbname, filename))
-      continue;
-
-    ldb_remove_file(path);
+  for (i = 0; i < to_delete.length; i++) {
+    ldb_remove_file(to_delete.items[i]);
+    ldb_free(to_delete.items[i]);
   }
 
-  rb_set64_clear(&live);
   ldb_vector_clear(&to_delete);
 
-  if (filenames != NULL)
-    ldb_free_children(filenames, len);
-
   ldb_mutex_lock(&db->mutex);
 }
 
+/* Build a table from the point entries and range tombstones
+   of a memtable, along with a blob file if "blob" is non-null. */
+static int
+ldb_build_memtable(ldb_family_t *fam, ldb_memtable_t *mem,
+                                      ldb_filemeta_t *meta,
+                                      ldb_blobmeta_t *blob) {
+  ldb_iter_t *iter = ldb_memiter_create(mem);
+  ldb_rangedel_t tombstones;
+  int rc;
+
+  ldb_rangedel_init(&tombstones, ldb_user_comparator(fam));
+  ldb_memtable_tombstones(mem, &tombstones);
+  ldb_rangedel_finish(&tombstones);
+
+  rc = ldb_build_table(fam->dirname,
+                       &fam->options,
+                       fam->table_cache,
+                       iter,
+                       &tombstones,
+                       meta,
+                       blob);
+
+  ldb_rangedel_clear(&tombstones);
+  ldb_iter_destroy(iter);
+
+  return rc;
+}
+
+/* Allocate a blob file for the large values of a new table,
+   if the column family separates them. */
+static ldb_blobmeta_t *
+ldb_new_blob_file(ldb_family_t *fam) {
+  ldb_blobmeta_t *blob;
+
+  if (fam->options.min_blob_size == 0)
+    return NULL;
+
+  blob = ldb_blobmeta_create(ldb_versions_new_file_number(fam->versions), 0, 0);
+
+  rb_set64_put(&fam->pending_outputs, blob->number);
+
+  return blob;
+}
+
 static int
-ldb_write_level0_table(ldb_t *db, ldb_memtable_t *mem,
+ldb_write_level0_table(ldb_t *db, ldb_family_t *fam,
+                                  ldb_memtable_t *mem,
                                   ldb_edit_t *edit,
                                   ldb_version_t *base) {
+  ldb_blobmeta_t *blob;
   int64_t start_micros;
   ldb_filemeta_t meta;
   ldb_stats_t stats;
-  ldb_iter_t *iter;
   int rc = LDB_OK;
   int level = 0;
 
@@ -753,11 +1478,11 @@ ldb_write_level0_table(ldb_t *db, ldb_memtable_t *mem,
 
   start_micros = ldb_now_usec();
 
-  meta.number = ldb_versions_new_file_number(db->versions);
+  meta.number = ldb_versions_new_file_number(fam->versions);
 
-  rb_set64_put(&db->pending_outputs, meta.number);
+  rb_set64_put(&fam->pending_outputs, meta.number);
 
-  iter = ldb_memiter_create(mem);
+  blob = ldb_new_blob_file(fam);
 
   ldb_log(db->options.info_log, "Level-0 table #%lu: started",
                                 (unsigned long)meta.number);
@@ -765,11 +1490,7 @@ ldb_write_level0_table(ldb_t *db, ldb_memtable_t *mem,
   {
     ldb_mutex_unlock(&db->mutex);
 
-    rc = ldb_build_table(db->dbname,
-                         &db->options,
-                         db->table_cache,
-                         iter,
-                         &meta);
+    rc = ldb_build_memtable(fam, mem, &meta, blob);
 
     ldb_mutex_lock(&db->mutex);
   }
@@ -779,13 +1500,13 @@ ldb_write_level0_table(ldb_t *db, ldb_memtable_t *mem,
                                 (unsigned long)meta.file_size,
                                 ldb_strerror(rc));
 
-  ldb_iter_destroy(iter);
-
-  rb_set64_del(&db->pending_outputs, meta.number);
+  rb_set64_del(&fam->pending_outputs, meta.number);
 
   /* Note that if file_size is zero, the file has been deleted and
      should not be added to the manifest. */
   if (rc == LDB_OK && meta.file_size > 0) {
+    ldb_filemeta_t *f;
+
     if (base != NULL) {
       ldb_slice_t min_user_key = ldb_ikey_user_key(&meta.smallest);
       ldb_slice_t max_user_key = ldb_ikey_user_key(&meta.largest);
@@ -795,23 +1516,188 @@ ldb_write_level0_table(ldb_t *db, ldb_memtable_t *mem,
                                                          &max_user_key);
     }
 
-    ldb_edit_add_file(edit, level,
-                      meta.number,
-                      meta.file_size,
-                      &meta.smallest,
-                      &meta.largest);
+    f = ldb_edit_add_file(edit, level,
+                          meta.number,
+                          meta.file_size,
+                          &meta.smallest,
+                          &meta.largest);
+
+    f->tombstones = meta.tombstones;
+    f->oldest_blob = meta.oldest_blob;
+    f->entries = meta.entries;
+    f->deletions = meta.deletions;
+    f->created = meta.created;
   }
 
   stats.micros = ldb_now_usec() - start_micros;
   stats.bytes_written = meta.file_size;
 
-  ldb_stats_add(&db->stats[level], &stats);
+  if (blob != NULL) {
+    rb_set64_del(&fam->pending_outputs, blob->number);
+
+    if (rc == LDB_OK && meta.file_size > 0 && blob->count > 0) {
+      ldb_edit_add_blob(edit, blob->number, blob->count, blob->bytes);
+
+      stats.bytes_written += blob->bytes;
+    }
+
+    ldb_free(blob);
+  }
+
+  ldb_stats_add(&fam->stats[level], &stats);
 
   ldb_filemeta_clear(&meta);
 
   return rc;
 }
 
+static void
+ldb_flush_call(void *arg) {
+  ldb_flush_t *job = (ldb_flush_t *)arg;
+  int64_t start_micros = ldb_now_usec();
+
+  job->status = ldb_build_memtable(job->family, job->mem, &job->meta,
+                                                        job->blob);
+
+  job->micros = ldb_now_usec() - start_micros;
+}
+
+/* Wait for all recovery flushes and record their output in the edit
+   of their column family. Tables are added in the order their file
+   numbers were allocated, which is the order serial replay would
+   have produced them in. */
+static int
+ldb_finish_level0_tables(ldb_t *db, ldb_rstate_t *state) {
+  int rc = LDB_OK;
+  size_t i;
+
+  ldb_mutex_assert_held(&db->mutex);
+
+  ldb_pool_wait(state->flushers);
+
+  for (i = 0; i < state->flushes.length; i++) {
+    ldb_flush_t *job = state->flushes.items[i];
+    ldb_family_t *fam = job->family;
+    ldb_filemeta_t *meta = &job->meta;
+    ldb_stats_t stats;
+
+    ldb_log(db->options.info_log, "Level-0 table #%lu: %lu bytes %s",
+                                  (unsigned long)meta->number,
+                                  (unsigned long)meta->file_size,
+                                  ldb_strerror(job->status));
+
+    rb_set64_del(&fam->pending_outputs, meta->number);
+
+    if (rc == LDB_OK)
+      rc = job->status;
+
+    /* Note that if file_size is zero, the file has been deleted and
+       should not be added to the manifest. */
+    if (rc == LDB_OK && meta->file_size > 0) {
+      ldb_filemeta_t *f = ldb_edit_add_file(&fam->edit, 0,
+                                            meta->number,
+                                            meta->file_size,
+                                            &meta->smallest,
+                                            &meta->largest);
+
+      f->tombstones = meta->tombstones;
+      f->oldest_blob = meta->oldest_blob;
+      f->entries = meta->entries;
+      f->deletions = meta->deletions;
+      f->created = meta->created;
+    }
+
+    ldb_stats_init(&stats);
+
+    stats.micros = job->micros;
+    stats.bytes_written = meta->file_size;
+
+    if (job->blob != NULL) {
+      ldb_blobmeta_t *blob = job->blob;
+
+      rb_set64_del(&fam->pending_outputs, blob->number);
+
+      if (rc == LDB_OK && meta->file_size > 0 && blob->count > 0) {
+        ldb_edit_add_blob(&fam->edit, blob->number, blob->count, blob->bytes);
+
+        stats.bytes_written += blob->bytes;
+      }
+    }
+
+    ldb_stats_add(&fam->stats[0], &stats);
+
+    ldb_flush_destroy(job);
+  }
+
+  ldb_vector_reset(&state->flushes);
+
+  return rc;
+}
+
+/* Release the outputs of a flush which will never be added to the
+   descriptor, so that its file numbers are not kept pending forever. */
+static void
+ldb_abandon_level0_table(ldb_flush_t *job) {
+  ldb_family_t *fam = job->family;
+  char fname[LDB_PATH_MAX];
+
+  rb_set64_del(&fam->pending_outputs, job->meta.number);
+
+  if (ldb_table_filename(fname, sizeof(fname), fam->dirname,
+                                               job->meta.number)) {
+    ldb_remove_file(fname);
+  }
+
+  if (job->blob != NULL) {
+    rb_set64_del(&fam->pending_outputs, job->blob->number);
+
+    if (ldb_blob_filename(fname, sizeof(fname), fam->dirname,
+                                                job->blob->number)) {
+      ldb_remove_file(fname);
+    }
+  }
+
+  ldb_flush_destroy(job);
+}
+
+/* Hand a full memtable off to a flusher thread. Takes ownership of
+   the caller's reference to *mem. File numbers are allocated here,
+   on the recovering thread, so that they match serial replay. */
+static int
+ldb_schedule_level0_table(ldb_t *db, ldb_rstate_t *state,
+                                     ldb_family_t *fam,
+                                     ldb_memtable_t *mem) {
+  ldb_flush_t *job;
+  uint64_t number;
+  int rc = LDB_OK;
+
+  ldb_mutex_assert_held(&db->mutex);
+
+  if (state->flushes.length >= LDB_REPLAY_FLUSHES)
+    rc = ldb_finish_level0_tables(db, state);
+
+  if (rc != LDB_OK) {
+    ldb_memtable_unref(mem);
+    return rc;
+  }
+
+  number = ldb_versions_new_file_number(fam->versions);
+  job = ldb_flush_create(fam, mem, number);
+
+  rb_set64_put(&fam->pending_outputs, job->meta.number);
+
+  job->blob = ldb_new_blob_file(fam);
+
+  ldb_log(db->options.info_log, "Level-0 table #%lu: started",
+                                (unsigned long)job->meta.number);
+
+  ldb_vector_push(&state->flushes, job);
+
+  ldb_pool_schedule(state->flushers, ldb_flush_call, job);
+
+  return rc;
+}
+
 static void
 report_corruption(ldb_reporter_t *report, size_t bytes, int status) {
   ldb_log(report->info_log, "%s%s: dropping %d bytes; %s",
@@ -822,22 +1708,87 @@ report_corruption(ldb_reporter_t *report, size_t bytes, int status) {
     *report->status = status;
 }
 
+/* Read the next chunk of records. Runs on the read-ahead thread
+   while the recovering thread inserts the previous chunk. */
+static void
+ldb_replay_fill(void *arg) {
+  ldb_replay_t *rp = (ldb_replay_t *)arg;
+  ldb_chunk_t *chunk = rp->next;
+  ldb_slice_t record;
+
+  ldb_buffer_reset(&chunk->data);
+  ldb_array_reset(&chunk->sizes);
+
+  chunk->last = 0;
+
+  while (chunk->data.size < LDB_REPLAY_CHUNK) {
+    if (!ldb_reader_read_record(&rp->reader, &record, &rp->scratch)) {
+      chunk->last = 1;
+      break;
+    }
+
+    if (rp->status != LDB_OK) {
+      /* A paranoid corruption ends the replay. */
+      chunk->last = 1;
+      break;
+    }
+
+    if (record.size < 12) {
+      /* "log record too small" */
+      rp->reporter.corruption(&rp->reporter, record.size, LDB_CORRUPTION);
+      continue;
+    }
+
+    ldb_buffer_concat(&chunk->data, &record);
+    ldb_array_push(&chunk->sizes, record.size);
+
+    rp->end = rp->reader.end_offset - rp->reader.buffer.size;
+  }
+}
+
+/* Find the memtable of a column family for a record being replayed. */
+static ldb_memtable_t *
+ldb_replay_lookup(void *arg, uint64_t number) {
+  ldb_rstate_t *state = (ldb_rstate_t *)arg;
+  ldb_t *db = state->db;
+  ldb_family_t *fam = ldb_family_find(db, number);
+
+  /* Numbers of dropped column families must not be reused. */
+  ldb_versions_mark_file_number(db->versions, number);
+
+  if (fam == NULL)
+    return NULL;
+
+  /* Records in older logs are already in the tables of the family. */
+  if (state->log_number < fam->versions->log_number) {
+    if (fam->number != 0 || state->log_number != db->versions->prev_log_number)
+      return NULL;
+  }
+
+  if (fam->mem == NULL) {
+    fam->mem = ldb_memtable_create(&fam->internal_comparator, &fam->options);
+    ldb_memtable_ref(fam->mem);
+  }
+
+  ldb_atomic_store(&fam->has_entries, 1, ldb_order_relaxed);
+
+  return fam->mem;
+}
+
 static int
-ldb_recover_log_file(ldb_t *db, uint64_t log_number,
+ldb_recover_log_file(ldb_t *db, ldb_rstate_t *state,
+                                uint64_t log_number,
                                 int last_log,
                                 int *save_manifest,
-                                ldb_edit_t *edit,
                                 ldb_seqnum_t *max_sequence) {
   char fname[LDB_PATH_MAX];
-  ldb_reporter_t reporter;
   ldb_rfile_t *file;
   int rc = LDB_OK;
-  ldb_buffer_t buf;
   ldb_slice_t record;
   ldb_batch_t batch;
   int compactions = 0;
-  ldb_memtable_t *mem = NULL;
-  ldb_reader_t reader;
+  ldb_replay_t rp;
+  size_t j;
 
   ldb_mutex_assert_held(&db->mutex);
 
@@ -852,60 +1803,87 @@ ldb_recover_log_file(ldb_t *db, uint64_t log_number,
     return rc;
   }
 
+  state->log_number = log_number;
+
   /* Create the log reader. */
-  reporter.fname = fname;
-  reporter.status = (db->options.paranoid_checks ? &rc : NULL);
-  reporter.info_log = db->options.info_log;
-  reporter.corruption = report_corruption;
+  rp.reporter.fname = fname;
+  rp.reporter.status = (db->options.paranoid_checks ? &rp.status : NULL);
+  rp.reporter.info_log = db->options.info_log;
+  rp.reporter.corruption = report_corruption;
+  rp.status = LDB_OK;
+  rp.end = 0;
 
   /* We intentionally make the log reader do checksumming even if
      paranoid_checks==0 so that corruptions cause entire commits
      to be skipped instead of propagating bad information (like
      overly large sequence numbers). */
-  ldb_reader_init(&reader, file, &reporter, 1, 0);
+  ldb_reader_init(&rp.reader, file, &rp.reporter, 1, 0);
+  ldb_reader_set_log_number(&rp.reader, log_number);
+  ldb_buffer_init(&rp.scratch);
+  ldb_chunk_init(&rp.chunks[0]);
+  ldb_chunk_init(&rp.chunks[1]);
   ldb_batch_init(&batch);
-  ldb_buffer_init(&buf);
 
   ldb_log(db->options.info_log, "Recovering log #%lu",
                                 (unsigned long)log_number);
 
-  /* Read all the records and add to a memtable. */
-  while (ldb_reader_read_record(&reader, &record, &buf) && rc == LDB_OK) {
-    ldb_seqnum_t last_seq;
+  /* Read all the records and add to the memtables. Reading and
+     checksumming of the next chunk overlaps with insertion of
+     the current one. Records are still inserted in log order. */
+  rp.next = &rp.chunks[0];
 
-    if (record.size < 12) {
-      /* "log record too small" */
-      reporter.corruption(&reporter, record.size, LDB_CORRUPTION);
-      continue;
-    }
+  ldb_pool_schedule(state->readahead, ldb_replay_fill, &rp);
+
+  for (;;) {
+    ldb_chunk_t *chunk;
+    size_t i, off = 0;
+
+    ldb_pool_wait(state->readahead);
 
-    ldb_batch_set_contents(&batch, &record);
+    chunk = rp.next;
 
-    if (mem == NULL) {
-      mem = ldb_memtable_create(&db->internal_comparator);
-      ldb_memtable_ref(mem);
+    if (!chunk->last) {
+      rp.next = (chunk == &rp.chunks[0]) ? &rp.chunks[1] : &rp.chunks[0];
+      ldb_pool_schedule(state->readahead, ldb_replay_fill, &rp);
     }
 
-    rc = ldb_batch_insert_into(&batch, mem);
+    for (i = 0; i < chunk->sizes.length; i++) {
+      ldb_seqnum_t last_seq;
 
-    ldb_maybe_ignore_error(db, &rc);
+      ldb_slice_set(&record, chunk->data.data + off, chunk->sizes.items[i]);
 
-    if (rc != LDB_OK)
-      break;
+      off += record.size;
 
-    last_seq = ldb_batch_sequence(&batch) + ldb_batch_count(&batch) - 1;
+      ldb_batch_set_contents(&batch, &record);
 
-    if (last_seq > *max_sequence)
-      *max_sequence = last_seq;
+      rc = ldb_batch_insert_families(&batch, ldb_replay_lookup, state);
 
-    if (ldb_memtable_usage(mem) > db->options.write_buffer_size) {
-      compactions++;
-      *save_manifest = 1;
+      ldb_maybe_ignore_error(db, &rc);
+
+      if (rc != LDB_OK)
+        break;
 
-      rc = ldb_write_level0_table(db, mem, edit, NULL);
+      last_seq = ldb_batch_sequence(&batch) + ldb_batch_count(&batch) - 1;
 
-      ldb_memtable_unref(mem);
-      mem = NULL;
+      if (last_seq > *max_sequence)
+        *max_sequence = last_seq;
+
+      for (j = 0; j < db->families.length && rc == LDB_OK; j++) {
+        ldb_family_t *fam = db->families.items[j];
+        ldb_memtable_t *mem = fam->mem;
+
+        if (mem == NULL)
+          continue;
+
+        if (ldb_memtable_usage(mem) > fam->options.write_buffer_size) {
+          compactions++;
+          *save_manifest = 1;
+
+          fam->mem = NULL;
+
+          rc = ldb_schedule_level0_table(db, state, fam, mem);
+        }
+      }
 
       if (rc != LDB_OK) {
         /* Reflect errors immediately so that conditions like full
@@ -913,11 +1891,21 @@ ldb_recover_log_file(ldb_t *db, uint64_t log_number,
         break;
       }
     }
+
+    if (rc != LDB_OK || chunk->last)
+      break;
   }
 
-  ldb_buffer_clear(&buf);
+  ldb_pool_wait(state->readahead);
+
+  if (rc == LDB_OK)
+    rc = rp.status;
+
   ldb_batch_clear(&batch);
-  ldb_reader_clear(&reader);
+  ldb_chunk_clear(&rp.chunks[0]);
+  ldb_chunk_clear(&rp.chunks[1]);
+  ldb_buffer_clear(&rp.scratch);
+  ldb_reader_clear(&rp.reader);
   ldb_rfile_destroy(file);
 
   /* See if we should keep reusing the last log file. */
@@ -926,34 +1914,44 @@ ldb_recover_log_file(ldb_t *db, uint64_t log_number,
 
     assert(db->logfile == NULL);
     assert(db->log == NULL);
-    assert(db->mem == NULL);
 
+    /* Only append if the last record ends the file. Anything past it
+       (the zeroed tail of a preallocated log, or a torn write) would
+       hide the records we append from the next recovery. */
     if (ldb_file_size(fname, &lfile_size) == LDB_OK &&
+        lfile_size == rp.end &&
         ldb_appendfile_create(fname, &db->logfile) == LDB_OK) {
       ldb_log(db->options.info_log, "Reusing old log %s", fname);
 
       db->log = ldb_writer_create(db->logfile, lfile_size);
       db->logfile_number = log_number;
 
-      if (mem != NULL) {
-        db->mem = mem;
-        mem = NULL;
-      } else {
-        /* mem can be NULL if lognum exists but was empty. */
-        db->mem = ldb_memtable_create(&db->internal_comparator);
-        ldb_memtable_ref(db->mem);
-      }
+      /* Never follow recyclable records with legacy ones. */
+      if (rp.reader.recycled || db->options.recycle_logs > 0)
+        ldb_writer_set_log_number(db->log, log_number);
+
+      /* The memtables are kept. Those which are still NULL (the log
+         held no entries for them) are created by ldb_open(). */
+      return LDB_OK;
     }
   }
 
-  if (mem != NULL) {
+  for (j = 0; j < db->families.length; j++) {
+    ldb_family_t *fam = db->families.items[j];
+    ldb_memtable_t *mem = fam->mem;
+
+    if (mem == NULL)
+      continue;
+
+    fam->mem = NULL;
+
     /* mem did not get reused; compact it. */
     if (rc == LDB_OK) {
       *save_manifest = 1;
-      rc = ldb_write_level0_table(db, mem, edit, NULL);
+      rc = ldb_schedule_level0_table(db, state, fam, mem);
+    } else {
+      ldb_memtable_unref(mem);
     }
-
-    ldb_memtable_unref(mem);
   }
 
   return rc;
@@ -964,34 +1962,140 @@ compare_ascending(uint64_t x, uint64_t y) {
   return LDB_CMP(x, y);
 }
 
-/* Recover the descriptor from persistent storage. May do a significant
-   amount of work to recover recently logged updates. Any changes to
-   be made to the descriptor are added to *edit. */
+/* Column families named by the caller of ldb_open_families(). */
+typedef struct ldb_request_s {
+  const char *const *names;
+  const ldb_dbopt_t **options;
+  size_t length;
+} ldb_request_t;
+
+/* Recover the column family stored in the directory numbered "number". */
 static int
-ldb_recover(ldb_t *db, ldb_edit_t *edit, int *save_manifest) {
-  uint64_t min_log, prev_log, number;
-  ldb_seqnum_t max_sequence = 0;
+ldb_recover_family(ldb_t *db, uint64_t number,
+                              const ldb_request_t *req,
+                              int *save_manifest) {
+  char dirname[LDB_PATH_MAX];
   char path[LDB_PATH_MAX];
   char **filenames = NULL;
   rb_set64_t expected;
   ldb_filetype_t type;
-  ldb_array_t logs;
+  ldb_family_t *fam;
+  ldb_buffer_t name;
+  uint64_t num;
   int rc = LDB_OK;
   int i, len;
+  size_t j;
 
   ldb_mutex_assert_held(&db->mutex);
 
-  /* Ignore error from create_dir since the creation of the DB is
-     committed only when the descriptor is created, and this directory
-     may already exist from a previous failed creation attempt. */
-  ldb_create_dir(db->dbname);
+  /* Never allocate the number again, even once the family is gone. */
+  ldb_versions_mark_file_number(db->versions, number);
 
-  assert(db->db_lock == NULL);
+  if (!ldb_family_dirname(dirname, sizeof(dirname), db->dbname, number))
+    return LDB_INVALID;
 
-  if (!ldb_lock_filename(path, sizeof(path), db->dbname))
+  if (!ldb_current_filename(path, sizeof(path), dirname))
     return LDB_INVALID;
 
-  rc = ldb_lock_file(path, &db->db_lock);
+  if (!ldb_file_exists(path)) {
+    /* The family was dropped, or its creation never completed. */
+    ldb_log(db->options.info_log, "Deleting column family %s", dirname);
+    ldb_destroy(dirname, NULL);
+    return LDB_OK;
+  }
+
+  ldb_buffer_init(&name);
+
+  rc = ldb_versions_family(dirname, &name);
+
+  if (rc != LDB_OK)
+    goto done;
+
+  for (j = 0; j < req->length; j++) {
+    const char *xp = req->names[j];
+
+    if (strlen(xp) == name.size && memcmp(xp, name.data, name.size) == 0)
+      break;
+  }
+
+  if (j == req->length) {
+    rc = LDB_INVALID; /* "column family not opened" */
+    goto done;
+  }
+
+  if (ldb_family_lookup_name(db, req->names[j]) != NULL) {
+    rc = LDB_CORRUPTION; /* "duplicate column family" */
+    goto done;
+  }
+
+  fam = ldb_family_new(db, number, req->names[j], dirname, req->options[j]);
+
+  ldb_vector_push(&db->families, fam);
+
+  rc = ldb_versions_recover(fam->versions, save_manifest);
+
+  if (rc != LDB_OK)
+    goto done;
+
+  len = ldb_get_children(dirname, &filenames);
+
+  if (len < 0) {
+    rc = ldb_system_error();
+    goto done;
+  }
+
+  rb_set64_init(&expected);
+
+  ldb_versions_add_files(fam->versions, &expected);
+
+  for (i = 0; i < len; i++) {
+    if (ldb_parse_filename(&type, &num, filenames[i]))
+      rb_set64_del(&expected, num);
+  }
+
+  ldb_free_children(filenames, len);
+
+  if (expected.size != 0)
+    rc = LDB_CORRUPTION; /* "[expected.size] missing files" */
+
+  rb_set64_clear(&expected);
+done:
+  ldb_buffer_clear(&name);
+  return rc;
+}
+
+/* Recover the descriptor from persistent storage. May do a significant
+   amount of work to recover recently logged updates. Any changes to
+   be made to the descriptors are added to the edit of each column
+   family. */
+static int
+ldb_recover(ldb_t *db, const ldb_request_t *req, int *save_manifest) {
+  uint64_t min_log, prev_log, number;
+  ldb_seqnum_t max_sequence = 0;
+  char path[LDB_PATH_MAX];
+  char **filenames = NULL;
+  rb_set64_t expected;
+  ldb_rstate_t state;
+  ldb_filetype_t type;
+  ldb_array_t families;
+  ldb_array_t logs;
+  int rc = LDB_OK;
+  size_t j;
+  int i, len;
+
+  ldb_mutex_assert_held(&db->mutex);
+
+  /* Ignore error from create_dir since the creation of the DB is
+     committed only when the descriptor is created, and this directory
+     may already exist from a previous failed creation attempt. */
+  ldb_create_dir(db->dbname);
+
+  assert(db->db_lock == NULL);
+
+  if (!ldb_lock_filename(path, sizeof(path), db->dbname))
+    return LDB_INVALID;
+
+  rc = ldb_lock_file(path, &db->db_lock);
 
   if (rc != LDB_OK)
     return rc;
@@ -1005,7 +2109,9 @@ ldb_recover(ldb_t *db, ldb_edit_t *edit, int *save_manifest) {
               "Creating DB %s since it was missing.",
               db->dbname);
 
-      rc = ldb_new_db(db);
+      rc = ldb_new_db(db->dbname,
+                      ldb_user_comparator(ldb_default_family(db))->name,
+                      NULL, 0);
 
       if (rc != LDB_OK)
         return rc;
@@ -1022,23 +2128,13 @@ ldb_recover(ldb_t *db, ldb_edit_t *edit, int *save_manifest) {
   if (rc != LDB_OK)
     return rc;
 
-  /* Recover from all newer log files than the ones named in the
-   * descriptor (new log files may have been added by the previous
-   * incarnation without registering them in the descriptor).
-   *
-   * Note that prev_log_number is no longer used, but we pay
-   * attention to it in case we are recovering a database
-   * produced by an older version of leveldb.
-   */
-  min_log = db->versions->log_number;
-  prev_log = db->versions->prev_log_number;
-
   len = ldb_get_children(db->dbname, &filenames);
 
   if (len < 0)
     return ldb_system_error();
 
   rb_set64_init(&expected);
+  ldb_array_init(&families);
   ldb_array_init(&logs);
 
   ldb_versions_add_files(db->versions, &expected);
@@ -1047,8 +2143,11 @@ ldb_recover(ldb_t *db, ldb_edit_t *edit, int *save_manifest) {
     if (ldb_parse_filename(&type, &number, filenames[i])) {
       rb_set64_del(&expected, number);
 
-      if (type == LDB_FILE_LOG && ((number >= min_log) || (number == prev_log)))
+      if (type == LDB_FILE_LOG)
         ldb_array_push(&logs, number);
+
+      if (type == LDB_FILE_FAMILY)
+        ldb_array_push(&families, number);
     }
   }
 
@@ -1059,18 +2158,55 @@ ldb_recover(ldb_t *db, ldb_edit_t *edit, int *save_manifest) {
     goto fail;
   }
 
+  ldb_array_sort(&families, compare_ascending);
+
+  for (j = 0; j < families.length; j++) {
+    rc = ldb_recover_family(db, families.items[j], req, save_manifest);
+
+    if (rc != LDB_OK)
+      goto fail;
+  }
+
+  /* Recover from all newer log files than the ones named in the
+   * descriptors (new log files may have been added by the previous
+   * incarnation without registering them in the descriptors).
+   *
+   * Note that prev_log_number is no longer used, but we pay
+   * attention to it in case we are recovering a database
+   * produced by an older version of leveldb.
+   */
+  min_log = db->versions->log_number;
+  prev_log = db->versions->prev_log_number;
+
+  for (j = 1; j < db->families.length; j++) {
+    ldb_family_t *fam = db->families.items[j];
+
+    if (fam->versions->log_number < min_log)
+      min_log = fam->versions->log_number;
+  }
+
+  for (i = 0, j = 0; i < (int)logs.length; i++) {
+    number = logs.items[i];
+
+    if ((number >= min_log) || (number == prev_log))
+      logs.items[j++] = number;
+  }
+
+  logs.length = j;
+
   /* Recover in the order in which the logs were generated. */
   ldb_array_sort(&logs, compare_ascending);
+  ldb_rstate_init(&state, db);
 
   for (i = 0; i < (int)logs.length; i++) {
-    rc = ldb_recover_log_file(db, logs.items[i],
+    rc = ldb_recover_log_file(db, &state,
+                                  logs.items[i],
                                   (i == (int)logs.length - 1),
                                   save_manifest,
-                                  edit,
                                   &max_sequence);
 
     if (rc != LDB_OK)
-      goto fail;
+      break;
 
     /* The previous incarnation may not have written any MANIFEST
        records after allocating this log number. So we manually
@@ -1078,12 +2214,30 @@ ldb_recover(ldb_t *db, ldb_edit_t *edit, int *save_manifest) {
     ldb_versions_mark_file_number(db->versions, logs.items[i]);
   }
 
+  if (rc == LDB_OK)
+    rc = ldb_finish_level0_tables(db, &state);
+
+  ldb_rstate_clear(&state);
+
+  if (rc != LDB_OK)
+    goto fail;
+
+  /* Column families record the sequence number of the database
+     whenever their descriptors are written. */
+  for (j = 1; j < db->families.length; j++) {
+    ldb_family_t *fam = db->families.items[j];
+
+    if (fam->versions->last_sequence > max_sequence)
+      max_sequence = fam->versions->last_sequence;
+  }
+
   if (db->versions->last_sequence < max_sequence)
     db->versions->last_sequence = max_sequence;
 
   rc = LDB_OK;
 fail:
   rb_set64_clear(&expected);
+  ldb_array_clear(&families);
   ldb_array_clear(&logs);
   return rc;
 }
@@ -1099,11 +2253,11 @@ ldb_record_background_error(ldb_t *db, int status) {
   }
 }
 
-/* Compact the in-memory write buffer to disk. Switches to a new
-   log-file/memtable and writes a new descriptor iff successful.
-   Errors are recorded in bg_error. */
+/* Compact the in-memory write buffer of a column family to disk.
+   Writes a new descriptor iff successful. Errors are recorded in
+   bg_error. */
 static void
-ldb_compact_memtable(ldb_t *db) {
+ldb_compact_memtable(ldb_t *db, ldb_family_t *fam) {
   ldb_version_t *base;
   ldb_edit_t edit;
   int rc = LDB_OK;
@@ -1112,14 +2266,14 @@ ldb_compact_memtable(ldb_t *db) {
 
   ldb_mutex_assert_held(&db->mutex);
 
-  assert(db->imm != NULL);
+  assert(fam->imm != NULL);
 
   /* Save the contents of the memtable as a new Table. */
-  base = db->versions->current;
+  base = fam->versions->current;
 
   ldb_version_ref(base);
 
-  rc = ldb_write_level0_table(db, db->imm, &edit, base);
+  rc = ldb_write_level0_table(db, fam, fam->imm, &edit, base);
 
   ldb_version_unref(base);
 
@@ -1129,17 +2283,17 @@ ldb_compact_memtable(ldb_t *db) {
   /* Replace immutable memtable with the generated Table. */
   if (rc == LDB_OK) {
     ldb_edit_set_prev_log_number(&edit, 0);
-    ldb_edit_set_log_number(&edit, db->logfile_number); /* Earlier logs no
-                                                           longer needed. */
+    ldb_edit_set_log_number(&edit, fam->imm_log_number); /* Earlier logs no
+                                                            longer needed. */
 
-    rc = ldb_versions_apply(db->versions, &edit, &db->mutex);
+    rc = ldb_family_apply(db, fam, &edit);
   }
 
   if (rc == LDB_OK) {
     /* Commit to the new state. */
-    ldb_memtable_unref(db->imm);
-    db->imm = NULL;
-    ldb_atomic_store(&db->has_imm, 0, ldb_order_release);
+    ldb_memtable_unref(fam->imm);
+    fam->imm = NULL;
+    ldb_update_has_imm(db);
     ldb_remove_obsolete_files(db);
   } else {
     ldb_record_background_error(db, rc);
@@ -1148,8 +2302,42 @@ ldb_compact_memtable(ldb_t *db) {
   ldb_edit_clear(&edit);
 }
 
+/* Compact the immutable memtables of all column families. */
+static void
+ldb_compact_memtables(ldb_t *db) {
+  ldb_mutex_assert_held(&db->mutex);
+
+  while (db->bg_error == LDB_OK) {
+    ldb_family_t *fam = NULL;
+    size_t i;
+
+    for (i = 0; i < db->families.length; i++) {
+      ldb_family_t *item = db->families.items[i];
+
+      if (item->imm != NULL) {
+        fam = item;
+        break;
+      }
+    }
+
+    if (fam == NULL)
+      break;
+
+    ldb_family_ref(db, fam);
+
+    fam->busy++;
+
+    ldb_compact_memtable(db, fam);
+
+    fam->busy--;
+
+    ldb_family_unref(db, fam);
+  }
+}
+
 static int
 ldb_open_compaction_output_file(ldb_t *db, ldb_cstate_t *state) {
+  ldb_family_t *fam = state->family;
   char fname[LDB_PATH_MAX];
   uint64_t file_number;
   int rc = LDB_OK;
@@ -1160,9 +2348,9 @@ ldb_open_compaction_output_file(ldb_t *db, ldb_cstate_t *state) {
   {
     ldb_mutex_lock(&db->mutex);
 
-    file_number = ldb_versions_new_file_number(db->versions);
+    file_number = ldb_versions_new_file_number(fam->versions);
 
-    rb_set64_put(&db->pending_outputs, file_number);
+    rb_set64_put(&fam->pending_outputs, file_number);
 
     ldb_vector_push(&state->outputs, ldb_output_create(file_number));
 
@@ -1170,21 +2358,75 @@ ldb_open_compaction_output_file(ldb_t *db, ldb_cstate_t *state) {
   }
 
   /* Make the output file. */
-  if (!ldb_table_filename(fname, sizeof(fname), db->dbname, file_number))
+  if (!ldb_table_filename(fname, sizeof(fname), fam->dirname, file_number))
     return LDB_INVALID;
 
   rc = ldb_truncfile_create(fname, &state->outfile);
 
   if (rc == LDB_OK)
-    state->builder = ldb_tablegen_create(&db->options, state->outfile);
+    state->builder = ldb_tablegen_create(&fam->options, state->outfile);
 
   return rc;
 }
 
+/* Add the kept tombstones falling in [lower, upper) to the current
+   output. A NULL upper bound is past the end of the compaction. */
+static void
+ldb_add_compaction_tombstones(ldb_cstate_t *state, const ldb_slice_t *upper) {
+  const ldb_comparator_t *ucmp = ldb_user_comparator(state->family);
+  ldb_output_t *out = ldb_cstate_top(state);
+  ldb_rangedel_t tombstones;
+  size_t i;
+
+  ldb_rangedel_init(&tombstones, ucmp);
+
+  for (i = 0; i < state->kept.length; i++) {
+    const ldb_tombstone_t *ts = state->kept.items[i];
+    const ldb_slice_t *start = &ts->start;
+    const ldb_slice_t *limit = &ts->limit;
+
+    if (state->has_lower && ldb_compare(ucmp, start, &state->lower) < 0)
+      start = &state->lower;
+
+    if (upper != NULL && ldb_compare(ucmp, limit, upper) > 0)
+      limit = upper;
+
+    ldb_rangedel_add(&tombstones, start, limit, ts->sequence);
+  }
+
+  ldb_rangedel_finish(&tombstones);
+
+  ldb_build_tombstones(state->builder,
+                       &state->family->internal_comparator,
+                       &tombstones,
+                       &out->smallest,
+                       &out->largest);
+
+  ldb_rangedel_clear(&tombstones);
+}
+
+/* Returns true if some kept tombstone lies at or after the lower bound. */
+static int
+ldb_has_compaction_tombstones(const ldb_cstate_t *state) {
+  const ldb_comparator_t *ucmp = ldb_user_comparator(state->family);
+  size_t i;
+
+  for (i = 0; i < state->kept.length; i++) {
+    const ldb_tombstone_t *ts = state->kept.items[i];
+
+    if (!state->has_lower || ldb_compare(ucmp, &ts->limit, &state->lower) > 0)
+      return 1;
+  }
+
+  return 0;
+}
+
 static int
 ldb_finish_compaction_output_file(ldb_t *db, ldb_cstate_t *state,
-                                             ldb_iter_t *input) {
+                                             ldb_iter_t *input,
+                                             const ldb_slice_t *upper) {
   uint64_t output_number, current_entries, current_bytes;
+  uint64_t current_tombstones;
   int rc = LDB_OK;
 
   assert(state != NULL);
@@ -1198,7 +2440,16 @@ ldb_finish_compaction_output_file(ldb_t *db, ldb_cstate_t *state,
   /* Check for iterator errors. */
   rc = ldb_iter_status(input);
 
+  if (rc == LDB_OK && state->kept.length > 0)
+    ldb_add_compaction_tombstones(state, upper);
+
+  if (upper != NULL) {
+    ldb_buffer_set(&state->lower, upper->data, upper->size);
+    state->has_lower = 1;
+  }
+
   current_entries = ldb_tablegen_entries(state->builder);
+  current_tombstones = ldb_tablegen_tombstones(state->builder);
 
   if (rc == LDB_OK)
     rc = ldb_tablegen_finish(state->builder);
@@ -1208,6 +2459,8 @@ ldb_finish_compaction_output_file(ldb_t *db, ldb_cstate_t *state,
   current_bytes = ldb_tablegen_size(state->builder);
 
   ldb_cstate_top(state)->file_size = current_bytes;
+  ldb_cstate_top(state)->tombstones = current_tombstones;
+  ldb_cstate_top(state)->entries = current_entries;
 
   state->total_bytes += current_bytes;
 
@@ -1224,12 +2477,13 @@ ldb_finish_compaction_output_file(ldb_t *db, ldb_cstate_t *state,
   ldb_wfile_destroy(state->outfile);
   state->outfile = NULL;
 
-  if (rc == LDB_OK && current_entries > 0) {
+  if (rc == LDB_OK && (current_entries > 0 || current_tombstones > 0)) {
     /* Verify that the table is usable. */
-    ldb_iter_t *iter = ldb_tables_iterate(db->table_cache,
+    ldb_iter_t *iter = ldb_tables_iterate(state->family->table_cache,
                                           ldb_readopt_default,
                                           output_number,
                                           current_bytes,
+                                          0,
                                           NULL);
 
     rc = ldb_iter_status(iter);
@@ -1240,7 +2494,7 @@ ldb_finish_compaction_output_file(ldb_t *db, ldb_cstate_t *state,
       ldb_log(db->options.info_log,
               "Generated table #%lu@%d: %lu keys, %lu bytes",
               (unsigned long)output_number,
-              state->compaction->level,
+              state->compaction->output_level,
               (unsigned long)current_entries,
               (unsigned long)current_bytes);
     }
@@ -1250,133 +2504,555 @@ ldb_finish_compaction_output_file(ldb_t *db, ldb_cstate_t *state,
 }
 
 static int
-ldb_install_compaction_results(ldb_t *db, ldb_cstate_t *state) {
-  ldb_edit_t *edit = &state->compaction->edit;
-  int level;
-  size_t i;
+ldb_open_compaction_blob_file(ldb_t *db, ldb_cstate_t *state) {
+  ldb_family_t *fam = state->family;
+  char fname[LDB_PATH_MAX];
+  uint64_t file_number;
+  int rc;
 
-  ldb_mutex_assert_held(&db->mutex);
+  assert(state->blobgen == NULL);
 
-  ldb_log(db->options.info_log, "Compacted %d@%d + %d@%d files => %ld bytes",
-          (int)state->compaction->inputs[0].length,
-          state->compaction->level + 0,
-          (int)state->compaction->inputs[1].length,
-          state->compaction->level + 1,
-          (long)state->total_bytes);
+  {
+    ldb_mutex_lock(&db->mutex);
 
-  /* Add compaction outputs. */
-  ldb_compaction_add_input_deletions(state->compaction, edit);
+    file_number = ldb_versions_new_file_number(fam->versions);
 
-  level = state->compaction->level;
+    rb_set64_put(&fam->pending_outputs, file_number);
 
-  for (i = 0; i < state->outputs.length; i++) {
-    const ldb_output_t *out = state->outputs.items[i];
+    ldb_vector_push(&state->blobs, ldb_blobmeta_create(file_number, 0, 0));
 
-    ldb_edit_add_file(edit, level + 1,
-                      out->number,
-                      out->file_size,
-                      &out->smallest,
-                      &out->largest);
+    ldb_mutex_unlock(&db->mutex);
   }
 
-  return ldb_versions_apply(db->versions, edit, &db->mutex);
+  if (!ldb_blob_filename(fname, sizeof(fname), fam->dirname, file_number))
+    return LDB_INVALID;
+
+  rc = ldb_truncfile_create(fname, &state->blobfile);
+
+  if (rc == LDB_OK)
+    state->blobgen = ldb_blobgen_create(state->blobfile, file_number);
+
+  return rc;
 }
 
 static int
-ldb_do_compaction_work(ldb_t *db, ldb_cstate_t *state) {
-  const ldb_comparator_t *ucmp = ldb_user_comparator(db);
-  ldb_seqnum_t last_sequence_for_key = LDB_MAX_SEQUENCE;
-  int64_t start_micros = ldb_now_usec();
-  int64_t imm_micros = 0; /* Micros spent doing db->imm compactions. */
-  ldb_buffer_t user_key;
-  int has_user_key = 0;
-  ldb_stats_t stats;
-  ldb_iter_t *input;
-  int rc = LDB_OK;
-  int which, level;
-  ldb_pkey_t ikey;
-  char tmp[100];
-  size_t i;
+ldb_finish_compaction_blob_file(ldb_t *db, ldb_cstate_t *state) {
+  ldb_blobmeta_t *blob = ldb_vector_top(&state->blobs);
+  int rc;
 
-  ldb_log(db->options.info_log, "Compacting %d@%d + %d@%d files",
-          (int)state->compaction->inputs[0].length,
-          state->compaction->level + 0,
-          (int)state->compaction->inputs[1].length,
-          state->compaction->level + 1);
+  assert(state->blobgen != NULL);
 
-  ldb_buffer_init(&user_key);
-  ldb_stats_init(&stats);
+  rc = ldb_blobgen_finish(state->blobgen);
 
-  assert(ldb_versions_files(db->versions, state->compaction->level) > 0);
+  blob->count = ldb_blobgen_count(state->blobgen);
+  blob->bytes = ldb_blobgen_size(state->blobgen);
 
-  assert(state->builder == NULL);
-  assert(state->outfile == NULL);
+  ldb_blobgen_destroy(state->blobgen);
+  state->blobgen = NULL;
 
-  if (ldb_snaplist_empty(&db->snapshots)) {
-    state->smallest_snapshot = db->versions->last_sequence;
-  } else {
-    state->smallest_snapshot =
-      ldb_snaplist_oldest(&db->snapshots)->sequence;
+  if (rc == LDB_OK)
+    rc = ldb_wfile_sync(state->blobfile);
+
+  if (rc == LDB_OK)
+    rc = ldb_wfile_close(state->blobfile);
+
+  ldb_wfile_destroy(state->blobfile);
+  state->blobfile = NULL;
+
+  if (rc == LDB_OK) {
+    ldb_log(db->options.info_log,
+            "Generated blob #%lu: %lu values, %lu bytes",
+            (unsigned long)blob->number,
+            (unsigned long)blob->count,
+            (unsigned long)blob->bytes);
   }
 
-  input = ldb_inputiter_create(db->versions, state->compaction);
+  return rc;
+}
 
-  /* Release mutex while we're actually doing the compaction work. */
-  ldb_mutex_unlock(&db->mutex);
+/* Read the value referenced by a blob index. */
+static int
+ldb_compaction_blob(ldb_cstate_t *state, const ldb_slice_t *index,
+                                         ldb_blobref_t *ref,
+                                         ldb_slice_t *value) {
+  /* Same as compaction iterators: if paranoid_checks
+     are on, turn on checksum verification. */
+  ldb_readopt_t options = *ldb_readopt_default;
 
-  ldb_iter_first(input);
+  options.verify_checksums = state->family->options.paranoid_checks;
 
-  while (ldb_iter_valid(input) && !ldb_atomic_load(&db->shutting_down,
-                                                   ldb_order_acquire)) {
-    ldb_slice_t key, value;
-    int drop = 0;
+  if (!ldb_blobref_import(ref, index))
+    return LDB_CORRUPTION; /* "bad blob index" */
 
-    /* Prioritize immutable compaction work. */
-    if (ldb_atomic_load(&db->has_imm, ldb_order_relaxed)) {
-      int64_t imm_start = ldb_now_usec();
+  return ldb_blobreader_read(&state->reader, &options, ref, value);
+}
 
-      ldb_mutex_lock(&db->mutex);
+/* Record that a blob record is no longer referenced. */
+static void
+ldb_compaction_garbage(ldb_cstate_t *state, const ldb_blobref_t *ref) {
+  ldb_edit_add_garbage(&state->compaction->edit, ref->number, 1, ref->size);
+}
 
-      if (db->imm != NULL) {
-        ldb_compact_memtable(db);
+/* Move large values of the entry at *key to a blob file, and move
+   the values referenced in blob files being relocated to a new one
+   (or back into the table, if they are no longer large). Updates
+   *key and *value to the entry to be written. */
+static int
+ldb_compaction_separate(ldb_t *db, ldb_cstate_t *state,
+                                   ldb_slice_t *key,
+                                   ldb_slice_t *value) {
+  const ldb_dbopt_t *options = &state->family->options;
+  ldb_output_t *out = ldb_cstate_top(state);
+  int relocated = 0;
+  ldb_blobref_t ref;
+  ldb_pkey_t pkey;
+  int rc;
 
-        /* Wake up make_room_for_write() if necessary. */
-        ldb_cond_broadcast(&db->background_work_finished_signal);
-      }
+  if (!ldb_pkey_import(&pkey, key))
+    return LDB_OK;
 
-      ldb_mutex_unlock(&db->mutex);
+  if (pkey.type == LDB_TYPE_BLOB) {
+    if (!ldb_blobref_import(&ref, value))
+      return LDB_CORRUPTION; /* "bad blob index" */
 
-      imm_micros += (ldb_now_usec() - imm_start);
+    if (!rb_set64_has(&state->relocate, ref.number)) {
+      if (out->oldest_blob == 0 || ref.number < out->oldest_blob)
+        out->oldest_blob = ref.number;
+
+      return LDB_OK;
     }
 
-    key = ldb_iter_key(input);
+    rc = ldb_compaction_blob(state, value, &ref, value);
+
+    if (rc != LDB_OK)
+      return rc;
 
-    if (ldb_compaction_should_stop_before(state->compaction, &key) &&
-        state->builder != NULL) {
-      rc = ldb_finish_compaction_output_file(db, state, input);
+    ldb_compaction_garbage(state, &ref);
+
+    pkey.type = LDB_TYPE_VALUE;
+    relocated = 1;
+  } else if (pkey.type != LDB_TYPE_VALUE) {
+    return LDB_OK;
+  }
+
+  if (options->min_blob_size > 0 && value->size >= options->min_blob_size) {
+    if (state->blobgen == NULL) {
+      rc = ldb_open_compaction_blob_file(db, state);
 
       if (rc != LDB_OK)
-        break;
+        return rc;
     }
 
-    /* Handle key/value, add to state, etc. */
-    if (!ldb_pkey_import(&ikey, &key)) {
-      /* Do not hide error keys. */
-      ldb_buffer_reset(&user_key);
-      has_user_key = 0;
-      last_sequence_for_key = LDB_MAX_SEQUENCE;
-    } else {
-      if (!has_user_key || ldb_compare(ucmp, &ikey.user_key, &user_key) != 0) {
-        /* First occurrence of this user key. */
-        ldb_buffer_set(&user_key, ikey.user_key.data, ikey.user_key.size);
-        has_user_key = 1;
-        last_sequence_for_key = LDB_MAX_SEQUENCE;
-      }
+    rc = ldb_blobgen_add(state->blobgen, &pkey.user_key, value, &ref);
 
-      if (last_sequence_for_key <= state->smallest_snapshot) {
-        /* Hidden by an newer entry for same user key. */
-        drop = 1; /* (A) */
-      } else if (ikey.type == LDB_TYPE_DELETION &&
+    if (rc != LDB_OK)
+      return rc;
+
+    if (out->oldest_blob == 0 || ref.number < out->oldest_blob)
+      out->oldest_blob = ref.number;
+
+    ldb_buffer_reset(&state->blob_index);
+    ldb_blobref_export(&state->blob_index, &ref);
+
+    *value = state->blob_index;
+
+    pkey.type = LDB_TYPE_BLOB;
+
+    /* Close blob file if it is big enough. */
+    if (ldb_blobgen_size(state->blobgen) >= options->blob_file_size) {
+      rc = ldb_finish_compaction_blob_file(db, state);
+
+      if (rc != LDB_OK)
+        return rc;
+    }
+  } else if (!relocated) {
+    return LDB_OK;
+  }
+
+  ldb_buffer_reset(&state->blob_key);
+  ldb_pkey_export(&state->blob_key, &pkey);
+
+  *key = state->blob_key;
+
+  return LDB_OK;
+}
+
+static int
+ldb_install_compaction_results(ldb_t *db, ldb_cstate_t *state) {
+  ldb_edit_t *edit = &state->compaction->edit;
+  int level;
+  size_t i;
+
+  ldb_mutex_assert_held(&db->mutex);
+
+  ldb_log(db->options.info_log, "Compacted %d@%d + %d@%d files => %ld bytes",
+          (int)state->compaction->inputs[0].length,
+          state->compaction->level + 0,
+          (int)state->compaction->inputs[1].length,
+          state->compaction->output_level,
+          (long)state->total_bytes);
+
+  /* Add compaction outputs. */
+  ldb_compaction_add_input_deletions(state->compaction, edit);
+
+  level = state->compaction->output_level;
+
+  for (i = 0; i < state->outputs.length; i++) {
+    const ldb_output_t *out = state->outputs.items[i];
+    ldb_filemeta_t *f;
+
+    /* Opened up front (see below), but nothing was kept. */
+    if (out->smallest.size == 0)
+      continue;
+
+    f = ldb_edit_add_file(edit, level,
+                                          out->number,
+                                          out->file_size,
+                                          &out->smallest,
+                                          &out->largest);
+
+    f->tombstones = out->tombstones;
+    f->oldest_blob = out->oldest_blob;
+    f->entries = out->entries;
+    f->deletions = out->deletions;
+    f->created = out->created;
+  }
+
+  for (i = 0; i < state->blobs.length; i++) {
+    const ldb_blobmeta_t *blob = state->blobs.items[i];
+
+    if (blob->count > 0)
+      ldb_edit_add_blob(edit, blob->number, blob->count, blob->bytes);
+  }
+
+  return ldb_family_apply(db, state->family, edit);
+}
+
+/* The oldest snapshot which sees an entry written at "sequence", or
+   LDB_MAX_SEQUENCE if only the current state does. No reader can tell
+   apart the states of a key between two entries for which this is the
+   same, so the older entry is hidden by the newer one. */
+static ldb_seqnum_t
+ldb_compaction_visible_at(const ldb_cstate_t *state, ldb_seqnum_t sequence) {
+  size_t lo = 0;
+  size_t hi = state->num_snapshots;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+
+    if (state->snapshots[mid] < sequence)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo == state->num_snapshots)
+    return LDB_MAX_SEQUENCE;
+
+  return state->snapshots[lo];
+}
+
+/* Which entries may be combined: no snapshot can tell apart the states
+   of a key between two entries in the same stripe. The entries seen by
+   some snapshots but not others are left alone. */
+static int
+ldb_compaction_stripe(const ldb_cstate_t *state, ldb_seqnum_t sequence) {
+  if (sequence <= state->smallest_snapshot)
+    return 0;
+
+  if (sequence > state->newest_snapshot)
+    return 2;
+
+  return 1;
+}
+
+/* Combine the merge operand at the input with the entries for the same
+ * key beneath it, storing the result in *key and *value. Operands are
+ * applied to a value, deletion or range tombstone in the same stripe,
+ * producing a value. Otherwise they are combined into a single operand.
+ * Leaves the input on the first entry not consumed.
+ */
+static int
+ldb_compaction_merge(ldb_cstate_t *state,
+                     ldb_iter_t *input,
+                     const ldb_slice_t *user_key,
+                     ldb_operands_t *operands,
+                     ldb_buffer_t *key,
+                     ldb_buffer_t *value) {
+  const ldb_comparator_t *ucmp = ldb_user_comparator(state->family);
+  ldb_valtype_t type = LDB_TYPE_MERGE;
+  const ldb_slice_t *base = NULL;
+  ldb_slice_t k = ldb_iter_key(input);
+  ldb_slice_t v = ldb_iter_value(input);
+  ldb_seqnum_t sequence, cover;
+  int exhausted = 1;
+  ldb_pkey_t pkey;
+  int stripe, rc;
+
+  if (!ldb_pkey_import(&pkey, &k))
+    return LDB_CORRUPTION;
+
+  sequence = pkey.sequence;
+  stripe = ldb_compaction_stripe(state, sequence);
+  cover = ldb_rangedel_covering(&state->tombstones, user_key, sequence);
+
+  ldb_operands_reset(operands);
+  ldb_operands_push(operands, &v);
+
+  for (ldb_iter_next(input); ldb_iter_valid(input); ldb_iter_next(input)) {
+    k = ldb_iter_key(input);
+    v = ldb_iter_value(input);
+
+    if (!ldb_pkey_import(&pkey, &k))
+      break;
+
+    if (ldb_compare(ucmp, &pkey.user_key, user_key) != 0)
+      break;
+
+    /* Deleted by a tombstone, which then lies beneath the operands. */
+    if (pkey.sequence < cover)
+      break;
+
+    if (ldb_compaction_stripe(state, pkey.sequence) != stripe) {
+      exhausted = 0;
+      break;
+    }
+
+    if (pkey.type == LDB_TYPE_MERGE) {
+      ldb_operands_push(operands, &v);
+      continue;
+    }
+
+    /* The value or deletion is consumed. */
+    if (pkey.type == LDB_TYPE_VALUE) {
+      ldb_buffer_copy(value, &v);
+      base = value;
+    } else if (pkey.type == LDB_TYPE_BLOB) {
+      ldb_blobref_t ref;
+      ldb_slice_t blob;
+
+      rc = ldb_compaction_blob(state, &v, &ref, &blob);
+
+      if (rc != LDB_OK)
+        return rc;
+
+      ldb_compaction_garbage(state, &ref);
+
+      ldb_buffer_copy(value, &blob);
+      base = value;
+    }
+
+    type = LDB_TYPE_VALUE;
+
+    ldb_iter_next(input);
+
+    break;
+  }
+
+  /* Nothing lies beneath the operands if they reached a tombstone,
+     or the bottom. */
+  if (type == LDB_TYPE_MERGE && exhausted) {
+    if (cover > 0) {
+      if (ldb_compaction_stripe(state, cover) == stripe)
+        type = LDB_TYPE_VALUE;
+    } else if (stripe == 0) {
+      if (ldb_compaction_is_base_level_for_key(state->compaction, user_key))
+        type = LDB_TYPE_VALUE;
+    }
+  }
+
+  if (type == LDB_TYPE_VALUE)
+    rc = ldb_operands_merge(operands, user_key, base, value);
+  else
+    rc = ldb_operands_combine(operands, user_key, value);
+
+  ldb_ikey_set(key, user_key, sequence, type);
+
+  return rc;
+}
+
+static int
+ldb_do_compaction_work(ldb_t *db, ldb_cstate_t *state) {
+  ldb_family_t *fam = state->family;
+  const ldb_comparator_t *ucmp = ldb_user_comparator(fam);
+  const ldb_cfilter_t *filter = fam->options.compaction_filter;
+  const ldb_merger_t *merger = fam->options.merge_operator;
+  ldb_seqnum_t last_sequence_for_key = LDB_MAX_SEQUENCE;
+  ldb_seqnum_t last_visible_for_key = 0;
+  int64_t start_micros = ldb_now_usec();
+  int64_t imm_micros = 0; /* Micros spent doing imm compactions. */
+  ldb_buffer_t user_key;
+  ldb_buffer_t filtered_key;
+  ldb_buffer_t merged_value;
+  ldb_operands_t operands;
+  int has_user_key = 0;
+  ldb_snapshot_t *snap;
+  ldb_stats_t stats;
+  ldb_iter_t *input;
+  int rc = LDB_OK;
+  int which, level;
+  ldb_pkey_t ikey;
+  char tmp[100];
+  size_t i;
+
+  ldb_log(db->options.info_log, "Compacting %d@%d + %d@%d files",
+          (int)state->compaction->inputs[0].length,
+          state->compaction->level + 0,
+          (int)state->compaction->inputs[1].length,
+          state->compaction->output_level);
+
+  ldb_buffer_init(&user_key);
+  ldb_buffer_init(&filtered_key);
+  ldb_buffer_init(&merged_value);
+  ldb_operands_init(&operands, merger);
+  ldb_stats_init(&stats);
+
+  assert(ldb_versions_files(fam->versions, state->compaction->level) > 0);
+
+  assert(state->builder == NULL);
+  assert(state->outfile == NULL);
+
+  if (ldb_snaplist_empty(&db->snapshots)) {
+    state->smallest_snapshot = db->versions->last_sequence;
+  } else {
+    state->smallest_snapshot =
+      ldb_snaplist_oldest(&db->snapshots)->sequence;
+    state->newest_snapshot =
+      ldb_snaplist_newest(&db->snapshots)->sequence;
+
+    for (snap = ldb_snaplist_oldest(&db->snapshots);
+         snap != &db->snapshots.head;
+         snap = snap->next) {
+      state->num_snapshots++;
+    }
+
+    state->snapshots = ldb_malloc(state->num_snapshots *
+                                  sizeof(ldb_seqnum_t));
+
+    for (i = 0, snap = ldb_snaplist_oldest(&db->snapshots);
+         snap != &db->snapshots.head;
+         snap = snap->next) {
+      state->snapshots[i++] = snap->sequence;
+    }
+  }
+
+  input = ldb_inputiter_create(fam->versions, state->compaction);
+
+  ldb_version_garbage_blobs(fam->versions->current, &state->relocate);
+
+  /* Release mutex while we're actually doing the compaction work. */
+  ldb_mutex_unlock(&db->mutex);
+
+  rc = ldb_compaction_tombstones(state->compaction, &state->tombstones);
+
+  ldb_rangedel_finish(&state->tombstones);
+
+  for (i = 0; i < ldb_rangedel_length(&state->tombstones); i++) {
+    const ldb_tombstone_t *ts = ldb_rangedel_get(&state->tombstones, i);
+
+    /* Like a deletion marker, a tombstone visible to every snapshot
+       is obsolete once nothing lies beneath it. */
+    if (ts->sequence <= state->smallest_snapshot &&
+        ldb_compaction_is_base_level_for_range(state->compaction,
+                                               &ts->start,
+                                               &ts->limit)) {
+      continue;
+    }
+
+    ldb_vector_push(&state->kept, ts);
+  }
+
+  /* Level-0 is searched newest first by file number. Number a level-0
+     output before any memtable flushed while we run, which is newer. */
+  if (rc == LDB_OK && state->compaction->output_level == 0)
+    rc = ldb_open_compaction_output_file(db, state);
+
+  ldb_iter_first(input);
+
+  while (rc == LDB_OK && ldb_iter_valid(input)
+                      && !ldb_atomic_load(&db->shutting_down,
+                                          ldb_order_acquire)) {
+    ldb_slice_t key, value;
+    int advanced = 0;
+    int was_blob = 0;
+    int garbage = 0;
+    ldb_seqnum_t visible;
+    ldb_blobref_t ref;
+    int drop = 0;
+    int stop;
+
+    /* Prioritize immutable compaction work. */
+    if (ldb_atomic_load(&db->has_imm, ldb_order_relaxed)) {
+      int64_t imm_start = ldb_now_usec();
+
+      ldb_mutex_lock(&db->mutex);
+
+      if (ldb_atomic_load(&db->has_imm, ldb_order_relaxed)) {
+        ldb_compact_memtables(db);
+
+        /* Wake up make_room_for_write() if necessary. */
+        ldb_cond_broadcast(&db->background_work_finished_signal);
+      }
+
+      ldb_mutex_unlock(&db->mutex);
+
+      imm_micros += (ldb_now_usec() - imm_start);
+    }
+
+    key = ldb_iter_key(input);
+    value = ldb_iter_value(input);
+
+    stop = ldb_compaction_should_stop_before(state->compaction, &key);
+
+    if (state->builder != NULL) {
+      ldb_slice_t upper = key.size >= 8 ? ldb_extract_user_key(&key) : key;
+
+      /* Close output file if it is big enough. */
+      if (ldb_tablegen_size(state->builder) >=
+          state->compaction->max_output_file_size) {
+        stop = 1;
+      }
+
+      /* Tombstones are split at the first user key of the next output,
+         so a user key must not span two outputs if there are any. */
+      if (stop && state->kept.length > 0 && has_user_key &&
+          ldb_compare(ucmp, &upper, &user_key) == 0) {
+        stop = 0;
+      }
+
+      if (stop) {
+        rc = ldb_finish_compaction_output_file(db, state, input, &upper);
+
+        if (rc != LDB_OK)
+          break;
+      }
+    }
+
+    /* Handle key/value, add to state, etc. */
+    if (!ldb_pkey_import(&ikey, &key)) {
+      /* Do not hide error keys. */
+      ldb_buffer_reset(&user_key);
+      has_user_key = 0;
+      last_sequence_for_key = LDB_MAX_SEQUENCE;
+    } else {
+      if (!has_user_key || ldb_compare(ucmp, &ikey.user_key, &user_key) != 0) {
+        /* First occurrence of this user key. */
+        ldb_buffer_set(&user_key, ikey.user_key.data, ikey.user_key.size);
+        has_user_key = 1;
+        last_sequence_for_key = LDB_MAX_SEQUENCE;
+      }
+
+      if (ikey.type == LDB_TYPE_BLOB)
+        was_blob = ldb_blobref_import(&ref, &value);
+
+      visible = ldb_compaction_visible_at(state, ikey.sequence);
+
+      if (last_sequence_for_key != LDB_MAX_SEQUENCE &&
+          last_visible_for_key == visible) {
+        /* Hidden by an newer entry for same user key, which every
+           snapshot seeing this entry also sees. */
+        drop = 1; /* (A) */
+      } else if (ikey.type == LDB_TYPE_DELETION &&
                  ikey.sequence <= state->smallest_snapshot &&
                  ldb_compaction_is_base_level_for_key(state->compaction,
                                                       &ikey.user_key)) {
@@ -1391,9 +3067,99 @@ ldb_do_compaction_work(ldb_t *db, ldb_cstate_t *state) {
          * Therefore this deletion marker is obsolete and can be dropped.
          */
         drop = 1;
+      } else if (ldb_rangedel_covers(&state->tombstones, &ikey, visible)) {
+        /* Deleted by a range tombstone which every snapshot
+           seeing this entry also sees. */
+        drop = 1;
+      }
+
+      if (!drop && filter != NULL && (ikey.type == LDB_TYPE_VALUE ||
+                                      ikey.type == LDB_TYPE_BLOB) &&
+                                     ikey.sequence > state->newest_snapshot) {
+        ldb_slice_t old_value = value;
+        ldb_slice_t new_value;
+
+        /* The filter sees the values held in blob files. */
+        if (ikey.type == LDB_TYPE_BLOB) {
+          rc = ldb_compaction_blob(state, &value, &ref, &old_value);
+
+          if (rc != LDB_OK)
+            break;
+        }
+
+        switch (filter->filter(filter, state->compaction->level,
+                               &ikey.user_key, &old_value, &new_value)) {
+          case LDB_FILTER_KEEP: {
+            break;
+          }
+
+          case LDB_FILTER_REMOVE: {
+            /* Older entries for the key may lie beneath us, so the
+               value becomes a deletion marker. Like any other, it
+               can be dropped if nothing is beneath it. */
+            stats.dropped++;
+
+            if (ikey.sequence <= state->smallest_snapshot &&
+                ldb_compaction_is_base_level_for_key(state->compaction,
+                                                     &ikey.user_key)) {
+              drop = 1;
+            } else {
+              ldb_ikey_set(&filtered_key, &ikey.user_key,
+                           ikey.sequence, LDB_TYPE_DELETION);
+
+              key = filtered_key;
+              value = ldb_slice(NULL, 0);
+              garbage = 1;
+            }
+
+            break;
+          }
+
+          case LDB_FILTER_CHANGE: {
+            if (ikey.type == LDB_TYPE_BLOB) {
+              ldb_ikey_set(&filtered_key, &ikey.user_key,
+                           ikey.sequence, LDB_TYPE_VALUE);
+
+              key = filtered_key;
+              garbage = 1;
+            }
+
+            value = new_value;
+
+            break;
+          }
+        }
+      }
+
+      if (!drop && ikey.type == LDB_TYPE_MERGE && merger != NULL &&
+          ldb_compaction_stripe(state, ikey.sequence) != 1) {
+        rc = ldb_compaction_merge(state, input, &user_key, &operands,
+                                  &filtered_key, &merged_value);
+
+        if (rc != LDB_OK)
+          break;
+
+        key = filtered_key;
+        value = merged_value;
+        advanced = 1;
+
+        ldb_pkey_import(&ikey, &key);
+      }
+
+      /* Operands do not hide the entries beneath them. */
+      if (ikey.type != LDB_TYPE_MERGE) {
+        last_sequence_for_key = ikey.sequence;
+        last_visible_for_key = visible;
+
+        /* A merge result takes the sequence of its newest operand. */
+        if (advanced)
+          last_visible_for_key = ldb_compaction_visible_at(state,
+                                                           ikey.sequence);
       }
 
-      last_sequence_for_key = ikey.sequence;
+      /* The record of a dropped or rewritten blob index is garbage. */
+      if (was_blob && (drop || garbage))
+        ldb_compaction_garbage(state, &ref);
     }
 
     if (!drop) {
@@ -1405,33 +3171,40 @@ ldb_do_compaction_work(ldb_t *db, ldb_cstate_t *state) {
           break;
       }
 
+      rc = ldb_compaction_separate(db, state, &key, &value);
+
+      if (rc != LDB_OK)
+        break;
+
       if (ldb_tablegen_entries(state->builder) == 0)
         ldb_ikey_copy(&ldb_cstate_top(state)->smallest, &key);
 
       ldb_ikey_copy(&ldb_cstate_top(state)->largest, &key);
 
-      value = ldb_iter_value(input);
+      if (ldb_extract_type(&key) == LDB_TYPE_DELETION)
+        ldb_cstate_top(state)->deletions++;
 
       ldb_tablegen_add(state->builder, &key, &value);
-
-      /* Close output file if it is big enough. */
-      if (ldb_tablegen_size(state->builder) >=
-          state->compaction->max_output_file_size) {
-        rc = ldb_finish_compaction_output_file(db, state, input);
-
-        if (rc != LDB_OK)
-          break;
-      }
     }
 
-    ldb_iter_next(input);
+    if (!advanced)
+      ldb_iter_next(input);
   }
 
   if (rc == LDB_OK && ldb_atomic_load(&db->shutting_down, ldb_order_acquire))
     rc = LDB_IOERR; /* "Deleting DB during compaction" */
 
+  /* Tombstones past the last point entry need a file of their own. */
+  if (rc == LDB_OK && state->builder == NULL &&
+      ldb_has_compaction_tombstones(state)) {
+    rc = ldb_open_compaction_output_file(db, state);
+  }
+
   if (rc == LDB_OK && state->builder != NULL)
-    rc = ldb_finish_compaction_output_file(db, state, input);
+    rc = ldb_finish_compaction_output_file(db, state, input, NULL);
+
+  if (rc == LDB_OK && state->blobgen != NULL)
+    rc = ldb_finish_compaction_blob_file(db, state);
 
   if (rc == LDB_OK)
     rc = ldb_iter_status(input);
@@ -1457,11 +3230,17 @@ ldb_do_compaction_work(ldb_t *db, ldb_cstate_t *state) {
     stats.bytes_written += out->file_size;
   }
 
+  for (i = 0; i < state->blobs.length; i++) {
+    ldb_blobmeta_t *blob = state->blobs.items[i];
+
+    stats.bytes_written += blob->bytes;
+  }
+
   ldb_mutex_lock(&db->mutex);
 
-  level = state->compaction->level;
+  level = state->compaction->output_level;
 
-  ldb_stats_add(&db->stats[level + 1], &stats);
+  ldb_stats_add(&fam->stats[level], &stats);
 
   if (rc == LDB_OK)
     rc = ldb_install_compaction_results(db, state);
@@ -1469,10 +3248,18 @@ ldb_do_compaction_work(ldb_t *db, ldb_cstate_t *state) {
   if (rc != LDB_OK)
     ldb_record_background_error(db, rc);
 
+  if (stats.dropped > 0) {
+    ldb_log(db->options.info_log, "Compaction filter %s removed %ld entries",
+            filter->name, (long)stats.dropped);
+  }
+
   ldb_buffer_clear(&user_key);
+  ldb_buffer_clear(&filtered_key);
+  ldb_buffer_clear(&merged_value);
+  ldb_operands_clear(&operands);
 
   ldb_log(db->options.info_log, "compacted to: %s",
-          ldb_versions_summary(db->versions, tmp));
+          ldb_versions_summary(fam->versions, tmp));
 
   return rc;
 }
@@ -1494,35 +3281,99 @@ ldb_cleanup_compaction(ldb_t *db, ldb_cstate_t *state) {
   if (state->outfile != NULL)
     ldb_wfile_destroy(state->outfile);
 
+  if (state->blobgen != NULL)
+    ldb_blobgen_destroy(state->blobgen);
+
+  if (state->blobfile != NULL)
+    ldb_wfile_destroy(state->blobfile);
+
   for (i = 0; i < state->outputs.length; i++) {
     const ldb_output_t *out = state->outputs.items[i];
 
-    rb_set64_del(&db->pending_outputs, out->number);
+    rb_set64_del(&state->family->pending_outputs, out->number);
+  }
+
+  for (i = 0; i < state->blobs.length; i++) {
+    const ldb_blobmeta_t *blob = state->blobs.items[i];
+
+    rb_set64_del(&state->family->pending_outputs, blob->number);
   }
 
   ldb_cstate_destroy(state);
 }
 
-static void
-ldb_background_compaction(ldb_t *db) {
-  int is_manual = (db->manual_compaction != NULL);
-  ldb_compaction_t *c;
-  int rc = LDB_OK;
+/* Pick the column family most in need of a compaction. */
+static ldb_family_t *
+ldb_pick_family(ldb_t *db) {
+  ldb_family_t *best = NULL;
+  size_t i;
 
-  ldb_mutex_assert_held(&db->mutex);
+  for (i = 0; i < db->families.length; i++) {
+    ldb_family_t *fam = db->families.items[i];
+    double score = fam->versions->current->compaction_score;
 
-  if (db->imm != NULL) {
-    ldb_compact_memtable(db);
-    return;
+    if (score < 1)
+      continue;
+
+    if (best == NULL || score > best->versions->current->compaction_score)
+      best = fam;
+  }
+
+  if (best != NULL)
+    return best;
+
+  for (i = 0; i < db->families.length; i++) {
+    ldb_family_t *fam = db->families.items[i];
+
+    if (ldb_versions_needs_compaction(fam->versions))
+      return fam;
+  }
+
+  return NULL;
+}
+
+static int
+ldb_needs_compaction(const ldb_t *db) {
+  size_t i;
+
+  for (i = 0; i < db->families.length; i++) {
+    ldb_family_t *fam = db->families.items[i];
+
+    if (ldb_versions_needs_compaction(fam->versions))
+      return 1;
+  }
+
+  return 0;
+}
+
+static void
+ldb_background_compaction(ldb_t *db) {
+  ldb_manual_t *m = db->manual_compaction;
+  int is_manual = (m != NULL);
+  ldb_family_t *fam = NULL;
+  ldb_compaction_t *c = NULL;
+  int whole_range = 0;
+  int rc = LDB_OK;
+
+  ldb_mutex_assert_held(&db->mutex);
+
+  if (ldb_atomic_load(&db->has_imm, ldb_order_relaxed)) {
+    ldb_compact_memtables(db);
+    return;
   }
 
   if (is_manual) {
-    ldb_manual_t *m = db->manual_compaction;
+    fam = m->family;
 
-    c = ldb_versions_compact_range(db->versions, m->level, m->begin, m->end);
+    if (!fam->dropped)
+      c = ldb_versions_compact_range(fam->versions, m->level, m->begin, m->end);
 
     m->done = (c == NULL);
 
+    /* A universal compaction merges every run in one go. The
+       manual compaction is only done once that has finished. */
+    whole_range = (c != NULL && c->output_level == m->level);
+
     if (c != NULL) {
       ldb_filemeta_t *f = ldb_vector_top(&c->inputs[0]);
 
@@ -1532,14 +3383,22 @@ ldb_background_compaction(ldb_t *db) {
 
     ldb_log(db->options.info_log, "Manual compaction at level-%d", m->level);
   } else {
-    c = ldb_versions_pick_compaction(db->versions);
+    fam = ldb_pick_family(db);
+
+    if (fam != NULL)
+      c = ldb_versions_pick_compaction(fam->versions);
+  }
+
+  if (fam != NULL) {
+    ldb_family_ref(db, fam);
+    fam->busy++;
   }
 
   if (c == NULL) {
     /* Nothing to do. */
   } else if (!is_manual && ldb_compaction_is_trivial_move(c)) {
     /* Move file to next level. */
-    ldb_filemeta_t *f;
+    ldb_filemeta_t *f, *moved;
     char tmp[100];
 
     assert(c->inputs[0].length == 1);
@@ -1548,25 +3407,33 @@ ldb_background_compaction(ldb_t *db) {
 
     ldb_edit_remove_file(&c->edit, c->level, f->number);
 
-    ldb_edit_add_file(&c->edit, c->level + 1,
-                                f->number,
-                                f->file_size,
-                                &f->smallest,
-                                &f->largest);
+    moved = ldb_edit_add_file(&c->edit, c->output_level,
+                                        f->number,
+                                        f->file_size,
+                                        &f->smallest,
+                                        &f->largest);
+
+    moved->tombstones = f->tombstones;
+    moved->oldest_blob = f->oldest_blob;
+    moved->sequence = f->sequence;
+    moved->entries = f->entries;
+    moved->deletions = f->deletions;
+    moved->created = f->created;
 
-    rc = ldb_versions_apply(db->versions, &c->edit, &db->mutex);
+    rc = ldb_family_apply(db, fam, &c->edit);
 
     if (rc != LDB_OK)
       ldb_record_background_error(db, rc);
 
     ldb_log(db->options.info_log, "Moved #%lu to level-%d %lu bytes %s: %s",
                                   (unsigned long)f->number,
-                                  c->level + 1,
+                                  c->output_level,
                                   (unsigned long)f->file_size,
                                   ldb_strerror(rc),
-                                  ldb_versions_summary(db->versions, tmp));
+                                  ldb_versions_summary(fam->versions, tmp));
   } else {
-    ldb_cstate_t *state = ldb_cstate_create(c);
+    ldb_cstate_t *state = ldb_cstate_create(c, fam, ldb_user_comparator(fam),
+                                                    fam->blob_cache);
 
     rc = ldb_do_compaction_work(db, state);
 
@@ -1583,6 +3450,11 @@ ldb_background_compaction(ldb_t *db) {
   if (c != NULL)
     ldb_compaction_destroy(c);
 
+  if (fam != NULL) {
+    fam->busy--;
+    ldb_family_unref(db, fam);
+  }
+
   if (rc == LDB_OK) {
     /* Done. */
   } else if (ldb_atomic_load(&db->shutting_down, ldb_order_acquire)) {
@@ -1591,10 +3463,10 @@ ldb_background_compaction(ldb_t *db) {
     ldb_log(db->options.info_log, "Compaction error: %s", ldb_strerror(rc));
   }
 
-  if (is_manual) {
-    ldb_manual_t *m = db->manual_compaction;
-
-    if (rc != LDB_OK)
+  /* The waiter may have given up on its manual compaction (and
+     released it) while the lock was not held. */
+  if (is_manual && db->manual_compaction == m) {
+    if (rc != LDB_OK || whole_range)
       m->done = 1;
 
     if (!m->done) {
@@ -1620,8 +3492,8 @@ ldb_maybe_schedule_compaction(ldb_t *db) {
     /* DB is being deleted; no more background compactions. */
   } else if (db->bg_error != LDB_OK) {
     /* Already got an error; no more changes. */
-  } else if (db->imm == NULL && db->manual_compaction == NULL &&
-             !ldb_versions_needs_compaction(db->versions)) {
+  } else if (!ldb_atomic_load(&db->has_imm, ldb_order_relaxed) &&
+             db->manual_compaction == NULL && !ldb_needs_compaction(db)) {
     /* No work to be done. */
   } else {
     db->background_compaction_scheduled = 1;
@@ -1656,6 +3528,104 @@ ldb_background_call(void *ptr) {
   ldb_mutex_unlock(&db->mutex);
 }
 
+static void
+ldb_warmup_call(void *arg) {
+  ldb_t *db = (ldb_t *)arg;
+  ldb_warmup_t *w = &db->warmup;
+  size_t i;
+
+  while (!ldb_atomic_load(&db->shutting_down, ldb_order_acquire)) {
+    int j = ldb_atomic_fetch_add(&w->next, 1, ldb_order_relaxed);
+    ldb_filemeta_t *f;
+
+    if (j >= (int)w->files.length)
+      break;
+
+    f = w->files.items[j];
+
+    /* Errors are not cached by the table cache and will
+       resurface on the first real read of the table. */
+    ldb_tables_load(w->tables.items[j], f->number, f->file_size);
+
+    ldb_atomic_fetch_add(&w->done, 1, ldb_order_relaxed);
+  }
+
+  if (ldb_atomic_fetch_sub(&w->workers, 1, ldb_order_acq_rel) == 1) {
+    ldb_mutex_lock(&db->mutex);
+
+    for (i = 0; i < w->versions.length; i++)
+      ldb_version_unref(w->versions.items[i]);
+
+    for (i = 0; i < w->families.length; i++)
+      ldb_family_unref(db, w->families.items[i]);
+
+    ldb_vector_reset(&w->versions);
+    ldb_vector_reset(&w->families);
+
+    ldb_mutex_unlock(&db->mutex);
+  }
+}
+
+/* Open the tables of the current versions, level by level,
+   in the background. */
+static void
+ldb_maybe_schedule_warmup(ldb_t *db) {
+  ldb_warmup_t *w = &db->warmup;
+  int level, i;
+  size_t j, k;
+
+  ldb_mutex_assert_held(&db->mutex);
+
+  if (db->options.warmup_threads <= 0)
+    return;
+
+  for (k = 0; k < db->families.length; k++) {
+    ldb_family_t *fam = db->families.items[k];
+    int limit = table_cache_size(&fam->options);
+    ldb_version_t *v = fam->versions->current;
+    size_t start = w->files.length;
+
+    for (level = 0; level < LDB_NUM_LEVELS; level++) {
+      for (j = 0; j < v->files[level].length; j++) {
+        if ((int)(w->files.length - start) >= limit)
+          break;
+
+        ldb_vector_push(&w->files, v->files[level].items[j]);
+        ldb_vector_push(&w->tables, fam->table_cache);
+      }
+    }
+
+    if (w->files.length > start) {
+      ldb_version_ref(v);
+      ldb_family_ref(db, fam);
+
+      ldb_vector_push(&w->versions, v);
+      ldb_vector_push(&w->families, fam);
+    }
+  }
+
+  if (w->files.length == 0)
+    return;
+
+  w->pool = ldb_pool_create(db->options.warmup_threads);
+
+  ldb_atomic_store(&w->workers, db->options.warmup_threads,
+                                ldb_order_release);
+
+  ldb_log(db->options.info_log, "Warming %d tables",
+                                (int)w->files.length);
+
+  /* Without threads, the pool runs the first worker inline and
+     it does all of the work. The workers need the mutex to
+     release the versions once they are done. */
+  ldb_mutex_unlock(&db->mutex);
+
+  for (i = 0; i < db->options.warmup_threads; i++)
+    ldb_pool_schedule(w->pool, ldb_warmup_call, db);
+
+  ldb_mutex_lock(&db->mutex);
+}
+
 static void
 cleanup_iter_state(void *arg1, void *arg2) {
   ldb_istate_destroy((ldb_istate_t *)arg1);
@@ -1663,7 +3633,9 @@ cleanup_iter_state(void *arg1, void *arg2) {
 }
 
 static ldb_iter_t *
-ldb_internal_iterator(ldb_t *db, const ldb_readopt_t *options,
+ldb_internal_iterator(ldb_t *db, ldb_family_t *fam,
+                                 const ldb_readopt_t *options,
+                                 ldb_rangedel_t *tombstones,
                                  ldb_seqnum_t *latest_snapshot,
                                  uint32_t *seed) {
   ldb_iter_t *internal_iter;
@@ -1678,33 +3650,56 @@ ldb_internal_iterator(ldb_t *db, const ldb_readopt_t *options,
   *latest_snapshot = db->versions->last_sequence;
 
   /* Collect together all needed child iterators. */
-  ldb_vector_push(&list, ldb_memiter_create(db->mem));
-  ldb_memtable_ref(db->mem);
+  ldb_vector_push(&list, ldb_memiter_create(fam->mem));
+  ldb_memtable_ref(fam->mem);
 
-  if (db->imm != NULL) {
-    ldb_vector_push(&list, ldb_memiter_create(db->imm));
-    ldb_memtable_ref(db->imm);
+  if (fam->imm != NULL) {
+    ldb_vector_push(&list, ldb_memiter_create(fam->imm));
+    ldb_memtable_ref(fam->imm);
   }
 
-  current = db->versions->current;
+  current = fam->versions->current;
 
   ldb_version_add_iterators(current, options, &list);
 
-  internal_iter = ldb_mergeiter_create(&db->internal_comparator,
+  internal_iter = ldb_mergeiter_create(&fam->internal_comparator,
                                        (ldb_iter_t **)list.items,
                                        list.length);
 
   ldb_version_ref(current);
+  ldb_family_ref(db, fam);
 
-  cleanup = ldb_istate_create(&db->mutex, db->mem, db->imm,
-                              db->versions->current);
+  cleanup = ldb_istate_create(db, &db->mutex, fam, fam->mem, fam->imm,
+                              fam->versions->current);
 
   ldb_iter_register_cleanup(internal_iter, cleanup_iter_state, cleanup, NULL);
 
   *seed = ++db->seed;
 
+  if (tombstones != NULL) {
+    ldb_memtable_tombstones(fam->mem, tombstones);
+
+    if (fam->imm != NULL)
+      ldb_memtable_tombstones(fam->imm, tombstones);
+  }
+
   ldb_mutex_unlock(&db->mutex);
 
+  /* The version is referenced by the iterator, so its tables can
+     be read without the lock. A table whose tombstones cannot be
+     read fails the whole iterator: its own child may never be
+     positioned, and deleted keys would otherwise reappear. */
+  if (tombstones != NULL) {
+    int rc = ldb_version_tombstones(current, tombstones);
+
+    ldb_rangedel_finish(tombstones);
+
+    if (rc != LDB_OK) {
+      ldb_iter_destroy(internal_iter);
+      internal_iter = ldb_emptyiter_create(rc);
+    }
+  }
+
   ldb_vector_clear(&list);
 
   return internal_iter;
@@ -1741,6 +3736,11 @@ ldb_build_batch_group(ldb_t *db, ldb_waiter_t **last_writer) {
 
   /* Advance past "first". */
   for (w = first->next; w != NULL; w = w->next) {
+    if (w->exclusive) {
+      /* Changes to the column families wait for the group. */
+      break;
+    }
+
     if (w->sync && !first->sync) {
       /* Do not include a sync write into a
          batch handled by a non-sync write. */
@@ -1774,48 +3774,191 @@ ldb_build_batch_group(ldb_t *db, ldb_waiter_t **last_writer) {
   return result;
 }
 
+/* Wait until this thread is at the front of the writer queue, for
+   an operation which must not run alongside any write. */
+static void
+ldb_writers_enter(ldb_t *db, ldb_waiter_t *w) {
+  ldb_mutex_assert_held(&db->mutex);
+
+  w->exclusive = 1;
+
+  ldb_queue_push(&db->writers, w);
+
+  while (w != db->writers.head)
+    ldb_cond_wait(&w->cv, &db->mutex);
+}
+
+static void
+ldb_writers_leave(ldb_t *db, ldb_waiter_t *w) {
+  ldb_mutex_assert_held(&db->mutex);
+
+  if (ldb_queue_shift(&db->writers) != w)
+    abort(); /* LCOV_EXCL_LINE */
+
+  /* Notify new head of write queue. */
+  if (db->writers.length > 0)
+    ldb_cond_signal(&db->writers.head->cv);
+}
+
+/* How close the column families are to having writes stopped, from 0
+   (writes need not be slowed down) to 1. Returns the cause of the
+   largest slowdown, or -1 if there is none. */
+static int
+ldb_write_pressure(const ldb_t *db, double *pressure) {
+  int cause = -1;
+  size_t i;
+
+  *pressure = 0;
+
+  for (i = 0; i < db->families.length; i++) {
+    const ldb_family_t *fam = db->families.items[i];
+    const ldb_dbopt_t *options = &fam->options;
+    const ldb_version_t *current = fam->versions->current;
+    int files = current->files[0].length;
+    uint64_t bytes = current->compaction_bytes;
+    uint64_t soft = options->soft_pending_compaction_bytes;
+    uint64_t hard = options->hard_pending_compaction_bytes;
+    double p;
+
+    if (files >= options->level0_slowdown_writes_trigger) {
+      int slowdown = options->level0_slowdown_writes_trigger;
+      int stop = options->level0_stop_writes_trigger;
+
+      p = (double)(files - slowdown + 1) / (stop - slowdown + 1);
+
+      if (p > *pressure) {
+        *pressure = p;
+        cause = LDB_STALL_LEVEL0_SLOWDOWN;
+      }
+    }
+
+    if (soft > 0 && bytes >= soft) {
+      if (hard > soft)
+        p = (double)(bytes - soft) / (double)(hard - soft);
+      else
+        p = 1;
+
+      if (p > *pressure) {
+        *pressure = p;
+        cause = LDB_STALL_PENDING_SLOWDOWN;
+      }
+    }
+  }
+
+  if (*pressure > 1)
+    *pressure = 1;
+
+  return cause;
+}
+
+/* Delay a write of "bytes" so that slowed down writes go through at the
+   delayed write rate, lowered in proportion to the pressure. Delays are
+   accumulated until they add up to a millisecond, rather than sleeping
+   for a few microseconds on every write. */
+static void
+ldb_delay_write(ldb_t *db, size_t bytes, double pressure, int cause) {
+  double rate = db->options.delayed_write_rate * (1 - pressure);
+  int64_t now = ldb_now_usec();
+  int64_t wait;
+
+  if (rate < db->options.delayed_write_rate / 16.0)
+    rate = db->options.delayed_write_rate / 16.0;
+
+  if (db->delay_until < now)
+    db->delay_until = now;
+
+  db->delay_until += (int64_t)(bytes * 1e6 / rate);
+
+  wait = db->delay_until - now;
+
+  if (wait >= 1000) {
+    ldb_mutex_unlock(&db->mutex);
+    ldb_sleep_usec(wait);
+    ldb_mutex_lock(&db->mutex);
+
+    db->stall_micros[cause] += wait;
+  }
+}
+
+/* Wait for background work, charging the time to a stall cause. */
+static void
+ldb_stall_write(ldb_t *db, int cause) {
+  int64_t start = ldb_now_usec();
+
+  ldb_cond_wait(&db->background_work_finished_signal, &db->mutex);
+
+  db->stall_micros[cause] += ldb_now_usec() - start;
+}
+
 /* REQUIRES: db->mutex is held. */
 /* REQUIRES: this thread is currently at the front of the writer queue. */
 static int
-ldb_make_room_for_write(ldb_t *db, int force) {
-  size_t write_buffer_size = db->options.write_buffer_size;
-  char fname[LDB_PATH_MAX];
-  int allow_delay = !force;
+ldb_make_room_for_write(ldb_t *db, ldb_family_t *force) {
+  const ldb_waiter_t *w = db->writers.head;
+  int allow_delay = (force == NULL);
+  double pressure = 0;
   int rc = LDB_OK;
+  int cause = -1;
 
   ldb_mutex_assert_held(&db->mutex);
 
   assert(db->writers.length > 0);
 
   for (;;) {
-#define L0_FILES ldb_versions_files(db->versions, 0)
+    ldb_family_t *fam = force;
+    size_t i;
+
+    if (allow_delay)
+      cause = ldb_write_pressure(db, &pressure);
+
+    if (fam == NULL) {
+      /* Find a column family whose memtable is full. */
+      for (i = 0; i < db->families.length; i++) {
+        ldb_family_t *item = db->families.items[i];
+
+        if (ldb_memtable_usage(item->mem) > item->options.write_buffer_size) {
+          fam = item;
+          break;
+        }
+      }
+    }
+
     if (db->bg_error != LDB_OK) {
       /* Yield previous error. */
       rc = db->bg_error;
       break;
-    } else if (allow_delay && L0_FILES >= LDB_L0_SLOWDOWN_WRITES_TRIGGER) {
+    } else if (allow_delay && cause >= 0) {
       /* We are getting close to hitting a hard limit on the number of
-         L0 files. Rather than delaying a single write by several
-         seconds when we hit the hard limit, start delaying each
-         individual write by 1ms to reduce latency variance. Also,
-         this delay hands over some CPU to the compaction thread in
-         case it is sharing the same core as the writer. */
-      ldb_mutex_unlock(&db->mutex);
-      ldb_sleep_usec(1000);
+         L0 files or on the compaction backlog. Rather than delaying a
+         single write by several seconds when we hit the hard limit,
+         start pacing writes, more slowly the closer we get. This also
+         hands over some CPU to the compaction thread in case it is
+         sharing the same core as the writer. */
+      size_t bytes = w->batch != NULL ? ldb_batch_size(w->batch) : 0;
+
+      ldb_delay_write(db, bytes, pressure, cause);
+
       allow_delay = 0; /* Do not delay a single write more than once. */
-      ldb_mutex_lock(&db->mutex);
-    } else if (!force && ldb_memtable_usage(db->mem) <= write_buffer_size) {
-      /* There is room in current memtable. */
+    } else if (fam == NULL) {
+      /* There is room in every memtable. */
       break;
-    } else if (db->imm != NULL) {
+    } else if (fam->imm != NULL) {
       /* We have filled up the current memtable, but the previous
          one is still being compacted, so we wait. */
       ldb_log(db->options.info_log, "Current memtable full; waiting...");
-      ldb_cond_wait(&db->background_work_finished_signal, &db->mutex);
-    } else if (L0_FILES >= LDB_L0_STOP_WRITES_TRIGGER) {
+      ldb_stall_write(db, LDB_STALL_MEMTABLE);
+    } else if (ldb_versions_files(fam->versions, 0) >=
+               fam->options.level0_stop_writes_trigger) {
       /* There are too many level-0 files. */
       ldb_log(db->options.info_log, "Too many L0 files; waiting...");
-      ldb_cond_wait(&db->background_work_finished_signal, &db->mutex);
+      ldb_stall_write(db, LDB_STALL_LEVEL0_STOP);
+    } else if (fam->options.hard_pending_compaction_bytes > 0 &&
+               fam->versions->current->compaction_bytes >=
+               fam->options.hard_pending_compaction_bytes) {
+      /* Compactions are too far behind. */
+      ldb_log(db->options.info_log, "Too many pending compaction bytes; "
+                                    "waiting...");
+      ldb_stall_write(db, LDB_STALL_PENDING_STOP);
     } else {
       ldb_wfile_t *lfile = NULL;
       uint64_t new_log_number;
@@ -1825,10 +3968,7 @@ ldb_make_room_for_write(ldb_t *db, int force) {
 
       new_log_number = ldb_versions_new_file_number(db->versions);
 
-      if (!ldb_log_filename(fname, sizeof(fname), db->dbname, new_log_number))
-        abort(); /* LCOV_EXCL_LINE */
-
-      rc = ldb_truncfile_create(fname, &lfile);
+      rc = ldb_create_logfile(db, new_log_number, &lfile);
 
       if (rc != LDB_OK) {
         /* Avoid chewing through file number space in a tight loop. */
@@ -1859,19 +3999,36 @@ ldb_make_room_for_write(ldb_t *db, int force) {
 
       db->logfile = lfile;
       db->logfile_number = new_log_number;
-      db->log = ldb_writer_create(lfile, 0);
-      db->imm = db->mem;
+      db->log = ldb_create_logwriter(db, new_log_number, lfile);
 
-      ldb_atomic_store(&db->has_imm, 1, ldb_order_release);
+      /* Other column families holding entries are switched along
+         with this one, so that they do not keep old logs alive. */
+      for (i = 0; i < db->families.length; i++) {
+        ldb_family_t *item = db->families.items[i];
+
+        if (item != fam) {
+          if (item->imm != NULL)
+            continue;
+
+          if (!ldb_atomic_load(&item->has_entries, ldb_order_relaxed))
+            continue;
+        }
+
+        item->imm = item->mem;
+        item->imm_log_number = new_log_number;
+        item->mem = ldb_memtable_create(&item->internal_comparator,
+                                        &item->options);
 
-      db->mem = ldb_memtable_create(&db->internal_comparator);
+        ldb_memtable_ref(item->mem);
+
+        ldb_atomic_store(&item->has_entries, 0, ldb_order_relaxed);
+      }
 
-      ldb_memtable_ref(db->mem);
+      ldb_atomic_store(&db->has_imm, 1, ldb_order_release);
 
-      force = 0; /* Do not force another compaction if have room. */
+      force = NULL; /* Do not force another compaction if have room. */
       ldb_maybe_schedule_compaction(db);
     }
-#undef L0_FILES
   }
 
   return rc;
@@ -1930,6 +4087,7 @@ ldb_backup_inner(const char *dbname, const char *bakname, rb_set64_t *live) {
         rc = ldb_copy_file(src, dst);
         break;
       case LDB_FILE_TABLE:
+      case LDB_FILE_BLOB:
         if (live == NULL || rb_set64_has(live, number))
           rc = ldb_link_file(src, dst);
         break;
@@ -1940,6 +4098,11 @@ ldb_backup_inner(const char *dbname, const char *bakname, rb_set64_t *live) {
         if (live == NULL)
           rc = ldb_copy_file(src, dst);
         break;
+      case LDB_FILE_FAMILY:
+        /* Backups copy the live column families separately. */
+        if (live == NULL)
+          rc = ldb_backup_inner(src, dst, NULL);
+        break;
     }
   }
 
@@ -1961,7 +4124,10 @@ ldb_backup_inner(const char *dbname, const char *bakname, rb_set64_t *live) {
       if (!ldb_join(dst, sizeof(dst), bakname, filename))
         continue;
 
-      ldb_remove_file(dst);
+      if (type == LDB_FILE_FAMILY)
+        ldb_destroy(dst, NULL);
+      else
+        ldb_remove_file(dst);
     }
 
     if (len >= 0)
@@ -1987,80 +4153,156 @@ ldb_backup_inner(const char *dbname, const char *bakname, rb_set64_t *live) {
 
 int
 ldb_open(const char *dbname, const ldb_dbopt_t *options, ldb_t **dbptr) {
+  return ldb_open_families(dbname, options, NULL, NULL, 0, NULL, dbptr);
+}
+
+static int
+ldb_check_options(const ldb_dbopt_t *options) {
+  if (options == NULL)
+    return 0;
+
+  if (options->filter_policy != NULL) {
+    if (strlen(options->filter_policy->name) > 64)
+      return 0;
+  }
+
+  return 1;
+}
+
+int
+ldb_open_families(const char *dbname,
+                  const ldb_dbopt_t *options,
+                  const char *const *names,
+                  const ldb_dbopt_t *const *family_options,
+                  size_t length,
+                  ldb_family_t **families,
+                  ldb_t **dbptr) {
+  const ldb_dbopt_t **opts = NULL;
   char path[LDB_PATH_MAX];
   int save_manifest = 0;
-  ldb_edit_t edit;
+  ldb_request_t req;
   int rc = LDB_OK;
+  size_t i, j;
   ldb_t *db;
 
   ldb_crc32c_init();
 
   *dbptr = NULL;
 
-  if (options == NULL)
+  if (!ldb_check_options(options))
     return LDB_INVALID;
 
-  if (options->filter_policy != NULL) {
-    if (strlen(options->filter_policy->name) > 64)
-      return LDB_INVALID;
+  if (length > 0) {
+    opts = ldb_malloc(length * sizeof(ldb_dbopt_t *));
+
+    for (i = 0; i < length; i++) {
+      opts[i] = options;
+
+      if (family_options != NULL && family_options[i] != NULL)
+        opts[i] = family_options[i];
+
+      families[i] = NULL;
+
+      if (names[i] == NULL || *names[i] == '\0' || !ldb_check_options(opts[i]))
+        rc = LDB_INVALID;
+
+      for (j = 0; j < i && rc == LDB_OK; j++) {
+        if (strcmp(names[i], names[j]) == 0)
+          rc = LDB_INVALID;
+      }
+    }
   }
 
-  if (!ldb_path_absolute(path, sizeof(path) - 35, dbname))
-    return LDB_INVALID;
+  if (rc == LDB_OK && !ldb_path_absolute(path, sizeof(path) - 35, dbname))
+    rc = LDB_INVALID;
+
+  if (rc != LDB_OK) {
+    if (opts != NULL)
+      ldb_free(opts);
+
+    return rc;
+  }
+
+  req.names = names;
+  req.options = opts;
+  req.length = length;
 
   db = ldb_create(path, options);
 
-  ldb_edit_init(&edit);
   ldb_mutex_lock(&db->mutex);
 
   /* Recover handles create_if_missing, error_if_exists. */
-  rc = ldb_recover(db, &edit, &save_manifest);
+  rc = ldb_recover(db, &req, &save_manifest);
 
-  if (rc == LDB_OK && db->mem == NULL) {
-    /* Create new log and a corresponding memtable. */
+  if (rc == LDB_OK && db->log == NULL) {
+    /* Create new log. */
     uint64_t new_log_number = ldb_versions_new_file_number(db->versions);
     ldb_wfile_t *lfile;
 
-    if (!ldb_log_filename(path, sizeof(path), db->dbname, new_log_number))
-      abort(); /* LCOV_EXCL_LINE */
-
-    rc = ldb_truncfile_create(path, &lfile);
+    rc = ldb_create_logfile(db, new_log_number, &lfile);
 
     if (rc == LDB_OK) {
-      ldb_edit_set_log_number(&edit, new_log_number);
-
       db->logfile = lfile;
       db->logfile_number = new_log_number;
-      db->log = ldb_writer_create(lfile, 0);
-      db->mem = ldb_memtable_create(&db->internal_comparator);
-
-      ldb_memtable_ref(db->mem);
+      db->log = ldb_create_logwriter(db, new_log_number, lfile);
     }
   }
 
-  if (rc == LDB_OK && save_manifest) {
-    ldb_edit_set_prev_log_number(&edit, 0); /* No older logs needed
-                                               after recovery. */
-    ldb_edit_set_log_number(&edit, db->logfile_number);
+  for (i = 0; i < db->families.length && rc == LDB_OK; i++) {
+    ldb_family_t *fam = db->families.items[i];
+
+    /* Create the memtables which were not kept from the last log. */
+    if (fam->mem == NULL) {
+      fam->mem = ldb_memtable_create(&fam->internal_comparator,
+                                     &fam->options);
+
+      ldb_memtable_ref(fam->mem);
+
+      ldb_atomic_store(&fam->has_entries, 0, ldb_order_relaxed);
+    }
+
+    if (save_manifest) {
+      ldb_edit_set_prev_log_number(&fam->edit, 0); /* No older logs needed
+                                                      after recovery. */
+      ldb_edit_set_log_number(&fam->edit, db->logfile_number);
+
+      rc = ldb_family_apply(db, fam, &fam->edit);
+    }
 
-    rc = ldb_versions_apply(db->versions, &edit, &db->mutex);
+    ldb_edit_reset(&fam->edit);
   }
 
   if (rc == LDB_OK) {
     ldb_remove_obsolete_files(db);
     ldb_maybe_schedule_compaction(db);
+    ldb_maybe_schedule_warmup(db);
   }
 
   ldb_mutex_unlock(&db->mutex);
 
+  /* Create the column families which do not exist yet. */
+  for (i = 0; i < length && rc == LDB_OK; i++) {
+    families[i] = ldb_family_lookup_name(db, names[i]);
+
+    if (families[i] == NULL) {
+      if (opts[i]->create_if_missing)
+        rc = ldb_family_create(db, names[i], opts[i], &families[i]);
+      else
+        rc = LDB_INVALID; /* "column family does not exist" */
+    }
+  }
+
   if (rc == LDB_OK) {
-    assert(db->mem != NULL);
     *dbptr = db;
   } else {
     ldb_destroy_internal(db);
+
+    for (i = 0; i < length; i++)
+      families[i] = NULL;
   }
 
-  ldb_edit_clear(&edit);
+  if (opts != NULL)
+    ldb_free(opts);
 
   return rc;
 }
@@ -2070,20 +4312,43 @@ ldb_close(ldb_t *db) {
   ldb_destroy_internal(db);
 }
 
-int
-ldb_get(ldb_t *db, const ldb_slice_t *key,
-                   ldb_slice_t *value,
-                   const ldb_readopt_t *options) {
+/* A value returned by ldb_get_pinned(). */
+struct ldb_pinned_s {
+  ldb_slice_t value;
+  ldb_istate_t *state; /* Memtables and version holding the value. */
+  ldb_cleanup_t blocks; /* Releases the block holding the value. */
+  ldb_buffer_t buffer; /* Value which could not be pinned. */
+};
+
+static int
+ldb_get_internal(ldb_t *db, ldb_family_t *family,
+                            const ldb_slice_t *key,
+                            ldb_slice_t *value,
+                            ldb_pinned_t *pin,
+                            const ldb_readopt_t *options) {
+  ldb_family_t *fam = ldb_family_get(db, family);
+  ldb_slice_t *pinned = NULL;
+  ldb_cleanup_t *blocks = NULL;
   ldb_memtable_t *mem, *imm;
   ldb_version_t *current;
   ldb_seqnum_t snapshot;
   int have_stat_update = 0;
+  ldb_operands_t operands;
   ldb_getstats_t stats;
   int rc = LDB_OK;
+  int held = 0;
+
+  if (pin != NULL) {
+    value = &pin->buffer;
+    pinned = &pin->value;
+    blocks = &pin->blocks;
+  }
 
   if (value != NULL)
     ldb_buffer_init(value);
 
+  ldb_operands_init(&operands, fam->options.merge_operator);
+
   if (options == NULL)
     options = ldb_readopt_default;
 
@@ -2094,9 +4359,9 @@ ldb_get(ldb_t *db, const ldb_slice_t *key,
   else
     snapshot = db->versions->last_sequence;
 
-  mem = db->mem;
-  imm = db->imm;
-  current = db->versions->current;
+  mem = fam->mem;
+  imm = fam->imm;
+  current = fam->versions->current;
 
   ldb_memtable_ref(mem);
 
@@ -2104,6 +4369,7 @@ ldb_get(ldb_t *db, const ldb_slice_t *key,
     ldb_memtable_ref(imm);
 
   ldb_version_ref(current);
+  ldb_family_ref(db, fam);
 
   /* Unlock while reading from files and memtables. */
   {
@@ -2114,56 +4380,174 @@ ldb_get(ldb_t *db, const ldb_slice_t *key,
     /* First look in the memtable, then in the immutable memtable (if any). */
     ldb_lkey_init(&lkey, key, snapshot);
 
-    if (ldb_memtable_get(mem, &lkey, value, &rc)) {
-      /* Done. */
-    } else if (imm != NULL && ldb_memtable_get(imm, &lkey, value, &rc)) {
-      /* Done. */
+    if (ldb_memtable_get(mem, &lkey, value, pinned, &operands, &rc)) {
+      held = (pinned != NULL);
+    } else if (imm != NULL && ldb_memtable_get(imm, &lkey, value, pinned,
+                                               &operands, &rc)) {
+      held = (pinned != NULL);
     } else {
-      rc = ldb_version_get(current, options, &lkey, value, &stats);
+      rc = ldb_version_get(current, options, &lkey, value, pinned,
+                           blocks, &operands, &stats);
+      held = (blocks != NULL && !ldb_cleanup_empty(blocks));
       have_stat_update = 1;
     }
 
     ldb_lkey_clear(&lkey);
 
+    if (rc != LDB_OK)
+      held = 0;
+
+    /* Apply any merge operands to the value beneath them. */
+    if (ldb_operands_length(&operands) > 0) {
+      if (rc == LDB_OK || rc == LDB_NOTFOUND) {
+        if (value == NULL) {
+          rc = LDB_OK;
+        } else {
+          const ldb_slice_t *base = NULL;
+
+          if (rc == LDB_OK)
+            base = held ? pinned : value;
+
+          rc = ldb_operands_merge(&operands, key, base, value);
+          held = 0;
+        }
+      }
+    }
+
+    if (blocks != NULL && !held)
+      ldb_cleanup_clear(blocks);
+
     ldb_mutex_lock(&db->mutex);
   }
 
   if (have_stat_update && ldb_version_update_stats(current, &stats))
     ldb_maybe_schedule_compaction(db);
 
-  ldb_memtable_unref(mem);
+  if (held) {
+    /* The references are released by ldb_unpin. */
+    pin->state = ldb_istate_create(db, &db->mutex, fam, mem, imm, current);
+  } else {
+    ldb_memtable_unref(mem);
 
-  if (imm != NULL)
-    ldb_memtable_unref(imm);
+    if (imm != NULL)
+      ldb_memtable_unref(imm);
 
-  ldb_version_unref(current);
+    ldb_version_unref(current);
+    ldb_family_unref(db, fam);
+  }
 
   ldb_mutex_unlock(&db->mutex);
 
-  if (value != NULL) {
+  ldb_operands_clear(&operands);
+
+  if (value != NULL && !held) {
     if (rc == LDB_OK)
       ldb_buffer_grow(value, 1);
     else
       ldb_buffer_clear(value);
   }
 
+  /* Point at the copy if the value could not be pinned. */
+  if (pin != NULL && rc == LDB_OK && !held)
+    ldb_slice_set(pinned, value->data, value->size);
+
   return rc;
 }
 
 int
-ldb_has(ldb_t *db, const ldb_slice_t *key, const ldb_readopt_t *options) {
-  return ldb_get(db, key, NULL, options);
+ldb_get(ldb_t *db, const ldb_slice_t *key,
+                   ldb_slice_t *value,
+                   const ldb_readopt_t *options) {
+  return ldb_get_internal(db, NULL, key, value, NULL, options);
 }
 
 int
-ldb_put(ldb_t *db, const ldb_slice_t *key,
+ldb_get_cf(ldb_t *db, ldb_family_t *family,
+                      const ldb_slice_t *key,
+                      ldb_slice_t *value,
+                      const ldb_readopt_t *options) {
+  return ldb_get_internal(db, family, key, value, NULL, options);
+}
+
+int
+ldb_get_pinned(ldb_t *db, const ldb_slice_t *key,
+                          ldb_slice_t *value,
+                          ldb_pinned_t **pin,
+                          const ldb_readopt_t *options) {
+  return ldb_get_pinned_cf(db, NULL, key, value, pin, options);
+}
+
+int
+ldb_get_pinned_cf(ldb_t *db, ldb_family_t *family,
+                             const ldb_slice_t *key,
+                             ldb_slice_t *value,
+                             ldb_pinned_t **pin,
+                             const ldb_readopt_t *options) {
+  ldb_pinned_t *p = ldb_malloc(sizeof(ldb_pinned_t));
+  int rc;
+
+  ldb_slice_init(&p->value);
+
+  p->state = NULL;
+
+  ldb_cleanup_init(&p->blocks);
+
+  rc = ldb_get_internal(db, family, key, NULL, p, options);
+
+  if (rc != LDB_OK) {
+    ldb_unpin(p);
+    ldb_slice_init(value);
+    *pin = NULL;
+    return rc;
+  }
+
+  *value = p->value;
+  *pin = p;
+
+  return LDB_OK;
+}
+
+void
+ldb_unpin(ldb_pinned_t *pin) {
+  /* Blocks first: releasing the table needs the family's cache. */
+  ldb_cleanup_clear(&pin->blocks);
+
+  if (pin->state != NULL)
+    ldb_istate_destroy(pin->state);
+
+  ldb_buffer_clear(&pin->buffer);
+  ldb_free(pin);
+}
+
+int
+ldb_has(ldb_t *db, const ldb_slice_t *key, const ldb_readopt_t *options) {
+  return ldb_get_cf(db, NULL, key, NULL, options);
+}
+
+int
+ldb_has_cf(ldb_t *db, ldb_family_t *family,
+                      const ldb_slice_t *key,
+                      const ldb_readopt_t *options) {
+  return ldb_get_cf(db, family, key, NULL, options);
+}
+
+int
+ldb_put(ldb_t *db, const ldb_slice_t *key,
                    const ldb_slice_t *value,
                    const ldb_writeopt_t *options) {
+  return ldb_put_cf(db, NULL, key, value, options);
+}
+
+int
+ldb_put_cf(ldb_t *db, ldb_family_t *family,
+                      const ldb_slice_t *key,
+                      const ldb_slice_t *value,
+                      const ldb_writeopt_t *options) {
   ldb_batch_t batch;
   int rc;
 
   ldb_batch_init(&batch);
-  ldb_batch_put(&batch, key, value);
+  ldb_batch_put_cf(&batch, family, key, value);
 
   rc = ldb_write(db, &batch, options);
 
@@ -2174,11 +4558,74 @@ ldb_put(ldb_t *db, const ldb_slice_t *key,
 
 int
 ldb_del(ldb_t *db, const ldb_slice_t *key, const ldb_writeopt_t *options) {
+  return ldb_del_cf(db, NULL, key, options);
+}
+
+int
+ldb_del_cf(ldb_t *db, ldb_family_t *family,
+                      const ldb_slice_t *key,
+                      const ldb_writeopt_t *options) {
+  ldb_batch_t batch;
+  int rc;
+
+  ldb_batch_init(&batch);
+  ldb_batch_del_cf(&batch, family, key);
+
+  rc = ldb_write(db, &batch, options);
+
+  ldb_batch_clear(&batch);
+
+  return rc;
+}
+
+int
+ldb_del_range(ldb_t *db,
+              const ldb_slice_t *start,
+              const ldb_slice_t *limit,
+              const ldb_writeopt_t *options) {
+  return ldb_del_range_cf(db, NULL, start, limit, options);
+}
+
+int
+ldb_del_range_cf(ldb_t *db,
+                 ldb_family_t *family,
+                 const ldb_slice_t *start,
+                 const ldb_slice_t *limit,
+                 const ldb_writeopt_t *options) {
+  ldb_batch_t batch;
+  int rc;
+
+  ldb_batch_init(&batch);
+  ldb_batch_del_range_cf(&batch, family, start, limit);
+
+  rc = ldb_write(db, &batch, options);
+
+  ldb_batch_clear(&batch);
+
+  return rc;
+}
+
+int
+ldb_merge(ldb_t *db, const ldb_slice_t *key,
+                     const ldb_slice_t *value,
+                     const ldb_writeopt_t *options) {
+  return ldb_merge_cf(db, NULL, key, value, options);
+}
+
+int
+ldb_merge_cf(ldb_t *db, ldb_family_t *family,
+                        const ldb_slice_t *key,
+                        const ldb_slice_t *value,
+                        const ldb_writeopt_t *options) {
+  ldb_family_t *fam = ldb_family_get(db, family);
   ldb_batch_t batch;
   int rc;
 
+  if (fam->options.merge_operator == NULL)
+    return LDB_INVALID; /* "no merge operator" */
+
   ldb_batch_init(&batch);
-  ldb_batch_del(&batch, key);
+  ldb_batch_merge_cf(&batch, family, key, value);
 
   rc = ldb_write(db, &batch, options);
 
@@ -2187,6 +4634,21 @@ ldb_del(ldb_t *db, const ldb_slice_t *key, const ldb_writeopt_t *options) {
   return rc;
 }
 
+/* Find the memtable of a column family for a record being written.
+   Records of dropped column families are skipped. */
+static ldb_memtable_t *
+ldb_family_lookup(void *arg, uint64_t number) {
+  ldb_t *db = (ldb_t *)arg;
+  ldb_family_t *fam = ldb_family_find(db, number);
+
+  if (fam == NULL)
+    return NULL;
+
+  ldb_atomic_store(&fam->has_entries, 1, ldb_order_relaxed);
+
+  return fam->mem;
+}
+
 int
 ldb_write(ldb_t *db, ldb_batch_t *updates, const ldb_writeopt_t *options) {
   ldb_waiter_t *last_writer;
@@ -2217,7 +4679,8 @@ ldb_write(ldb_t *db, ldb_batch_t *updates, const ldb_writeopt_t *options) {
   }
 
   /* May temporarily unlock and wait. */
-  rc = ldb_make_room_for_write(db, updates == NULL);
+  rc = ldb_make_room_for_write(db, updates == NULL ? ldb_default_family(db)
+                                                   : NULL);
   last_sequence = db->versions->last_sequence;
   last_writer = &w;
 
@@ -2228,10 +4691,10 @@ ldb_write(ldb_t *db, ldb_batch_t *updates, const ldb_writeopt_t *options) {
 
     last_sequence += ldb_batch_count(write_batch);
 
-    /* Add to log and apply to memtable. We can release the lock
+    /* Add to log and apply to memtables. We can release the lock
        during this phase since &w is currently responsible for logging
        and protects against concurrent loggers and concurrent writes
-       into db->mem. */
+       into the memtables. */
     {
       ldb_slice_t contents;
       int sync_error = 0;
@@ -2250,7 +4713,7 @@ ldb_write(ldb_t *db, ldb_batch_t *updates, const ldb_writeopt_t *options) {
       }
 
       if (rc == LDB_OK)
-        rc = ldb_batch_insert_into(write_batch, db->mem);
+        rc = ldb_batch_insert_families(write_batch, ldb_family_lookup, db);
 
       ldb_mutex_lock(&db->mutex);
 
@@ -2319,7 +4782,15 @@ ldb_release(ldb_t *db, const ldb_snapshot_t *snapshot) {
 
 ldb_iter_t *
 ldb_iterator(ldb_t *db, const ldb_readopt_t *options) {
-  const ldb_comparator_t *ucmp = ldb_user_comparator(db);
+  return ldb_iterator_cf(db, NULL, options);
+}
+
+ldb_iter_t *
+ldb_iterator_cf(ldb_t *db, ldb_family_t *family,
+                           const ldb_readopt_t *options) {
+  ldb_family_t *fam = ldb_family_get(db, family);
+  const ldb_comparator_t *ucmp = ldb_user_comparator(fam);
+  ldb_rangedel_t *tombstones = ldb_rangedel_create(ucmp);
   ldb_seqnum_t latest_snapshot;
   ldb_iter_t *iter;
   uint32_t seed;
@@ -2327,9 +4798,17 @@ ldb_iterator(ldb_t *db, const ldb_readopt_t *options) {
   if (options == NULL)
     options = ldb_iteropt_default;
 
-  iter = ldb_internal_iterator(db, options, &latest_snapshot, &seed);
+  iter = ldb_internal_iterator(db, fam, options, tombstones,
+                                                 &latest_snapshot,
+                                                 &seed);
 
-  return ldb_dbiter_create(db, ucmp, iter,
+  if (ldb_rangedel_length(tombstones) == 0) {
+    ldb_rangedel_destroy(tombstones);
+    tombstones = NULL;
+  }
+
+  return ldb_dbiter_create(db, fam, ucmp, fam->options.merge_operator,
+                           fam->blob_cache, options, iter, tombstones,
                            (options->snapshot != NULL
                               ? options->snapshot->sequence
                               : latest_snapshot),
@@ -2338,217 +4817,983 @@ ldb_iterator(ldb_t *db, const ldb_readopt_t *options) {
 
 int
 ldb_property(ldb_t *db, const char *property, char **value) {
+  return ldb_property_cf(db, NULL, property, value);
+}
+
+int
+ldb_property_cf(ldb_t *db, ldb_family_t *family,
+                           const char *property,
+                           char **value) {
+  ldb_family_t *fam = ldb_family_get(db, family);
   const char *in = property;
 
-  *value = NULL;
+  *value = NULL;
+
+  if (!ldb_starts_with(in, "leveldb."))
+    return 0;
+
+  in += 8;
+
+  ldb_mutex_lock(&db->mutex);
+
+  if (ldb_starts_with(in, "num-files-at-level")) {
+    uint64_t level;
+    int ok;
+
+    in += 18;
+
+    ok = ldb_decode_int(&level, &in) && *in == 0;
+
+    if (!ok || level >= LDB_NUM_LEVELS) {
+      ldb_mutex_unlock(&db->mutex);
+      return 0;
+    }
+
+    *value = ldb_malloc(21);
+
+    ldb_encode_int(*value, ldb_versions_files(fam->versions, level), 0);
+
+    ldb_mutex_unlock(&db->mutex);
+
+    return 1;
+  }
+
+  if (strcmp(in, "stats") == 0) {
+    ldb_buffer_t val;
+    char buf[200];
+    int level, i;
+
+    ldb_buffer_init(&val);
+
+    sprintf(buf, "                               Compactions\n"
+                 "Level  Files Size(MB) Time(sec) Read(MB) Write(MB)"
+                 "  Dropped\n"
+                 "--------------------------------------------------"
+                 "---------\n");
+
+    ldb_buffer_string(&val, buf);
+
+    for (level = 0; level < LDB_NUM_LEVELS; level++) {
+      int files = ldb_versions_files(fam->versions, level);
+      ldb_stats_t *stats = &fam->stats[level];
+
+      if (stats->micros > 0 || files > 0) {
+        int64_t bytes = ldb_versions_bytes(fam->versions, level);
+
+        sprintf(buf, "%3d %8d %8.0f %9.0f %8.0f %9.0f %8ld\n",
+                     level, files, bytes / 1048576.0,
+                     stats->micros / 1e6,
+                     stats->bytes_read / 1048576.0,
+                     stats->bytes_written / 1048576.0,
+                     (long)stats->dropped);
+
+        ldb_buffer_string(&val, buf);
+      }
+    }
+
+    sprintf(buf, "\n              Write Stalls\n"
+                 "Cause                          Time(sec)\n"
+                 "----------------------------------------\n");
+
+    ldb_buffer_string(&val, buf);
+
+    for (i = 0; i < LDB_STALL_MAX; i++) {
+      sprintf(buf, "%-28s %11.3f\n", ldb_stall_names[i],
+                                      db->stall_micros[i] / 1e6);
+
+      ldb_buffer_string(&val, buf);
+    }
+
+    ldb_buffer_push(&val, 0);
+
+    *value = (char *)val.data;
+
+    ldb_mutex_unlock(&db->mutex);
+
+    return 1;
+  }
+
+  if (strcmp(in, "bytes-written") == 0) {
+    /* Table and blob bytes written by flushes and compactions. */
+    uint64_t total = 0;
+    int level;
+
+    for (level = 0; level < LDB_NUM_LEVELS; level++)
+      total += fam->stats[level].bytes_written;
+
+    *value = ldb_malloc(21);
+
+    ldb_encode_int(*value, total, 0);
+
+    ldb_mutex_unlock(&db->mutex);
+
+    return 1;
+  }
+
+  if (strcmp(in, "sstables") == 0) {
+    ldb_buffer_t val;
+
+    ldb_buffer_init(&val);
+    ldb_version_debug(&val, fam->versions->current);
+    ldb_buffer_push(&val, 0);
+
+    *value = (char *)val.data;
+
+    ldb_mutex_unlock(&db->mutex);
+
+    return 1;
+  }
+
+  if (strcmp(in, "warmup-progress") == 0) {
+    int done = ldb_atomic_load(&db->warmup.done, ldb_order_relaxed);
+    char *zp;
+
+    *value = ldb_malloc(43);
+
+    zp = *value;
+    zp += ldb_encode_int(zp, done, 0);
+    *zp++ = '/';
+    zp += ldb_encode_int(zp, db->warmup.files.length, 0);
+
+    ldb_mutex_unlock(&db->mutex);
+
+    return 1;
+  }
+
+  if (strcmp(in, "approximate-memory-usage") == 0) {
+    size_t total_usage = ldb_lru_usage(db->options.block_cache);
+    size_t i;
+
+    /* The memtables of all column families. */
+    for (i = 0; i < db->families.length; i++) {
+      ldb_family_t *item = db->families.items[i];
+
+      if (item->mem != NULL)
+        total_usage += ldb_memtable_usage(item->mem);
+
+      if (item->imm != NULL)
+        total_usage += ldb_memtable_usage(item->imm);
+    }
+
+    *value = ldb_malloc(21);
+
+    ldb_encode_int(*value, total_usage, 0);
+
+    ldb_mutex_unlock(&db->mutex);
+
+    return 1;
+  }
+
+  ldb_mutex_unlock(&db->mutex);
+
+  return 0;
+}
+
+void
+ldb_approximate_sizes(ldb_t *db, const ldb_range_t *range,
+                                 size_t length,
+                                 uint64_t *sizes) {
+  ldb_approximate_sizes_cf(db, NULL, range, length, sizes);
+}
+
+void
+ldb_approximate_sizes_cf(ldb_t *db, ldb_family_t *family,
+                                    const ldb_range_t *range,
+                                    size_t length,
+                                    uint64_t *sizes) {
+  ldb_family_t *fam = ldb_family_get(db, family);
+  uint64_t start, limit;
+  ldb_ikey_t k1, k2;
+  ldb_version_t *v;
+  size_t i;
+
+  ldb_mutex_lock(&db->mutex);
+
+  v = fam->versions->current;
+
+  ldb_version_ref(v);
+
+  ldb_ikey_init(&k1);
+  ldb_ikey_init(&k2);
+
+  for (i = 0; i < length; i++) {
+    /* Convert user_key into a corresponding internal key. */
+    ldb_ikey_set(&k1, &range[i].start, LDB_MAX_SEQUENCE, LDB_VALTYPE_SEEK);
+    ldb_ikey_set(&k2, &range[i].limit, LDB_MAX_SEQUENCE, LDB_VALTYPE_SEEK);
+
+    start = ldb_versions_approximate_offset(fam->versions, v, &k1);
+    limit = ldb_versions_approximate_offset(fam->versions, v, &k2);
+
+    sizes[i] = (limit >= start ? limit - start : 0);
+  }
+
+  ldb_ikey_clear(&k1);
+  ldb_ikey_clear(&k2);
+
+  ldb_version_unref(v);
+
+  ldb_mutex_unlock(&db->mutex);
+}
+
+/* Force the memtable of a column family to be compacted and
+   wait until the compaction completes. */
+static int
+ldb_flush_family(ldb_t *db, ldb_family_t *fam) {
+  ldb_waiter_t w;
+  int rc;
+
+  ldb_waiter_init(&w);
+
+  ldb_mutex_lock(&db->mutex);
+
+  ldb_writers_enter(db, &w);
+
+  rc = ldb_make_room_for_write(db, fam);
+
+  ldb_writers_leave(db, &w);
+
+  if (rc == LDB_OK) {
+    while (fam->imm != NULL && db->bg_error == LDB_OK)
+      ldb_cond_wait(&db->background_work_finished_signal, &db->mutex);
+
+    if (fam->imm != NULL)
+      rc = db->bg_error;
+  }
+
+  ldb_mutex_unlock(&db->mutex);
+
+  ldb_waiter_clear(&w);
+
+  return rc;
+}
+
+/* Compact any files of a column family in the named level
+   that overlap [*begin,*end]. */
+static void
+ldb_compact_level(ldb_t *db, ldb_family_t *fam,
+                             int level,
+                             const ldb_slice_t *begin,
+                             const ldb_slice_t *end) {
+  ldb_ikey_t begin_storage, end_storage;
+  ldb_manual_t manual;
+
+  assert(level >= 0);
+  assert(level + 1 < LDB_NUM_LEVELS);
+
+  ldb_manual_init(&manual, fam, level);
+
+  if (begin == NULL) {
+    manual.begin = NULL;
+  } else {
+    ldb_ikey_init(&begin_storage);
+    ldb_ikey_set(&begin_storage, begin, LDB_MAX_SEQUENCE, LDB_VALTYPE_SEEK);
+    manual.begin = &begin_storage;
+  }
+
+  if (end == NULL) {
+    manual.end = NULL;
+  } else {
+    ldb_ikey_init(&end_storage);
+    ldb_ikey_set(&end_storage, end, 0, (ldb_valtype_t)0);
+    manual.end = &end_storage;
+  }
+
+  ldb_mutex_lock(&db->mutex);
+
+  ldb_family_ref(db, fam);
+
+  while (!manual.done &&
+         !ldb_atomic_load(&db->shutting_down, ldb_order_acquire) &&
+         db->bg_error == LDB_OK) {
+    if (db->manual_compaction == NULL) { /* Idle. */
+      db->manual_compaction = &manual;
+      ldb_maybe_schedule_compaction(db);
+    } else { /* Running either my compaction or another compaction. */
+      ldb_cond_wait(&db->background_work_finished_signal, &db->mutex);
+    }
+  }
+
+  if (db->manual_compaction == &manual) {
+    /* Cancel my manual compaction since we aborted early for some reason. */
+    db->manual_compaction = NULL;
+  }
+
+  ldb_family_unref(db, fam);
+
+  ldb_mutex_unlock(&db->mutex);
+
+  if (begin != NULL)
+    ldb_ikey_clear(&begin_storage);
+
+  if (end != NULL)
+    ldb_ikey_clear(&end_storage);
+
+  ldb_manual_clear(&manual);
+}
+
+void
+ldb_compact(ldb_t *db, const ldb_slice_t *begin, const ldb_slice_t *end) {
+  ldb_compact_cf(db, NULL, begin, end);
+}
+
+void
+ldb_compact_cf(ldb_t *db, ldb_family_t *family,
+                          const ldb_slice_t *begin,
+                          const ldb_slice_t *end) {
+  ldb_family_t *fam = ldb_family_get(db, family);
+  int max_level_with_files = 1;
+  int level;
+
+  {
+    ldb_version_t *base;
+
+    ldb_mutex_lock(&db->mutex);
+
+    base = fam->versions->current;
+
+    for (level = 1; level < LDB_NUM_LEVELS; level++) {
+      if (ldb_version_overlap_in_level(base, level, begin, end))
+        max_level_with_files = level;
+    }
+
+    ldb_mutex_unlock(&db->mutex);
+  }
+
+  ldb_flush_family(db, fam);
+
+  for (level = 0; level < max_level_with_files; level++)
+    ldb_compact_level(db, fam, level, begin, end);
+}
+
+/* A table to be ingested, and the range of keys it holds. Its entries
+   are all at sequence zero (see sst_writer.h). */
+typedef struct ldb_ingest_s {
+  const char *path;
+  uint64_t number;
+  uint64_t file_size;
+  ldb_ikey_t smallest;
+  ldb_ikey_t largest;
+  int linked;
+} ldb_ingest_t;
+
+static void
+ldb_ingest_init(ldb_ingest_t *file, const char *path) {
+  file->path = path;
+  file->number = 0;
+  file->file_size = 0;
+  file->linked = 0;
+
+  ldb_ikey_init(&file->smallest);
+  ldb_ikey_init(&file->largest);
+}
+
+static void
+ldb_ingest_clear(ldb_ingest_t *file) {
+  ldb_ikey_clear(&file->smallest);
+  ldb_ikey_clear(&file->largest);
+}
+
+static int
+ldb_ingest_key(ldb_ikey_t *z, const ldb_iter_t *iter) {
+  ldb_slice_t key = ldb_iter_key(iter);
+  ldb_pkey_t pkey;
+
+  if (!ldb_pkey_import(&pkey, &key))
+    return LDB_CORRUPTION;
+
+  if (pkey.sequence != 0)
+    return LDB_INVALID; /* "table was not written for ingestion" */
+
+  ldb_buffer_copy(z, &key);
+
+  return LDB_OK;
+}
+
+/* Read the smallest and largest keys of a table. */
+static int
+ldb_ingest_read(ldb_ingest_t *file, const ldb_dbopt_t *options) {
+  ldb_readopt_t iteropt = *ldb_readopt_default;
+  ldb_rfile_t *rfile = NULL;
+  ldb_table_t *table = NULL;
+  ldb_iter_t *iter;
+  int rc;
+
+  iteropt.verify_checksums = 1;
+  iteropt.fill_cache = 0;
+
+  rc = ldb_file_size(file->path, &file->file_size);
+
+  if (rc == LDB_OK)
+    rc = ldb_randfile_create(file->path, &rfile, 0);
+
+  if (rc == LDB_OK)
+    rc = ldb_table_open(options, rfile, file->file_size, &table);
+
+  if (rc == LDB_OK && ldb_table_tombstones(table) != NULL)
+    rc = LDB_INVALID;
+
+  if (rc == LDB_OK) {
+    iter = ldb_tableiter_create(table, &iteropt);
+
+    ldb_iter_first(iter);
+
+    if (ldb_iter_valid(iter))
+      rc = ldb_ingest_key(&file->smallest, iter);
+    else if ((rc = ldb_iter_status(iter)) == LDB_OK)
+      rc = LDB_INVALID; /* "table is empty" */
+
+    if (rc == LDB_OK)
+      ldb_iter_last(iter);
+
+    if (rc == LDB_OK && ldb_iter_valid(iter))
+      rc = ldb_ingest_key(&file->largest, iter);
+
+    if (rc == LDB_OK)
+      rc = ldb_iter_status(iter);
+
+    ldb_iter_destroy(iter);
+  }
+
+  if (table != NULL)
+    ldb_table_destroy(table);
+
+  if (rfile != NULL)
+    ldb_rfile_destroy(rfile);
+
+  return rc;
+}
+
+static int
+ldb_ingest_compare(const ldb_comparator_t *ucmp,
+                   const ldb_ikey_t *x,
+                   const ldb_ikey_t *y) {
+  ldb_slice_t xk = ldb_ikey_user_key(x);
+  ldb_slice_t yk = ldb_ikey_user_key(y);
+
+  return ldb_compare(ucmp, &xk, &yk);
+}
+
+/* Sort the tables by their smallest key and check that
+   no two of them overlap. */
+static int
+ldb_ingest_sort(ldb_ingest_t *files, size_t length,
+                const ldb_comparator_t *ucmp) {
+  size_t i, j;
+
+  for (i = 1; i < length; i++) {
+    ldb_ingest_t tmp = files[i];
+
+    for (j = i; j > 0; j--) {
+      if (ldb_ingest_compare(ucmp, &files[j - 1].smallest,
+                                   &tmp.smallest) <= 0) {
+        break;
+      }
+
+      files[j] = files[j - 1];
+    }
+
+    files[j] = tmp;
+  }
+
+  for (i = 1; i < length; i++) {
+    if (ldb_ingest_compare(ucmp, &files[i - 1].largest,
+                                 &files[i].smallest) >= 0) {
+      return LDB_INVALID; /* "ingested tables overlap" */
+    }
+  }
+
+  return LDB_OK;
+}
+
+/* Whether the memtable holds any key or range tombstone in
+   the range of the tables. */
+static int
+ldb_ingest_overlaps(ldb_memtable_t *mem,
+                    const ldb_ingest_t *files,
+                    size_t length,
+                    const ldb_comparator_t *ucmp) {
+  ldb_iter_t *iter = ldb_memiter_create(mem);
+  ldb_rangedel_t tombstones;
+  int result = 0;
+  ldb_ikey_t key;
+  size_t i, j;
+
+  ldb_ikey_init(&key);
+  ldb_rangedel_init(&tombstones, ucmp);
+
+  ldb_memtable_tombstones(mem, &tombstones);
+
+  for (i = 0; i < length && !result; i++) {
+    ldb_slice_t start = ldb_ikey_user_key(&files[i].smallest);
+    ldb_slice_t limit = ldb_ikey_user_key(&files[i].largest);
+
+    ldb_ikey_set(&key, &start, LDB_MAX_SEQUENCE, LDB_VALTYPE_SEEK);
+
+    ldb_iter_seek(iter, &key);
+
+    if (ldb_iter_valid(iter)) {
+      ldb_slice_t ikey = ldb_iter_key(iter);
+      ldb_slice_t ukey = ldb_extract_user_key(&ikey);
+
+      result = (ldb_compare(ucmp, &ukey, &limit) <= 0);
+    }
+
+    /* A tombstone is read before the tables as well, and
+       would hide their keys. The limit is exclusive. */
+    for (j = 0; j < ldb_rangedel_length(&tombstones) && !result; j++) {
+      const ldb_tombstone_t *ts = ldb_rangedel_get(&tombstones, j);
+
+      result = (ldb_compare(ucmp, &ts->start, &limit) <= 0 &&
+                ldb_compare(ucmp, &ts->limit, &start) > 0);
+    }
+  }
+
+  ldb_rangedel_clear(&tombstones);
+  ldb_ikey_clear(&key);
+
+  ldb_iter_destroy(iter);
+
+  return result;
+}
+
+/* Return the deepest level the table can be placed at: one above
+   the first level holding keys in its range. */
+static int
+ldb_ingest_level(ldb_version_t *base, const ldb_ingest_t *file) {
+  ldb_slice_t smallest = ldb_ikey_user_key(&file->smallest);
+  ldb_slice_t largest = ldb_ikey_user_key(&file->largest);
+  int level;
+
+  /* Universal compaction only ever picks runs from level-0. */
+  if (base->vset->options->compaction_style == LDB_UNIVERSAL_COMPACTION)
+    return 0;
+
+  for (level = 0; level < LDB_NUM_LEVELS; level++) {
+    if (ldb_version_overlap_in_level(base, level, &smallest, &largest))
+      return level > 0 ? level - 1 : 0;
+  }
+
+  return LDB_NUM_LEVELS - 1;
+}
+
+static void
+ldb_ingest_set_sequence(ldb_ikey_t *key, ldb_seqnum_t sequence) {
+  ldb_pkey_t pkey;
+  ldb_ikey_t tmp;
+
+  ldb_ikey_init(&tmp);
+
+  if (!ldb_pkey_import(&pkey, key))
+    abort(); /* LCOV_EXCL_LINE */
+
+  ldb_ikey_set(&tmp, &pkey.user_key, sequence, pkey.type);
+  ldb_buffer_swap(key, &tmp);
+
+  ldb_ikey_clear(&tmp);
+}
+
+int
+ldb_ingest_files(ldb_t *db, const char *const *paths, size_t length) {
+  return ldb_ingest_files_cf(db, NULL, paths, length);
+}
+
+int
+ldb_ingest_files_cf(ldb_t *db, ldb_family_t *family,
+                               const char *const *paths,
+                               size_t length) {
+  ldb_family_t *fam = ldb_family_get(db, family);
+  const ldb_comparator_t *ucmp = ldb_user_comparator(fam);
+  char fname[LDB_PATH_MAX];
+  ldb_ingest_t *files;
+  int reserved = 0;
+  int rc = LDB_OK;
+  ldb_waiter_t w;
+  size_t i;
+
+  if (length == 0)
+    return LDB_OK;
+
+  files = ldb_malloc(length * sizeof(ldb_ingest_t));
+
+  for (i = 0; i < length; i++)
+    ldb_ingest_init(&files[i], paths[i]);
+
+  /* The tables are only read to find their key ranges. They are
+     linked into the database as they are, with no rewrite. */
+  for (i = 0; i < length && rc == LDB_OK; i++)
+    rc = ldb_ingest_read(&files[i], &fam->options);
+
+  if (rc == LDB_OK)
+    rc = ldb_ingest_sort(files, length, ucmp);
+
+  ldb_waiter_init(&w);
+
+  ldb_mutex_lock(&db->mutex);
+
+  /* Wait for the writes before us to finish. Later writes
+     wait for us, as the tables take the next sequence number. */
+  ldb_writers_enter(db, &w);
+
+  ldb_family_ref(db, fam);
+
+  if (rc == LDB_OK && fam->dropped)
+    rc = LDB_INVALID;
+
+  if (rc == LDB_OK)
+    rc = db->bg_error;
+
+  /* Entries in the memtables are read before those of the tables,
+     even though they are older. Flush them if they overlap. */
+  if (rc == LDB_OK && ldb_ingest_overlaps(fam->mem, files, length, ucmp))
+    rc = ldb_make_room_for_write(db, fam);
+
+  if (rc == LDB_OK && fam->imm != NULL &&
+      ldb_ingest_overlaps(fam->imm, files, length, ucmp)) {
+    while (fam->imm != NULL && db->bg_error == LDB_OK)
+      ldb_cond_wait(&db->background_work_finished_signal, &db->mutex);
+
+    if (fam->imm != NULL)
+      rc = db->bg_error;
+  }
+
+  /* A compaction started before the tables are placed could write
+     an output overlapping them. Keep any from being scheduled. */
+  if (rc == LDB_OK) {
+    while (db->background_compaction_scheduled)
+      ldb_cond_wait(&db->background_work_finished_signal, &db->mutex);
+
+    db->background_compaction_scheduled = 1;
+
+    reserved = 1;
+
+    rc = db->bg_error;
+  }
+
+  if (rc == LDB_OK) {
+    for (i = 0; i < length; i++) {
+      files[i].number = ldb_versions_new_file_number(fam->versions);
+
+      rb_set64_put(&fam->pending_outputs, files[i].number);
+    }
+
+    ldb_mutex_unlock(&db->mutex);
+
+    for (i = 0; i < length && rc == LDB_OK; i++) {
+      if (!ldb_table_filename(fname, sizeof(fname), fam->dirname,
+                                                    files[i].number)) {
+        rc = LDB_INVALID;
+        break;
+      }
+
+      rc = ldb_link_file(files[i].path, fname);
+
+      if (rc != LDB_OK)
+        rc = ldb_copy_file(files[i].path, fname);
+
+      files[i].linked = (rc == LDB_OK);
+    }
+
+    if (rc == LDB_OK)
+      rc = ldb_sync_dir(fam->dirname);
+
+    ldb_mutex_lock(&db->mutex);
+  }
+
+  if (rc == LDB_OK) {
+    ldb_seqnum_t sequence = db->versions->last_sequence + 1;
+    ldb_version_t *base = fam->versions->current;
+    ldb_edit_t edit;
+
+    ldb_edit_init(&edit);
+
+    for (i = 0; i < length; i++) {
+      ldb_ingest_t *file = &files[i];
+      int level = ldb_ingest_level(base, file);
+      ldb_filemeta_t *f;
+
+      ldb_ingest_set_sequence(&file->smallest, sequence);
+      ldb_ingest_set_sequence(&file->largest, sequence);
+
+      f = ldb_edit_add_file(&edit, level, file->number,
+                                          file->file_size,
+                                          &file->smallest,
+                                          &file->largest);
+
+      f->sequence = sequence;
+      f->created = ldb_now_usec() / 1000000;
+
+      ldb_log(db->options.info_log,
+              "Ingested table #%lu@%d: %lu bytes at sequence %lu",
+              (unsigned long)file->number,
+              level,
+              (unsigned long)file->file_size,
+              (unsigned long)sequence);
+    }
+
+    db->versions->last_sequence = sequence;
+
+    rc = ldb_family_apply(db, fam, &edit);
+
+    ldb_edit_clear(&edit);
+  }
+
+  for (i = 0; i < length; i++) {
+    if (files[i].number == 0)
+      continue;
 
-  if (!ldb_starts_with(in, "leveldb."))
-    return 0;
+    rb_set64_del(&fam->pending_outputs, files[i].number);
 
-  in += 8;
+    if (rc != LDB_OK && files[i].linked) {
+      if (ldb_table_filename(fname, sizeof(fname), fam->dirname,
+                                                   files[i].number)) {
+        ldb_remove_file(fname);
+      }
+    }
+  }
 
-  ldb_mutex_lock(&db->mutex);
+  if (reserved) {
+    db->background_compaction_scheduled = 0;
 
-  if (ldb_starts_with(in, "num-files-at-level")) {
-    uint64_t level;
-    int ok;
+    /* The tables may have made a level too large. */
+    ldb_maybe_schedule_compaction(db);
 
-    in += 18;
+    ldb_cond_broadcast(&db->background_work_finished_signal);
+  }
 
-    ok = ldb_decode_int(&level, &in) && *in == 0;
+  ldb_family_unref(db, fam);
 
-    if (!ok || level >= LDB_NUM_LEVELS) {
-      ldb_mutex_unlock(&db->mutex);
-      return 0;
-    }
+  ldb_writers_leave(db, &w);
 
-    *value = ldb_malloc(21);
+  ldb_mutex_unlock(&db->mutex);
 
-    ldb_encode_int(*value, ldb_versions_files(db->versions, level), 0);
+  ldb_waiter_clear(&w);
 
-    ldb_mutex_unlock(&db->mutex);
+  for (i = 0; i < length; i++)
+    ldb_ingest_clear(&files[i]);
 
-    return 1;
-  }
+  ldb_free(files);
 
-  if (strcmp(in, "stats") == 0) {
-    ldb_buffer_t val;
-    char buf[200];
-    int level;
+  return rc;
+}
 
-    ldb_buffer_init(&val);
+int
+ldb_backup(ldb_t *db, const char *name) {
+  char dirname[LDB_PATH_MAX];
+  int partial = 0;
+  rb_set64_t live;
+  size_t i;
+  int rc;
 
-    sprintf(buf, "                               Compactions\n"
-                 "Level  Files Size(MB) Time(sec) Read(MB) Write(MB)\n"
-                 "--------------------------------------------------\n");
+  if (strlen(name) + 1 > LDB_PATH_MAX - 35)
+    return LDB_INVALID;
 
-    ldb_buffer_string(&val, buf);
+  ldb_mutex_lock(&db->mutex);
 
-    for (level = 0; level < LDB_NUM_LEVELS; level++) {
-      int files = ldb_versions_files(db->versions, level);
-      ldb_stats_t *stats = &db->stats[level];
+  while (db->background_compaction_scheduled)
+    ldb_cond_wait(&db->background_work_finished_signal, &db->mutex);
 
-      if (stats->micros > 0 || files > 0) {
-        int64_t bytes = ldb_versions_bytes(db->versions, level);
+  rc = db->bg_error;
 
-        sprintf(buf, "%3d %8d %8.0f %9.0f %8.0f %9.0f\n",
-                     level, files, bytes / 1048576.0,
-                     stats->micros / 1e6,
-                     stats->bytes_read / 1048576.0,
-                     stats->bytes_written / 1048576.0);
+  /* The default column family first, then each of the others
+     into a directory of the same name. */
+  for (i = 0; i < db->families.length && rc == LDB_OK; i++) {
+    ldb_family_t *fam = db->families.items[i];
+    const char *bakname = name;
 
-        ldb_buffer_string(&val, buf);
+    if (fam->number != 0) {
+      if (!ldb_family_dirname(dirname, sizeof(dirname), name, fam->number)) {
+        rc = LDB_INVALID;
+        break;
       }
+
+      bakname = dirname;
     }
 
-    ldb_buffer_push(&val, 0);
+    rb_set64_init(&live);
 
-    *value = (char *)val.data;
+    ldb_versions_add_files(fam->versions, &live);
 
-    ldb_mutex_unlock(&db->mutex);
+    rc = ldb_backup_inner(fam->dirname, bakname, &live);
 
-    return 1;
+    rb_set64_clear(&live);
+
+    if (rc == LDB_OK)
+      partial = 1;
   }
 
-  if (strcmp(in, "sstables") == 0) {
-    ldb_buffer_t val;
+  /* Remove the backups of the column families done so far. */
+  if (rc != LDB_OK && partial)
+    ldb_destroy(name, NULL);
 
-    ldb_buffer_init(&val);
-    ldb_version_debug(&val, db->versions->current);
-    ldb_buffer_push(&val, 0);
+  ldb_mutex_unlock(&db->mutex);
 
-    *value = (char *)val.data;
+  return rc;
+}
 
-    ldb_mutex_unlock(&db->mutex);
+#undef ldb_compare
 
-    return 1;
-  }
+int
+ldb_compare(const ldb_t *db, const ldb_slice_t *x, const ldb_slice_t *y) {
+  const ldb_comparator_t *cmp = ldb_user_comparator(ldb_default_family(db));
+  return cmp->compare(cmp, x, y);
+}
 
-  if (strcmp(in, "approximate-memory-usage") == 0) {
-    size_t total_usage = ldb_lru_usage(db->options.block_cache);
+#define ldb_compare ldb_compare_internal
 
-    if (db->mem != NULL)
-      total_usage += ldb_memtable_usage(db->mem);
+/*
+ * Column Family
+ */
 
-    if (db->imm != NULL)
-      total_usage += ldb_memtable_usage(db->imm);
+int
+ldb_family_create(ldb_t *db, const char *name,
+                             const ldb_dbopt_t *options,
+                             ldb_family_t **family) {
+  char dirname[LDB_PATH_MAX];
+  ldb_family_t *fam = NULL;
+  int save_manifest = 0;
+  uint64_t log_number = 0;
+  uint64_t number = 0;
+  int rc = LDB_OK;
+  ldb_waiter_t w;
 
-    *value = ldb_malloc(21);
+  *family = NULL;
 
-    ldb_encode_int(*value, total_usage, 0);
+  if (name == NULL || *name == '\0' || !ldb_check_options(options))
+    return LDB_INVALID;
 
-    ldb_mutex_unlock(&db->mutex);
+  ldb_waiter_init(&w);
 
-    return 1;
-  }
+  ldb_mutex_lock(&db->mutex);
 
-  ldb_mutex_unlock(&db->mutex);
+  /* Wait for the writes before us to finish. */
+  ldb_writers_enter(db, &w);
 
-  return 0;
-}
+  if (ldb_family_lookup_name(db, name) != NULL)
+    rc = LDB_INVALID; /* "column family exists" */
 
-void
-ldb_approximate_sizes(ldb_t *db, const ldb_range_t *range,
-                                 size_t length,
-                                 uint64_t *sizes) {
-  uint64_t start, limit;
-  ldb_ikey_t k1, k2;
-  ldb_version_t *v;
-  size_t i;
+  if (rc == LDB_OK) {
+    number = ldb_versions_new_file_number(db->versions);
+    log_number = db->logfile_number;
 
-  ldb_mutex_lock(&db->mutex);
+    if (!ldb_family_dirname(dirname, sizeof(dirname), db->dbname, number))
+      rc = LDB_INVALID;
+  }
 
-  v = db->versions->current;
+  if (rc == LDB_OK) {
+    fam = ldb_family_new(db, number, name, dirname, options);
 
-  ldb_version_ref(v);
+    ldb_mutex_unlock(&db->mutex);
 
-  ldb_ikey_init(&k1);
-  ldb_ikey_init(&k2);
+    /* The family exists once its descriptor does. Its records
+       are all written to the current log or later ones. */
+    rc = ldb_create_dir(dirname);
 
-  for (i = 0; i < length; i++) {
-    /* Convert user_key into a corresponding internal key. */
-    ldb_ikey_set(&k1, &range[i].start, LDB_MAX_SEQUENCE, LDB_VALTYPE_SEEK);
-    ldb_ikey_set(&k2, &range[i].limit, LDB_MAX_SEQUENCE, LDB_VALTYPE_SEEK);
+    if (rc == LDB_OK) {
+      rc = ldb_new_db(dirname, ldb_user_comparator(fam)->name,
+                               fam->name,
+                               log_number);
+    }
 
-    start = ldb_versions_approximate_offset(db->versions, v, &k1);
-    limit = ldb_versions_approximate_offset(db->versions, v, &k2);
+    if (rc == LDB_OK)
+      rc = ldb_versions_recover(fam->versions, &save_manifest);
 
-    sizes[i] = (limit >= start ? limit - start : 0);
-  }
+    ldb_mutex_lock(&db->mutex);
 
-  ldb_ikey_clear(&k1);
-  ldb_ikey_clear(&k2);
+    /* Switch to the descriptor the versions now expect. Otherwise
+       the initial one would be deleted as obsolete while CURRENT
+       still points to it. */
+    if (rc == LDB_OK && save_manifest) {
+      ldb_edit_set_prev_log_number(&fam->edit, 0);
+      ldb_edit_set_log_number(&fam->edit, log_number);
 
-  ldb_version_unref(v);
+      rc = ldb_family_apply(db, fam, &fam->edit);
 
-  ldb_mutex_unlock(&db->mutex);
-}
+      ldb_edit_reset(&fam->edit);
+    }
 
-void
-ldb_compact(ldb_t *db, const ldb_slice_t *begin, const ldb_slice_t *end) {
-  int max_level_with_files = 1;
-  int level;
+    if (rc == LDB_OK) {
+      fam->mem = ldb_memtable_create(&fam->internal_comparator,
+                                     &fam->options);
 
-  {
-    ldb_version_t *base;
+      ldb_memtable_ref(fam->mem);
 
-    ldb_mutex_lock(&db->mutex);
+      ldb_vector_push(&db->families, fam);
 
-    base = db->versions->current;
+      ldb_log(db->options.info_log, "Created column family %s", dirname);
 
-    for (level = 1; level < LDB_NUM_LEVELS; level++) {
-      if (ldb_version_overlap_in_level(base, level, begin, end))
-        max_level_with_files = level;
+      *family = fam;
+    } else {
+      ldb_family_destroy(fam);
+      ldb_destroy(dirname, NULL);
     }
-
-    ldb_mutex_unlock(&db->mutex);
   }
 
-  ldb_test_compact_memtable(db);
+  ldb_writers_leave(db, &w);
 
-  for (level = 0; level < max_level_with_files; level++)
-    ldb_test_compact_range(db, level, begin, end);
+  ldb_mutex_unlock(&db->mutex);
+
+  ldb_waiter_clear(&w);
+
+  return rc;
 }
 
 int
-ldb_backup(ldb_t *db, const char *name) {
-  rb_set64_t live;
+ldb_family_drop(ldb_t *db, ldb_family_t *family) {
+  char path[LDB_PATH_MAX];
+  ldb_waiter_t w;
   int rc;
 
-  if (strlen(name) + 1 > LDB_PATH_MAX - 35)
+  if (family == NULL || family->number == 0)
+    return LDB_INVALID; /* "cannot drop the default column family" */
+
+  if (!ldb_current_filename(path, sizeof(path), family->dirname))
     return LDB_INVALID;
 
+  ldb_waiter_init(&w);
+
   ldb_mutex_lock(&db->mutex);
 
-  while (db->background_compaction_scheduled)
-    ldb_cond_wait(&db->background_work_finished_signal, &db->mutex);
+  /* Wait for the writes before us to finish. */
+  ldb_writers_enter(db, &w);
 
-  rc = db->bg_error;
+  ldb_family_remove(db, family);
+  ldb_update_has_imm(db);
 
-  if (rc == LDB_OK) {
-    rb_set64_init(&live);
+  family->dropped = 1;
+
+  /* Wait for the background thread to let go of the family, so that
+     it does not write a new descriptor once CURRENT is removed. */
+  while (family->busy > 0)
+    ldb_cond_wait(&db->background_work_finished_signal, &db->mutex);
 
-    ldb_versions_add_files(db->versions, &live);
+  /* The drop is durable once CURRENT is gone: the directory is
+     deleted when the database is next opened, if not before. */
+  rc = ldb_remove_file(path);
 
-    rc = ldb_backup_inner(db->dbname, name, &live);
+  ldb_log(db->options.info_log, "Dropped column family %s: %s",
+                                family->dirname,
+                                ldb_strerror(rc));
 
-    rb_set64_clear(&live);
-  }
+  ldb_family_unref(db, family);
+
+  ldb_writers_leave(db, &w);
 
   ldb_mutex_unlock(&db->mutex);
 
+  ldb_waiter_clear(&w);
+
   return rc;
 }
 
-#undef ldb_compare
-
-int
-ldb_compare(const ldb_t *db, const ldb_slice_t *x, const ldb_slice_t *y) {
-  const ldb_comparator_t *cmp = ldb_user_comparator(db);
-  return cmp->compare(cmp, x, y);
+const char *
+ldb_family_name(const ldb_family_t *family) {
+  return family != NULL ? family->name : NULL;
 }
 
-#define ldb_compare ldb_compare_internal
+uint64_t
+ldb_family_number(const ldb_family_t *family) {
+  return family != NULL ? family->number : 0;
+}
 
 /*
  * Static
@@ -2642,7 +5887,10 @@ ldb_destroy(const char *dbname, const ldb_dbopt_t *options) {
         continue;
       }
 
-      status = ldb_remove_file(path);
+      if (type == LDB_FILE_FAMILY)
+        status = ldb_destroy(path, options);
+      else
+        status = ldb_remove_file(path);
 
       if (rc == LDB_OK && status != LDB_OK)
         rc = status;
@@ -2692,80 +5940,14 @@ ldb_destroy(const char *dbname, const ldb_dbopt_t *options) {
 
 int
 ldb_test_compact_memtable(ldb_t *db) {
-  /* NULL batch means just wait for earlier writes to be done. */
-  int rc = ldb_write(db, NULL, ldb_writeopt_default);
-
-  if (rc == LDB_OK) {
-    /* Wait until the compaction completes. */
-    ldb_mutex_lock(&db->mutex);
-
-    while (db->imm != NULL && db->bg_error == LDB_OK)
-      ldb_cond_wait(&db->background_work_finished_signal, &db->mutex);
-
-    if (db->imm != NULL)
-      rc = db->bg_error;
-
-    ldb_mutex_unlock(&db->mutex);
-  }
-
-  return rc;
+  return ldb_flush_family(db, ldb_default_family(db));
 }
 
 void
 ldb_test_compact_range(ldb_t *db, int level,
                                   const ldb_slice_t *begin,
                                   const ldb_slice_t *end) {
-  ldb_ikey_t begin_storage, end_storage;
-  ldb_manual_t manual;
-
-  assert(level >= 0);
-  assert(level + 1 < LDB_NUM_LEVELS);
-
-  ldb_manual_init(&manual, level);
-
-  if (begin == NULL) {
-    manual.begin = NULL;
-  } else {
-    ldb_ikey_init(&begin_storage);
-    ldb_ikey_set(&begin_storage, begin, LDB_MAX_SEQUENCE, LDB_VALTYPE_SEEK);
-    manual.begin = &begin_storage;
-  }
-
-  if (end == NULL) {
-    manual.end = NULL;
-  } else {
-    ldb_ikey_init(&end_storage);
-    ldb_ikey_set(&end_storage, end, 0, (ldb_valtype_t)0);
-    manual.end = &end_storage;
-  }
-
-  ldb_mutex_lock(&db->mutex);
-
-  while (!manual.done &&
-         !ldb_atomic_load(&db->shutting_down, ldb_order_acquire) &&
-         db->bg_error == LDB_OK) {
-    if (db->manual_compaction == NULL) { /* Idle. */
-      db->manual_compaction = &manual;
-      ldb_maybe_schedule_compaction(db);
-    } else { /* Running either my compaction or another compaction. */
-      ldb_cond_wait(&db->background_work_finished_signal, &db->mutex);
-    }
-  }
-
-  if (db->manual_compaction == &manual) {
-    /* Cancel my manual compaction since we aborted early for some reason. */
-    db->manual_compaction = NULL;
-  }
-
-  ldb_mutex_unlock(&db->mutex);
-
-  if (begin != NULL)
-    ldb_ikey_clear(&begin_storage);
-
-  if (end != NULL)
-    ldb_ikey_clear(&end_storage);
-
-  ldb_manual_clear(&manual);
+  ldb_compact_level(db, ldb_default_family(db), level, begin, end);
 }
 
 ldb_iter_t *
@@ -2773,7 +5955,9 @@ ldb_test_internal_iterator(ldb_t *db) {
   ldb_seqnum_t ignored;
   uint32_t ignored_seed;
 
-  return ldb_internal_iterator(db, ldb_readopt_default,
+  return ldb_internal_iterator(db, ldb_default_family(db),
+                                   ldb_readopt_default,
+                                   NULL,
                                    &ignored,
                                    &ignored_seed);
 }
@@ -2792,15 +5976,30 @@ ldb_test_max_next_level_overlapping_bytes(ldb_t *db) {
  */
 
 void
-ldb_record_read_sample(ldb_t *db, const ldb_slice_t *key) {
+ldb_record_read_sample(ldb_t *db, ldb_family_t *family,
+                                  const ldb_slice_t *key) {
   ldb_version_t *current;
 
   ldb_mutex_lock(&db->mutex);
 
-  current = db->versions->current;
+  current = family->versions->current;
 
   if (ldb_version_record_read_sample(current, key))
     ldb_maybe_schedule_compaction(db);
 
   ldb_mutex_unlock(&db->mutex);
 }
+
+void
+ldb_record_skipped(ldb_t *db, ldb_family_t *family, const ldb_slice_t *key) {
+  ldb_version_t *current;
+
+  ldb_mutex_lock(&db->mutex);
+
+  current = family->versions->current;
+
+  if (ldb_version_record_skipped(current, key))
+    ldb_maybe_schedule_compaction(db);
+
+  ldb_mutex_unlock(&db->mutex);
+}
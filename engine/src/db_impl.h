@@ -31,6 +31,8 @@ struct ldb_iter_s;
 struct ldb_snapshot_s;
 
 typedef struct ldb_s ldb_t;
+typedef struct ldb_family_s ldb_family_t;
+typedef struct ldb_pinned_s ldb_pinned_t;
 
 /*
  * Helpers
@@ -51,6 +53,19 @@ ldb_sanitize_options(const char *dbname,
 LDB_EXTERN int
 ldb_open(const char *dbname, const ldb_dbopt_t *options, ldb_t **dbptr);
 
+/* Open the database along with the column families named in "names".
+   The default column family always uses "options". Column families
+   which do not exist are created if their options have
+   create_if_missing set. Every existing column family must be named. */
+LDB_EXTERN int
+ldb_open_families(const char *dbname,
+                  const ldb_dbopt_t *options,
+                  const char *const *names,
+                  const ldb_dbopt_t *const *family_options,
+                  size_t length,
+                  ldb_family_t **families,
+                  ldb_t **dbptr);
+
 LDB_EXTERN void
 ldb_close(ldb_t *db);
 
@@ -59,17 +74,86 @@ ldb_get(ldb_t *db, const ldb_slice_t *key,
                    ldb_slice_t *value,
                    const ldb_readopt_t *options);
 
+LDB_EXTERN int
+ldb_get_cf(ldb_t *db, ldb_family_t *family,
+                      const ldb_slice_t *key,
+                      ldb_slice_t *value,
+                      const ldb_readopt_t *options);
+
+/* Like ldb_get, but *value points directly into the memtable entry
+   or cached block holding the value rather than into a copy. The
+   memory stays valid until ldb_unpin(*pin) is called. Values which
+   cannot be pinned (merge results and blob values) are copied into
+   memory owned by *pin. Unlike ldb_get, the value is not
+   null-terminated. On failure, *pin is set to NULL. */
+LDB_EXTERN int
+ldb_get_pinned(ldb_t *db, const ldb_slice_t *key,
+                          ldb_slice_t *value,
+                          ldb_pinned_t **pin,
+                          const ldb_readopt_t *options);
+
+LDB_EXTERN int
+ldb_get_pinned_cf(ldb_t *db, ldb_family_t *family,
+                             const ldb_slice_t *key,
+                             ldb_slice_t *value,
+                             ldb_pinned_t **pin,
+                             const ldb_readopt_t *options);
+
+/* Release the memory held for a value returned by ldb_get_pinned. */
+LDB_EXTERN void
+ldb_unpin(ldb_pinned_t *pin);
+
 LDB_EXTERN int
 ldb_has(ldb_t *db, const ldb_slice_t *key, const ldb_readopt_t *options);
 
+LDB_EXTERN int
+ldb_has_cf(ldb_t *db, ldb_family_t *family,
+                      const ldb_slice_t *key,
+                      const ldb_readopt_t *options);
+
 LDB_EXTERN int
 ldb_put(ldb_t *db, const ldb_slice_t *key,
                    const ldb_slice_t *value,
                    const ldb_writeopt_t *options);
 
+LDB_EXTERN int
+ldb_put_cf(ldb_t *db, ldb_family_t *family,
+                      const ldb_slice_t *key,
+                      const ldb_slice_t *value,
+                      const ldb_writeopt_t *options);
+
 LDB_EXTERN int
 ldb_del(ldb_t *db, const ldb_slice_t *key, const ldb_writeopt_t *options);
 
+LDB_EXTERN int
+ldb_del_cf(ldb_t *db, ldb_family_t *family,
+                      const ldb_slice_t *key,
+                      const ldb_writeopt_t *options);
+
+LDB_EXTERN int
+ldb_del_range(ldb_t *db,
+              const ldb_slice_t *start,
+              const ldb_slice_t *limit,
+              const ldb_writeopt_t *options);
+
+LDB_EXTERN int
+ldb_del_range_cf(ldb_t *db,
+                 ldb_family_t *family,
+                 const ldb_slice_t *start,
+                 const ldb_slice_t *limit,
+                 const ldb_writeopt_t *options);
+
+LDB_EXTERN int
+ldb_merge(ldb_t *db, const ldb_slice_t *key,
+                     const ldb_slice_t *value,
+                     const ldb_writeopt_t *options);
+
+LDB_EXTERN int
+ldb_merge_cf(ldb_t *db, ldb_family_t *family,
+                        const ldb_slice_t *key,
+                        const ldb_slice_t *value,
+                        const ldb_writeopt_t *options);
+
 LDB_EXTERN int
 ldb_write(ldb_t *db, struct ldb_batch_s *updates,
                      const ldb_writeopt_t *options);
@@ -83,20 +167,78 @@ ldb_release(ldb_t *db, const struct ldb_snapshot_s *snapshot);
 LDB_EXTERN struct ldb_iter_s *
 ldb_iterator(ldb_t *db, const ldb_readopt_t *options);
 
+LDB_EXTERN struct ldb_iter_s *
+ldb_iterator_cf(ldb_t *db, ldb_family_t *family,
+                           const ldb_readopt_t *options);
+
 LDB_EXTERN int
 ldb_property(ldb_t *db, const char *property, char **value);
 
+LDB_EXTERN int
+ldb_property_cf(ldb_t *db, ldb_family_t *family,
+                           const char *property,
+                           char **value);
+
 LDB_EXTERN void
 ldb_approximate_sizes(ldb_t *db, const ldb_range_t *range,
                                  size_t length,
                                  uint64_t *sizes);
 
+LDB_EXTERN void
+ldb_approximate_sizes_cf(ldb_t *db, ldb_family_t *family,
+                                    const ldb_range_t *range,
+                                    size_t length,
+                                    uint64_t *sizes);
+
 LDB_EXTERN void
 ldb_compact(ldb_t *db, const ldb_slice_t *begin, const ldb_slice_t *end);
 
+LDB_EXTERN void
+ldb_compact_cf(ldb_t *db, ldb_family_t *family,
+                          const ldb_slice_t *begin,
+                          const ldb_slice_t *end);
+
+/* Add tables written with ldb_sstwriter_t to the database. The tables
+   must not overlap one another. They are given the next sequence number
+   and placed at the deepest level which holds none of their keys. The
+   files are linked into the database and must not be modified after. */
+LDB_EXTERN int
+ldb_ingest_files(ldb_t *db, const char *const *paths, size_t length);
+
+LDB_EXTERN int
+ldb_ingest_files_cf(ldb_t *db, ldb_family_t *family,
+                               const char *const *paths,
+                               size_t length);
+
 LDB_EXTERN int
 ldb_backup(ldb_t *db, const char *name);
 
+/*
+ * Column Family
+ */
+
+/* Create a column family named "name". The family shares the log,
+   sequence numbers and snapshots of the database, but keeps its own
+   tables, memtable and options. */
+LDB_EXTERN int
+ldb_family_create(ldb_t *db, const char *name,
+                             const ldb_dbopt_t *options,
+                             ldb_family_t **family);
+
+/* Drop a column family and delete its data. The handle must not be
+   used after this call. Open iterators remain usable. */
+LDB_EXTERN int
+ldb_family_drop(ldb_t *db, ldb_family_t *family);
+
+/* Return the name of a column family (NULL for the default). */
+LDB_EXTERN const char *
+ldb_family_name(const ldb_family_t *family);
+
+/* Return the number identifying a column family in write batches
+   (zero for the default, or NULL). */
+uint64_t
+ldb_family_number(const ldb_family_t *family);
+
 #undef ldb_compare
 
 LDB_EXTERN int
@@ -152,6 +294,12 @@ ldb_test_max_next_level_overlapping_bytes(ldb_t *db);
    Samples are taken approximately once every LDB_READ_BYTES_PERIOD
    bytes. */
 void
-ldb_record_read_sample(ldb_t *db, const ldb_slice_t *key);
+ldb_record_read_sample(ldb_t *db, ldb_family_t *family,
+                                  const ldb_slice_t *key);
+
+/* Record a run of LDB_ITER_SKIP_PERIOD hidden entries skipped by an
+   iterator, ending at the specified internal key. */
+void
+ldb_record_skipped(ldb_t *db, ldb_family_t *family, const ldb_slice_t *key);
 
 #endif /* LDB_DB_IMPL_H */
@@ -19,13 +19,17 @@
 #include "util/buffer.h"
 #include "util/comparator.h"
 #include "util/internal.h"
+#include "util/options.h"
 #include "util/random.h"
 #include "util/slice.h"
 #include "util/status.h"
 
+#include "blob_file.h"
 #include "db_impl.h"
 #include "db_iter.h"
 #include "dbformat.h"
+#include "merge.h"
+#include "range_del.h"
 
 /*
  * Constants
@@ -34,7 +38,10 @@
 /* Which direction is the iterator currently moving?
  *
  * (1) When moving forward, the internal iterator is positioned at
- *     the exact entry that yields key(iter), value(iter).
+ *     the exact entry that yields key(iter), value(iter). If that
+ *     value was merged from several entries, the internal iterator
+ *     is instead positioned after the last of them, and the key and
+ *     value are in saved_key and saved_value.
  *
  * (2) When moving backwards, the internal iterator is positioned
  *     just before all entries whose user key == key(iter).
@@ -52,16 +59,26 @@ enum ldb_direction { LDB_FORWARD, LDB_REVERSE };
    numbers, deletion markers, overwrites, etc. */
 typedef struct ldb_dbiter_s {
   ldb_t *db;
+  ldb_family_t *family;
   const ldb_comparator_t *ucmp;
   ldb_iter_t *iter;
+  ldb_rangedel_t *tombstones; /* NULL if there are none */
   ldb_seqnum_t sequence;
   int status;
   ldb_buffer_t saved_key;   /* == current key when direction==REVERSE */
   ldb_buffer_t saved_value; /* == current value when direction==REVERSE */
+  ldb_operands_t operands;
+  int merged;
+  ldb_blobreader_t reader;
+  ldb_readopt_t options; /* For reading blob files. */
+  ldb_slice_t blob_value; /* == current value if blob (FORWARD) */
+  int blob;
+  int saved_blob; /* saved_value holds a blob index (REVERSE) */
   enum ldb_direction direction;
   int valid;
   ldb_rand_t rnd;
   size_t bytes_until_read_sampling;
+  size_t skipped; /* Hidden entries skipped since the last yield. */
 } ldb_dbiter_t;
 
 /*
@@ -83,7 +100,7 @@ parse_key(ldb_dbiter_t *iter, ldb_pkey_t *ikey) {
 
   while (iter->bytes_until_read_sampling < bytes_read) {
     iter->bytes_until_read_sampling += random_compaction_period(iter);
-    ldb_record_read_sample(iter->db, &k);
+    ldb_record_read_sample(iter->db, iter->family, &k);
   }
 
   assert(iter->bytes_until_read_sampling >= bytes_read);
@@ -95,9 +112,62 @@ parse_key(ldb_dbiter_t *iter, ldb_pkey_t *ikey) {
     return 0;
   }
 
+  /* A value deleted by a range tombstone behaves as a point
+     deletion, hiding itself and every older entry of its key. */
+  if (ikey->type == LDB_TYPE_VALUE ||
+      ikey->type == LDB_TYPE_BLOB ||
+      ikey->type == LDB_TYPE_MERGE) {
+    if (ldb_rangedel_covers(iter->tombstones, ikey, iter->sequence))
+      ikey->type = LDB_TYPE_DELETION;
+  }
+
   return 1;
 }
 
+static LDB_INLINE int
+past_upper_bound(const ldb_dbiter_t *iter, const ldb_slice_t *user_key) {
+  const ldb_slice_t *bound = iter->options.iterate_upper_bound;
+  return bound != NULL && ldb_compare(iter->ucmp, user_key, bound) >= 0;
+}
+
+static LDB_INLINE int
+before_lower_bound(const ldb_dbiter_t *iter, const ldb_slice_t *user_key) {
+  const ldb_slice_t *bound = iter->options.iterate_lower_bound;
+  return bound != NULL && ldb_compare(iter->ucmp, user_key, bound) < 0;
+}
+
+/* Count a hidden entry at the internal iterator. Long runs of them
+   are reported so that a compaction can drop them. */
+static LDB_INLINE void
+record_skipped(ldb_dbiter_t *iter) {
+  if (++iter->skipped == LDB_ITER_SKIP_PERIOD) {
+    ldb_slice_t k = ldb_iter_key(iter->iter);
+
+    ldb_record_skipped(iter->db, iter->family, &k);
+
+    iter->skipped = 0;
+  }
+}
+
+/* Read the value referenced by a blob index. */
+static int
+read_blob(ldb_dbiter_t *iter, const ldb_slice_t *index, ldb_slice_t *value) {
+  ldb_blobref_t ref;
+  int rc;
+
+  if (!ldb_blobref_import(&ref, index))
+    rc = LDB_CORRUPTION; /* "bad blob index in DBIter" */
+  else
+    rc = ldb_blobreader_read(&iter->reader, &iter->options, &ref, value);
+
+  if (rc != LDB_OK) {
+    iter->status = rc;
+    iter->valid = 0;
+  }
+
+  return rc == LDB_OK;
+}
+
 static LDB_INLINE void
 clear_saved_value(ldb_dbiter_t *iter) {
   if (iter->saved_value.alloc > 1048576)
@@ -106,32 +176,132 @@ clear_saved_value(ldb_dbiter_t *iter) {
     ldb_buffer_reset(&iter->saved_value);
 }
 
+/* Collect the merge operands for the current key, starting with the
+   entry at the internal iterator, and apply them to the value beneath
+   them. Leaves the internal iterator past the operands. */
+static void
+merge_values_forward(ldb_dbiter_t *iter, const ldb_pkey_t *first) {
+  const ldb_slice_t *base = NULL;
+  ldb_slice_t value;
+  int rc;
+
+  ldb_buffer_copy(&iter->saved_key, &first->user_key);
+
+  ldb_operands_reset(&iter->operands);
+
+  value = ldb_iter_value(iter->iter);
+
+  ldb_operands_push(&iter->operands, &value);
+
+  for (ldb_iter_next(iter->iter);
+       ldb_iter_valid(iter->iter);
+       ldb_iter_next(iter->iter)) {
+    ldb_pkey_t ikey;
+
+    if (!parse_key(iter, &ikey))
+      break;
+
+    if (ldb_compare(iter->ucmp, &ikey.user_key, &iter->saved_key) != 0)
+      break;
+
+    if (ikey.type == LDB_TYPE_VALUE) {
+      value = ldb_iter_value(iter->iter);
+      base = &value;
+      break;
+    }
+
+    if (ikey.type == LDB_TYPE_BLOB) {
+      ldb_slice_t index = ldb_iter_value(iter->iter);
+
+      if (!read_blob(iter, &index, &value))
+        return;
+
+      base = &value;
+      break;
+    }
+
+    if (ikey.type != LDB_TYPE_MERGE)
+      break;
+
+    value = ldb_iter_value(iter->iter);
+
+    ldb_operands_push(&iter->operands, &value);
+  }
+
+  rc = ldb_operands_merge(&iter->operands, &iter->saved_key,
+                          base, &iter->saved_value);
+
+  if (rc != LDB_OK) {
+    iter->status = rc;
+    iter->valid = 0;
+    return;
+  }
+
+  iter->merged = 1;
+  iter->valid = 1;
+}
+
 static void
 find_next_user_entry(ldb_dbiter_t *iter, int skipping, ldb_buffer_t *skip) {
   /* Loop until we hit an acceptable entry to yield. */
   assert(ldb_iter_valid(iter->iter));
   assert(iter->direction == LDB_FORWARD);
 
+  iter->merged = 0;
+  iter->blob = 0;
+
   do {
     ldb_pkey_t ikey;
+    int parsed = parse_key(iter, &ikey);
 
-    if (parse_key(iter, &ikey) && ikey.sequence <= iter->sequence) {
+    /* Stop at the upper bound without reading any further. */
+    if (parsed && past_upper_bound(iter, &ikey.user_key))
+      break;
+
+    if (parsed && ikey.sequence <= iter->sequence) {
       switch (ikey.type) {
         case LDB_TYPE_DELETION:
           /* Arrange to skip all upcoming entries for this key since
              they are hidden by this deletion. */
           ldb_buffer_copy(skip, &ikey.user_key);
           skipping = 1;
+          record_skipped(iter);
           break;
         case LDB_TYPE_VALUE:
+        case LDB_TYPE_BLOB:
           if (skipping && ldb_compare(iter->ucmp, &ikey.user_key, skip) <= 0) {
             /* Entry hidden. */
+            record_skipped(iter);
           } else {
-            iter->valid = 1;
             ldb_buffer_reset(&iter->saved_key);
+            iter->skipped = 0;
+
+            if (ikey.type == LDB_TYPE_BLOB) {
+              ldb_slice_t index = ldb_iter_value(iter->iter);
+
+              if (!read_blob(iter, &index, &iter->blob_value))
+                return;
+
+              iter->blob = 1;
+            }
+
+            iter->valid = 1;
             return;
           }
           break;
+        case LDB_TYPE_MERGE:
+          if (skipping && ldb_compare(iter->ucmp, &ikey.user_key, skip) <= 0) {
+            /* Entry hidden. */
+            record_skipped(iter);
+          } else {
+            iter->skipped = 0;
+            merge_values_forward(iter, &ikey);
+            return;
+          }
+          break;
+        case LDB_TYPE_RANGE_DELETION:
+          /* Range tombstones are kept out of the internal iterator. */
+          break;
       }
     }
 
@@ -152,22 +322,72 @@ find_prev_user_entry(ldb_dbiter_t *iter) {
   ldb_buffer_grow(&iter->saved_key, 1);
   ldb_buffer_grow(&iter->saved_value, 1);
 
+  iter->saved_blob = 0;
+
   if (ldb_iter_valid(iter->iter)) {
     do {
       ldb_pkey_t ikey;
+      int parsed = parse_key(iter, &ikey);
+
+      /* Entries below the lower bound are treated as a previous key. */
+      if (parsed && before_lower_bound(iter, &ikey.user_key))
+        break;
 
-      if (parse_key(iter, &ikey) && ikey.sequence <= iter->sequence) {
+      if (parsed && ikey.sequence <= iter->sequence) {
         if ((value_type != LDB_TYPE_DELETION) &&
             ldb_compare(iter->ucmp, &ikey.user_key, &iter->saved_key) < 0) {
           /* We encountered a non-deleted value in entries for previous keys. */
           break;
         }
 
-        value_type = ikey.type;
+        /* Every entry but the yielded ones is hidden. */
+        record_skipped(iter);
+
+        if (ikey.type == LDB_TYPE_MERGE) {
+          /* Entries are visited oldest first, so each operand can be
+             applied as it is found. */
+          ldb_slice_t value = ldb_iter_value(iter->iter);
+          const ldb_slice_t *existing = NULL;
+          ldb_slice_t blob_value;
+          ldb_buffer_t result;
+          int rc;
+
+          if (value_type != LDB_TYPE_DELETION)
+            existing = &iter->saved_value;
+
+          if (iter->saved_blob) {
+            if (!read_blob(iter, &iter->saved_value, &blob_value)) {
+              value_type = LDB_TYPE_DELETION;
+              break;
+            }
+
+            existing = &blob_value;
+            iter->saved_blob = 0;
+          }
+
+          ldb_buffer_init(&result);
+
+          rc = ldb_merge_apply(iter->operands.op, &ikey.user_key,
+                               existing, &value, &result);
+
+          if (rc == LDB_OK) {
+            ldb_buffer_copy(&iter->saved_key, &ikey.user_key);
+            ldb_buffer_swap(&iter->saved_value, &result);
+          }
+
+          ldb_buffer_clear(&result);
+
+          if (rc != LDB_OK) {
+            iter->status = rc;
+            value_type = LDB_TYPE_DELETION;
+            break;
+          }
 
-        if (value_type == LDB_TYPE_DELETION) {
+          value_type = LDB_TYPE_VALUE;
+        } else if ((value_type = ikey.type) == LDB_TYPE_DELETION) {
           ldb_buffer_reset(&iter->saved_key);
           clear_saved_value(iter);
+          iter->saved_blob = 0;
         } else {
           ldb_slice_t key = ldb_iter_key(iter->iter);
           ldb_slice_t ukey = ldb_extract_user_key(&key);
@@ -178,6 +398,9 @@ find_prev_user_entry(ldb_dbiter_t *iter) {
 
           ldb_buffer_copy(&iter->saved_key, &ukey);
           ldb_buffer_copy(&iter->saved_value, &value);
+
+          /* Only the value which is yielded is read. */
+          iter->saved_blob = (ikey.type == LDB_TYPE_BLOB);
         }
       }
 
@@ -185,6 +408,17 @@ find_prev_user_entry(ldb_dbiter_t *iter) {
     } while (ldb_iter_valid(iter->iter));
   }
 
+  if (value_type != LDB_TYPE_DELETION && iter->saved_blob) {
+    ldb_slice_t value;
+
+    if (read_blob(iter, &iter->saved_value, &value))
+      ldb_buffer_copy(&iter->saved_value, &value);
+    else
+      value_type = LDB_TYPE_DELETION;
+
+    iter->saved_blob = 0;
+  }
+
   if (value_type == LDB_TYPE_DELETION) {
     /* End. */
     iter->valid = 0;
@@ -193,6 +427,7 @@ find_prev_user_entry(ldb_dbiter_t *iter) {
     iter->direction = LDB_FORWARD;
   } else {
     iter->valid = 1;
+    iter->skipped = 0;
   }
 }
 
@@ -203,32 +438,52 @@ find_prev_user_entry(ldb_dbiter_t *iter) {
 static void
 ldb_dbiter_init(ldb_dbiter_t *iter,
                 ldb_t *db,
+                ldb_family_t *family,
                 const ldb_comparator_t *ucmp,
+                const ldb_merger_t *merger,
+                ldb_blobs_t *blobs,
+                const ldb_readopt_t *options,
                 ldb_iter_t *internal_iter,
+                ldb_rangedel_t *tombstones,
                 ldb_seqnum_t sequence,
                 uint32_t seed) {
   iter->db = db;
+  iter->family = family;
   iter->ucmp = ucmp;
   iter->iter = internal_iter;
+  iter->tombstones = tombstones;
   iter->sequence = sequence;
   iter->status = LDB_OK;
 
   ldb_buffer_init(&iter->saved_key);
   ldb_buffer_init(&iter->saved_value);
+  ldb_operands_init(&iter->operands, merger);
+  ldb_blobreader_init(&iter->reader, blobs, LDB_BLOB_READAHEAD);
 
+  iter->options = *options;
+  iter->merged = 0;
+  iter->blob = 0;
+  iter->saved_blob = 0;
   iter->direction = LDB_FORWARD;
   iter->valid = 0;
 
   ldb_rand_init(&iter->rnd, seed);
 
   iter->bytes_until_read_sampling = random_compaction_period(iter);
+  iter->skipped = 0;
 }
 
 static void
 ldb_dbiter_clear(ldb_dbiter_t *iter) {
   ldb_iter_destroy(iter->iter);
+
+  if (iter->tombstones != NULL)
+    ldb_rangedel_destroy(iter->tombstones);
+
   ldb_buffer_clear(&iter->saved_key);
   ldb_buffer_clear(&iter->saved_value);
+  ldb_operands_clear(&iter->operands);
+  ldb_blobreader_clear(&iter->reader);
 }
 
 static int
@@ -240,7 +495,7 @@ static ldb_slice_t
 ldb_dbiter_key(const ldb_dbiter_t *iter) {
   assert(iter->valid);
 
-  if (iter->direction == LDB_FORWARD) {
+  if (iter->direction == LDB_FORWARD && !iter->merged) {
     ldb_slice_t key = ldb_iter_key(iter->iter);
     return ldb_extract_user_key(&key);
   }
@@ -252,8 +507,12 @@ static ldb_slice_t
 ldb_dbiter_value(const ldb_dbiter_t *iter) {
   assert(iter->valid);
 
-  if (iter->direction == LDB_FORWARD)
+  if (iter->direction == LDB_FORWARD && !iter->merged) {
+    if (iter->blob)
+      return iter->blob_value;
+
     return ldb_iter_value(iter->iter);
+  }
 
   return iter->saved_value;
 }
@@ -288,6 +547,14 @@ ldb_dbiter_next(ldb_dbiter_t *iter) {
     }
 
     /* iter->saved_key already contains the key to skip past. */
+  } else if (iter->merged) {
+    /* iter->iter is already past the merged entries, and
+       iter->saved_key contains the key to skip past. */
+    if (!ldb_iter_valid(iter->iter)) {
+      iter->valid = 0;
+      ldb_buffer_reset(&iter->saved_key);
+      return;
+    }
   } else {
     /* Store in iter->saved_key the current key so we skip it below. */
     ldb_slice_t key = ldb_iter_key(iter->iter);
@@ -314,19 +581,27 @@ ldb_dbiter_prev(ldb_dbiter_t *iter) {
   assert(iter->valid);
 
   if (iter->direction == LDB_FORWARD) { /* Switch directions? */
-    /* iter->iter is pointing at the current entry. Scan backwards until
-       the key changes so we can use the normal reverse scanning code. */
-    ldb_slice_t key = ldb_iter_key(iter->iter);
-    ldb_slice_t ukey = ldb_extract_user_key(&key);
-
-    assert(ldb_iter_valid(iter->iter)); /* Otherwise iter->valid
-                                           would have been false. */
+    /* iter->iter is pointing at the current entry (or past it, if
+       merged). Scan backwards until the key changes so we can use
+       the normal reverse scanning code. */
+    ldb_slice_t key, ukey;
+
+    if (iter->merged) {
+      /* iter->saved_key already contains the current key. */
+      if (!ldb_iter_valid(iter->iter))
+        ldb_iter_last(iter->iter);
+
+      iter->merged = 0;
+    } else {
+      assert(ldb_iter_valid(iter->iter)); /* Otherwise iter->valid
+                                             would have been false. */
+      key = ldb_iter_key(iter->iter);
+      ukey = ldb_extract_user_key(&key);
 
-    ldb_buffer_copy(&iter->saved_key, &ukey);
+      ldb_buffer_copy(&iter->saved_key, &ukey);
+    }
 
     for (;;) {
-      ldb_iter_prev(iter->iter);
-
       if (!ldb_iter_valid(iter->iter)) {
         iter->valid = 0;
         ldb_buffer_reset(&iter->saved_key);
@@ -339,6 +614,8 @@ ldb_dbiter_prev(ldb_dbiter_t *iter) {
 
       if (ldb_compare(iter->ucmp, &ukey, &iter->saved_key) < 0)
         break;
+
+      ldb_iter_prev(iter->iter);
     }
 
     iter->direction = LDB_REVERSE;
@@ -351,6 +628,9 @@ static void
 ldb_dbiter_seek(ldb_dbiter_t *iter, const ldb_slice_t *target) {
   ldb_pkey_t pkey;
 
+  if (before_lower_bound(iter, target))
+    target = iter->options.iterate_lower_bound;
+
   iter->direction = LDB_FORWARD;
 
   clear_saved_value(iter);
@@ -370,6 +650,11 @@ ldb_dbiter_seek(ldb_dbiter_t *iter, const ldb_slice_t *target) {
 
 static void
 ldb_dbiter_first(ldb_dbiter_t *iter) {
+  if (iter->options.iterate_lower_bound != NULL) {
+    ldb_dbiter_seek(iter, iter->options.iterate_lower_bound);
+    return;
+  }
+
   iter->direction = LDB_FORWARD;
 
   clear_saved_value(iter);
@@ -384,11 +669,30 @@ ldb_dbiter_first(ldb_dbiter_t *iter) {
 
 static void
 ldb_dbiter_last(ldb_dbiter_t *iter) {
+  const ldb_slice_t *upper = iter->options.iterate_upper_bound;
+
   iter->direction = LDB_REVERSE;
 
   clear_saved_value(iter);
 
-  ldb_iter_last(iter->iter);
+  if (upper != NULL) {
+    /* Position just before the first entry at the upper bound. */
+    ldb_pkey_t pkey;
+
+    ldb_buffer_reset(&iter->saved_key);
+
+    ldb_pkey_init(&pkey, upper, LDB_MAX_SEQUENCE, LDB_VALTYPE_SEEK);
+    ldb_pkey_export(&iter->saved_key, &pkey);
+
+    ldb_iter_seek(iter->iter, &iter->saved_key);
+
+    if (ldb_iter_valid(iter->iter))
+      ldb_iter_prev(iter->iter);
+    else
+      ldb_iter_last(iter->iter);
+  } else {
+    ldb_iter_last(iter->iter);
+  }
 
   find_prev_user_entry(iter);
 }
@@ -397,11 +701,19 @@ LDB_ITERATOR_FUNCTIONS(ldb_dbiter);
 
 ldb_iter_t *
 ldb_dbiter_create(ldb_t *db,
+                  ldb_family_t *family,
                   const ldb_comparator_t *user_comparator,
+                  const ldb_merger_t *merger,
+                  ldb_blobs_t *blobs,
+                  const ldb_readopt_t *options,
                   ldb_iter_t *internal_iter,
+                  ldb_rangedel_t *tombstones,
                   ldb_seqnum_t sequence,
                   uint32_t seed) {
   ldb_dbiter_t *iter = ldb_malloc(sizeof(ldb_dbiter_t));
-  ldb_dbiter_init(iter, db, user_comparator, internal_iter, sequence, seed);
+
+  ldb_dbiter_init(iter, db, family, user_comparator, merger, blobs, options,
+                  internal_iter, tombstones, sequence, seed);
+
   return ldb_iter_create(iter, &ldb_dbiter_table, user_comparator);
 }
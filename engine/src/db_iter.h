@@ -17,13 +17,25 @@
 #include "util/types.h"
 
 struct ldb_s;
+struct ldb_blobs_s;
+struct ldb_family_s;
 struct ldb_comparator_s;
 struct ldb_iter_s;
+struct ldb_merger_s;
+struct ldb_rangedel_s;
+struct ldb_readopt_s;
 
+/* Takes ownership of "tombstones", which may be NULL. Values held in
+   blob files are read through "blobs" using "options". */
 struct ldb_iter_s *
 ldb_dbiter_create(struct ldb_s *db,
+                  struct ldb_family_s *family,
                   const struct ldb_comparator_s *user_comparator,
+                  const struct ldb_merger_s *merger,
+                  struct ldb_blobs_s *blobs,
+                  const struct ldb_readopt_s *options,
                   struct ldb_iter_s *internal_iter,
+                  struct ldb_rangedel_s *tombstones,
                   uint64_t sequence,
                   uint32_t seed);
 
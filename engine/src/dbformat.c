@@ -30,7 +30,7 @@
 static uint64_t
 pack_seqtype(uint64_t sequence, ldb_valtype_t type) {
   assert(sequence <= LDB_MAX_SEQUENCE);
-  assert(type <= LDB_VALTYPE_SEEK);
+  assert(type <= LDB_VALTYPE_SEEK || type == LDB_TYPE_RANGE_DELETION);
   return (sequence << 8) | type;
 }
 
@@ -95,7 +95,7 @@ ldb_pkey_import(ldb_pkey_t *z, const ldb_slice_t *x) {
   num = ldb_fixed64_decode(xp + xn - 8);
   type = num & 0xff;
 
-  if (type > LDB_TYPE_VALUE)
+  if (type > LDB_TYPE_BLOB && type != LDB_TYPE_RANGE_DELETION)
     return 0;
 
   ldb_slice_set(&z->user_key, xp, xn - 8);
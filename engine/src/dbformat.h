@@ -27,15 +27,6 @@
    parameters set via options. */
 #define LDB_NUM_LEVELS 7 /* kNumLevels */
 
-/* Level-0 compaction is started when we hit this many files. */
-#define LDB_L0_COMPACTION_TRIGGER 4 /* kL0_CompactionTrigger */
-
-/* Soft limit on number of level-0 files. We slow down writes at this point. */
-#define LDB_L0_SLOWDOWN_WRITES_TRIGGER 8 /* kL0_SlowdownWritesTrigger */
-
-/* Maximum number of level-0 files. We stop writes at this point. */
-#define LDB_L0_STOP_WRITES_TRIGGER 12 /* kL0_StopWritesTrigger */
-
 /* Maximum level to which a new compacted memtable is pushed if it
    does not create overlap. We try to push to level 2 to avoid the
    relatively expensive level 0=>1 compactions and to avoid some
@@ -47,12 +38,28 @@
 /* Approximate gap in bytes between samples of data read during iteration. */
 #define LDB_READ_BYTES_PERIOD 1048576 /* kReadBytesPeriod */
 
+/* Number of consecutive hidden entries (deletion markers and the
+   entries they or newer values shadow) an iterator may skip before
+   the range they lie in is marked for compaction. */
+#define LDB_ITER_SKIP_PERIOD 4096
+
 /* Value types encoded as the last component of internal keys.
    DO NOT CHANGE THESE ENUM VALUES: they are embedded in the on-disk
    data structures. */
 enum ldb_valtype {
   LDB_TYPE_DELETION = 0x0, /* kTypeDeletion */
-  LDB_TYPE_VALUE = 0x1 /* kTypeValue */
+  LDB_TYPE_VALUE = 0x1, /* kTypeValue */
+  /* An operand for the merge operator, to be combined with the
+     older entries of its key when read or compacted. */
+  LDB_TYPE_MERGE = 0x2, /* kTypeMerge */
+  /* A value stored in a blob file. Only found in tables: the table
+     holds a reference to the record (see blob_file.h), which readers
+     resolve in place of the value. */
+  LDB_TYPE_BLOB = 0x3, /* kTypeBlobIndex */
+  /* Range tombstones. These never appear among point entries: they
+     are kept in a separate memtable list and table block, with the
+     exclusive end of the range stored as the value. */
+  LDB_TYPE_RANGE_DELETION = 0xf /* kTypeRangeDeletion */
 };
 
 /* LDB_VALTYPE_SEEK defines the ldb_valtype that should be passed when
@@ -62,7 +69,7 @@ enum ldb_valtype {
  * number in internal keys, we need to use the highest-numbered
  * ldb_valtype, not the lowest).
  */
-#define LDB_VALTYPE_SEEK LDB_TYPE_VALUE /* kValueTypeForSeek */
+#define LDB_VALTYPE_SEEK LDB_TYPE_BLOB /* kValueTypeForSeek */
 
 /* We leave eight bits empty at the bottom so a type and sequence#
    can be packed together into 64-bits. */
@@ -113,6 +120,9 @@ typedef struct ldb_lkey_s {
 
 #define ldb_extract_user_key(x) ldb_slice((x)->data, (x)->size - 8)
 
+/* The low byte of the little-endian tag. */
+#define ldb_extract_type(x) ((ldb_valtype_t)(x)->data[(x)->size - 8])
+
 /*
  * ParsedInternalKey
  */
@@ -29,6 +29,7 @@
 #include "util/status.h"
 #include "util/strutil.h"
 
+#include "blob_file.h"
 #include "dbformat.h"
 #include "dumpfile.h"
 #include "filename.h"
@@ -107,6 +108,18 @@ print_log_contents(const char *fname,
   return LDB_OK;
 }
 
+/* Prefix of an item, naming its column family if not the default. */
+static void
+handle_family(ldb_buffer_t *r, const ldb_handler_t *h) {
+  ldb_buffer_string(r, "  ");
+
+  if (h->family != 0) {
+    ldb_buffer_string(r, "family ");
+    ldb_buffer_number(r, h->family);
+    ldb_buffer_string(r, " ");
+  }
+}
+
 /* Called on every item found in a WriteBatch. */
 static void
 handle_put(ldb_handler_t *h, const ldb_slice_t *key, const ldb_slice_t *value) {
@@ -114,7 +127,8 @@ handle_put(ldb_handler_t *h, const ldb_slice_t *key, const ldb_slice_t *value) {
   ldb_buffer_t r;
 
   ldb_buffer_init(&r);
-  ldb_buffer_string(&r, "  put '");
+  handle_family(&r, h);
+  ldb_buffer_string(&r, "put '");
   ldb_buffer_escape(&r, key);
   ldb_buffer_string(&r, "' '");
   ldb_buffer_escape(&r, value);
@@ -130,7 +144,8 @@ handle_del(ldb_handler_t *h, const ldb_slice_t *key) {
   ldb_buffer_t r;
 
   ldb_buffer_init(&r);
-  ldb_buffer_string(&r, "  del '");
+  handle_family(&r, h);
+  ldb_buffer_string(&r, "del '");
   ldb_buffer_escape(&r, key);
   ldb_buffer_string(&r, "'\n");
 
@@ -138,6 +153,44 @@ handle_del(ldb_handler_t *h, const ldb_slice_t *key) {
   ldb_buffer_clear(&r);
 }
 
+static void
+handle_del_range(ldb_handler_t *h,
+                 const ldb_slice_t *start,
+                 const ldb_slice_t *limit) {
+  FILE *dst = h->state;
+  ldb_buffer_t r;
+
+  ldb_buffer_init(&r);
+  handle_family(&r, h);
+  ldb_buffer_string(&r, "del_range '");
+  ldb_buffer_escape(&r, start);
+  ldb_buffer_string(&r, "' '");
+  ldb_buffer_escape(&r, limit);
+  ldb_buffer_string(&r, "'\n");
+
+  stream_append(dst, &r);
+  ldb_buffer_clear(&r);
+}
+
+static void
+handle_merge(ldb_handler_t *h,
+             const ldb_slice_t *key,
+             const ldb_slice_t *value) {
+  FILE *dst = h->state;
+  ldb_buffer_t r;
+
+  ldb_buffer_init(&r);
+  handle_family(&r, h);
+  ldb_buffer_string(&r, "merge '");
+  ldb_buffer_escape(&r, key);
+  ldb_buffer_string(&r, "' '");
+  ldb_buffer_escape(&r, value);
+  ldb_buffer_string(&r, "'\n");
+
+  stream_append(dst, &r);
+  ldb_buffer_clear(&r);
+}
+
 /* Called on every log record (each one of which is a WriteBatch)
    found in a LDB_FILE_LOG. */
 static void
@@ -173,6 +226,8 @@ write_batch_printer(uint64_t pos, const ldb_slice_t *record, FILE *dst) {
   printer.state = dst;
   printer.put = handle_put;
   printer.del = handle_del;
+  printer.del_range = handle_del_range;
+  printer.merge = handle_merge;
 
   rc = ldb_batch_iterate(&batch, &printer);
 
@@ -271,6 +326,7 @@ dump_table(const char *fname, FILE *dst) {
   for (ldb_iter_first(iter); ldb_iter_valid(iter); ldb_iter_next(iter)) {
     ldb_slice_t key = ldb_iter_key(iter);
     ldb_slice_t val = ldb_iter_value(iter);
+    ldb_blobref_t ref;
     ldb_pkey_t pkey;
 
     ldb_buffer_reset(&r);
@@ -293,12 +349,26 @@ dump_table(const char *fname, FILE *dst) {
         ldb_buffer_string(&r, "del");
       else if (pkey.type == LDB_TYPE_VALUE)
         ldb_buffer_string(&r, "val");
+      else if (pkey.type == LDB_TYPE_MERGE)
+        ldb_buffer_string(&r, "merge");
+      else if (pkey.type == LDB_TYPE_BLOB)
+        ldb_buffer_string(&r, "blob");
       else
         ldb_buffer_number(&r, pkey.type);
 
-      ldb_buffer_string(&r, " => '");
-      ldb_buffer_escape(&r, &val);
-      ldb_buffer_string(&r, "'\n");
+      if (pkey.type == LDB_TYPE_BLOB && ldb_blobref_import(&ref, &val)) {
+        ldb_buffer_string(&r, " => #");
+        ldb_buffer_number(&r, ref.number);
+        ldb_buffer_string(&r, " @ ");
+        ldb_buffer_number(&r, ref.offset);
+        ldb_buffer_string(&r, " (");
+        ldb_buffer_number(&r, ref.size);
+        ldb_buffer_string(&r, " bytes)\n");
+      } else {
+        ldb_buffer_string(&r, " => '");
+        ldb_buffer_escape(&r, &val);
+        ldb_buffer_string(&r, "'\n");
+      }
 
       stream_append(dst, &r);
     }
@@ -324,6 +394,54 @@ dump_table(const char *fname, FILE *dst) {
   return LDB_OK;
 }
 
+static void
+blob_printer(void *arg,
+             const ldb_blobref_t *ref,
+             const ldb_slice_t *key,
+             const ldb_slice_t *value) {
+  FILE *dst = arg;
+  ldb_buffer_t r;
+
+  ldb_buffer_init(&r);
+  ldb_buffer_string(&r, "--- offset ");
+  ldb_buffer_number(&r, ref->offset);
+  ldb_buffer_string(&r, "; '");
+  ldb_buffer_escape(&r, key);
+  ldb_buffer_string(&r, "' => '");
+  ldb_buffer_escape(&r, value);
+  ldb_buffer_string(&r, "'\n");
+
+  stream_append(dst, &r);
+  ldb_buffer_clear(&r);
+}
+
+static int
+dump_blob(const char *fname, FILE *dst) {
+  const char *base = ldb_basename(fname);
+  ldb_filetype_t type;
+  uint64_t number;
+  int rc;
+
+  if (!ldb_parse_filename(&type, &number, base))
+    return LDB_INVALID;
+
+  rc = ldb_blob_scan(fname, number, dst, blob_printer);
+
+  if (rc != LDB_OK) {
+    ldb_buffer_t r;
+
+    ldb_buffer_init(&r);
+    ldb_buffer_string(&r, "blob error: ");
+    ldb_buffer_string(&r, ldb_strerror(rc));
+    ldb_buffer_push(&r, '\n');
+
+    stream_append(dst, &r);
+    ldb_buffer_clear(&r);
+  }
+
+  return LDB_OK;
+}
+
 int
 ldb_dump_file(const char *fname, FILE *dst) {
   ldb_filetype_t type;
@@ -340,6 +458,8 @@ ldb_dump_file(const char *fname, FILE *dst) {
       return dump_descriptor(fname, dst);
     case LDB_FILE_TABLE:
       return dump_table(fname, dst);
+    case LDB_FILE_BLOB:
+      return dump_blob(fname, dst);
     default:
       break;
   }
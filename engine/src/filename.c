@@ -65,6 +65,12 @@ ldb_sstable_filename(char *buf, size_t size, const char *dbname, uint64_t num) {
   return make_filename(buf, size, dbname, num, "sst");
 }
 
+int
+ldb_blob_filename(char *buf, size_t size, const char *dbname, uint64_t num) {
+  assert(num > 0);
+  return make_filename(buf, size, dbname, num, "blob");
+}
+
 int
 ldb_desc_filename(char *buf, size_t size, const char *dbname, uint64_t num) {
   char tmp[128];
@@ -105,13 +111,28 @@ ldb_oldinfo_filename(char *buf, size_t size, const char *dbname) {
   return ldb_join(buf, size, dbname, "LOG.old");
 }
 
+int
+ldb_family_dirname(char *buf, size_t size, const char *dbname, uint64_t num) {
+  char tmp[128];
+  char id[32];
+
+  assert(num > 0);
+
+  ldb_encode_int(id, num, 6);
+
+  sprintf(tmp, "FAMILY-%s", id);
+
+  return ldb_join(buf, size, dbname, tmp);
+}
+
 /* Owned filenames have the form:
  *    dbname/CURRENT
  *    dbname/LOCK
  *    dbname/LOG
  *    dbname/LOG.old
  *    dbname/MANIFEST-[0-9]+
- *    dbname/[0-9]+.(log|sst|ldb)
+ *    dbname/FAMILY-[0-9]+
+ *    dbname/[0-9]+.(log|sst|ldb|blob)
  */
 int
 ldb_parse_filename(ldb_filetype_t *type, uint64_t *num, const char *name) {
@@ -137,11 +158,24 @@ ldb_parse_filename(ldb_filetype_t *type, uint64_t *num, const char *name) {
 
     *type = LDB_FILE_DESC;
     *num = x;
+  } else if (ldb_starts_with(name, "FAMILY-")) {
+    name += 7;
+
+    if (!ldb_decode_int(&x, &name))
+      return 0;
+
+    if (*name != '\0')
+      return 0;
+
+    *type = LDB_FILE_FAMILY;
+    *num = x;
   } else if (ldb_decode_int(&x, &name)) {
     if (strcmp(name, ".log") == 0)
       *type = LDB_FILE_LOG;
     else if (strcmp(name, ".sst") == 0 || strcmp(name, ".ldb") == 0)
       *type = LDB_FILE_TABLE;
+    else if (strcmp(name, ".blob") == 0)
+      *type = LDB_FILE_BLOB;
     else if (strcmp(name, ".dbtmp") == 0)
       *type = LDB_FILE_TEMP;
     else
@@ -27,7 +27,9 @@ typedef enum ldb_filetype {
   LDB_FILE_DESC,
   LDB_FILE_CURRENT,
   LDB_FILE_TEMP,
-  LDB_FILE_INFO /* Either the current one, or an old one */
+  LDB_FILE_INFO, /* Either the current one, or an old one */
+  LDB_FILE_FAMILY, /* Directory of a column family */
+  LDB_FILE_BLOB
 } ldb_filetype_t;
 
 /*
@@ -52,6 +54,12 @@ ldb_table_filename(char *buf, size_t size, const char *dbname, uint64_t num);
 int
 ldb_sstable_filename(char *buf, size_t size, const char *dbname, uint64_t num);
 
+/* Return the name of the blob file with the specified number
+   in the db named by "dbname". The result will be prefixed with
+   "dbname". */
+int
+ldb_blob_filename(char *buf, size_t size, const char *dbname, uint64_t num);
+
 /* Return the name of the descriptor file for the db named by
    "dbname" and the specified incarnation number. The result will be
    prefixed with "dbname". */
@@ -82,6 +90,11 @@ ldb_info_filename(char *buf, size_t size, const char *dbname);
 int
 ldb_oldinfo_filename(char *buf, size_t size, const char *dbname);
 
+/* Return the name of the directory holding the column family with
+   the specified number. The result will be prefixed with "dbname". */
+int
+ldb_family_dirname(char *buf, size_t size, const char *dbname, uint64_t num);
+
 /* If filename is a database file, store the type of the file in *type.
    The number encoded in the filename is stored in *num. If the
    filename was successfully parsed, returns true. Else return false. */
@@ -20,14 +20,27 @@ typedef enum ldb_rectype {
   /* For fragments. */
   LDB_TYPE_FIRST = 2,
   LDB_TYPE_MIDDLE = 3,
-  LDB_TYPE_LAST = 4
+  LDB_TYPE_LAST = 4,
+  /* For recycled log files. */
+  LDB_TYPE_RECYCLABLE_FULL = 5,
+  LDB_TYPE_RECYCLABLE_FIRST = 6,
+  LDB_TYPE_RECYCLABLE_MIDDLE = 7,
+  LDB_TYPE_RECYCLABLE_LAST = 8
 } ldb_rectype_t;
 
-#define LDB_MAX_RECTYPE LDB_TYPE_LAST
+#define LDB_MAX_RECTYPE LDB_TYPE_RECYCLABLE_LAST
+
+/* Offset from a legacy type to its recyclable counterpart. */
+#define LDB_RECYCLABLE_DELTA (LDB_TYPE_RECYCLABLE_FULL - LDB_TYPE_FULL)
 
 #define LDB_BLOCK_SIZE 32768
 
 /* Header is checksum (4 bytes), length (2 bytes), type (1 byte). */
 #define LDB_HEADER_SIZE (4 + 2 + 1)
 
+/* Recyclable header is checksum (4 bytes), length (2 bytes), type (1 byte),
+   log number (4 bytes). The log number lets a reader tell the records of
+   a recycled file apart from those left over from its previous life. */
+#define LDB_RECYCLABLE_HEADER_SIZE (LDB_HEADER_SIZE + 4)
+
 #endif /* LDB_LOG_FORMAT_H */
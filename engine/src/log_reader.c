@@ -42,7 +42,11 @@ enum {
    * - The record is a 0-length record (No drop is reported)
    * - The record is below constructor's initial_offset (No drop is reported)
    */
-  LDB_BAD_RECORD = LDB_MAX_RECTYPE + 2
+  LDB_BAD_RECORD = LDB_MAX_RECTYPE + 2,
+
+  /* Returned when we find a record written before the file was
+     recycled (or anything invalid after a recyclable record). */
+  LDB_OLD_RECORD = LDB_MAX_RECTYPE + 3
 };
 
 /*
@@ -67,6 +71,9 @@ ldb_reader_init(ldb_reader_t *lr,
   lr->end_offset = 0;
   lr->initial_offset = initial_offset;
   lr->resyncing = (initial_offset > 0);
+  lr->has_log_number = 0;
+  lr->log_number = 0;
+  lr->recycled = 0;
 }
 
 void
@@ -74,6 +81,12 @@ ldb_reader_clear(ldb_reader_t *lr) {
   ldb_free(lr->backing_store);
 }
 
+void
+ldb_reader_set_log_number(ldb_reader_t *lr, uint64_t log_number) {
+  lr->has_log_number = 1;
+  lr->log_number = (uint32_t)log_number;
+}
+
 /* Reports dropped bytes to the reporter. */
 /* buffer must be updated to remove the dropped bytes prior to invocation. */
 static void
@@ -92,7 +105,8 @@ report_corruption(ldb_reader_t *lr, uint64_t bytes, const char *reason) {
 
 /* Return type, or one of the preceding special values. */
 static unsigned int
-read_physical_record(ldb_reader_t *lr, ldb_slice_t *result) {
+read_physical_record(ldb_reader_t *lr, ldb_slice_t *result, size_t *hsize) {
+  size_t header_size = LDB_HEADER_SIZE;
   const uint8_t *header;
   uint32_t a, b, length;
   unsigned int type;
@@ -156,11 +170,44 @@ read_physical_record(ldb_reader_t *lr, ldb_slice_t *result) {
     type = header[6];
     length = a | (b << 8);
 
-    if (LDB_HEADER_SIZE + length > lr->buffer.size) {
+    if (type >= LDB_TYPE_RECYCLABLE_FULL && type <= LDB_TYPE_RECYCLABLE_LAST) {
+      header_size = LDB_RECYCLABLE_HEADER_SIZE;
+
+      if (lr->buffer.size < header_size) {
+        size_t drop_size = lr->buffer.size;
+
+        ldb_slice_reset(&lr->buffer);
+
+        if (!lr->eof && !lr->recycled) {
+          report_corruption(lr, drop_size, "bad record header");
+          return LDB_BAD_RECORD;
+        }
+
+        return LDB_EOF;
+      }
+
+      if (!lr->has_log_number)
+        ldb_reader_set_log_number(lr, ldb_fixed32_decode(header + 7));
+
+      if (ldb_fixed32_decode(header + 7) != lr->log_number) {
+        ldb_slice_reset(&lr->buffer);
+        return LDB_OLD_RECORD;
+      }
+    } else if (lr->recycled && type != LDB_TYPE_ZERO) {
+      /* The writer of a recycled file never goes back to the
+         legacy format. This is stale data. */
+      ldb_slice_reset(&lr->buffer);
+      return LDB_OLD_RECORD;
+    }
+
+    if (header_size + length > lr->buffer.size) {
       size_t drop_size = lr->buffer.size;
 
       ldb_slice_reset(&lr->buffer);
 
+      if (lr->recycled)
+        return LDB_OLD_RECORD;
+
       if (!lr->eof) {
         report_corruption(lr, drop_size, "bad record length");
         return LDB_BAD_RECORD;
@@ -184,7 +231,8 @@ read_physical_record(ldb_reader_t *lr, ldb_slice_t *result) {
     /* Check crc. */
     if (lr->checksum) {
       uint32_t expect = ldb_crc32c_unmask(ldb_fixed32_decode(header));
-      uint32_t actual = ldb_crc32c_value(header + 6, 1 + length);
+      uint32_t actual = ldb_crc32c_value(header + 6,
+                                         header_size - 6 + length);
 
       if (actual != expect) {
         /* Drop the rest of the buffer since "length" itself may have
@@ -195,22 +243,33 @@ read_physical_record(ldb_reader_t *lr, ldb_slice_t *result) {
 
         ldb_slice_reset(&lr->buffer);
 
+        /* Likely a record torn by overwriting a recycled file. */
+        if (lr->recycled)
+          return LDB_OLD_RECORD;
+
         report_corruption(lr, drop_size, "checksum mismatch");
 
         return LDB_BAD_RECORD;
       }
     }
 
-    ldb_slice_eat(&lr->buffer, LDB_HEADER_SIZE + length);
+    ldb_slice_eat(&lr->buffer, header_size + length);
+
+    *hsize = header_size;
 
     /* Skip physical record that started before initial_offset. */
-    if (lr->end_offset - lr->buffer.size - LDB_HEADER_SIZE - length <
+    if (lr->end_offset - lr->buffer.size - header_size - length <
         lr->initial_offset) {
       ldb_slice_reset(result);
       return LDB_BAD_RECORD;
     }
 
-    ldb_slice_set(result, header + LDB_HEADER_SIZE, length);
+    ldb_slice_set(result, header + header_size, length);
+
+    if (header_size == LDB_RECYCLABLE_HEADER_SIZE) {
+      lr->recycled = 1;
+      type -= LDB_RECYCLABLE_DELTA;
+    }
 
     return type;
   }
@@ -263,6 +322,7 @@ ldb_reader_read_record(ldb_reader_t *lr,
      0 is a dummy value to make compilers happy. */
   uint64_t prospective_offset = 0;
   int in_fragmented_record = 0;
+  size_t header_size;
   ldb_slice_t fragment;
 
   if (lr->last_offset < lr->initial_offset) {
@@ -274,15 +334,19 @@ ldb_reader_read_record(ldb_reader_t *lr,
   ldb_buffer_reset(scratch);
 
   for (;;) {
-    unsigned int record_type = read_physical_record(lr, &fragment);
+    unsigned int record_type;
+    uint64_t physical_offset;
+
+    header_size = LDB_HEADER_SIZE;
+    record_type = read_physical_record(lr, &fragment, &header_size);
 
     /* read_physical_record may have only had an empty trailer remaining in its
        internal buffer. Calculate the offset of the next physical record now
        that it has returned, properly accounting for its header size. */
-    uint64_t physical_offset = (lr->end_offset -
-                                lr->buffer.size -
-                                LDB_HEADER_SIZE -
-                                fragment.size);
+    physical_offset = (lr->end_offset -
+                       lr->buffer.size -
+                       header_size -
+                       fragment.size);
 
     if (lr->resyncing) {
       if (record_type == LDB_TYPE_MIDDLE)
@@ -369,7 +433,8 @@ ldb_reader_read_record(ldb_reader_t *lr,
         break;
       }
 
-      case LDB_EOF: {
+      case LDB_EOF:
+      case LDB_OLD_RECORD: {
         if (in_fragmented_record) {
           /* This can be caused by the writer dying immediately after
              writing a physical record but before completing the next; don't
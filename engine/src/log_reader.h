@@ -62,6 +62,16 @@ typedef struct ldb_reader_s {
      particular, a run of LDB_TYPE_MIDDLE and LDB_TYPE_LAST records can
      be silently skipped in this mode. */
   int resyncing;
+
+  /* Log number expected in recyclable records. If not set by the
+     caller, it is taken from the first recyclable record. */
+  int has_log_number;
+  uint32_t log_number;
+
+  /* True once a recyclable record has been read. From then on, any
+     record which fails to validate is assumed to be left over from
+     the file's previous life and marks the end of the log. */
+  int recycled;
 } ldb_reader_t;
 
 /*
@@ -90,6 +100,10 @@ ldb_reader_init(ldb_reader_t *lr,
 void
 ldb_reader_clear(ldb_reader_t *lr);
 
+/* Only accept recyclable records tagged with "log_number". */
+void
+ldb_reader_set_log_number(ldb_reader_t *lr, uint64_t log_number);
+
 /* Read the next record into *record. Returns true if read
  * successfully, false if we hit end of the input. May use
  * "*scratch" as temporary storage. The contents filled in *record
@@ -54,39 +54,58 @@ ldb_writer_init(ldb_writer_t *lw, ldb_wfile_t *file, uint64_t length) {
   lw->file = file;
   lw->dst = NULL; /* For testing. */
   lw->block_offset = length % LDB_BLOCK_SIZE;
+  lw->header_size = LDB_HEADER_SIZE;
+  lw->log_number = 0;
   init_type_crc(lw->type_crc);
 }
 
+void
+ldb_writer_set_log_number(ldb_writer_t *lw, uint64_t log_number) {
+  lw->header_size = LDB_RECYCLABLE_HEADER_SIZE;
+  lw->log_number = (uint32_t)log_number;
+}
+
 static int
 emit_physical_record(ldb_writer_t *lw,
                      ldb_rectype_t type,
                      const uint8_t *ptr,
                      size_t length) {
-  uint8_t buf[LDB_HEADER_SIZE];
+  uint8_t buf[LDB_RECYCLABLE_HEADER_SIZE];
+  int header_size = lw->header_size;
   ldb_slice_t data;
   int rc = LDB_OK;
   uint32_t crc;
 
   assert(length <= 0xffff); /* Must fit in two bytes. */
-  assert(lw->block_offset + LDB_HEADER_SIZE + length <= LDB_BLOCK_SIZE);
+  assert(lw->block_offset + header_size + length <= LDB_BLOCK_SIZE);
+
+  if (header_size == LDB_RECYCLABLE_HEADER_SIZE)
+    type = (ldb_rectype_t)(type + LDB_RECYCLABLE_DELTA);
 
   /* Format the header. */
   buf[4] = (uint8_t)(length & 0xff);
   buf[5] = (uint8_t)(length >> 8);
   buf[6] = (uint8_t)(type);
 
-  /* Compute the crc of the record type and the payload. */
-  crc = ldb_crc32c_extend(lw->type_crc[type], ptr, length);
+  /* Compute the crc of the record type, the log number and the payload. */
+  crc = lw->type_crc[type];
+
+  if (header_size == LDB_RECYCLABLE_HEADER_SIZE) {
+    ldb_fixed32_write(buf + 7, lw->log_number);
+    crc = ldb_crc32c_extend(crc, buf + 7, 4);
+  }
+
+  crc = ldb_crc32c_extend(crc, ptr, length);
   crc = ldb_crc32c_mask(crc); /* Adjust for storage. */
 
   ldb_fixed32_write(buf, crc);
 
   if (lw->dst != NULL) {
-    ldb_buffer_append(lw->dst, buf, LDB_HEADER_SIZE);
+    ldb_buffer_append(lw->dst, buf, header_size);
     ldb_buffer_append(lw->dst, ptr, length);
   } else {
     /* Write the header and the payload. */
-    ldb_slice_set(&data, buf, LDB_HEADER_SIZE);
+    ldb_slice_set(&data, buf, header_size);
 
     rc = ldb_wfile_append(lw->file, &data);
 
@@ -100,14 +119,14 @@ emit_physical_record(ldb_writer_t *lw,
     }
   }
 
-  lw->block_offset += LDB_HEADER_SIZE + length;
+  lw->block_offset += header_size + length;
 
   return rc;
 }
 
 int
 ldb_writer_add_record(ldb_writer_t *lw, const ldb_slice_t *slice) {
-  static const uint8_t zeroes[LDB_HEADER_SIZE] = {0};
+  static const uint8_t zeroes[LDB_RECYCLABLE_HEADER_SIZE] = {0};
   const uint8_t *ptr = slice->data;
   size_t left = slice->size;
   int rc = LDB_OK;
@@ -124,7 +143,7 @@ ldb_writer_add_record(ldb_writer_t *lw, const ldb_slice_t *slice) {
 
     assert(leftover >= 0);
 
-    if (leftover < LDB_HEADER_SIZE) {
+    if (leftover < lw->header_size) {
       /* Switch to a new block. */
       if (leftover > 0) {
         /* Fill the trailer. */
@@ -141,10 +160,10 @@ ldb_writer_add_record(ldb_writer_t *lw, const ldb_slice_t *slice) {
       lw->block_offset = 0;
     }
 
-    /* Invariant: we never leave < LDB_HEADER_SIZE bytes in a block. */
-    assert(LDB_BLOCK_SIZE - lw->block_offset - LDB_HEADER_SIZE >= 0);
+    /* Invariant: we never leave < header_size bytes in a block. */
+    assert(LDB_BLOCK_SIZE - lw->block_offset - lw->header_size >= 0);
 
-    avail = LDB_BLOCK_SIZE - lw->block_offset - LDB_HEADER_SIZE;
+    avail = LDB_BLOCK_SIZE - lw->block_offset - lw->header_size;
     fragment_length = (left < avail) ? left : avail;
     end = (left == fragment_length);
 
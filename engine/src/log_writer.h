@@ -28,6 +28,8 @@ typedef struct ldb_writer_s {
   struct ldb_wfile_s *file;
   ldb_buffer_t *dst; /* For testing. */
   int block_offset; /* Current offset in block. */
+  int header_size; /* Size of each record header. */
+  uint32_t log_number; /* For the recyclable format. */
 
   /* crc32c values for all supported record types. These are
      pre-computed to reduce the overhead of computing the crc of the
@@ -54,6 +56,13 @@ ldb_writer_init(ldb_writer_t *lw,
                 struct ldb_wfile_s *file,
                 uint64_t length);
 
+/* Write the recyclable record format from now on, tagging each
+ * record with "log_number". Required when "*file" may contain
+ * stale records from a previous log.
+ */
+void
+ldb_writer_set_log_number(ldb_writer_t *lw, uint64_t log_number);
+
 int
 ldb_writer_add_record(ldb_writer_t *lw, const ldb_slice_t *slice);
 
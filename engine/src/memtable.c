@@ -13,69 +13,363 @@
 #include <assert.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "table/iterator.h"
+#include "table/merger.h"
 
 #include "util/arena.h"
 #include "util/atomic.h"
 #include "util/buffer.h"
 #include "util/coding.h"
 #include "util/comparator.h"
+#include "util/hash.h"
 #include "util/internal.h"
+#include "util/options.h"
 #include "util/port.h"
 #include "util/slice.h"
 #include "util/status.h"
+#include "util/vector.h"
 
 #include "dbformat.h"
 #include "memtable.h"
+#include "merge.h"
+#include "range_del.h"
 #include "skiplist.h"
 
+/*
+ * Types
+ */
+
+/* Append-only array of entries, sorted when first read. */
+typedef struct ldb_memvec_s {
+  const uint8_t **items;
+  size_t length;
+  size_t alloc;
+  size_t sorted; /* items[0, sorted) are in order. */
+  ldb_atomic(size_t) usage;
+} ldb_memvec_t;
+
+/* Every iterator over a hash memtable merges one child iterator per
+   non-empty bucket, so the bucket count is kept small. */
+#define LDB_MEMHASH_MAX_BUCKETS 1024
+
+/* Skiplists bucketed by a hash of the user key prefix. */
+typedef struct ldb_memhash_s {
+#ifdef LDB_HAVE_ATOMICS
+  ldb_atomic_ptr(ldb_skiplist_t) *buckets;
+#else
+  ldb_skiplist_t **buckets;
+#endif
+  uint32_t mask;
+  size_t prefix;
+} ldb_memhash_t;
+
 /*
  * MemTable
  */
 
 struct ldb_memtable_s {
   ldb_comparator_t comparator;
+  enum ldb_memtable type;
   int refs;
   ldb_arena_t arena;
-#ifndef LDB_HAVE_ATOMICS
+  /* Guards the vector, or the skiplists without atomics. */
   ldb_mutex_t mutex;
-#endif
-  ldb_skiplist_t table;
+  ldb_skiplist_t table; /* LDB_SKIPLIST_MEMTABLE */
+  ldb_memvec_t vec; /* LDB_VECTOR_MEMTABLE */
+  ldb_memhash_t hash; /* LDB_HASH_MEMTABLE */
+  /* Range tombstones, kept apart from the point entries. */
+  ldb_skiplist_t ranges;
+  ldb_atomic(size_t) tombstones;
 };
 
+static int
+ldb_memtable_compare(const ldb_memtable_t *mt,
+                     const uint8_t *xp,
+                     const uint8_t *yp) {
+  ldb_slice_t x = ldb_slice_decode(xp);
+  ldb_slice_t y = ldb_slice_decode(yp);
+  return ldb_compare(&mt->comparator, &x, &y);
+}
+
 static void
-ldb_memtable_init(ldb_memtable_t *mt, const ldb_comparator_t *comparator) {
-  assert(comparator->user_comparator != NULL);
+ldb_memtable_skiplist(ldb_memtable_t *mt, ldb_skiplist_t *list) {
+#ifdef LDB_HAVE_ATOMICS
+  ldb_skiplist_init(list, &mt->comparator, &mt->arena, NULL);
+#else
+  ldb_skiplist_init(list, &mt->comparator, &mt->arena, &mt->mutex);
+#endif
+}
 
-  mt->comparator = *comparator;
-  mt->refs = 0;
+/*
+ * Vector
+ */
+
+static void
+ldb_memvec_init(ldb_memvec_t *vec) {
+  vec->items = NULL;
+  vec->length = 0;
+  vec->alloc = 0;
+  vec->sorted = 0;
+
+  ldb_atomic_init(&vec->usage, 0);
+}
+
+static void
+ldb_memvec_clear(ldb_memvec_t *vec) {
+  if (vec->items != NULL)
+    ldb_free((void *)vec->items);
+}
+
+static void
+ldb_memvec_push(ldb_memtable_t *mt, const uint8_t *entry) {
+  ldb_memvec_t *vec = &mt->vec;
 
-  ldb_arena_init(&mt->arena);
+  ldb_mutex_lock(&mt->mutex);
+
+  if (vec->length == vec->alloc) {
+    size_t alloc = vec->alloc == 0 ? 1024 : vec->alloc * 2;
+
+    vec->items = ldb_realloc((void *)vec->items, alloc * sizeof(uint8_t *));
+    vec->alloc = alloc;
+
+    ldb_atomic_store(&vec->usage, alloc * sizeof(uint8_t *),
+                     ldb_order_relaxed);
+  }
+
+  vec->items[vec->length++] = entry;
+
+  ldb_mutex_unlock(&mt->mutex);
+}
+
+static void
+ldb_memvec_merge(const ldb_memtable_t *mt,
+                 const uint8_t **items,
+                 const uint8_t **tmp,
+                 size_t lo,
+                 size_t mid,
+                 size_t hi) {
+  size_t i = lo;
+  size_t j = mid;
+  size_t k = lo;
+
+  /* Bulk loads are often already in order. */
+  if (ldb_memtable_compare(mt, items[mid - 1], items[mid]) <= 0)
+    return;
+
+  memcpy(tmp + lo, items + lo, (hi - lo) * sizeof(uint8_t *));
+
+  while (i < mid && j < hi) {
+    if (ldb_memtable_compare(mt, tmp[j], tmp[i]) < 0)
+      items[k++] = tmp[j++];
+    else
+      items[k++] = tmp[i++];
+  }
+
+  while (i < mid)
+    items[k++] = tmp[i++];
+
+  while (j < hi)
+    items[k++] = tmp[j++];
+}
+
+static void
+ldb_memvec_sort(const ldb_memtable_t *mt,
+                const uint8_t **items,
+                const uint8_t **tmp,
+                size_t lo,
+                size_t hi) {
+  size_t mid;
+
+  if (hi - lo < 2)
+    return;
+
+  mid = lo + (hi - lo) / 2;
+
+  ldb_memvec_sort(mt, items, tmp, lo, mid);
+  ldb_memvec_sort(mt, items, tmp, mid, hi);
+  ldb_memvec_merge(mt, items, tmp, lo, mid, hi);
+}
+
+/* Sort everything appended since the last read into place. */
+static void
+ldb_memvec_order(ldb_memtable_t *mt) {
+  ldb_memvec_t *vec = &mt->vec;
+  const uint8_t **tmp;
+
+  ldb_mutex_assert_held(&mt->mutex);
+
+  if (vec->sorted == vec->length)
+    return;
+
+  tmp = ldb_malloc(vec->length * sizeof(uint8_t *));
+
+  ldb_memvec_sort(mt, vec->items, tmp, vec->sorted, vec->length);
+
+  if (vec->sorted > 0)
+    ldb_memvec_merge(mt, vec->items, tmp, 0, vec->sorted, vec->length);
+
+  vec->sorted = vec->length;
+
+  ldb_free((void *)tmp);
+}
+
+/* Index of the first entry >= target. */
+static size_t
+ldb_memvec_search(const ldb_memtable_t *mt,
+                  const uint8_t **items,
+                  size_t length,
+                  const ldb_slice_t *target) {
+  size_t lo = 0;
+  size_t hi = length;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    ldb_slice_t key = ldb_slice_decode(items[mid]);
+
+    if (ldb_compare(&mt->comparator, &key, target) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+/*
+ * Hash
+ */
 
+static void
+ldb_memhash_init(ldb_memtable_t *mt, const ldb_dbopt_t *options) {
+  ldb_memhash_t *hash = &mt->hash;
+  size_t target = options->write_buffer_size >> 10;
+  size_t count = 256;
+  size_t i;
+
+  /* Aim for one bucket per kilobyte of write buffer. */
+  while (count < target && count < LDB_MEMHASH_MAX_BUCKETS)
+    count <<= 1;
+
+  hash->buckets = ldb_arena_alloc_aligned(&mt->arena,
+                                          count * sizeof(*hash->buckets));
+  hash->mask = count - 1;
+  hash->prefix = options->memtable_prefix;
+
+  for (i = 0; i < count; i++) {
 #ifdef LDB_HAVE_ATOMICS
-  ldb_skiplist_init(&mt->table, &mt->comparator, &mt->arena, NULL);
+    ldb_atomic_init_ptr(&hash->buckets[i], NULL);
 #else
-  ldb_mutex_init(&mt->mutex);
-  ldb_skiplist_init(&mt->table, &mt->comparator, &mt->arena, &mt->mutex);
+    hash->buckets[i] = NULL;
+#endif
+  }
+}
+
+static uint32_t
+ldb_memhash_index(const ldb_memtable_t *mt, const ldb_slice_t *ukey) {
+  const ldb_memhash_t *hash = &mt->hash;
+  size_t size = ukey->size;
+
+  if (hash->prefix > 0 && hash->prefix < size)
+    size = hash->prefix;
+
+  return ldb_hash(ukey->data, size, 0) & hash->mask;
+}
+
+static ldb_skiplist_t *
+ldb_memhash_get(const ldb_memtable_t *mt, uint32_t index) {
+#ifdef LDB_HAVE_ATOMICS
+  /* Acquire so that we observe a fully initialized skiplist. */
+  return ldb_atomic_load_ptr(&mt->hash.buckets[index], ldb_order_acquire);
+#else
+  ldb_skiplist_t *list;
+
+  ldb_mutex_lock((ldb_mutex_t *)&mt->mutex);
+
+  list = mt->hash.buckets[index];
+
+  ldb_mutex_unlock((ldb_mutex_t *)&mt->mutex);
+
+  return list;
 #endif
 }
 
+/* Only called by the writer. */
+static ldb_skiplist_t *
+ldb_memhash_bucket(ldb_memtable_t *mt, const ldb_slice_t *ukey) {
+  uint32_t index = ldb_memhash_index(mt, ukey);
+  ldb_skiplist_t *list = ldb_memhash_get(mt, index);
+
+  if (list == NULL) {
+    list = ldb_arena_alloc_aligned(&mt->arena, sizeof(ldb_skiplist_t));
+
+    ldb_memtable_skiplist(mt, list);
+
+#ifdef LDB_HAVE_ATOMICS
+    ldb_atomic_store_ptr(&mt->hash.buckets[index], list, ldb_order_release);
+#else
+    ldb_mutex_lock(&mt->mutex);
+    mt->hash.buckets[index] = list;
+    ldb_mutex_unlock(&mt->mutex);
+#endif
+  }
+
+  return list;
+}
+
+/*
+ * MemTable
+ */
+
+static void
+ldb_memtable_init(ldb_memtable_t *mt,
+                  const ldb_comparator_t *comparator,
+                  const ldb_dbopt_t *options) {
+  assert(comparator->user_comparator != NULL);
+
+  if (options == NULL)
+    options = ldb_dbopt_default;
+
+  mt->comparator = *comparator;
+  mt->type = options->memtable_type;
+  mt->refs = 0;
+
+  ldb_arena_init(&mt->arena,
+                 options->arena_block_size,
+                 options->memtable_huge_pages);
+  ldb_mutex_init(&mt->mutex);
+  ldb_memvec_init(&mt->vec);
+  ldb_memtable_skiplist(mt, &mt->ranges);
+  ldb_atomic_init(&mt->tombstones, 0);
+
+  switch (mt->type) {
+    case LDB_VECTOR_MEMTABLE:
+      break;
+    case LDB_HASH_MEMTABLE:
+      ldb_memhash_init(mt, options);
+      break;
+    default:
+      mt->type = LDB_SKIPLIST_MEMTABLE;
+      ldb_memtable_skiplist(mt, &mt->table);
+      break;
+  }
+}
+
 static void
 ldb_memtable_clear(ldb_memtable_t *mt) {
   assert(mt->refs == 0);
 
-#ifndef LDB_HAVE_ATOMICS
+  ldb_memvec_clear(&mt->vec);
   ldb_mutex_destroy(&mt->mutex);
-#endif
-
   ldb_arena_clear(&mt->arena);
 }
 
 ldb_memtable_t *
-ldb_memtable_create(const ldb_comparator_t *comparator) {
+ldb_memtable_create(const ldb_comparator_t *comparator,
+                    const ldb_dbopt_t *options) {
   ldb_memtable_t *mt = ldb_malloc(sizeof(ldb_memtable_t));
-  ldb_memtable_init(mt, comparator);
+  ldb_memtable_init(mt, comparator, options);
   return mt;
 }
 
@@ -102,7 +396,8 @@ ldb_memtable_unref(ldb_memtable_t *mt) {
 
 size_t
 ldb_memtable_usage(const ldb_memtable_t *mt) {
-  return ldb_arena_usage(&mt->arena);
+  return ldb_arena_usage(&mt->arena)
+       + ldb_atomic_load(&mt->vec.usage, ldb_order_relaxed);
 }
 
 void
@@ -139,63 +434,256 @@ ldb_memtable_add(ldb_memtable_t *mt,
 
   assert(zp == tp + zn);
 
-  ldb_skiplist_insert(&mt->table, tp);
+  if (type == LDB_TYPE_RANGE_DELETION) {
+    ldb_skiplist_insert(&mt->ranges, tp);
+    ldb_atomic_fetch_add(&mt->tombstones, 1, ldb_order_release);
+    return;
+  }
+
+  switch (mt->type) {
+    case LDB_VECTOR_MEMTABLE:
+      ldb_memvec_push(mt, tp);
+      break;
+    case LDB_HASH_MEMTABLE:
+      ldb_skiplist_insert(ldb_memhash_bucket(mt, key), tp);
+      break;
+    default:
+      ldb_skiplist_insert(&mt->table, tp);
+      break;
+  }
+}
+
+/* Call func on each entry from the first entry >= key onward, until
+   it returns false. */
+static void
+ldb_memtable_scan(ldb_memtable_t *mt,
+                  const ldb_lkey_t *key,
+                  int (*func)(void *, const uint8_t *),
+                  void *arg) {
+  ldb_slice_t mkey = ldb_lkey_memtable_key(key);
+  const ldb_skiplist_t *list = &mt->table;
+  ldb_skipiter_t iter;
+
+  switch (mt->type) {
+    case LDB_VECTOR_MEMTABLE: {
+      ldb_slice_t ikey = ldb_lkey_internal_key(key);
+      size_t index;
+
+      ldb_mutex_lock(&mt->mutex);
+
+      ldb_memvec_order(mt);
+
+      index = ldb_memvec_search(mt, mt->vec.items, mt->vec.length, &ikey);
+
+      while (index < mt->vec.length) {
+        if (!func(arg, mt->vec.items[index++]))
+          break;
+      }
+
+      ldb_mutex_unlock(&mt->mutex);
+
+      return;
+    }
+
+    case LDB_HASH_MEMTABLE: {
+      ldb_slice_t ukey = ldb_lkey_user_key(key);
+
+      list = ldb_memhash_get(mt, ldb_memhash_index(mt, &ukey));
+
+      if (list == NULL)
+        return;
+
+      break;
+    }
+
+    default: {
+      break;
+    }
+  }
+
+  ldb_skipiter_init(&iter, list);
+  ldb_skipiter_seek(&iter, mkey.data);
+
+  while (ldb_skipiter_valid(&iter)) {
+    if (!func(arg, ldb_skipiter_key(&iter)))
+      break;
+
+    ldb_skipiter_next(&iter);
+  }
+}
+
+/* Return the newest tombstone visible to the lookup which covers
+   its user key, or zero. The list is expected to be short, and is
+   scanned up to the key. */
+static ldb_seqnum_t
+ldb_memtable_covering(ldb_memtable_t *mt, const ldb_lkey_t *key) {
+  const ldb_comparator_t *cmp = mt->comparator.user_comparator;
+  ldb_slice_t ukey = ldb_lkey_user_key(key);
+  ldb_seqnum_t snapshot = ldb_fixed64_decode(key->end - 8) >> 8;
+  ldb_seqnum_t cover = 0;
+  ldb_skipiter_t iter;
+
+  if (ldb_atomic_load(&mt->tombstones, ldb_order_acquire) == 0)
+    return 0;
+
+  ldb_skipiter_init(&iter, &mt->ranges);
+
+  for (ldb_skipiter_first(&iter);
+       ldb_skipiter_valid(&iter);
+       ldb_skipiter_next(&iter)) {
+    ldb_slice_t start = ldb_slice_decode(ldb_skipiter_key(&iter));
+    ldb_slice_t limit = ldb_slice_decode(start.data + start.size);
+    ldb_seqnum_t seq;
+
+    start.size -= 8;
+
+    if (ldb_compare(cmp, &start, &ukey) > 0)
+      break;
+
+    seq = ldb_fixed64_decode(start.data + start.size) >> 8;
+
+    if (seq <= snapshot && seq > cover && ldb_compare(cmp, &ukey, &limit) < 0)
+      cover = seq;
+  }
+
+  return cover;
+}
+
+/* State for ldb_memtable_get(). */
+typedef struct ldb_memget_s {
+  const ldb_comparator_t *ucmp;
+  ldb_slice_t user_key;
+  ldb_seqnum_t cover;
+  ldb_buffer_t *value;
+  ldb_slice_t *pinned;
+  ldb_operands_t *operands;
+  int status;
+  int found;
+} ldb_memget_t;
+
+static int
+ldb_memget_entry(void *arg, const uint8_t *entry) {
+  /* Entry format is:
+   *
+   *    klength  varint32
+   *    userkey  char[klength]
+   *    tag      uint64
+   *    vlength  varint32
+   *    value    char[vlength]
+   *
+   * Check that it belongs to same user key. We do not check the
+   * sequence number since the seek() call above should have skipped
+   * all entries with overly large sequence numbers.
+   */
+  ldb_memget_t *state = arg;
+  ldb_slice_t okey = ldb_slice_decode(entry);
+  ldb_slice_t value;
+  uint64_t tag;
+
+  assert(okey.size >= 8);
+
+  okey.size -= 8;
+
+  if (ldb_compare(state->ucmp, &okey, &state->user_key) != 0)
+    return 0;
+
+  /* Correct user key. */
+  tag = ldb_fixed64_decode(okey.data + okey.size);
+  value = ldb_slice_decode(okey.data + okey.size + 8);
+
+  if ((tag >> 8) < state->cover) {
+    state->status = LDB_NOTFOUND;
+    state->found = 1;
+    return 0;
+  }
+
+  switch ((ldb_valtype_t)(tag & 0xff)) {
+    case LDB_TYPE_VALUE: {
+      if (state->pinned != NULL)
+        *state->pinned = value;
+      else if (state->value != NULL)
+        ldb_buffer_copy(state->value, &value);
+
+      state->found = 1;
+
+      return 0;
+    }
+
+    case LDB_TYPE_DELETION: {
+      state->status = LDB_NOTFOUND;
+      state->found = 1;
+      return 0;
+    }
+
+    case LDB_TYPE_MERGE: {
+      /* Keep looking for the value beneath. */
+      ldb_operands_push(state->operands, &value);
+      return 1;
+    }
+
+    case LDB_TYPE_RANGE_DELETION: {
+      /* Kept in a separate list. */
+      break;
+    }
+
+    case LDB_TYPE_BLOB: {
+      /* Only written to tables. */
+      break;
+    }
+  }
+
+  return 1;
 }
 
 int
 ldb_memtable_get(ldb_memtable_t *mt,
                  const ldb_lkey_t *key,
                  ldb_buffer_t *value,
+                 ldb_slice_t *pinned,
+                 ldb_operands_t *operands,
                  int *status) {
-  ldb_slice_t mkey = ldb_lkey_memtable_key(key);
+  ldb_memget_t state;
+
+  state.ucmp = mt->comparator.user_comparator;
+  state.user_key = ldb_lkey_user_key(key);
+  state.cover = ldb_memtable_covering(mt, key);
+  state.value = value;
+  state.pinned = pinned;
+  state.operands = operands;
+  state.status = LDB_OK;
+  state.found = 0;
+
+  ldb_memtable_scan(mt, key, ldb_memget_entry, &state);
+
+  /* A tombstone here hides everything in the older layers. */
+  if (!state.found && state.cover > 0) {
+    state.status = LDB_NOTFOUND;
+    state.found = 1;
+  }
+
+  if (state.found)
+    *status = state.status;
+
+  return state.found;
+}
+
+void
+ldb_memtable_tombstones(ldb_memtable_t *mt, ldb_rangedel_t *rd) {
   ldb_skipiter_t iter;
 
-  ldb_skipiter_init(&iter, &mt->table);
-  ldb_skipiter_seek(&iter, mkey.data);
+  if (ldb_atomic_load(&mt->tombstones, ldb_order_acquire) == 0)
+    return;
 
-  if (ldb_skipiter_valid(&iter)) {
-    /* Entry format is:
-     *
-     *    klength  varint32
-     *    userkey  char[klength]
-     *    tag      uint64
-     *    vlength  varint32
-     *    value    char[vlength]
-     *
-     * Check that it belongs to same user key. We do not check the
-     * sequence number since the seek() call above should have skipped
-     * all entries with overly large sequence numbers.
-     */
-    const ldb_comparator_t *cmp = mt->comparator.user_comparator;
-    ldb_slice_t okey = ldb_slice_decode(ldb_skipiter_key(&iter));
-    ldb_slice_t ukey = ldb_lkey_user_key(key);
-
-    assert(okey.size >= 8);
-
-    okey.size -= 8;
-
-    if (ldb_compare(cmp, &okey, &ukey) == 0) {
-      /* Correct user key. */
-      uint64_t tag = ldb_fixed64_decode(okey.data + okey.size);
-
-      switch ((ldb_valtype_t)(tag & 0xff)) {
-        case LDB_TYPE_VALUE: {
-          if (value != NULL) {
-            ldb_slice_t val = ldb_slice_decode(okey.data + okey.size + 8);
-            ldb_buffer_copy(value, &val);
-          }
-          return 1;
-        }
-
-        case LDB_TYPE_DELETION: {
-          *status = LDB_NOTFOUND;
-          return 1;
-        }
-      }
-    }
-  }
+  ldb_skipiter_init(&iter, &mt->ranges);
 
-  return 0;
+  for (ldb_skipiter_first(&iter);
+       ldb_skipiter_valid(&iter);
+       ldb_skipiter_next(&iter)) {
+    ldb_slice_t key = ldb_slice_decode(ldb_skipiter_key(&iter));
+    ldb_slice_t limit = ldb_slice_decode(key.data + key.size);
+
+    ldb_rangedel_add_entry(rd, &key, &limit);
+  }
 }
 
 /*
@@ -272,11 +760,147 @@ ldb_memiter_status(const ldb_memiter_t *iter) {
 
 LDB_ITERATOR_FUNCTIONS(ldb_memiter);
 
-ldb_iter_t *
-ldb_memiter_create(const ldb_memtable_t *mt) {
+static ldb_iter_t *
+ldb_skiplist_iterator(const ldb_memtable_t *mt, const ldb_skiplist_t *list) {
   ldb_memiter_t *iter = ldb_malloc(sizeof(ldb_memiter_t));
 
-  ldb_memiter_init(iter, &mt->table);
+  ldb_memiter_init(iter, list);
 
   return ldb_iter_create(iter, &ldb_memiter_table, &mt->comparator);
 }
+
+/*
+ * MemTable Vector Iterator
+ */
+
+/* Iterates over a sorted copy of the vector, so that writes may
+   continue while the iterator is live. */
+typedef struct ldb_veciter_s {
+  const ldb_memtable_t *mt;
+  const uint8_t **items;
+  size_t length;
+  size_t index; /* Invalid if index == length. */
+} ldb_veciter_t;
+
+static void
+ldb_veciter_init(ldb_veciter_t *iter, ldb_memtable_t *mt) {
+  ldb_memvec_t *vec = &mt->vec;
+
+  ldb_mutex_lock(&mt->mutex);
+
+  ldb_memvec_order(mt);
+
+  iter->mt = mt;
+  iter->items = ldb_malloc((vec->length + 1) * sizeof(uint8_t *));
+  iter->length = vec->length;
+  iter->index = vec->length;
+
+  if (vec->length > 0)
+    memcpy(iter->items, vec->items, vec->length * sizeof(uint8_t *));
+
+  ldb_mutex_unlock(&mt->mutex);
+}
+
+static void
+ldb_veciter_clear(ldb_veciter_t *iter) {
+  ldb_free((void *)iter->items);
+}
+
+static int
+ldb_veciter_valid(const ldb_veciter_t *iter) {
+  return iter->index < iter->length;
+}
+
+static void
+ldb_veciter_seek(ldb_veciter_t *iter, const ldb_slice_t *key) {
+  iter->index = ldb_memvec_search(iter->mt, iter->items, iter->length, key);
+}
+
+static void
+ldb_veciter_first(ldb_veciter_t *iter) {
+  iter->index = 0;
+}
+
+static void
+ldb_veciter_last(ldb_veciter_t *iter) {
+  iter->index = iter->length > 0 ? iter->length - 1 : 0;
+}
+
+static void
+ldb_veciter_next(ldb_veciter_t *iter) {
+  assert(ldb_veciter_valid(iter));
+  iter->index++;
+}
+
+static void
+ldb_veciter_prev(ldb_veciter_t *iter) {
+  assert(ldb_veciter_valid(iter));
+
+  if (iter->index == 0)
+    iter->index = iter->length;
+  else
+    iter->index--;
+}
+
+static ldb_slice_t
+ldb_veciter_key(const ldb_veciter_t *iter) {
+  assert(ldb_veciter_valid(iter));
+  return ldb_slice_decode(iter->items[iter->index]);
+}
+
+static ldb_slice_t
+ldb_veciter_value(const ldb_veciter_t *iter) {
+  ldb_slice_t key = ldb_veciter_key(iter);
+  return ldb_slice_decode(key.data + key.size);
+}
+
+static int
+ldb_veciter_status(const ldb_veciter_t *iter) {
+  (void)iter;
+  return LDB_OK;
+}
+
+LDB_ITERATOR_FUNCTIONS(ldb_veciter);
+
+ldb_iter_t *
+ldb_memiter_create(const ldb_memtable_t *mt) {
+  switch (mt->type) {
+    case LDB_VECTOR_MEMTABLE: {
+      ldb_veciter_t *iter = ldb_malloc(sizeof(ldb_veciter_t));
+
+      /* Sorting does not change the contents. */
+      ldb_veciter_init(iter, (ldb_memtable_t *)mt);
+
+      return ldb_iter_create(iter, &ldb_veciter_table, &mt->comparator);
+    }
+
+    case LDB_HASH_MEMTABLE: {
+      /* Merge the buckets into a single ordered stream. Buckets
+         created after this point only hold newer entries. */
+      ldb_vector_t list;
+      ldb_iter_t *iter;
+      uint32_t i;
+
+      ldb_vector_init(&list);
+
+      for (i = 0; i <= mt->hash.mask; i++) {
+        ldb_skiplist_t *bucket = ldb_memhash_get(mt, i);
+
+        if (bucket != NULL)
+          ldb_vector_push(&list, ldb_skiplist_iterator(mt, bucket));
+      }
+
+      iter = ldb_mergeiter_create(&mt->comparator,
+                                  (ldb_iter_t **)list.items,
+                                  list.length);
+
+      ldb_vector_clear(&list);
+
+      return iter;
+    }
+
+    default: {
+      return ldb_skiplist_iterator(mt, &mt->table);
+    }
+  }
+}
@@ -20,8 +20,11 @@
  */
 
 struct ldb_comparator_s;
+struct ldb_dbopt_s;
 struct ldb_iter_s;
 struct ldb_lkey_s;
+struct ldb_operands_s;
+struct ldb_rangedel_s;
 
 typedef struct ldb_memtable_s ldb_memtable_t;
 
@@ -30,9 +33,13 @@ typedef struct ldb_memtable_s ldb_memtable_t;
  */
 
 /* MemTables are reference counted. The initial reference count
-   is zero and the caller must call ref() at least once. */
+   is zero and the caller must call ref() at least once.
+
+   The representation is chosen by options->memtable_type (a
+   skiplist if options is NULL). */
 ldb_memtable_t *
-ldb_memtable_create(const struct ldb_comparator_s *comparator);
+ldb_memtable_create(const struct ldb_comparator_s *comparator,
+                    const struct ldb_dbopt_s *options);
 
 void
 ldb_memtable_destroy(ldb_memtable_t *mt);
@@ -61,15 +68,25 @@ ldb_memtable_add(ldb_memtable_t *mt,
                  const ldb_slice_t *value);
 
 /* If memtable contains a value for key, store it in *value and return true.
-   If memtable contains a deletion for key, store a NOTFOUND error
-   in *status and return true.
-   Else, return false. */
+   If memtable contains a deletion for key, or a range tombstone covering
+   it, store a NOTFOUND error in *status and return true.
+   Else, return false. In every case, the merge operands found above the
+   value (newest first) are added to *operands. If "pinned" is non-NULL,
+   it is set to point at the value in the memtable instead, which stays
+   valid for as long as the memtable is referenced. */
 int
 ldb_memtable_get(ldb_memtable_t *mt,
                  const struct ldb_lkey_s *key,
                  ldb_buffer_t *value,
+                 ldb_slice_t *pinned,
+                 struct ldb_operands_s *operands,
                  int *status);
 
+/* Add the range tombstones in the memtable to "rd". Range tombstones
+   are not returned by the iterator below. */
+void
+ldb_memtable_tombstones(ldb_memtable_t *mt, struct ldb_rangedel_s *rd);
+
 /*
  * MemTable Iterator
  */
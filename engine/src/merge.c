@@ -0,0 +1,152 @@
+/*!
+ * merge.c - merge operator for lcdb
+ * Copyright (c) 2022, Christopher Jeffrey (MIT License).
+ * https://github.com/chjj/lcdb
+ *
+ * See LICENSE for more information.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/buffer.h"
+#include "util/internal.h"
+#include "util/slice.h"
+#include "util/status.h"
+#include "util/vector.h"
+
+#include "merge.h"
+
+/*
+ * Merge
+ */
+
+void
+ldb_merge_append(ldb_buffer_t *result, const void *data, size_t size) {
+  ldb_buffer_append(result, (const uint8_t *)data, size);
+}
+
+int
+ldb_merge_apply(const ldb_merger_t *op,
+                const ldb_slice_t *key,
+                const ldb_slice_t *existing,
+                const ldb_slice_t *value,
+                ldb_buffer_t *result) {
+  if (op == NULL)
+    return LDB_INVALID; /* "no merge operator" */
+
+  ldb_buffer_reset(result);
+
+  if (!op->merge(op, key, existing, value, result))
+    return LDB_CORRUPTION; /* "merge operator failed" */
+
+  return LDB_OK;
+}
+
+/*
+ * Operands
+ */
+
+void
+ldb_operands_init(ldb_operands_t *ops, const ldb_merger_t *op) {
+  ops->op = op;
+  ops->length = 0;
+
+  ldb_vector_init(&ops->items);
+}
+
+void
+ldb_operands_clear(ldb_operands_t *ops) {
+  size_t i;
+
+  for (i = 0; i < ops->items.length; i++) {
+    ldb_buffer_t *item = ops->items.items[i];
+
+    ldb_buffer_clear(item);
+    ldb_free(item);
+  }
+
+  ldb_vector_clear(&ops->items);
+}
+
+void
+ldb_operands_reset(ldb_operands_t *ops) {
+  ops->length = 0;
+}
+
+void
+ldb_operands_push(ldb_operands_t *ops, const ldb_slice_t *value) {
+  ldb_buffer_t *item;
+
+  /* Buffers are kept around for the next key. */
+  if (ops->length == ops->items.length) {
+    item = ldb_malloc(sizeof(ldb_buffer_t));
+
+    ldb_buffer_init(item);
+
+    ldb_vector_push(&ops->items, item);
+  }
+
+  item = ops->items.items[ops->length++];
+
+  ldb_buffer_copy(item, value);
+}
+
+static int
+ldb_operands_fold(const ldb_operands_t *ops,
+                  const ldb_slice_t *key,
+                  const ldb_slice_t *base,
+                  size_t count,
+                  ldb_buffer_t *result) {
+  const ldb_slice_t *existing = base;
+  ldb_buffer_t acc, tmp;
+  int rc = LDB_OK;
+  size_t i;
+
+  ldb_buffer_init(&acc);
+  ldb_buffer_init(&tmp);
+
+  if (count == 0 && base != NULL)
+    ldb_buffer_copy(&acc, base);
+
+  for (i = count; i-- > 0;) {
+    rc = ldb_merge_apply(ops->op, key, existing, ops->items.items[i], &tmp);
+
+    if (rc != LDB_OK)
+      break;
+
+    ldb_buffer_swap(&acc, &tmp);
+
+    existing = &acc;
+  }
+
+  if (rc == LDB_OK)
+    ldb_buffer_swap(result, &acc);
+
+  ldb_buffer_clear(&acc);
+  ldb_buffer_clear(&tmp);
+
+  return rc;
+}
+
+int
+ldb_operands_merge(const ldb_operands_t *ops,
+                   const ldb_slice_t *key,
+                   const ldb_slice_t *base,
+                   ldb_buffer_t *result) {
+  return ldb_operands_fold(ops, key, base, ops->length, result);
+}
+
+int
+ldb_operands_combine(const ldb_operands_t *ops,
+                     const ldb_slice_t *key,
+                     ldb_buffer_t *result) {
+  const ldb_slice_t *oldest;
+
+  if (ops->length == 0)
+    return LDB_INVALID;
+
+  oldest = ops->items.items[ops->length - 1];
+
+  return ldb_operands_fold(ops, key, oldest, ops->length - 1, result);
+}
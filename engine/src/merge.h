@@ -0,0 +1,109 @@
+/*!
+ * merge.h - merge operator for lcdb
+ * Copyright (c) 2022, Christopher Jeffrey (MIT License).
+ * https://github.com/chjj/lcdb
+ *
+ * See LICENSE for more information.
+ */
+
+#ifndef LDB_MERGE_H
+#define LDB_MERGE_H
+
+#include <stddef.h>
+
+#include "util/extern.h"
+#include "util/types.h"
+
+/*
+ * Types
+ */
+
+/* A merge operator combines a value written with ldb_merge() with the
+ * existing value of its key, allowing read-modify-write updates (such
+ * as counters or appends) to be written blindly. The operands of a key
+ * are combined lazily: when the key is read, and when the entries are
+ * compacted together.
+ *
+ * The operator must be associative: merging "a" with "b" and then the
+ * result with "c" must give the same result as merging "a" with the
+ * result of merging "b" and "c". This allows compactions to combine
+ * operands before the value beneath them is known.
+ *
+ * The operator may be invoked concurrently from multiple threads and
+ * must be thread-safe.
+ */
+typedef struct ldb_merger_s {
+  /* The name of the operator, for the info log. */
+  const char *name;
+
+  /* Combine "value" with "existing" (NULL if the key has no value),
+   * writing the result with ldb_merge_append(). Returns false if the
+   * operands cannot be combined, which reads report as corruption.
+   */
+  int (*merge)(const struct ldb_merger_s *op,
+               const ldb_slice_t *key,
+               const ldb_slice_t *existing,
+               const ldb_slice_t *value,
+               ldb_buffer_t *result);
+
+  /* Extra state. */
+  void *state;
+} ldb_merger_t;
+
+/* The merge operands of a key, newest first. */
+typedef struct ldb_operands_s {
+  const ldb_merger_t *op;
+  ldb_vector_t items; /* ldb_buffer_t */
+  size_t length;
+} ldb_operands_t;
+
+/*
+ * Merge
+ */
+
+/* Append to the result of a merge. */
+LDB_EXTERN void
+ldb_merge_append(ldb_buffer_t *result, const void *data, size_t size);
+
+/* Apply a single operand. "result" must not alias the inputs. */
+int
+ldb_merge_apply(const ldb_merger_t *op,
+                const ldb_slice_t *key,
+                const ldb_slice_t *existing,
+                const ldb_slice_t *value,
+                ldb_buffer_t *result);
+
+/*
+ * Operands
+ */
+
+void
+ldb_operands_init(ldb_operands_t *ops, const ldb_merger_t *op);
+
+void
+ldb_operands_clear(ldb_operands_t *ops);
+
+void
+ldb_operands_reset(ldb_operands_t *ops);
+
+#define ldb_operands_length(ops) ((ops)->length)
+
+/* Add an operand older than those already added. */
+void
+ldb_operands_push(ldb_operands_t *ops, const ldb_slice_t *value);
+
+/* Apply the operands, oldest first, to "base" (NULL if the key has no
+   value). The result may alias "base". */
+int
+ldb_operands_merge(const ldb_operands_t *ops,
+                   const ldb_slice_t *key,
+                   const ldb_slice_t *base,
+                   ldb_buffer_t *result);
+
+/* Combine the operands into a single operand. */
+int
+ldb_operands_combine(const ldb_operands_t *ops,
+                     const ldb_slice_t *key,
+                     ldb_buffer_t *result);
+
+#endif /* LDB_MERGE_H */
@@ -0,0 +1,430 @@
+/*!
+ * range_del.c - range tombstones for lcdb
+ * Copyright (c) 2022, Christopher Jeffrey (MIT License).
+ * https://github.com/chjj/lcdb
+ *
+ * See LICENSE for more information.
+ */
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "util/buffer.h"
+#include "util/comparator.h"
+#include "util/internal.h"
+#include "util/slice.h"
+#include "util/vector.h"
+
+#include "dbformat.h"
+#include "range_del.h"
+
+/*
+ * Types
+ */
+
+/* A piece of the key space, [start, limit), covered by the
+   tombstones with the given sequence numbers (in decreasing
+   order). Fragments never overlap. */
+typedef struct ldb_fragment_s {
+  const ldb_slice_t *start;
+  const ldb_slice_t *limit;
+  size_t length;
+  ldb_seqnum_t seqs[1];
+} ldb_fragment_t;
+
+typedef int ldb_rangedel_cmp_f(const ldb_comparator_t *,
+                               const void *,
+                               const void *);
+
+/*
+ * Tombstone
+ */
+
+static ldb_tombstone_t *
+ldb_tombstone_create(const ldb_slice_t *start,
+                     const ldb_slice_t *limit,
+                     ldb_seqnum_t sequence) {
+  ldb_tombstone_t *ts = ldb_malloc(sizeof(ldb_tombstone_t));
+
+  ldb_buffer_init(&ts->start);
+  ldb_buffer_init(&ts->limit);
+
+  ldb_buffer_copy(&ts->start, start);
+  ldb_buffer_copy(&ts->limit, limit);
+
+  ts->sequence = sequence;
+
+  return ts;
+}
+
+static void
+ldb_tombstone_destroy(ldb_tombstone_t *ts) {
+  ldb_buffer_clear(&ts->start);
+  ldb_buffer_clear(&ts->limit);
+  ldb_free(ts);
+}
+
+void
+ldb_tombstone_export(ldb_buffer_t *z, const ldb_tombstone_t *x) {
+  ldb_pkey_t pkey;
+
+  ldb_pkey_init(&pkey, &x->start, x->sequence, LDB_TYPE_RANGE_DELETION);
+  ldb_pkey_export(z, &pkey);
+}
+
+/*
+ * Sorting
+ */
+
+/* Tombstones sort by start key and then by decreasing sequence
+   (as their internal keys do), and finally by decreasing limit. */
+static int
+ldb_tombstone_compare(const ldb_comparator_t *ucmp,
+                      const void *xp,
+                      const void *yp) {
+  const ldb_tombstone_t *x = xp;
+  const ldb_tombstone_t *y = yp;
+  int r = ldb_compare(ucmp, &x->start, &y->start);
+
+  if (r != 0)
+    return r;
+
+  if (x->sequence != y->sequence)
+    return x->sequence > y->sequence ? -1 : 1;
+
+  return ldb_compare(ucmp, &y->limit, &x->limit);
+}
+
+static int
+ldb_boundary_compare(const ldb_comparator_t *ucmp,
+                     const void *xp,
+                     const void *yp) {
+  return ldb_compare(ucmp, (const ldb_slice_t *)xp,
+                           (const ldb_slice_t *)yp);
+}
+
+/* The vector sort takes no context, so the comparator is
+   threaded through a merge sort of our own. */
+static void
+ldb_rangedel_sort(const ldb_comparator_t *ucmp,
+                  void **items,
+                  void **tmp,
+                  size_t lo,
+                  size_t hi,
+                  ldb_rangedel_cmp_f *cmp) {
+  size_t mid, i, j, k;
+
+  if (hi - lo < 2)
+    return;
+
+  mid = lo + (hi - lo) / 2;
+
+  ldb_rangedel_sort(ucmp, items, tmp, lo, mid, cmp);
+  ldb_rangedel_sort(ucmp, items, tmp, mid, hi, cmp);
+
+  if (cmp(ucmp, items[mid - 1], items[mid]) <= 0)
+    return;
+
+  memcpy(tmp + lo, items + lo, (hi - lo) * sizeof(void *));
+
+  i = lo;
+  j = mid;
+  k = lo;
+
+  while (i < mid && j < hi) {
+    if (cmp(ucmp, tmp[j], tmp[i]) < 0)
+      items[k++] = tmp[j++];
+    else
+      items[k++] = tmp[i++];
+  }
+
+  while (i < mid)
+    items[k++] = tmp[i++];
+
+  while (j < hi)
+    items[k++] = tmp[j++];
+}
+
+static void
+ldb_rangedel_order(const ldb_comparator_t *ucmp,
+                   ldb_vector_t *list,
+                   ldb_rangedel_cmp_f *cmp) {
+  void **tmp;
+
+  if (list->length < 2)
+    return;
+
+  tmp = ldb_malloc(list->length * sizeof(void *));
+
+  ldb_rangedel_sort(ucmp, list->items, tmp, 0, list->length, cmp);
+
+  ldb_free(tmp);
+}
+
+/*
+ * RangeDel
+ */
+
+void
+ldb_rangedel_init(ldb_rangedel_t *rd, const ldb_comparator_t *ucmp) {
+  rd->ucmp = ucmp;
+  rd->finished = 0;
+
+  ldb_vector_init(&rd->tombstones);
+  ldb_vector_init(&rd->fragments);
+}
+
+void
+ldb_rangedel_clear(ldb_rangedel_t *rd) {
+  size_t i;
+
+  for (i = 0; i < rd->tombstones.length; i++)
+    ldb_tombstone_destroy(rd->tombstones.items[i]);
+
+  for (i = 0; i < rd->fragments.length; i++)
+    ldb_free(rd->fragments.items[i]);
+
+  ldb_vector_clear(&rd->tombstones);
+  ldb_vector_clear(&rd->fragments);
+}
+
+ldb_rangedel_t *
+ldb_rangedel_create(const ldb_comparator_t *ucmp) {
+  ldb_rangedel_t *rd = ldb_malloc(sizeof(ldb_rangedel_t));
+  ldb_rangedel_init(rd, ucmp);
+  return rd;
+}
+
+void
+ldb_rangedel_destroy(ldb_rangedel_t *rd) {
+  ldb_rangedel_clear(rd);
+  ldb_free(rd);
+}
+
+void
+ldb_rangedel_add(ldb_rangedel_t *rd,
+                 const ldb_slice_t *start,
+                 const ldb_slice_t *limit,
+                 ldb_seqnum_t sequence) {
+  assert(!rd->finished);
+
+  if (ldb_compare(rd->ucmp, start, limit) >= 0)
+    return;
+
+  ldb_vector_push(&rd->tombstones,
+                  ldb_tombstone_create(start, limit, sequence));
+}
+
+int
+ldb_rangedel_add_entry(ldb_rangedel_t *rd,
+                       const ldb_slice_t *key,
+                       const ldb_slice_t *limit) {
+  ldb_pkey_t pkey;
+
+  if (!ldb_pkey_import(&pkey, key))
+    return 0;
+
+  if (pkey.type != LDB_TYPE_RANGE_DELETION)
+    return 0;
+
+  ldb_rangedel_add(rd, &pkey.user_key, limit, pkey.sequence);
+
+  return 1;
+}
+
+void
+ldb_rangedel_merge(ldb_rangedel_t *z, const ldb_rangedel_t *x) {
+  size_t i;
+
+  assert(!z->finished);
+
+  for (i = 0; i < x->tombstones.length; i++) {
+    const ldb_tombstone_t *ts = x->tombstones.items[i];
+
+    ldb_vector_push(&z->tombstones,
+                    ldb_tombstone_create(&ts->start,
+                                         &ts->limit,
+                                         ts->sequence));
+  }
+}
+
+static void
+ldb_rangedel_fragment(ldb_rangedel_t *rd,
+                      const ldb_slice_t *start,
+                      const ldb_slice_t *limit,
+                      const ldb_vector_t *active) {
+  size_t size = sizeof(ldb_fragment_t)
+              + active->length * sizeof(ldb_seqnum_t);
+  ldb_fragment_t *frag = ldb_malloc(size);
+  size_t i, j;
+
+  frag->start = start;
+  frag->limit = limit;
+  frag->length = 0;
+
+  /* Insertion sort by decreasing sequence. */
+  for (i = 0; i < active->length; i++) {
+    const ldb_tombstone_t *ts = active->items[i];
+
+    j = frag->length++;
+
+    while (j > 0 && frag->seqs[j - 1] < ts->sequence) {
+      frag->seqs[j] = frag->seqs[j - 1];
+      j--;
+    }
+
+    frag->seqs[j] = ts->sequence;
+  }
+
+  ldb_vector_push(&rd->fragments, frag);
+}
+
+void
+ldb_rangedel_finish(ldb_rangedel_t *rd) {
+  const ldb_comparator_t *ucmp = rd->ucmp;
+  ldb_vector_t bounds, active;
+  size_t i, j, k, n;
+
+  if (rd->finished)
+    return;
+
+  rd->finished = 1;
+
+  if (rd->tombstones.length == 0)
+    return;
+
+  ldb_rangedel_order(ucmp, &rd->tombstones, ldb_tombstone_compare);
+
+  /* Every start and limit splits the key space. */
+  ldb_vector_init(&bounds);
+  ldb_vector_init(&active);
+
+  for (i = 0; i < rd->tombstones.length; i++) {
+    ldb_tombstone_t *ts = rd->tombstones.items[i];
+
+    ldb_vector_push(&bounds, &ts->start);
+    ldb_vector_push(&bounds, &ts->limit);
+  }
+
+  ldb_rangedel_order(ucmp, &bounds, ldb_boundary_compare);
+
+  for (i = 1, n = 1; i < bounds.length; i++) {
+    if (ldb_compare(ucmp, bounds.items[n - 1], bounds.items[i]) != 0)
+      bounds.items[n++] = bounds.items[i];
+  }
+
+  bounds.length = n;
+
+  /* Sweep the boundaries, tracking the tombstones which are live
+     between each pair of them. */
+  for (i = 0, j = 0; i + 1 < bounds.length; i++) {
+    const ldb_slice_t *start = bounds.items[i];
+    const ldb_slice_t *limit = bounds.items[i + 1];
+
+    while (j < rd->tombstones.length) {
+      ldb_tombstone_t *ts = rd->tombstones.items[j];
+
+      if (ldb_compare(ucmp, &ts->start, start) > 0)
+        break;
+
+      ldb_vector_push(&active, ts);
+
+      j++;
+    }
+
+    for (k = 0, n = 0; k < active.length; k++) {
+      ldb_tombstone_t *ts = active.items[k];
+
+      if (ldb_compare(ucmp, &ts->limit, start) > 0)
+        active.items[n++] = ts;
+    }
+
+    active.length = n;
+
+    if (active.length > 0)
+      ldb_rangedel_fragment(rd, start, limit, &active);
+  }
+
+  ldb_vector_clear(&bounds);
+  ldb_vector_clear(&active);
+}
+
+void
+ldb_rangedel_bounds(const ldb_rangedel_t *rd,
+                    const ldb_comparator_t *icmp,
+                    ldb_buffer_t *smallest,
+                    ldb_buffer_t *largest) {
+  ldb_buffer_t key;
+  size_t i;
+
+  ldb_buffer_init(&key);
+
+  for (i = 0; i < rd->tombstones.length; i++) {
+    const ldb_tombstone_t *ts = rd->tombstones.items[i];
+
+    ldb_buffer_reset(&key);
+    ldb_tombstone_export(&key, ts);
+
+    if (smallest->size == 0 || ldb_compare(icmp, &key, smallest) < 0)
+      ldb_buffer_copy(smallest, &key);
+
+    /* The limit is exclusive, so use the first possible key for it. */
+    ldb_ikey_set(&key, &ts->limit, LDB_MAX_SEQUENCE, LDB_TYPE_RANGE_DELETION);
+
+    if (largest->size == 0 || ldb_compare(icmp, &key, largest) > 0)
+      ldb_buffer_copy(largest, &key);
+  }
+
+  ldb_buffer_clear(&key);
+}
+
+ldb_seqnum_t
+ldb_rangedel_covering(const ldb_rangedel_t *rd,
+                      const ldb_slice_t *user_key,
+                      ldb_seqnum_t snapshot) {
+  const ldb_fragment_t *frag;
+  size_t lo = 0;
+  size_t hi = rd->fragments.length;
+  size_t i;
+
+  assert(rd->finished);
+
+  /* Find the last fragment starting at or before the key. */
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+
+    frag = rd->fragments.items[mid];
+
+    if (ldb_compare(rd->ucmp, frag->start, user_key) <= 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo == 0)
+    return 0;
+
+  frag = rd->fragments.items[lo - 1];
+
+  if (ldb_compare(rd->ucmp, user_key, frag->limit) >= 0)
+    return 0;
+
+  for (i = 0; i < frag->length; i++) {
+    if (frag->seqs[i] <= snapshot)
+      return frag->seqs[i];
+  }
+
+  return 0;
+}
+
+int
+ldb_rangedel_covers(const ldb_rangedel_t *rd,
+                    const ldb_pkey_t *key,
+                    ldb_seqnum_t snapshot) {
+  if (rd == NULL || rd->fragments.length == 0)
+    return 0;
+
+  return ldb_rangedel_covering(rd, &key->user_key, snapshot) > key->sequence;
+}
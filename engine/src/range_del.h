@@ -0,0 +1,129 @@
+/*!
+ * range_del.h - range tombstones for lcdb
+ * Copyright (c) 2022, Christopher Jeffrey (MIT License).
+ * https://github.com/chjj/lcdb
+ *
+ * See LICENSE for more information.
+ */
+
+#ifndef LDB_RANGE_DEL_H
+#define LDB_RANGE_DEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/types.h"
+
+#include "dbformat.h"
+
+/*
+ * Types
+ */
+
+struct ldb_comparator_s;
+
+/* Deletes every user key in [start, limit) with a sequence
+   number less than "sequence". */
+typedef struct ldb_tombstone_s {
+  ldb_buffer_t start;
+  ldb_buffer_t limit;
+  ldb_seqnum_t sequence;
+} ldb_tombstone_t;
+
+/* A collection of range tombstones.
+ *
+ * Once finished, the tombstones are sorted by start key (and by
+ * decreasing sequence number) and the key space is split at every
+ * start and limit into fragments, each of which records the sequence
+ * numbers of the tombstones covering it. A lookup is then a binary
+ * search, regardless of how the tombstones overlap.
+ *
+ * A finished collection is immutable and may be shared between
+ * threads.
+ */
+typedef struct ldb_rangedel_s {
+  const struct ldb_comparator_s *ucmp;
+  ldb_vector_t tombstones; /* ldb_tombstone_t */
+  ldb_vector_t fragments;  /* ldb_fragment_t */
+  int finished;
+} ldb_rangedel_t;
+
+/*
+ * Tombstone
+ */
+
+/* Encode the start of the tombstone as an internal key. This is the
+   key the tombstone is stored under, the limit being its value. */
+void
+ldb_tombstone_export(ldb_buffer_t *z, const ldb_tombstone_t *x);
+
+/*
+ * RangeDel
+ */
+
+void
+ldb_rangedel_init(ldb_rangedel_t *rd, const struct ldb_comparator_s *ucmp);
+
+void
+ldb_rangedel_clear(ldb_rangedel_t *rd);
+
+ldb_rangedel_t *
+ldb_rangedel_create(const struct ldb_comparator_s *ucmp);
+
+void
+ldb_rangedel_destroy(ldb_rangedel_t *rd);
+
+#define ldb_rangedel_length(rd) ((rd)->tombstones.length)
+#define ldb_rangedel_get(rd, i) \
+  ((const ldb_tombstone_t *)(rd)->tombstones.items[i])
+
+/* Add a tombstone. Empty ranges are ignored. */
+/* REQUIRES: !finished */
+void
+ldb_rangedel_add(ldb_rangedel_t *rd,
+                 const ldb_slice_t *start,
+                 const ldb_slice_t *limit,
+                 ldb_seqnum_t sequence);
+
+/* Add a tombstone stored as an internal key and limit. Returns
+   false if the key could not be parsed. */
+/* REQUIRES: !finished */
+int
+ldb_rangedel_add_entry(ldb_rangedel_t *rd,
+                       const ldb_slice_t *key,
+                       const ldb_slice_t *limit);
+
+/* Add all of the tombstones in "x". */
+/* REQUIRES: !finished */
+void
+ldb_rangedel_merge(ldb_rangedel_t *z, const ldb_rangedel_t *x);
+
+/* Sort the tombstones and build the fragments. */
+void
+ldb_rangedel_finish(ldb_rangedel_t *rd);
+
+/* Widen the internal key range [*smallest, *largest] to include the
+   tombstones. Empty keys are treated as unset. The upper bound for a
+   tombstone sorts before every real entry of its limit. */
+void
+ldb_rangedel_bounds(const ldb_rangedel_t *rd,
+                    const struct ldb_comparator_s *icmp,
+                    ldb_buffer_t *smallest,
+                    ldb_buffer_t *largest);
+
+/* Return the largest sequence number <= snapshot among the
+   tombstones covering user_key, or zero if there are none. */
+/* REQUIRES: finished */
+ldb_seqnum_t
+ldb_rangedel_covering(const ldb_rangedel_t *rd,
+                      const ldb_slice_t *user_key,
+                      ldb_seqnum_t snapshot);
+
+/* Returns true if "key" is deleted by a tombstone visible at "snapshot". */
+/* REQUIRES: finished */
+int
+ldb_rangedel_covers(const ldb_rangedel_t *rd,
+                    const ldb_pkey_t *key,
+                    ldb_seqnum_t snapshot);
+
+#endif /* LDB_RANGE_DEL_H */
@@ -33,6 +33,7 @@
 #include "util/strutil.h"
 #include "util/vector.h"
 
+#include "blob_file.h"
 #include "builder.h"
 #include "db_impl.h"
 #include "dbformat.h"
@@ -41,6 +42,7 @@
 #include "log_reader.h"
 #include "log_writer.h"
 #include "memtable.h"
+#include "range_del.h"
 #include "table_cache.h"
 #include "version_edit.h"
 #include "write_batch.h"
@@ -53,7 +55,11 @@
  *     (a) smallest/largest for the table
  *     (b) largest sequence number in the table
  *
- * (3) We generate descriptor contents:
+ * (3) We scan every blob file to count its records, and count
+ *     the records referenced by the tables. Records which are
+ *     not referenced are recorded as garbage.
+ *
+ * (4) We generate descriptor contents:
  *      - log number is set to zero
  *      - next-file-number is set to 1 + largest file number we found
  *      - last-sequence-number is set to largest sequence# found across
@@ -61,6 +67,10 @@
  *      - compaction pointers are cleared
  *      - every table file is added at level 0
  *
+ * The sequence number assigned to an ingested table is only kept in the
+ * descriptor. Its entries are recovered at sequence zero, where they
+ * lose to any other entry for the same key.
+ *
  * Possible optimization 1:
  *   (a) Compute total size and use to pick appropriate max-level M
  *   (b) Sort tables by largest sequence# in the table
@@ -98,6 +108,31 @@ tabinfo_destroy(ldb_tabinfo_t *t) {
   ldb_free(t);
 }
 
+/*
+ * BlobInfo
+ */
+
+typedef struct ldb_blobinfo_s {
+  uint64_t number;
+  uint64_t count;
+  uint64_t bytes;
+  uint64_t refs;      /* Records referenced by the tables. */
+  uint64_t ref_bytes; /* Size of those records. */
+} ldb_blobinfo_t;
+
+static ldb_blobinfo_t *
+blobinfo_create(uint64_t number) {
+  ldb_blobinfo_t *b = ldb_malloc(sizeof(ldb_blobinfo_t));
+
+  b->number = number;
+  b->count = 0;
+  b->bytes = 0;
+  b->refs = 0;
+  b->ref_bytes = 0;
+
+  return b;
+}
+
 /*
  * Repairer
  */
@@ -114,7 +149,9 @@ typedef struct ldb_repair_s {
   ldb_array_t manifests;
   ldb_array_t table_numbers;
   ldb_array_t logs;
+  ldb_array_t blob_numbers;
   ldb_vector_t tables; /* ldb_tabinfo_t */
+  ldb_vector_t blobs; /* ldb_blobinfo_t */
   uint64_t next_file_number;
 } ldb_repair_t;
 
@@ -147,7 +184,9 @@ repair_init(ldb_repair_t *rep, const char *dbname, const ldb_dbopt_t *options) {
   ldb_array_init(&rep->manifests);
   ldb_array_init(&rep->table_numbers);
   ldb_array_init(&rep->logs);
+  ldb_array_init(&rep->blob_numbers);
   ldb_vector_init(&rep->tables);
+  ldb_vector_init(&rep->blobs);
 
   rep->next_file_number = 1;
 }
@@ -167,11 +206,16 @@ repair_clear(ldb_repair_t *rep) {
   for (i = 0; i < rep->tables.length; i++)
     tabinfo_destroy(rep->tables.items[i]);
 
+  for (i = 0; i < rep->blobs.length; i++)
+    ldb_free(rep->blobs.items[i]);
+
   ldb_edit_clear(&rep->edit);
   ldb_array_clear(&rep->manifests);
   ldb_array_clear(&rep->table_numbers);
   ldb_array_clear(&rep->logs);
+  ldb_array_clear(&rep->blob_numbers);
   ldb_vector_clear(&rep->tables);
+  ldb_vector_clear(&rep->blobs);
 }
 
 static int
@@ -207,6 +251,8 @@ find_files(ldb_repair_t *rep) {
         ldb_array_push(&rep->logs, number);
       else if (type == LDB_FILE_TABLE)
         ldb_array_push(&rep->table_numbers, number);
+      else if (type == LDB_FILE_BLOB)
+        ldb_array_push(&rep->blob_numbers, number);
     }
   }
 
@@ -265,6 +311,7 @@ convert_log_to_table(ldb_repair_t *rep, uint64_t log) {
   ldb_buffer_t scratch;
   ldb_slice_t record;
   ldb_batch_t batch;
+  ldb_rangedel_t tombstones;
   ldb_memtable_t *mem;
   ldb_filemeta_t meta;
   ldb_iter_t *iter;
@@ -288,12 +335,13 @@ convert_log_to_table(ldb_repair_t *rep, uint64_t log) {
      propagating bad information (like overly large sequence
      numbers). */
   ldb_reader_init(&reader, lfile, &reporter, 0, 0);
+  ldb_reader_set_log_number(&reader, log);
   ldb_buffer_init(&scratch);
   ldb_slice_init(&record);
   ldb_batch_init(&batch);
 
   /* Read all the records and add to a memtable. */
-  mem = ldb_memtable_create(&rep->icmp);
+  mem = ldb_memtable_create(&rep->icmp, &rep->options);
   counter = 0;
 
   ldb_memtable_ref(mem);
@@ -332,12 +380,19 @@ convert_log_to_table(ldb_repair_t *rep, uint64_t log) {
 
   iter = ldb_memiter_create(mem);
 
+  ldb_rangedel_init(&tombstones, rep->icmp.user_comparator);
+  ldb_memtable_tombstones(mem, &tombstones);
+  ldb_rangedel_finish(&tombstones);
+
   rc = ldb_build_table(rep->dbname,
                        &rep->options,
                        rep->table_cache,
                        iter,
-                       &meta);
+                       &tombstones,
+                       &meta,
+                       NULL);
 
+  ldb_rangedel_clear(&tombstones);
   ldb_iter_destroy(iter);
 
   ldb_memtable_unref(mem);
@@ -394,6 +449,7 @@ tableiter_create(ldb_repair_t *rep, const ldb_filemeta_t *meta) {
                             &options,
                             meta->number,
                             meta->file_size,
+                            0,
                             NULL);
 }
 
@@ -401,6 +457,7 @@ static void
 repair_table(ldb_repair_t *rep, const char *src, ldb_tabinfo_t *t) {
   /* We will copy src contents to a new table and then rename the
      new table over the source. */
+  ldb_rangedel_t tombstones;
   ldb_tablegen_t *builder;
   char copy[LDB_PATH_MAX];
   char orig[LDB_PATH_MAX];
@@ -439,6 +496,23 @@ repair_table(ldb_repair_t *rep, const char *src, ldb_tabinfo_t *t) {
 
   ldb_iter_destroy(iter);
 
+  /* Copy range tombstones. */
+  ldb_rangedel_init(&tombstones, rep->icmp.user_comparator);
+
+  if (ldb_tables_tombstones(rep->table_cache, t->meta.number,
+                            t->meta.file_size, &tombstones) == LDB_OK) {
+    ldb_rangedel_finish(&tombstones);
+
+    ldb_build_tombstones(builder, &rep->icmp, &tombstones,
+                         &t->meta.smallest, &t->meta.largest);
+
+    t->meta.tombstones = ldb_tablegen_tombstones(builder);
+
+    counter += t->meta.tombstones;
+  }
+
+  ldb_rangedel_clear(&tombstones);
+
   ldb_tables_evict(rep->table_cache, t->meta.number);
 
   archive_file(rep, src);
@@ -484,6 +558,20 @@ repair_table(ldb_repair_t *rep, const char *src, ldb_tabinfo_t *t) {
     tabinfo_destroy(t);
 }
 
+static ldb_blobinfo_t *
+find_blob(ldb_repair_t *rep, uint64_t number) {
+  size_t i;
+
+  for (i = 0; i < rep->blobs.length; i++) {
+    ldb_blobinfo_t *b = rep->blobs.items[i];
+
+    if (b->number == number)
+      return b;
+  }
+
+  return NULL;
+}
+
 static void
 scan_table(ldb_repair_t *rep, uint64_t number) {
   char fname[LDB_PATH_MAX];
@@ -491,8 +579,10 @@ scan_table(ldb_repair_t *rep, uint64_t number) {
   int counter, empty;
   ldb_pkey_t parsed;
   ldb_iter_t *iter;
+  ldb_rangedel_t tombstones;
   ldb_tabinfo_t *t;
   int rc, status;
+  size_t i;
 
   if (!ldb_table_filename(fname, sizeof(fname), rep->dbname, number))
     abort(); /* LCOV_EXCL_LINE */
@@ -555,6 +645,30 @@ scan_table(ldb_repair_t *rep, uint64_t number) {
 
     if (parsed.sequence > t->max_sequence)
       t->max_sequence = parsed.sequence;
+
+    if (parsed.type == LDB_TYPE_DELETION)
+      t->meta.deletions++;
+
+    if (parsed.type == LDB_TYPE_BLOB) {
+      ldb_slice_t val = ldb_iter_value(iter);
+      ldb_blobinfo_t *b = NULL;
+      ldb_blobref_t ref;
+
+      if (ldb_blobref_import(&ref, &val))
+        b = find_blob(rep, ref.number);
+
+      if (b == NULL) {
+        ldb_log(rep->options.info_log, "Table #%lu: missing blob record",
+                                       (unsigned long)t->meta.number);
+        continue;
+      }
+
+      b->refs += 1;
+      b->ref_bytes += ref.size;
+
+      if (t->meta.oldest_blob == 0 || b->number < t->meta.oldest_blob)
+        t->meta.oldest_blob = b->number;
+    }
   }
 
   if (ldb_iter_status(iter) != LDB_OK)
@@ -562,6 +676,37 @@ scan_table(ldb_repair_t *rep, uint64_t number) {
 
   ldb_iter_destroy(iter);
 
+  /* The original creation time is lost. */
+  t->meta.entries = counter;
+  t->meta.created = ldb_now_usec() / 1000000;
+
+  /* Range tombstones widen the key range of the table. */
+  ldb_rangedel_init(&tombstones, rep->icmp.user_comparator);
+
+  if (rc == LDB_OK) {
+    rc = ldb_tables_tombstones(rep->table_cache, t->meta.number,
+                               t->meta.file_size, &tombstones);
+  }
+
+  if (rc == LDB_OK && ldb_rangedel_length(&tombstones) > 0) {
+    ldb_rangedel_finish(&tombstones);
+
+    ldb_rangedel_bounds(&tombstones, &rep->icmp,
+                        &t->meta.smallest, &t->meta.largest);
+
+    for (i = 0; i < ldb_rangedel_length(&tombstones); i++) {
+      const ldb_tombstone_t *ts = ldb_rangedel_get(&tombstones, i);
+
+      if (ts->sequence > t->max_sequence)
+        t->max_sequence = ts->sequence;
+    }
+
+    t->meta.tombstones = ldb_rangedel_length(&tombstones);
+    counter += t->meta.tombstones;
+  }
+
+  ldb_rangedel_clear(&tombstones);
+
   ldb_log(rep->options.info_log, "Table #%lu: %d entries %s",
                                  (unsigned long)t->meta.number,
                                  counter, ldb_strerror(rc));
@@ -572,10 +717,52 @@ scan_table(ldb_repair_t *rep, uint64_t number) {
     repair_table(rep, fname, t); /* repair_table archives input file. */
 }
 
+static void
+count_record(void *arg,
+             const ldb_blobref_t *ref,
+             const ldb_slice_t *key,
+             const ldb_slice_t *value) {
+  ldb_blobinfo_t *b = arg;
+
+  (void)key;
+  (void)value;
+
+  b->count += 1;
+  b->bytes += ref->size;
+}
+
+static void
+scan_blob(ldb_repair_t *rep, uint64_t number) {
+  ldb_blobinfo_t *b = blobinfo_create(number);
+  char fname[LDB_PATH_MAX];
+  int rc;
+
+  if (!ldb_blob_filename(fname, sizeof(fname), rep->dbname, number))
+    abort(); /* LCOV_EXCL_LINE */
+
+  /* Records before any corruption remain usable. */
+  rc = ldb_blob_scan(fname, number, b, count_record);
+
+  ldb_log(rep->options.info_log, "Blob #%lu: %lu records %s",
+                                 (unsigned long)number,
+                                 (unsigned long)b->count,
+                                 ldb_strerror(rc));
+
+  if (b->count > 0) {
+    ldb_vector_push(&rep->blobs, b);
+  } else {
+    archive_file(rep, fname);
+    ldb_free(b);
+  }
+}
+
 static void
 extract_meta_data(ldb_repair_t *rep) {
   size_t i;
 
+  for (i = 0; i < rep->blob_numbers.length; i++)
+    scan_blob(rep, rep->blob_numbers.items[i]);
+
   for (i = 0; i < rep->table_numbers.length; i++)
     scan_table(rep, rep->table_numbers.items[i]);
 }
@@ -611,11 +798,32 @@ write_descriptor(ldb_repair_t *rep) {
 
   for (i = 0; i < rep->tables.length; i++) {
     const ldb_tabinfo_t *t = rep->tables.items[i];
+    ldb_filemeta_t *f;
+
+    f = ldb_edit_add_file(&rep->edit, 0, t->meta.number,
+                                         t->meta.file_size,
+                                         &t->meta.smallest,
+                                         &t->meta.largest);
+
+    f->tombstones = t->meta.tombstones;
+    f->oldest_blob = t->meta.oldest_blob;
+    f->entries = t->meta.entries;
+    f->deletions = t->meta.deletions;
+    f->created = t->meta.created;
+  }
+
+  for (i = 0; i < rep->blobs.length; i++) {
+    const ldb_blobinfo_t *b = rep->blobs.items[i];
 
-    ldb_edit_add_file(&rep->edit, 0, t->meta.number,
-                                     t->meta.file_size,
-                                     &t->meta.smallest,
-                                     &t->meta.largest);
+    ldb_edit_add_blob(&rep->edit, b->number, b->count, b->bytes);
+
+    /* Records past a corruption may be referenced without being
+       counted; the file is kept alive by its counted records. */
+    if (b->refs < b->count) {
+      ldb_edit_add_garbage(&rep->edit, b->number,
+                           b->count - b->refs,
+                           b->bytes - LDB_MIN(b->ref_bytes, b->bytes));
+    }
   }
 
   {
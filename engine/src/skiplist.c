@@ -17,6 +17,7 @@
 
 #include "util/arena.h"
 #include "util/atomic.h"
+#include "util/coding.h"
 #include "util/comparator.h"
 #include "util/internal.h"
 #include "util/port.h"
@@ -68,6 +69,10 @@
 
 struct ldb_skipnode_s {
   const uint8_t *key;
+  /* First 8 bytes of the user key (zero-padded, big-endian). Kept
+     next to the links so that a search hop can usually be decided
+     without touching the entry itself. Only set for bytewise lists. */
+  uint64_t prefix;
   /* Array of length equal to the node height.
      next[0] is lowest level link. */
 #ifdef LDB_HAVE_ATOMICS
@@ -78,8 +83,9 @@ struct ldb_skipnode_s {
 };
 
 static void
-ldb_skipnode_init(ldb_skipnode_t *node, const uint8_t *key) {
+ldb_skipnode_init(ldb_skipnode_t *node, const uint8_t *key, uint64_t prefix) {
   node->key = key;
+  node->prefix = prefix;
 }
 
 static ldb_skipnode_t *
@@ -128,7 +134,10 @@ ldb_skipnode_set_nb(ldb_skipnode_t *node, int n, ldb_skipnode_t *x) {
 }
 
 static ldb_skipnode_t *
-ldb_skipnode_create(ldb_skiplist_t *list, const uint8_t *key, int height) {
+ldb_skipnode_create(ldb_skiplist_t *list,
+                    const uint8_t *key,
+                    uint64_t prefix,
+                    int height) {
 #ifdef LDB_HAVE_ATOMICS
   size_t size = (sizeof(ldb_skipnode_t) +
                  sizeof(ldb_atomic_ptr(ldb_skipnode_t)) * (height - 1));
@@ -139,7 +148,7 @@ ldb_skipnode_create(ldb_skiplist_t *list, const uint8_t *key, int height) {
 
   ldb_skipnode_t *node = ldb_arena_alloc_aligned(list->arena, size);
 
-  ldb_skipnode_init(node, key);
+  ldb_skipnode_init(node, key, prefix);
 
   return node;
 }
@@ -157,7 +166,8 @@ ldb_skiplist_init(ldb_skiplist_t *list,
 
   list->comparator = cmp;
   list->arena = arena;
-  list->head = ldb_skipnode_create(list, NULL, LDB_MAX_HEIGHT);
+  list->head = ldb_skipnode_create(list, NULL, 0, LDB_MAX_HEIGHT);
+  list->bytewise = (cmp->user_comparator == ldb_bytewise_comparator);
 
 #ifdef LDB_HAVE_ATOMICS
   ldb_atomic_init(&list->max_height, 1);
@@ -182,6 +192,34 @@ ldb_skiplist_maxheight(const ldb_skiplist_t *list) {
 #endif
 }
 
+/* InternalKeyComparator::Compare() specialized for a bytewise
+   user comparator, avoiding the indirect calls. */
+static int
+ldb_skiplist_bytewise(const ldb_slice_t *x, const ldb_slice_t *y) {
+  size_t xn = x->size - 8;
+  size_t yn = y->size - 8;
+  size_t n = LDB_MIN(xn, yn);
+  int r = n ? memcmp(x->data, y->data, n) : 0;
+
+  if (r == 0) {
+    if (xn < yn) {
+      r = -1;
+    } else if (xn > yn) {
+      r = +1;
+    } else {
+      uint64_t xs = ldb_fixed64_decode(x->data + xn);
+      uint64_t ys = ldb_fixed64_decode(y->data + yn);
+
+      if (xs > ys)
+        r = -1;
+      else if (xs < ys)
+        r = +1;
+    }
+  }
+
+  return r;
+}
+
 /* MemTable::KeyComparator::operator() */
 static int
 ldb_skiplist_compare(const ldb_skiplist_t *list,
@@ -191,9 +229,52 @@ ldb_skiplist_compare(const ldb_skiplist_t *list,
   ldb_slice_t x = ldb_slice_decode(xp);
   ldb_slice_t y = ldb_slice_decode(yp);
 
+  if (list->bytewise)
+    return ldb_skiplist_bytewise(&x, &y);
+
   return ldb_compare(list->comparator, &x, &y);
 }
 
+/* Compute the inline prefix of an entry. A prefix orders the
+   same way as the user keys it was taken from whenever two
+   prefixes differ, so only equal prefixes need a full compare. */
+static uint64_t
+ldb_skiplist_prefix(const ldb_skiplist_t *list, const uint8_t *key) {
+  uint64_t z = 0;
+  ldb_slice_t x;
+  size_t i, n;
+
+  if (!list->bytewise)
+    return 0;
+
+  x = ldb_slice_decode(key);
+
+  assert(x.size >= 8);
+
+  n = LDB_MIN(x.size - 8, 8);
+
+  for (i = 0; i < 8; i++) {
+    z <<= 8;
+
+    if (i < n)
+      z |= x.data[i];
+  }
+
+  return z;
+}
+
+/* Compare the key of "node" with "key", whose prefix is "prefix". */
+static int
+ldb_skiplist_compare_node(const ldb_skiplist_t *list,
+                          ldb_skipnode_t *node,
+                          const uint8_t *key,
+                          uint64_t prefix) {
+  if (list->bytewise && node->prefix != prefix)
+    return node->prefix < prefix ? -1 : 1;
+
+  return ldb_skiplist_compare(list, node->key, key);
+}
+
 static int
 ldb_skiplist_equal(const ldb_skiplist_t *list,
                    const uint8_t *xp,
@@ -219,9 +300,11 @@ ldb_skiplist_randheight(ldb_skiplist_t *list) {
 static int
 ldb_skiplist_key_after_node(const ldb_skiplist_t *list,
                             const uint8_t *key,
+                            uint64_t prefix,
                             ldb_skipnode_t *node) {
   /* A null node is considered infinite. */
-  return (node != NULL) && (ldb_skiplist_compare(list, node->key, key) < 0);
+  return (node != NULL)
+      && (ldb_skiplist_compare_node(list, node, key, prefix) < 0);
 }
 
 /* Return the earliest node that comes at or after key.
@@ -233,6 +316,7 @@ ldb_skiplist_key_after_node(const ldb_skiplist_t *list,
 static ldb_skipnode_t *
 ldb_skiplist_find_ge(const ldb_skiplist_t *list,
                      const uint8_t *key,
+                     uint64_t prefix,
                      ldb_skipnode_t **prev) {
   int level = ldb_skiplist_maxheight(list) - 1;
   ldb_skipnode_t *x = list->head;
@@ -240,7 +324,7 @@ ldb_skiplist_find_ge(const ldb_skiplist_t *list,
   for (;;) {
     ldb_skipnode_t *next = ldb_skipnode_next(x, level);
 
-    if (ldb_skiplist_key_after_node(list, key, next)) {
+    if (ldb_skiplist_key_after_node(list, key, prefix, next)) {
       /* Keep searching in this list. */
       x = next;
     } else {
@@ -259,9 +343,11 @@ ldb_skiplist_find_ge(const ldb_skiplist_t *list,
 /* Return the latest node with a key < key. */
 /* Return head if there is no such node. */
 static ldb_skipnode_t *
-ldb_skiplist_find_lt(const ldb_skiplist_t *list, const uint8_t *key) {
+ldb_skiplist_find_lt(const ldb_skiplist_t *list, ldb_skipnode_t *node) {
   int level = ldb_skiplist_maxheight(list) - 1;
   ldb_skipnode_t *x = list->head;
+  const uint8_t *key = node->key;
+  uint64_t prefix = node->prefix;
   ldb_skipnode_t *next;
 
   for (;;) {
@@ -269,7 +355,8 @@ ldb_skiplist_find_lt(const ldb_skiplist_t *list, const uint8_t *key) {
 
     next = ldb_skipnode_next(x, level);
 
-    if (next == NULL || ldb_skiplist_compare(list, next->key, key) >= 0) {
+    if (next == NULL
+        || ldb_skiplist_compare_node(list, next, key, prefix) >= 0) {
       if (level == 0)
         return x;
 
@@ -305,13 +392,14 @@ ldb_skiplist_find_last(const ldb_skiplist_t *list) {
 
 void
 ldb_skiplist_insert(ldb_skiplist_t *list, const uint8_t *key) {
+  uint64_t prefix = ldb_skiplist_prefix(list, key);
   ldb_skipnode_t *prev[LDB_MAX_HEIGHT];
   ldb_skipnode_t *x;
   int i, height;
 
   SKIP_LOCK(list->mutex);
 
-  x = ldb_skiplist_find_ge(list, key, prev);
+  x = ldb_skiplist_find_ge(list, key, prefix, prev);
 
   /* Our data structure does not allow duplicate insertion. */
   assert(x == NULL || !ldb_skiplist_equal(list, key, x->key));
@@ -336,7 +424,7 @@ ldb_skiplist_insert(ldb_skiplist_t *list, const uint8_t *key) {
 #endif
   }
 
-  x = ldb_skipnode_create(list, key, height);
+  x = ldb_skipnode_create(list, key, prefix, height);
 
   for (i = 0; i < height; i++) {
     /* set_nb() suffices since we will add a barrier
@@ -354,7 +442,7 @@ ldb_skiplist_contains(const ldb_skiplist_t *list, const uint8_t *key) {
 
   SKIP_LOCK(list->mutex);
 
-  x = ldb_skiplist_find_ge(list, key, NULL);
+  x = ldb_skiplist_find_ge(list, key, ldb_skiplist_prefix(list, key), NULL);
 
   SKIP_UNLOCK(list->mutex);
 
@@ -404,7 +492,7 @@ ldb_skipiter_prev(ldb_skipiter_t *iter) {
 
   SKIP_LOCK(iter->list->mutex);
 
-  iter->node = ldb_skiplist_find_lt(iter->list, iter->node->key);
+  iter->node = ldb_skiplist_find_lt(iter->list, iter->node);
 
   if (iter->node == iter->list->head)
     iter->node = NULL;
@@ -414,9 +502,11 @@ ldb_skipiter_prev(ldb_skipiter_t *iter) {
 
 void
 ldb_skipiter_seek(ldb_skipiter_t *iter, const uint8_t *target) {
+  uint64_t prefix = ldb_skiplist_prefix(iter->list, target);
+
   SKIP_LOCK(iter->list->mutex);
 
-  iter->node = ldb_skiplist_find_ge(iter->list, target, NULL);
+  iter->node = ldb_skiplist_find_ge(iter->list, target, prefix, NULL);
 
   SKIP_UNLOCK(iter->list->mutex);
 }
@@ -33,6 +33,7 @@ typedef struct ldb_skiplist_s {
   const struct ldb_comparator_s *comparator;
   struct ldb_arena_s *arena;
   ldb_skipnode_t *head;
+  int bytewise; /* Whether node prefixes are usable. */
 
 #ifdef LDB_HAVE_ATOMICS
   /* Modified only by insert(). Read racily by readers, but stale
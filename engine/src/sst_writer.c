@@ -0,0 +1,184 @@
+/*!
+ * sst_writer.c - sstable writer for lcdb
+ * Copyright (c) 2022, Christopher Jeffrey (MIT License).
+ * https://github.com/chjj/lcdb
+ *
+ * See LICENSE for more information.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "table/table_builder.h"
+
+#include "util/bloom.h"
+#include "util/buffer.h"
+#include "util/comparator.h"
+#include "util/env.h"
+#include "util/internal.h"
+#include "util/options.h"
+#include "util/slice.h"
+#include "util/status.h"
+
+#include "dbformat.h"
+#include "sst_writer.h"
+
+/*
+ * SST Writer
+ */
+
+struct ldb_sstwriter_s {
+  char filename[LDB_PATH_MAX];
+  ldb_comparator_t icmp;
+  ldb_bloom_t ipolicy;
+  ldb_dbopt_t options;
+  ldb_wfile_t *file;
+  ldb_tablegen_t *builder;
+  ldb_buffer_t last_key; /* Internal key. */
+  ldb_buffer_t key;
+  int finished;
+};
+
+int
+ldb_sstwriter_open(const char *filename,
+                   const ldb_dbopt_t *options,
+                   ldb_sstwriter_t **writer) {
+  ldb_sstwriter_t *w;
+  ldb_wfile_t *file;
+  int rc;
+
+  *writer = NULL;
+
+  if (options == NULL)
+    options = ldb_dbopt_default;
+
+  if (strlen(filename) + 1 > LDB_PATH_MAX)
+    return LDB_INVALID;
+
+  rc = ldb_truncfile_create(filename, &file);
+
+  if (rc != LDB_OK)
+    return rc;
+
+  w = ldb_malloc(sizeof(ldb_sstwriter_t));
+
+  strcpy(w->filename, filename);
+
+  if (options->comparator != NULL)
+    ldb_ikc_init(&w->icmp, options->comparator);
+  else
+    ldb_ikc_init(&w->icmp, ldb_bytewise_comparator);
+
+  if (options->filter_policy != NULL)
+    ldb_ifp_init(&w->ipolicy, options->filter_policy);
+
+  w->options = *options;
+  w->options.comparator = &w->icmp;
+  w->options.filter_policy = options->filter_policy != NULL ? &w->ipolicy
+                                                            : NULL;
+
+  w->file = file;
+  w->builder = ldb_tablegen_create(&w->options, file);
+  w->finished = 0;
+
+  ldb_buffer_init(&w->last_key);
+  ldb_buffer_init(&w->key);
+
+  *writer = w;
+
+  return LDB_OK;
+}
+
+void
+ldb_sstwriter_close(ldb_sstwriter_t *w) {
+  if (!w->finished) {
+    ldb_tablegen_abandon(w->builder);
+    ldb_wfile_close(w->file);
+    ldb_remove_file(w->filename);
+  }
+
+  ldb_tablegen_destroy(w->builder);
+  ldb_wfile_destroy(w->file);
+
+  ldb_buffer_clear(&w->last_key);
+  ldb_buffer_clear(&w->key);
+
+  ldb_free(w);
+}
+
+static int
+ldb_sstwriter_add(ldb_sstwriter_t *w,
+                  const ldb_slice_t *key,
+                  const ldb_slice_t *value,
+                  ldb_valtype_t type) {
+  int rc = ldb_tablegen_status(w->builder);
+
+  if (rc != LDB_OK)
+    return rc;
+
+  if (w->finished)
+    return LDB_INVALID;
+
+  ldb_ikey_set(&w->key, key, 0, type);
+
+  if (w->last_key.size > 0) {
+    ldb_slice_t last = ldb_extract_user_key(&w->last_key);
+
+    /* Each key may only be written once. */
+    if (ldb_compare(w->icmp.user_comparator, &last, key) >= 0)
+      return LDB_INVALID;
+  }
+
+  ldb_tablegen_add(w->builder, &w->key, value);
+
+  ldb_buffer_swap(&w->last_key, &w->key);
+
+  return ldb_tablegen_status(w->builder);
+}
+
+int
+ldb_sstwriter_put(ldb_sstwriter_t *w,
+                  const ldb_slice_t *key,
+                  const ldb_slice_t *value) {
+  return ldb_sstwriter_add(w, key, value, LDB_TYPE_VALUE);
+}
+
+int
+ldb_sstwriter_del(ldb_sstwriter_t *w, const ldb_slice_t *key) {
+  ldb_slice_t value = ldb_slice(NULL, 0);
+  return ldb_sstwriter_add(w, key, &value, LDB_TYPE_DELETION);
+}
+
+int
+ldb_sstwriter_finish(ldb_sstwriter_t *w) {
+  int rc;
+
+  if (w->finished)
+    return LDB_INVALID;
+
+  if (ldb_tablegen_entries(w->builder) == 0)
+    return LDB_INVALID;
+
+  rc = ldb_tablegen_finish(w->builder);
+
+  if (rc == LDB_OK)
+    rc = ldb_wfile_sync(w->file);
+
+  if (rc == LDB_OK)
+    rc = ldb_wfile_close(w->file);
+  else
+    ldb_wfile_close(w->file);
+
+  if (rc != LDB_OK)
+    ldb_remove_file(w->filename);
+
+  w->finished = 1;
+
+  return rc;
+}
+
+uint64_t
+ldb_sstwriter_size(const ldb_sstwriter_t *w) {
+  return ldb_tablegen_size(w->builder);
+}
@@ -0,0 +1,62 @@
+/*!
+ * sst_writer.h - sstable writer for lcdb
+ * Copyright (c) 2022, Christopher Jeffrey (MIT License).
+ * https://github.com/chjj/lcdb
+ *
+ * See LICENSE for more information.
+ */
+
+#ifndef LDB_SST_WRITER_H
+#define LDB_SST_WRITER_H
+
+#include <stdint.h>
+
+#include "util/extern.h"
+#include "util/options.h"
+#include "util/types.h"
+
+/*
+ * Types
+ */
+
+/* Writes a table outside of any database, to be added to one with
+ * ldb_ingest_files(). Keys must be added in strictly increasing order
+ * according to the comparator of the database. Every entry is written
+ * at sequence zero: the database assigns the table a sequence number
+ * when it is ingested.
+ *
+ * The comparator and filter policy of "options" must match those of
+ * the database which will ingest the table.
+ */
+typedef struct ldb_sstwriter_s ldb_sstwriter_t;
+
+/*
+ * SST Writer
+ */
+
+LDB_EXTERN int
+ldb_sstwriter_open(const char *filename,
+                   const ldb_dbopt_t *options,
+                   ldb_sstwriter_t **writer);
+
+/* Destroy the writer. The file is removed unless finish() succeeded. */
+LDB_EXTERN void
+ldb_sstwriter_close(ldb_sstwriter_t *writer);
+
+LDB_EXTERN int
+ldb_sstwriter_put(ldb_sstwriter_t *writer,
+                  const ldb_slice_t *key,
+                  const ldb_slice_t *value);
+
+LDB_EXTERN int
+ldb_sstwriter_del(ldb_sstwriter_t *writer, const ldb_slice_t *key);
+
+/* Finish and sync the table. Fails if no keys were added. */
+LDB_EXTERN int
+ldb_sstwriter_finish(ldb_sstwriter_t *writer);
+
+/* Number of bytes written so far. */
+LDB_EXTERN uint64_t
+ldb_sstwriter_size(const ldb_sstwriter_t *writer);
+
+#endif /* LDB_SST_WRITER_H */
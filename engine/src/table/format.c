@@ -14,6 +14,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "../util/buffer.h"
 #include "../util/coding.h"
@@ -158,48 +159,16 @@ ldb_contents_init(ldb_contents_t *x) {
  * ReadBlock
  */
 
-int
-ldb_read_block(ldb_contents_t *result,
-               ldb_rfile_t *file,
-               const ldb_readopt_t *options,
-               const ldb_handle_t *handle) {
-  ldb_slice_t contents;
-  const uint8_t *data;
-  uint8_t *buf = NULL;
-  size_t n, len;
-  int rc;
-
-  ldb_contents_init(result);
-
-  /* Check for overflow. */
-  if (handle->size > SIZE_MAX - LDB_TRAILER_SIZE)
-    return LDB_CORRUPTION;
-
-  /* Read the block contents as well as the type/crc footer. */
-  /* See table_builder.c for the code that built this structure. */
-  n = handle->size;
-  len = n + LDB_TRAILER_SIZE;
-
-  if (!ldb_rfile_mapped(file)) {
-    if ((buf = malloc(len)) == NULL)
-      return LDB_ENOMEM;
-  }
-
-  rc = ldb_rfile_pread(file, &contents, buf, len, handle->offset);
-
-  if (rc != LDB_OK) {
-    ldb_free(buf);
-    return rc;
-  }
-
-  if (contents.size != len) {
-    ldb_free(buf);
-    return LDB_IOERR; /* "truncated block read" */
-  }
-
+/* Check and decompress a block of "n" bytes (plus the trailer) read
+   into "data". "buf" is the heap buffer data was read into (if any),
+   which is freed or owned by the result. */
+static int
+ldb_decode_block(ldb_contents_t *result,
+                 const ldb_readopt_t *options,
+                 const uint8_t *data,
+                 size_t n,
+                 uint8_t *buf) {
   /* Check the crc of the type and the block contents. */
-  data = contents.data; /* Pointer to where Read put the data. */
-
   if (options->verify_checksums) {
     uint32_t crc = ldb_crc32c_unmask(ldb_fixed32_decode(data + n + 1));
     uint32_t actual = ldb_crc32c_value(data, n + 1);
@@ -268,3 +237,138 @@ ldb_read_block(ldb_contents_t *result,
 
   return LDB_OK;
 }
+
+int
+ldb_read_block(ldb_contents_t *result,
+               ldb_rfile_t *file,
+               const ldb_readopt_t *options,
+               const ldb_handle_t *handle) {
+  ldb_slice_t contents;
+  uint8_t *buf = NULL;
+  size_t n, len;
+  int rc;
+
+  ldb_contents_init(result);
+
+  /* Check for overflow. */
+  if (handle->size > SIZE_MAX - LDB_TRAILER_SIZE)
+    return LDB_CORRUPTION;
+
+  /* Read the block contents as well as the type/crc footer. */
+  /* See table_builder.c for the code that built this structure. */
+  n = handle->size;
+  len = n + LDB_TRAILER_SIZE;
+
+  if (!ldb_rfile_mapped(file)) {
+    if ((buf = malloc(len)) == NULL)
+      return LDB_ENOMEM;
+  }
+
+  rc = ldb_rfile_pread(file, &contents, buf, len, handle->offset);
+
+  if (rc != LDB_OK) {
+    ldb_free(buf);
+    return rc;
+  }
+
+  if (contents.size != len) {
+    ldb_free(buf);
+    return LDB_IOERR; /* "truncated block read" */
+  }
+
+  return ldb_decode_block(result, options, contents.data, n, buf);
+}
+
+/*
+ * Readahead
+ */
+
+void
+ldb_readahead_init(ldb_readahead_t *ra, size_t fixed) {
+  ra->fixed = fixed;
+  ra->window = 0;
+  ra->next = 0;
+  ra->offset = 0;
+
+  ldb_buffer_init(&ra->data);
+}
+
+void
+ldb_readahead_clear(ldb_readahead_t *ra) {
+  ldb_buffer_clear(&ra->data);
+}
+
+void
+ldb_readahead_skip(ldb_readahead_t *ra, const ldb_handle_t *handle) {
+  if (handle->offset == ra->next)
+    ra->next = handle->offset + handle->size + LDB_TRAILER_SIZE;
+}
+
+int
+ldb_readahead_block(ldb_readahead_t *ra,
+                    ldb_contents_t *result,
+                    ldb_rfile_t *file,
+                    const ldb_readopt_t *options,
+                    const ldb_handle_t *handle) {
+  uint64_t offset = handle->offset;
+  size_t n, len;
+  uint8_t *buf;
+
+  if (ldb_rfile_mapped(file))
+    return ldb_read_block(result, file, options, handle);
+
+  /* Check for overflow. */
+  if (handle->size > SIZE_MAX - LDB_TRAILER_SIZE)
+    return LDB_CORRUPTION;
+
+  n = handle->size;
+  len = n + LDB_TRAILER_SIZE;
+
+  if (offset < ra->offset || offset + len > ra->offset + ra->data.size) {
+    ldb_slice_t contents;
+    int rc;
+
+    if (ra->fixed > 0) {
+      ra->window = ra->fixed;
+    } else if (offset != ra->next) {
+      ra->window = 0;
+    } else if (ra->window == 0) {
+      ra->window = LDB_MIN_READAHEAD;
+    } else if (ra->window < LDB_MAX_READAHEAD) {
+      ra->window *= 2;
+    }
+
+    ra->next = offset + len;
+
+    if (ra->window <= len)
+      return ldb_read_block(result, file, options, handle);
+
+    ra->data.size = 0;
+
+    ldb_buffer_grow(&ra->data, ra->window);
+
+    rc = ldb_rfile_pread(file, &contents, ra->data.data,
+                         ra->window, offset);
+
+    if (rc != LDB_OK)
+      return rc;
+
+    if (contents.size < len)
+      return LDB_IOERR; /* "truncated block read" */
+
+    ra->offset = offset;
+    ra->data.size = contents.size;
+  } else {
+    ra->next = offset + len;
+  }
+
+  /* The buffer is overwritten by the next read. */
+  if ((buf = malloc(len)) == NULL)
+    return LDB_ENOMEM;
+
+  memcpy(buf, ra->data.data + (offset - ra->offset), len);
+
+  ldb_contents_init(result);
+
+  return ldb_decode_block(result, options, buf, n, buf);
+}
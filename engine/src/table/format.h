@@ -38,6 +38,10 @@
    and taking the leading 64 bits. */
 #define LDB_TABLE_MAGIC UINT64_C(0xdb4775248b80fb57) /* kTableMagicNumber */
 
+/* Bounds of the adaptive readahead window of table scans. */
+#define LDB_MIN_READAHEAD (8 << 10)
+#define LDB_MAX_READAHEAD (256 << 10)
+
 /*
  * Types
  */
@@ -65,6 +69,18 @@ typedef struct ldb_contents_s {
   int heap_allocated;  /* True iff caller should free() data.data. */
 } ldb_contents_t;
 
+/* Buffers the bytes following the blocks read by a scan. Once blocks
+   are read one after another, the window doubles with each read (up
+   to LDB_MAX_READAHEAD), so that a long scan issues a few large reads
+   instead of one per block. A fixed size may be given instead. */
+typedef struct ldb_readahead_s {
+  size_t fixed;    /* Window size if non-zero. */
+  size_t window;   /* Current window size. */
+  uint64_t next;   /* Offset following the last block read. */
+  uint64_t offset; /* Offset of the buffered bytes. */
+  ldb_buffer_t data;
+} ldb_readahead_t;
+
 /*
  * BlockHandle
  */
@@ -123,4 +139,27 @@ ldb_read_block(ldb_contents_t *result,
                const struct ldb_readopt_s *options,
                const ldb_handle_t *handle);
 
+/*
+ * Readahead
+ */
+
+void
+ldb_readahead_init(ldb_readahead_t *ra, size_t fixed);
+
+void
+ldb_readahead_clear(ldb_readahead_t *ra);
+
+/* Note a block found elsewhere (i.e. in the block cache), so that
+   reading around it does not end the sequential run. */
+void
+ldb_readahead_skip(ldb_readahead_t *ra, const ldb_handle_t *handle);
+
+/* Like ldb_read_block(), but reads through the readahead buffer. */
+int
+ldb_readahead_block(ldb_readahead_t *ra,
+                    ldb_contents_t *result,
+                    struct ldb_rfile_s *file,
+                    const struct ldb_readopt_s *options,
+                    const ldb_handle_t *handle);
+
 #endif /* LDB_TABLE_FORMAT_H */
@@ -21,6 +21,56 @@
 
 #include "iterator.h"
 
+/*
+ * Cleanup
+ */
+
+void
+ldb_cleanup_init(ldb_cleanup_t *head) {
+  head->func = NULL;
+  head->arg1 = NULL;
+  head->arg2 = NULL;
+  head->next = NULL;
+}
+
+void
+ldb_cleanup_push(ldb_cleanup_t *head,
+                 ldb_cleanup_f func,
+                 void *arg1,
+                 void *arg2) {
+  ldb_cleanup_t *node;
+
+  if (ldb_cleanup_empty(head)) {
+    node = head;
+  } else {
+    node = ldb_malloc(sizeof(ldb_cleanup_t));
+    node->next = head->next;
+    head->next = node;
+  }
+
+  node->func = func;
+  node->arg1 = arg1;
+  node->arg2 = arg2;
+}
+
+void
+ldb_cleanup_clear(ldb_cleanup_t *head) {
+  ldb_cleanup_t *node, *next;
+
+  if (ldb_cleanup_empty(head))
+    return;
+
+  ldb_cleanup_run(head);
+
+  for (node = head->next; node != NULL; node = next) {
+    next = node->next;
+    ldb_cleanup_run(node);
+    ldb_free(node);
+  }
+
+  ldb_cleanup_init(head);
+}
+
 /*
  * Iterator
  */
@@ -31,28 +81,19 @@ ldb_iter_init(ldb_iter_t *iter,
               const ldb_itertbl_t *table,
               const ldb_comparator_t *cmp) {
   iter->ptr = ptr;
-  iter->cleanup_head.func = NULL;
-  iter->cleanup_head.next = NULL;
+  ldb_cleanup_init(&iter->cleanup_head);
   iter->table = table;
   iter->cmp = cmp;
 }
 
 static void
 ldb_iter_clear(ldb_iter_t *iter) {
-  if (!ldb_cleanup_empty(&iter->cleanup_head)) {
-    ldb_cleanup_t *node, *next;
-
-    ldb_cleanup_run(&iter->cleanup_head);
-
-    for (node = iter->cleanup_head.next; node != NULL; node = next) {
-      next = node->next;
-      ldb_cleanup_run(node);
-      ldb_free(node);
-    }
-  }
-
+  /* The cleanups may release what the iterator itself
+     holds on to (e.g. the cache of its tables). */
   iter->table->clear(iter->ptr);
 
+  ldb_cleanup_clear(&iter->cleanup_head);
+
   ldb_free(iter->ptr);
 }
 
@@ -76,19 +117,27 @@ ldb_iter_register_cleanup(ldb_iter_t *iter,
                           ldb_cleanup_f func,
                           void *arg1,
                           void *arg2) {
-  ldb_cleanup_t *node;
+  ldb_cleanup_push(&iter->cleanup_head, func, arg1, arg2);
+}
 
-  if (ldb_cleanup_empty(&iter->cleanup_head)) {
-    node = &iter->cleanup_head;
-  } else {
-    node = ldb_malloc(sizeof(ldb_cleanup_t));
-    node->next = iter->cleanup_head.next;
-    iter->cleanup_head.next = node;
+void
+ldb_iter_transfer_cleanup(ldb_iter_t *iter, ldb_cleanup_t *head) {
+  ldb_cleanup_t *node, *next;
+
+  if (ldb_cleanup_empty(&iter->cleanup_head))
+    return;
+
+  node = &iter->cleanup_head;
+
+  ldb_cleanup_push(head, node->func, node->arg1, node->arg2);
+
+  for (node = node->next; node != NULL; node = next) {
+    next = node->next;
+    ldb_cleanup_push(head, node->func, node->arg1, node->arg2);
+    ldb_free(node);
   }
 
-  node->func = func;
-  node->arg1 = arg1;
-  node->arg2 = arg2;
+  ldb_cleanup_init(&iter->cleanup_head);
 }
 
 int
@@ -213,6 +213,20 @@ static const ldb_itertbl_t name ## _table = {                  \
 /* Invokes the cleanup function. */
 #define ldb_cleanup_run(x) (x)->func((x)->arg1, (x)->arg2)
 
+/* A list headed by "head" may also be kept outside of an iterator. */
+void
+ldb_cleanup_init(ldb_cleanup_t *head);
+
+void
+ldb_cleanup_push(ldb_cleanup_t *head,
+                 ldb_cleanup_f func,
+                 void *arg1,
+                 void *arg2);
+
+/* Invoke every function on the list and empty it. */
+void
+ldb_cleanup_clear(ldb_cleanup_t *head);
+
 /*
  * Iterator
  */
@@ -231,6 +245,11 @@ ldb_iter_register_cleanup(ldb_iter_t *iter,
                           void *arg1,
                           void *arg2);
 
+/* Move the cleanup functions of the iterator onto the list at "head".
+   Whatever they release outlives the iterator until "head" is cleared. */
+void
+ldb_iter_transfer_cleanup(ldb_iter_t *iter, ldb_cleanup_t *head);
+
 #ifdef LDB_ITERATOR_C
 
 LDB_EXTERN int
@@ -36,12 +36,13 @@ enum ldb_direction {
  */
 
 typedef struct ldb_mergeiter_s {
-  /* We might want to use a heap in case there are lots of children.
-     For now we use a simple array since we expect a very small number
-     of children in the current implementation. */
   const ldb_comparator_t *comparator;
   ldb_wrapiter_t *children;
   int n;
+  /* Binary heap of the valid children. The top is the smallest child
+     when moving forward and the largest when moving in reverse. */
+  ldb_wrapiter_t **heap;
+  int length;
   ldb_wrapiter_t *current;
   enum ldb_direction direction;
 } ldb_mergeiter_t;
@@ -56,6 +57,8 @@ ldb_mergeiter_init(ldb_mergeiter_t *mi,
   mi->comparator = comparator;
   mi->children = ldb_malloc(n * sizeof(ldb_wrapiter_t));
   mi->n = n;
+  mi->heap = ldb_malloc(n * sizeof(ldb_wrapiter_t *));
+  mi->length = 0;
   mi->current = NULL;
   mi->direction = LDB_FORWARD;
 
@@ -71,6 +74,7 @@ ldb_mergeiter_clear(ldb_mergeiter_t *mi) {
     ldb_wrapiter_clear(&mi->children[i]);
 
   ldb_free(mi->children);
+  ldb_free(mi->heap);
 }
 
 static int
@@ -103,52 +107,88 @@ ldb_mergeiter_status(const ldb_mergeiter_t *mi) {
   return rc;
 }
 
+static int
+ldb_mergeiter_compare(const ldb_mergeiter_t *mi,
+                      const ldb_wrapiter_t *x,
+                      const ldb_wrapiter_t *y) {
+  ldb_slice_t x_key = ldb_wrapiter_key(x);
+  ldb_slice_t y_key = ldb_wrapiter_key(y);
+  return ldb_compare(mi->comparator, &x_key, &y_key);
+}
+
+/* Whether child "x" belongs above child "y" in the heap. Equal keys
+   are ordered by position so that we yield them in the same order as
+   a linear scan would: first child first when moving forward, last
+   child first in reverse. */
+static int
+ldb_mergeiter_before(const ldb_mergeiter_t *mi,
+                     const ldb_wrapiter_t *x,
+                     const ldb_wrapiter_t *y) {
+  int r = ldb_mergeiter_compare(mi, x, y);
+
+  if (mi->direction == LDB_FORWARD)
+    return r < 0 || (r == 0 && x < y);
+
+  return r > 0 || (r == 0 && x > y);
+}
+
 static void
-ldb_mergeiter_find_smallest(ldb_mergeiter_t *mi) {
-  ldb_wrapiter_t *smallest = NULL;
-  int i;
+ldb_mergeiter_sift_down(ldb_mergeiter_t *mi, int i) {
+  ldb_wrapiter_t **heap = mi->heap;
+  ldb_wrapiter_t *item = heap[i];
+  int len = mi->length;
 
-  for (i = 0; i < mi->n; i++) {
-    ldb_wrapiter_t *child = &mi->children[i];
+  for (;;) {
+    int j = 2 * i + 1;
 
-    if (ldb_wrapiter_valid(child)) {
-      if (smallest == NULL) {
-        smallest = child;
-      } else {
-        ldb_slice_t child_key = ldb_wrapiter_key(child);
-        ldb_slice_t smallest_key = ldb_wrapiter_key(smallest);
+    if (j >= len)
+      break;
 
-        if (ldb_compare(mi->comparator, &child_key, &smallest_key) < 0)
-          smallest = child;
-      }
-    }
+    if (j + 1 < len && ldb_mergeiter_before(mi, heap[j + 1], heap[j]))
+      j += 1;
+
+    if (!ldb_mergeiter_before(mi, heap[j], item))
+      break;
+
+    heap[i] = heap[j];
+    i = j;
   }
 
-  mi->current = smallest;
+  heap[i] = item;
 }
 
+/* Rebuild the heap from scratch after repositioning every child. */
 static void
-ldb_mergeiter_find_largest(ldb_mergeiter_t *mi) {
-  ldb_wrapiter_t *largest = NULL;
+ldb_mergeiter_heapify(ldb_mergeiter_t *mi) {
   int i;
 
-  for (i = mi->n - 1; i >= 0; i--) {
-    ldb_wrapiter_t *child = &mi->children[i];
+  mi->length = 0;
 
-    if (ldb_wrapiter_valid(child)) {
-      if (largest == NULL) {
-        largest = child;
-      } else {
-        ldb_slice_t child_key = ldb_wrapiter_key(child);
-        ldb_slice_t largest_key = ldb_wrapiter_key(largest);
+  for (i = 0; i < mi->n; i++) {
+    ldb_wrapiter_t *child = &mi->children[i];
 
-        if (ldb_compare(mi->comparator, &child_key, &largest_key) > 0)
-          largest = child;
-      }
-    }
+    if (ldb_wrapiter_valid(child))
+      mi->heap[mi->length++] = child;
   }
 
-  mi->current = largest;
+  for (i = mi->length / 2 - 1; i >= 0; i--)
+    ldb_mergeiter_sift_down(mi, i);
+
+  mi->current = mi->length > 0 ? mi->heap[0] : NULL;
+}
+
+/* Restore the heap after the top child has been moved. */
+static void
+ldb_mergeiter_update_top(ldb_mergeiter_t *mi) {
+  assert(mi->length > 0);
+
+  if (!ldb_wrapiter_valid(mi->heap[0]))
+    mi->heap[0] = mi->heap[--mi->length];
+
+  if (mi->length > 0)
+    ldb_mergeiter_sift_down(mi, 0);
+
+  mi->current = mi->length > 0 ? mi->heap[0] : NULL;
 }
 
 static void
@@ -158,9 +198,9 @@ ldb_mergeiter_first(ldb_mergeiter_t *mi) {
   for (i = 0; i < mi->n; i++)
     ldb_wrapiter_first(&mi->children[i]);
 
-  ldb_mergeiter_find_smallest(mi);
-
   mi->direction = LDB_FORWARD;
+
+  ldb_mergeiter_heapify(mi);
 }
 
 static void
@@ -170,9 +210,9 @@ ldb_mergeiter_last(ldb_mergeiter_t *mi) {
   for (i = 0; i < mi->n; i++)
     ldb_wrapiter_last(&mi->children[i]);
 
-  ldb_mergeiter_find_largest(mi);
-
   mi->direction = LDB_REVERSE;
+
+  ldb_mergeiter_heapify(mi);
 }
 
 static void
@@ -182,9 +222,9 @@ ldb_mergeiter_seek(ldb_mergeiter_t *mi, const ldb_slice_t *target) {
   for (i = 0; i < mi->n; i++)
     ldb_wrapiter_seek(&mi->children[i], target);
 
-  ldb_mergeiter_find_smallest(mi);
-
   mi->direction = LDB_FORWARD;
+
+  ldb_mergeiter_heapify(mi);
 }
 
 static void
@@ -195,32 +235,42 @@ ldb_mergeiter_next(ldb_mergeiter_t *mi) {
      If we are moving in the forward direction, it is already
      true for all of the non-current children since current is
      the smallest child and key(mi) == key(current). Otherwise,
-     we explicitly position the non-current children. */
+     we explicitly position the non-current children.
+
+     In reverse, each non-current child sits at its last entry
+     before key(mi), or is exhausted if it has no such entry. So
+     rather than seeking, a single step (or a rewind) suffices. */
   if (mi->direction != LDB_FORWARD) {
+    ldb_wrapiter_t *current = mi->current;
     int i;
 
     for (i = 0; i < mi->n; i++) {
       ldb_wrapiter_t *child = &mi->children[i];
 
-      if (child != mi->current) {
-        ldb_slice_t mi_key = ldb_mergeiter_key(mi);
+      if (child == current)
+        continue;
 
-        ldb_wrapiter_seek(child, &mi_key);
+      if (!ldb_wrapiter_valid(child))
+        ldb_wrapiter_first(child);
+      else if (ldb_mergeiter_compare(mi, child, current) < 0)
+        ldb_wrapiter_next(child);
 
-        if (ldb_wrapiter_valid(child)) {
-          ldb_slice_t child_key = ldb_wrapiter_key(child);
-
-          if (ldb_compare(mi->comparator, &mi_key, &child_key) == 0)
-            ldb_wrapiter_next(child);
-        }
+      if (ldb_wrapiter_valid(child)) {
+        if (ldb_mergeiter_compare(mi, child, current) == 0)
+          ldb_wrapiter_next(child);
       }
     }
 
     mi->direction = LDB_FORWARD;
+
+    ldb_wrapiter_next(current);
+    ldb_mergeiter_heapify(mi);
+
+    return;
   }
 
   ldb_wrapiter_next(mi->current);
-  ldb_mergeiter_find_smallest(mi);
+  ldb_mergeiter_update_top(mi);
 }
 
 static void
@@ -231,33 +281,44 @@ ldb_mergeiter_prev(ldb_mergeiter_t *mi) {
      If we are moving in the reverse direction, it is already
      true for all of the non-current children since current is
      the largest child and key(mi) == key(current). Otherwise,
-     we explicitly position the non-current children. */
+     we explicitly position the non-current children.
+
+     Moving forward, each non-current child sits at its first entry
+     at or after key(mi), or is exhausted if it has no such entry. */
   if (mi->direction != LDB_REVERSE) {
+    ldb_wrapiter_t *current = mi->current;
     int i;
 
     for (i = 0; i < mi->n; i++) {
       ldb_wrapiter_t *child = &mi->children[i];
 
-      if (child != mi->current) {
-        ldb_slice_t mi_key = ldb_mergeiter_key(mi);
+      if (child == current)
+        continue;
 
-        ldb_wrapiter_seek(child, &mi_key);
+      if (ldb_wrapiter_valid(child)) {
+        /* Child is at first entry >= key(). Step back one to be < key(). */
+        ldb_wrapiter_prev(child);
+      } else {
+        /* Child has no entries >= key(). Position at last entry. */
+        ldb_wrapiter_last(child);
+      }
 
-        if (ldb_wrapiter_valid(child)) {
-          /* Child is at first entry >= key(). Step back one to be < key(). */
+      if (ldb_wrapiter_valid(child)) {
+        if (ldb_mergeiter_compare(mi, child, current) == 0)
           ldb_wrapiter_prev(child);
-        } else {
-          /* Child has no entries >= key(). Position at last entry. */
-          ldb_wrapiter_last(child);
-        }
       }
     }
 
     mi->direction = LDB_REVERSE;
+
+    ldb_wrapiter_prev(current);
+    ldb_mergeiter_heapify(mi);
+
+    return;
   }
 
   ldb_wrapiter_prev(mi->current);
-  ldb_mergeiter_find_largest(mi);
+  ldb_mergeiter_update_top(mi);
 }
 
 LDB_ITERATOR_FUNCTIONS(ldb_mergeiter);
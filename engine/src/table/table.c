@@ -15,6 +15,7 @@
 #include <stdint.h>
 
 #include "../util/bloom.h"
+#include "../util/buffer.h"
 #include "../util/cache.h"
 #include "../util/coding.h"
 #include "../util/comparator.h"
@@ -24,6 +25,9 @@
 #include "../util/slice.h"
 #include "../util/status.h"
 
+#include "../dbformat.h"
+#include "../range_del.h"
+
 #include "block.h"
 #include "filter_block.h"
 #include "format.h"
@@ -45,6 +49,7 @@ struct ldb_table_s {
   ldb_handle_t metaindex_handle; /* Handle to metaindex_block:
                                     saved from footer. */
   ldb_block_t *index_block;
+  ldb_rangedel_t *tombstones; /* NULL if the table has none. */
 };
 
 static void
@@ -77,6 +82,63 @@ ldb_table_read_filter(ldb_table_t *table,
   table->filter = ldb_filter_create(table->options.filter_policy, &block.data);
 }
 
+static void
+ldb_table_read_tombstones(ldb_table_t *table,
+                          const ldb_slice_t *range_handle_value) {
+  const ldb_comparator_t *ucmp = table->options.comparator->user_comparator;
+  ldb_readopt_t opt = *ldb_readopt_default;
+  ldb_handle_t range_handle;
+  ldb_contents_t contents;
+  ldb_rangedel_t *rd;
+  ldb_block_t *block;
+  ldb_iter_t *iter;
+  int rc;
+
+  if (!ldb_handle_import(&range_handle, range_handle_value))
+    return;
+
+  if (table->options.paranoid_checks)
+    opt.verify_checksums = 1;
+
+  rc = ldb_read_block(&contents, table->file, &opt, &range_handle);
+
+  if (rc != LDB_OK) {
+    /* Unlike the filter, the tombstones are needed for correctness. */
+    table->status = rc;
+    return;
+  }
+
+  rd = ldb_rangedel_create(ucmp);
+  block = ldb_block_create(&contents);
+  iter = ldb_blockiter_create(block, table->options.comparator);
+
+  for (ldb_iter_first(iter); ldb_iter_valid(iter); ldb_iter_next(iter)) {
+    ldb_slice_t key = ldb_iter_key(iter);
+    ldb_slice_t limit = ldb_iter_value(iter);
+
+    if (!ldb_rangedel_add_entry(rd, &key, &limit)) {
+      rc = LDB_CORRUPTION;
+      break;
+    }
+  }
+
+  if (rc == LDB_OK)
+    rc = ldb_iter_status(iter);
+
+  ldb_iter_destroy(iter);
+  ldb_block_destroy(block);
+
+  if (rc != LDB_OK) {
+    ldb_rangedel_destroy(rd);
+    table->status = rc;
+    return;
+  }
+
+  ldb_rangedel_finish(rd);
+
+  table->tombstones = rd;
+}
+
 static void
 ldb_table_read_meta(ldb_table_t *table, const ldb_footer_t *footer) {
   ldb_readopt_t opt = *ldb_readopt_default;
@@ -87,15 +149,18 @@ ldb_table_read_meta(ldb_table_t *table, const ldb_footer_t *footer) {
   char name[72];
   int rc;
 
-  if (table->options.filter_policy == NULL)
+  /* An empty metaindex block is only its restart array. Range
+     tombstones are only looked for in tables belonging to a
+     database (i.e. with an internal key comparator). */
+  if (table->options.filter_policy == NULL &&
+      (footer->metaindex_handle.size <= 8 ||
+       table->options.comparator->user_comparator == NULL)) {
     return; /* Do not need any metadata. */
+  }
 
   if (table->options.paranoid_checks)
     opt.verify_checksums = 1;
 
-  if (!ldb_bloom_name(name, sizeof(name), table->options.filter_policy))
-    return;
-
   rc = ldb_read_block(&contents,
                       table->file,
                       &opt,
@@ -109,15 +174,32 @@ ldb_table_read_meta(ldb_table_t *table, const ldb_footer_t *footer) {
   meta = ldb_block_create(&contents);
   iter = ldb_blockiter_create(meta, ldb_bytewise_comparator);
 
-  ldb_slice_set_str(&key, name);
-  ldb_iter_seek(iter, &key);
+  if (table->options.filter_policy != NULL &&
+      ldb_bloom_name(name, sizeof(name), table->options.filter_policy)) {
+    ldb_slice_set_str(&key, name);
+    ldb_iter_seek(iter, &key);
 
-  if (ldb_iter_valid(iter)) {
-    ldb_slice_t iter_key = ldb_iter_key(iter);
+    if (ldb_iter_valid(iter)) {
+      ldb_slice_t iter_key = ldb_iter_key(iter);
 
-    if (ldb_slice_equal(&iter_key, &key)) {
-      ldb_slice_t iter_value = ldb_iter_value(iter);
-      ldb_table_read_filter(table, &iter_value);
+      if (ldb_slice_equal(&iter_key, &key)) {
+        ldb_slice_t iter_value = ldb_iter_value(iter);
+        ldb_table_read_filter(table, &iter_value);
+      }
+    }
+  }
+
+  if (table->options.comparator->user_comparator != NULL) {
+    ldb_slice_set_str(&key, "rangedel");
+    ldb_iter_seek(iter, &key);
+
+    if (ldb_iter_valid(iter)) {
+      ldb_slice_t iter_key = ldb_iter_key(iter);
+
+      if (ldb_slice_equal(&iter_key, &key)) {
+        ldb_slice_t iter_value = ldb_iter_value(iter);
+        ldb_table_read_tombstones(table, &iter_value);
+      }
     }
   }
 
@@ -177,13 +259,19 @@ ldb_table_open(const ldb_dbopt_t *options,
     tbl->filter_data = NULL;
     tbl->metaindex_handle = footer.metaindex_handle;
     tbl->index_block = index_block;
+    tbl->tombstones = NULL;
 
     if (options->block_cache != NULL)
       tbl->cache_id = ldb_lru_id(options->block_cache);
 
     ldb_table_read_meta(tbl, &footer);
 
-    *table = tbl;
+    rc = tbl->status;
+
+    if (rc == LDB_OK)
+      *table = tbl;
+    else
+      ldb_table_destroy(tbl);
   }
 
   return rc;
@@ -199,9 +287,17 @@ ldb_table_destroy(ldb_table_t *table) {
 
   ldb_block_destroy(table->index_block);
 
+  if (table->tombstones != NULL)
+    ldb_rangedel_destroy(table->tombstones);
+
   ldb_free(table);
 }
 
+const ldb_rangedel_t *
+ldb_table_tombstones(const ldb_table_t *table) {
+  return table->tombstones;
+}
+
 static void
 delete_block(void *arg, void *ignored) {
   ldb_block_t *block = (ldb_block_t *)arg;
@@ -224,13 +320,26 @@ release_block(void *arg, void *h) {
   ldb_lru_release(cache, handle);
 }
 
+static int
+ldb_table_read_block(ldb_table_t *table,
+                     ldb_readahead_t *ra,
+                     ldb_contents_t *contents,
+                     const ldb_readopt_t *options,
+                     const ldb_handle_t *handle) {
+  if (ra != NULL)
+    return ldb_readahead_block(ra, contents, table->file, options, handle);
+
+  return ldb_read_block(contents, table->file, options, handle);
+}
+
 /* Convert an index iterator value (i.e., an encoded BlockHandle)
-   into an iterator over the contents of the corresponding block. */
+   into an iterator over the contents of the corresponding block.
+   Blocks which are not cached are read through "ra" if non-NULL. */
 static ldb_iter_t *
-ldb_table_blockreader(void *arg,
-                      const ldb_readopt_t *options,
-                      const ldb_slice_t *index_value) {
-  ldb_table_t *table = (ldb_table_t *)arg;
+ldb_table_block(ldb_table_t *table,
+                ldb_readahead_t *ra,
+                const ldb_readopt_t *options,
+                const ldb_slice_t *index_value) {
   ldb_lru_t *block_cache = table->options.block_cache;
   ldb_entry_t *cache_handle = NULL;
   ldb_block_t *block = NULL;
@@ -260,8 +369,11 @@ ldb_table_blockreader(void *arg,
 
       if (cache_handle != NULL) {
         block = (ldb_block_t *)ldb_lru_value(cache_handle);
+
+        if (ra != NULL)
+          ldb_readahead_skip(ra, &handle);
       } else {
-        rc = ldb_read_block(&contents, table->file, options, &handle);
+        rc = ldb_table_read_block(table, ra, &contents, options, &handle);
 
         if (rc == LDB_OK) {
           block = ldb_block_create(&contents);
@@ -276,7 +388,7 @@ ldb_table_blockreader(void *arg,
         }
       }
     } else {
-      rc = ldb_read_block(&contents, table->file, options, &handle);
+      rc = ldb_table_read_block(table, ra, &contents, options, &handle);
 
       if (rc == LDB_OK)
         block = ldb_block_create(&contents);
@@ -299,28 +411,67 @@ ldb_table_blockreader(void *arg,
   return iter;
 }
 
+/* A table iterator reads ahead of itself. */
+typedef struct ldb_scan_s {
+  ldb_table_t *table;
+  ldb_readahead_t ra;
+} ldb_scan_t;
+
+static ldb_iter_t *
+ldb_table_scanreader(void *arg,
+                     const ldb_readopt_t *options,
+                     const ldb_slice_t *index_value) {
+  ldb_scan_t *scan = (ldb_scan_t *)arg;
+  return ldb_table_block(scan->table, &scan->ra, options, index_value);
+}
+
+static void
+delete_scan(void *arg, void *ignored) {
+  ldb_scan_t *scan = (ldb_scan_t *)arg;
+  (void)ignored;
+  ldb_readahead_clear(&scan->ra);
+  ldb_free(scan);
+}
+
 ldb_iter_t *
 ldb_tableiter_create(const ldb_table_t *table, const ldb_readopt_t *options) {
   ldb_iter_t *iter = ldb_blockiter_create(table->index_block,
                                           table->options.comparator);
+  ldb_scan_t *scan = ldb_malloc(sizeof(ldb_scan_t));
+
+  scan->table = (ldb_table_t *)table;
 
-  return ldb_twoiter_create(iter,
-                            &ldb_table_blockreader,
-                            (void *)table,
-                            options);
+  ldb_readahead_init(&scan->ra, options->readahead_size);
+
+  iter = ldb_twoiter_create(iter, &ldb_table_scanreader, scan, options);
+
+  ldb_iter_register_cleanup(iter, &delete_scan, scan, NULL);
+
+  return iter;
 }
 
 int
 ldb_table_internal_get(ldb_table_t *table,
                        const ldb_readopt_t *options,
                        const ldb_slice_t *k,
+                       ldb_cleanup_t *pin,
                        void *arg,
-                       void (*handle_result)(void *,
-                                             const ldb_slice_t *,
-                                             const ldb_slice_t *)) {
+                       int (*handle_result)(void *,
+                                            const ldb_slice_t *,
+                                            const ldb_slice_t *)) {
+  const ldb_comparator_t *ucmp = table->options.comparator->user_comparator;
+  ldb_seqnum_t cover = 0;
+  ldb_slice_t ukey = ldb_extract_user_key(k);
   ldb_iter_t *index_iter;
+  int more = 1;
   int rc = LDB_OK;
 
+  if (table->tombstones != NULL) {
+    ldb_seqnum_t snapshot = ldb_fixed64_decode(k->data + k->size - 8) >> 8;
+
+    cover = ldb_rangedel_covering(table->tombstones, &ukey, snapshot);
+  }
+
   index_iter = ldb_blockiter_create(table->index_block,
                                     table->options.comparator);
 
@@ -335,24 +486,70 @@ ldb_table_internal_get(ldb_table_t *table,
         ldb_handle_import(&handle, &iter_value) &&
         !ldb_filter_matches(filter, handle.offset, k)) {
       /* Not found. */
+      more = (cover > 0);
     } else {
-      ldb_iter_t *block_iter = ldb_table_blockreader(table,
-                                                     options,
-                                                     &iter_value);
+      ldb_iter_t *block_iter = ldb_table_block(table, NULL,
+                                               options,
+                                               &iter_value);
 
       ldb_iter_seek(block_iter, k);
 
-      if (ldb_iter_valid(block_iter)) {
-        ldb_slice_t block_iter_key = ldb_iter_key(block_iter);
-        ldb_slice_t block_iter_value = ldb_iter_value(block_iter);
+      for (;;) {
+        while (more && ldb_iter_valid(block_iter)) {
+          ldb_slice_t block_iter_key = ldb_iter_key(block_iter);
+          ldb_slice_t block_iter_value = ldb_iter_value(block_iter);
+          ldb_pkey_t pkey;
+
+          /* Entries older than a covering tombstone are deleted. */
+          if (cover > 0 && !(ldb_pkey_import(&pkey, &block_iter_key) &&
+                             ldb_compare(ucmp, &pkey.user_key, &ukey) == 0 &&
+                             pkey.sequence > cover)) {
+            break;
+          }
+
+          more = (*handle_result)(arg, &block_iter_key, &block_iter_value);
+
+          ldb_iter_next(block_iter);
+        }
+
+        /* The entries for a key (merge operands) may continue in
+           the next block. */
+        if (!more || ldb_iter_valid(block_iter))
+          break;
+
+        rc = ldb_iter_status(block_iter);
+
+        if (rc != LDB_OK)
+          break;
+
+        ldb_iter_destroy(block_iter);
+
+        ldb_iter_next(index_iter);
 
-        (*handle_result)(arg, &block_iter_key, &block_iter_value);
+        if (!ldb_iter_valid(index_iter)) {
+          block_iter = NULL;
+          break;
+        }
+
+        iter_value = ldb_iter_value(index_iter);
+        block_iter = ldb_table_block(table, NULL, options, &iter_value);
+
+        ldb_iter_first(block_iter);
       }
 
-      rc = ldb_iter_status(block_iter);
+      if (block_iter != NULL) {
+        if (rc == LDB_OK)
+          rc = ldb_iter_status(block_iter);
 
-      ldb_iter_destroy(block_iter);
+        /* Keep the block alive for the caller's last entry. */
+        if (pin != NULL && !more)
+          ldb_iter_transfer_cleanup(block_iter, pin);
+
+        ldb_iter_destroy(block_iter);
+      }
     }
+  } else {
+    more = (cover > 0);
   }
 
   if (rc == LDB_OK)
@@ -360,6 +557,19 @@ ldb_table_internal_get(ldb_table_t *table,
 
   ldb_iter_destroy(index_iter);
 
+  if (rc == LDB_OK && cover > 0 && more) {
+    /* Report the tombstone as a deletion of the key. */
+    static const ldb_slice_t empty = {NULL, 0, 0};
+    ldb_buffer_t key;
+
+    ldb_buffer_init(&key);
+    ldb_ikey_set(&key, &ukey, cover, LDB_TYPE_DELETION);
+
+    (*handle_result)(arg, &key, &empty);
+
+    ldb_buffer_clear(&key);
+  }
+
   return rc;
 }
 
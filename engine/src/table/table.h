@@ -21,8 +21,10 @@
  * Types
  */
 
+struct ldb_cleanup_s;
 struct ldb_dbopt_s;
 struct ldb_iter_s;
+struct ldb_rangedel_s;
 struct ldb_readopt_s;
 struct ldb_rfile_s;
 
@@ -57,6 +59,10 @@ ldb_table_open(const struct ldb_dbopt_s *options,
 void
 ldb_table_destroy(ldb_table_t *table);
 
+/* Returns the range tombstones stored in the table, or NULL if
+   there are none. The result lives as long as the table. */
+const struct ldb_rangedel_s *
+ldb_table_tombstones(const ldb_table_t *table);
 
 /* Returns a new iterator over the table contents.
  * The result of create() is initially invalid (caller must
@@ -67,17 +73,24 @@ ldb_tableiter_create(const ldb_table_t *table,
                      const struct ldb_readopt_s *options);
 
 /* Calls (*handle_result)(arg, ...) with the entry found after a call
- * to seek(key). May not make such a call if filter policy says
- * that key is not present.
+ * to seek(key), and with each following entry for as long as it
+ * returns true. May not make such a call if filter policy says
+ * that key is not present. If a range tombstone in the table hides
+ * the key, a deletion at the tombstone's sequence is passed instead.
+ *
+ * If "pin" is non-NULL and (*handle_result) stops the lookup, the
+ * block holding the last entry is not released. The function which
+ * releases it is added to "pin" instead.
  */
 int
 ldb_table_internal_get(ldb_table_t *table,
                        const struct ldb_readopt_s *options,
                        const ldb_slice_t *k,
+                       struct ldb_cleanup_s *pin,
                        void *arg,
-                       void (*handle_result)(void *,
-                                             const ldb_slice_t *,
-                                             const ldb_slice_t *));
+                       int (*handle_result)(void *,
+                                            const ldb_slice_t *,
+                                            const ldb_slice_t *));
 
 /* Given a key, return an approximate byte offset in the file where
  * the data for that key begins (or would begin if the key were
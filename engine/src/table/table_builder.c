@@ -47,6 +47,8 @@ struct ldb_tablegen_s {
   int64_t num_entries;
   int closed; /* Either finish() or abandon() has been called. */
   ldb_filtergen_t *filter_block;
+  ldb_blockgen_t range_block;
+  int64_t num_tombstones;
 
   /* We do not emit the index entry for a block until we have seen the
      first key for the next data block. This allows us to use shorter
@@ -73,12 +75,14 @@ ldb_tablegen_init(ldb_tablegen_t *tb,
 
   ldb_blockgen_init(&tb->data_block, &tb->options);
   ldb_blockgen_init(&tb->index_block, &tb->index_block_options);
+  ldb_blockgen_init(&tb->range_block, &tb->options);
 
   ldb_buffer_init(&tb->last_key);
 
   tb->num_entries = 0;
   tb->closed = 0;
   tb->filter_block = NULL;
+  tb->num_tombstones = 0;
   tb->pending_index_entry = 0;
 
   ldb_handle_init(&tb->pending_handle);
@@ -99,6 +103,7 @@ ldb_tablegen_clear(ldb_tablegen_t *tb) {
 
   ldb_blockgen_clear(&tb->data_block);
   ldb_blockgen_clear(&tb->index_block);
+  ldb_blockgen_clear(&tb->range_block);
 
   ldb_buffer_clear(&tb->last_key);
   ldb_buffer_clear(&tb->compressed_output);
@@ -254,6 +259,20 @@ ldb_tablegen_add(ldb_tablegen_t *tb,
     ldb_tablegen_flush(tb);
 }
 
+void
+ldb_tablegen_add_tombstone(ldb_tablegen_t *tb,
+                           const ldb_slice_t *key,
+                           const ldb_slice_t *limit) {
+  assert(!tb->closed);
+
+  if (tb->status != LDB_OK)
+    return;
+
+  ldb_blockgen_add(&tb->range_block, key, limit);
+
+  tb->num_tombstones++;
+}
+
 void
 ldb_tablegen_flush(ldb_tablegen_t *tb) {
   assert(!tb->closed);
@@ -282,6 +301,7 @@ ldb_tablegen_finish(ldb_tablegen_t *tb) {
   ldb_handle_t metaindex_handle = {0, 0};
   ldb_handle_t index_handle = {0, 0};
   ldb_handle_t filter_handle;
+  ldb_handle_t range_handle;
 
   ldb_tablegen_flush(tb);
 
@@ -298,6 +318,10 @@ ldb_tablegen_finish(ldb_tablegen_t *tb) {
                                      &filter_handle);
   }
 
+  /* Write range tombstone block. */
+  if (tb->status == LDB_OK && tb->num_tombstones > 0)
+    ldb_tablegen_write_block(tb, &tb->range_block, &range_handle);
+
   /* Write metaindex block. */
   if (tb->status == LDB_OK) {
     ldb_blockgen_t metaindex_block;
@@ -322,6 +346,19 @@ ldb_tablegen_finish(ldb_tablegen_t *tb) {
       ldb_blockgen_add(&metaindex_block, &key, &handle_encoding);
     }
 
+    if (tb->num_tombstones > 0) {
+      /* Add mapping from "rangedel" to location of the tombstones.
+         Sorts after "filter.Name". */
+      uint8_t tmp[LDB_HANDLE_SIZE];
+      ldb_buffer_t handle_encoding;
+      ldb_slice_t key;
+
+      ldb_slice_set_str(&key, "rangedel");
+      ldb_buffer_rwset(&handle_encoding, tmp, sizeof(tmp));
+      ldb_handle_export(&handle_encoding, &range_handle);
+      ldb_blockgen_add(&metaindex_block, &key, &handle_encoding);
+    }
+
     ldb_tablegen_write_block(tb, &metaindex_block, &metaindex_handle);
 
     ldb_blockgen_clear(&metaindex_block);
@@ -380,6 +417,11 @@ ldb_tablegen_entries(const ldb_tablegen_t *tb) {
   return tb->num_entries;
 }
 
+uint64_t
+ldb_tablegen_tombstones(const ldb_tablegen_t *tb) {
+  return tb->num_tombstones;
+}
+
 uint64_t
 ldb_tablegen_size(const ldb_tablegen_t *tb) {
   return tb->offset;
@@ -50,6 +50,15 @@ ldb_tablegen_add(ldb_tablegen_t *tb,
                  const ldb_slice_t *key,
                  const ldb_slice_t *value);
 
+/* Add a range tombstone, stored as its internal start key and the
+   exclusive user key limit. Tombstones are kept in their own block. */
+/* REQUIRES: key is after any previously added tombstone. */
+/* REQUIRES: finish(), abandon() have not been called */
+void
+ldb_tablegen_add_tombstone(ldb_tablegen_t *tb,
+                           const ldb_slice_t *key,
+                           const ldb_slice_t *limit);
+
 /* Advanced operation: flush any buffered key/value pairs to file.
  * Can be used to ensure that two adjacent entries never live in
  * the same data block. Most clients should not need to use this method.
@@ -82,6 +91,10 @@ ldb_tablegen_status(const ldb_tablegen_t *tb);
 uint64_t
 ldb_tablegen_entries(const ldb_tablegen_t *tb);
 
+/* Number of calls to add_tombstone() so far. */
+uint64_t
+ldb_tablegen_tombstones(const ldb_tablegen_t *tb);
+
 /* Size of the file generated so far. If invoked after a successful
    finish() call, returns the size of the final generated file. */
 uint64_t
@@ -17,15 +17,19 @@
 #include "table/iterator.h"
 #include "table/table.h"
 
+#include "util/buffer.h"
 #include "util/cache.h"
 #include "util/coding.h"
+#include "util/comparator.h"
 #include "util/env.h"
 #include "util/internal.h"
 #include "util/options.h"
 #include "util/slice.h"
 #include "util/status.h"
 
+#include "dbformat.h"
 #include "filename.h"
+#include "range_del.h"
 #include "table_cache.h"
 
 /*
@@ -43,6 +47,23 @@ typedef struct table_entry_s {
   ldb_table_t *table;
 } table_entry_t;
 
+/* An ingested table is written with every entry at sequence zero.
+   Its keys are given the sequence assigned to the file on read. */
+typedef struct ldb_seqiter_s {
+  const ldb_comparator_t *ucmp;
+  ldb_iter_t *iter;
+  ldb_seqnum_t sequence;
+  ldb_buffer_t key;
+} ldb_seqiter_t;
+
+typedef struct seq_state_s {
+  void *arg;
+  int (*handle_result)(void *, const ldb_slice_t *, const ldb_slice_t *);
+  ldb_seqnum_t sequence;
+  ldb_seqnum_t snapshot;
+  ldb_buffer_t key;
+} seq_state_t;
+
 /*
  * Helpers
  */
@@ -66,6 +87,136 @@ unref_entry(void *arg1, void *arg2) {
   ldb_lru_release(lru, h);
 }
 
+/* Replace the sequence number of internal key "x". */
+static void
+set_sequence(ldb_buffer_t *z, const ldb_slice_t *x, ldb_seqnum_t sequence) {
+  uint64_t tag;
+
+  assert(x->size >= 8);
+
+  tag = ldb_fixed64_decode(x->data + x->size - 8);
+  tag = (sequence << 8) | (tag & 0xff);
+
+  ldb_buffer_set(z, x->data, x->size);
+  ldb_fixed64_write(z->data + z->size - 8, tag);
+}
+
+static ldb_seqnum_t
+get_sequence(const ldb_slice_t *x) {
+  assert(x->size >= 8);
+  return ldb_fixed64_decode(x->data + x->size - 8) >> 8;
+}
+
+/*
+ * SequenceIterator
+ */
+
+static void
+ldb_seqiter_update(ldb_seqiter_t *iter) {
+  if (ldb_iter_valid(iter->iter)) {
+    ldb_slice_t key = ldb_iter_key(iter->iter);
+
+    set_sequence(&iter->key, &key, iter->sequence);
+  }
+}
+
+static void
+ldb_seqiter_clear(ldb_seqiter_t *iter) {
+  ldb_iter_destroy(iter->iter);
+  ldb_buffer_clear(&iter->key);
+}
+
+static int
+ldb_seqiter_valid(const ldb_seqiter_t *iter) {
+  return ldb_iter_valid(iter->iter);
+}
+
+static void
+ldb_seqiter_first(ldb_seqiter_t *iter) {
+  ldb_iter_first(iter->iter);
+  ldb_seqiter_update(iter);
+}
+
+static void
+ldb_seqiter_last(ldb_seqiter_t *iter) {
+  ldb_iter_last(iter->iter);
+  ldb_seqiter_update(iter);
+}
+
+static void
+ldb_seqiter_seek(ldb_seqiter_t *iter, const ldb_slice_t *target) {
+  /* Every entry sorts after a target with the same user key. Skip
+     the entry if its sequence makes it sort before the target. */
+  ldb_iter_seek(iter->iter, target);
+
+  if (ldb_iter_valid(iter->iter) && iter->sequence > get_sequence(target)) {
+    ldb_slice_t key = ldb_iter_key(iter->iter);
+    ldb_slice_t x = ldb_extract_user_key(&key);
+    ldb_slice_t y = ldb_extract_user_key(target);
+
+    if (ldb_compare(iter->ucmp, &x, &y) == 0)
+      ldb_iter_next(iter->iter);
+  }
+
+  ldb_seqiter_update(iter);
+}
+
+static void
+ldb_seqiter_next(ldb_seqiter_t *iter) {
+  ldb_iter_next(iter->iter);
+  ldb_seqiter_update(iter);
+}
+
+static void
+ldb_seqiter_prev(ldb_seqiter_t *iter) {
+  ldb_iter_prev(iter->iter);
+  ldb_seqiter_update(iter);
+}
+
+static ldb_slice_t
+ldb_seqiter_key(const ldb_seqiter_t *iter) {
+  assert(ldb_seqiter_valid(iter));
+  return iter->key;
+}
+
+static ldb_slice_t
+ldb_seqiter_value(const ldb_seqiter_t *iter) {
+  return ldb_iter_value(iter->iter);
+}
+
+static int
+ldb_seqiter_status(const ldb_seqiter_t *iter) {
+  return ldb_iter_status(iter->iter);
+}
+
+LDB_ITERATOR_FUNCTIONS(ldb_seqiter);
+
+static ldb_iter_t *
+ldb_seqiter_create(ldb_iter_t *base, ldb_seqnum_t sequence) {
+  ldb_seqiter_t *iter = ldb_malloc(sizeof(ldb_seqiter_t));
+
+  iter->ucmp = base->cmp->user_comparator;
+  iter->iter = base;
+  iter->sequence = sequence;
+
+  ldb_buffer_init(&iter->key);
+
+  return ldb_iter_create(iter, &ldb_seqiter_table, base->cmp);
+}
+
+static int
+seq_handle_result(void *arg, const ldb_slice_t *k, const ldb_slice_t *v) {
+  seq_state_t *state = (seq_state_t *)arg;
+
+  /* Entries newer than the lookup are not visible to it. */
+  if (state->sequence > state->snapshot)
+    return 0;
+
+  set_sequence(&state->key, k, state->sequence);
+
+  return state->handle_result(state->arg, &state->key, v);
+}
+
 /*
  * TableCache
  */
@@ -152,6 +303,7 @@ ldb_tables_iterate(ldb_tables_t *cache,
                    const ldb_readopt_t *options,
                    uint64_t file_number,
                    uint64_t file_size,
+                   ldb_seqnum_t sequence,
                    ldb_table_t **tableptr) {
   ldb_entry_t *handle = NULL;
   ldb_table_t *table;
@@ -169,6 +321,9 @@ ldb_tables_iterate(ldb_tables_t *cache,
   table = ((table_entry_t *)ldb_lru_value(handle))->table;
   result = ldb_tableiter_create(table, options);
 
+  if (sequence > 0)
+    result = ldb_seqiter_create(result, sequence);
+
   ldb_iter_register_cleanup(result, &unref_entry, cache->lru, handle);
 
   if (tableptr != NULL)
@@ -182,11 +337,57 @@ ldb_tables_get(ldb_tables_t *cache,
                const ldb_readopt_t *options,
                uint64_t file_number,
                uint64_t file_size,
+               ldb_seqnum_t sequence,
                const ldb_slice_t *k,
+               ldb_cleanup_t *pin,
                void *arg,
-               void (*handle_result)(void *,
-                                     const ldb_slice_t *,
-                                     const ldb_slice_t *)) {
+               int (*handle_result)(void *,
+                                    const ldb_slice_t *,
+                                    const ldb_slice_t *)) {
+  ldb_entry_t *handle = NULL;
+  int rc;
+
+  assert(pin == NULL || ldb_cleanup_empty(pin));
+
+  rc = find_table(cache, file_number, file_size, &handle);
+
+  if (rc == LDB_OK) {
+    ldb_table_t *table = ((table_entry_t *)ldb_lru_value(handle))->table;
+
+    if (sequence > 0) {
+      seq_state_t state;
+
+      state.arg = arg;
+      state.handle_result = handle_result;
+      state.sequence = sequence;
+      state.snapshot = get_sequence(k);
+
+      ldb_buffer_init(&state.key);
+
+      rc = ldb_table_internal_get(table, options, k, pin, &state,
+                                  seq_handle_result);
+
+      ldb_buffer_clear(&state.key);
+    } else {
+      rc = ldb_table_internal_get(table, options, k, pin,
+                                  arg, handle_result);
+    }
+
+    /* A pinned block may point into the table's mapped file. */
+    if (pin != NULL && !ldb_cleanup_empty(pin))
+      ldb_cleanup_push(pin, unref_entry, cache->lru, handle);
+    else
+      ldb_lru_release(cache->lru, handle);
+  }
+
+  return rc;
+}
+
+int
+ldb_tables_tombstones(ldb_tables_t *cache,
+                      uint64_t file_number,
+                      uint64_t file_size,
+                      ldb_rangedel_t *rd) {
   ldb_entry_t *handle = NULL;
   int rc;
 
@@ -194,8 +395,10 @@ ldb_tables_get(ldb_tables_t *cache,
 
   if (rc == LDB_OK) {
     ldb_table_t *table = ((table_entry_t *)ldb_lru_value(handle))->table;
+    const ldb_rangedel_t *tombstones = ldb_table_tombstones(table);
 
-    rc = ldb_table_internal_get(table, options, k, arg, handle_result);
+    if (tombstones != NULL)
+      ldb_rangedel_merge(rd, tombstones);
 
     ldb_lru_release(cache->lru, handle);
   }
@@ -203,6 +406,19 @@ ldb_tables_get(ldb_tables_t *cache,
   return rc;
 }
 
+int
+ldb_tables_load(ldb_tables_t *cache, uint64_t file_number, uint64_t file_size) {
+  ldb_entry_t *handle = NULL;
+  int rc;
+
+  rc = find_table(cache, file_number, file_size, &handle);
+
+  if (rc == LDB_OK)
+    ldb_lru_release(cache->lru, handle);
+
+  return rc;
+}
+
 void
 ldb_tables_evict(ldb_tables_t *cache, uint64_t file_number) {
   ldb_slice_t key;
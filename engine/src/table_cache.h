@@ -19,11 +19,15 @@
 #include "util/options.h"
 #include "util/types.h"
 
+#include "dbformat.h"
+
 /*
  * Types
  */
 
+struct ldb_cleanup_s;
 struct ldb_iter_s;
+struct ldb_rangedel_s;
 
 typedef struct ldb_tables_s ldb_tables_t;
 
@@ -44,26 +48,47 @@ ldb_tables_destroy(ldb_tables_t *cache);
  * underlies the returned iterator. The returned "*tableptr" object is owned
  * by the cache and should not be deleted, and is valid for as long as the
  * returned iterator is live.
+ *
+ * A non-zero "sequence" is the sequence number assigned to an ingested
+ * table. It replaces that of every entry read from the table.
  */
 struct ldb_iter_s *
 ldb_tables_iterate(ldb_tables_t *cache,
                    const ldb_readopt_t *options,
                    uint64_t file_number,
                    uint64_t file_size,
+                   ldb_seqnum_t sequence,
                    ldb_table_t **tableptr);
 
 /* If a seek to internal key "k" in specified file finds an entry,
-   call (*handle_result)(arg, found_key, found_value). */
+   call (*handle_result)(arg, found_key, found_value), and continue
+   with the following entries for as long as it returns true. If
+   "pin" is non-NULL, the last entry passed stays valid (along with
+   the table) until "pin" is cleared. See ldb_table_internal_get. */
 int
 ldb_tables_get(ldb_tables_t *cache,
                const ldb_readopt_t *options,
                uint64_t file_number,
                uint64_t file_size,
+               ldb_seqnum_t sequence,
                const ldb_slice_t *k,
+               struct ldb_cleanup_s *pin,
                void *arg,
-               void (*handle_result)(void *,
-                                     const ldb_slice_t *,
-                                     const ldb_slice_t *));
+               int (*handle_result)(void *,
+                                    const ldb_slice_t *,
+                                    const ldb_slice_t *));
+
+/* Add the range tombstones of the specified file to "rd". */
+int
+ldb_tables_tombstones(ldb_tables_t *cache,
+                      uint64_t file_number,
+                      uint64_t file_size,
+                      struct ldb_rangedel_s *rd);
+
+/* Open the table for the specified file number and insert it into
+   the cache if it is not already present. Used to warm the cache. */
+int
+ldb_tables_load(ldb_tables_t *cache, uint64_t file_number, uint64_t file_size);
 
 /* Evict any entry for the specified file number. */
 void
@@ -15,6 +15,7 @@
 #include <stdlib.h>
 #include "arena.h"
 #include "atomic.h"
+#include "env.h"
 #include "internal.h"
 #include "vector.h"
 
@@ -29,12 +30,24 @@
  */
 
 void
-ldb_arena_init(ldb_arena_t *arena) {
+ldb_arena_init(ldb_arena_t *arena, size_t block_size, int huge) {
+  if (block_size < LDB_ARENA_BLOCK)
+    block_size = LDB_ARENA_BLOCK;
+
+  if (huge) {
+    size_t mask = LDB_HUGE_PAGE_SIZE - 1;
+
+    block_size = (block_size + mask) & ~mask;
+  }
+
   arena->data = NULL;
   arena->left = 0;
+  arena->block_size = block_size;
+  arena->huge = huge;
 
   ldb_atomic_init(&arena->usage, 0);
   ldb_vector_init(&arena->blocks);
+  ldb_vector_init(&arena->huge_blocks);
 }
 
 void
@@ -44,7 +57,11 @@ ldb_arena_clear(ldb_arena_t *arena) {
   for (i = 0; i < arena->blocks.length; i++)
     ldb_free(arena->blocks.items[i]);
 
+  for (i = 0; i < arena->huge_blocks.length; i++)
+    ldb_huge_free(arena->huge_blocks.items[i], arena->block_size);
+
   ldb_vector_clear(&arena->blocks);
+  ldb_vector_clear(&arena->huge_blocks);
 }
 
 size_t
@@ -65,11 +82,30 @@ ldb_arena_alloc_block(ldb_arena_t *arena, size_t size) {
   return result;
 }
 
+static void *
+ldb_arena_alloc_huge(ldb_arena_t *arena) {
+  void *result = ldb_huge_alloc(arena->block_size);
+
+  if (result == NULL) {
+    /* Unsupported. Don't bother trying again. */
+    arena->huge = 0;
+    return ldb_arena_alloc_block(arena, arena->block_size);
+  }
+
+  ldb_vector_push(&arena->huge_blocks, result);
+
+  ldb_atomic_fetch_add(&arena->usage,
+                       arena->block_size + sizeof(void *),
+                       ldb_order_relaxed);
+
+  return result;
+}
+
 static void *
 ldb_arena_alloc_fallback(ldb_arena_t *arena, size_t size) {
   void *result;
 
-  if (size > LDB_ARENA_BLOCK / 4) {
+  if (size > arena->block_size / 4) {
     /* Object is more than a quarter of our block size.
        Allocate it separately to avoid wasting too much
        space in leftover bytes. */
@@ -77,8 +113,12 @@ ldb_arena_alloc_fallback(ldb_arena_t *arena, size_t size) {
   }
 
   /* We waste the remaining space in the current block. */
-  arena->data = ldb_arena_alloc_block(arena, LDB_ARENA_BLOCK);
-  arena->left = LDB_ARENA_BLOCK;
+  if (arena->huge)
+    arena->data = ldb_arena_alloc_huge(arena);
+  else
+    arena->data = ldb_arena_alloc_block(arena, arena->block_size);
+
+  arena->left = arena->block_size;
 
   result = arena->data;
 
@@ -31,14 +31,22 @@ typedef struct ldb_arena_s {
   ldb_atomic(size_t) usage;
   /* Array of allocated memory blocks. */
   ldb_vector_t blocks;
+  /* Size of each block. */
+  size_t block_size;
+  /* Blocks of block_size bytes backed by huge pages. */
+  int huge;
+  ldb_vector_t huge_blocks;
 } ldb_arena_t;
 
 /*
  * Arena
  */
 
+/* Blocks are "block_size" bytes (4KB if zero). If "huge" is true,
+   blocks are rounded up to a multiple of the huge page size and
+   backed by huge pages where the platform allows it. */
 void
-ldb_arena_init(ldb_arena_t *arena);
+ldb_arena_init(ldb_arena_t *arena, size_t block_size, int huge);
 
 void
 ldb_arena_clear(ldb_arena_t *arena);
@@ -138,6 +138,44 @@ ldb_appendfile_create(const char *filename, ldb_wfile_t **file) {
   return ldb_appendfile_create0(filename, file);
 }
 
+int
+ldb_reusefile_create(const char *filename, ldb_wfile_t **file) {
+#ifndef NDEBUG
+  struct ldb_env_state_s *state = &ldb_env_state;
+
+  if (state->enable_testing) {
+    if (ldb_atomic_load(&state->non_writable, ldb_order_acquire))
+      return LDB_IOERR; /* "simulated write error" */
+
+    if (state->writable_file_error) {
+      ++state->num_writable_file_errors;
+      return LDB_IOERR; /* "fake error" */
+    }
+  }
+#endif
+
+  return ldb_reusefile_create0(filename, file);
+}
+
+int
+ldb_mmapfile_create(const char *filename, uint64_t size, ldb_wfile_t **file) {
+#ifndef NDEBUG
+  struct ldb_env_state_s *state = &ldb_env_state;
+
+  if (state->enable_testing) {
+    if (ldb_atomic_load(&state->non_writable, ldb_order_acquire))
+      return LDB_IOERR; /* "simulated write error" */
+
+    if (state->writable_file_error) {
+      ++state->num_writable_file_errors;
+      return LDB_IOERR; /* "fake error" */
+    }
+  }
+#endif
+
+  return ldb_mmapfile_create0(filename, size, file);
+}
+
 int
 ldb_write_file(const char *fname, const ldb_slice_t *data, int should_sync) {
   ldb_wfile_t *file = NULL;
@@ -178,6 +178,19 @@ ldb_truncfile_create(const char *filename, ldb_wfile_t **file);
 int
 ldb_appendfile_create(const char *filename, ldb_wfile_t **file);
 
+/* Like ldb_truncfile_create(), but existing contents are overwritten
+   in place rather than truncated. The file keeps its size (and its
+   allocated blocks) until writing goes past the old end. */
+int
+ldb_reusefile_create(const char *filename, ldb_wfile_t **file);
+
+/* Like ldb_truncfile_create(), but the file is preallocated to "size"
+   bytes and written through a shared memory mapping where the platform
+   supports it. Syncing only flushes the written range. Unused space is
+   released when the file is closed or destroyed. */
+int
+ldb_mmapfile_create(const char *filename, uint64_t size, ldb_wfile_t **file);
+
 int
 ldb_wfile_append(ldb_wfile_t *file, const ldb_slice_t *data);
 
@@ -212,6 +225,23 @@ ldb_logger_fopen(FILE *stream);
 int
 ldb_logger_open(const char *filename, ldb_logger_t **result);
 
+/*
+ * Memory
+ */
+
+/* Size (and alignment) of a huge page. */
+#define LDB_HUGE_PAGE_SIZE (2 << 20)
+
+/* Allocate "size" bytes (a multiple of LDB_HUGE_PAGE_SIZE) backed by
+   huge pages where possible. Returns NULL if unsupported. Pages are not
+   touched, so they end up on the NUMA node of the first thread to
+   write to them. */
+void *
+ldb_huge_alloc(size_t size);
+
+void
+ldb_huge_free(void *ptr, size_t size);
+
 /*
  * Time
  */
@@ -769,6 +769,27 @@ ldb_truncfile_create0(const char *filename, ldb_wfile_t **file) {
   return LDB_OK;
 }
 
+/*
+ * ReusableFile
+ */
+
+static LDB_INLINE int
+ldb_reusefile_create0(const char *filename, ldb_wfile_t **file) {
+  /* Memory files only support appending. */
+  return ldb_truncfile_create0(filename, file);
+}
+
+/*
+ * MappedFile
+ */
+
+static LDB_INLINE int
+ldb_mmapfile_create0(const char *filename, uint64_t size, ldb_wfile_t **file) {
+  /* Memory files are never mapped. */
+  (void)size;
+  return ldb_truncfile_create0(filename, file);
+}
+
 /*
  * AppendableFile
  */
@@ -806,6 +827,24 @@ ldb_logger_open(const char *filename, ldb_logger_t **result) {
   return LDB_OK;
 }
 
+/*
+ * Memory
+ */
+
+void *
+ldb_huge_alloc(size_t size) {
+  /* Left to the allocator. */
+  (void)size;
+  return NULL;
+}
+
+void
+ldb_huge_free(void *ptr, size_t size) {
+  (void)ptr;
+  (void)size;
+  abort(); /* LCOV_EXCL_LINE */
+}
+
 /*
  * Time
  */
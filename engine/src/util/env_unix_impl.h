@@ -59,6 +59,8 @@
 #undef HAVE_FLOCK
 #undef HAVE_FDATASYNC
 #undef HAVE_PREAD
+#undef HAVE_FALLOCATE
+#undef HAVE_MAPWRITE
 
 #if !defined(__wasi__) && !defined(__EMSCRIPTEN__)
 #  define HAVE_FCNTL
@@ -90,6 +92,16 @@
 #  define HAVE_PREAD
 #endif
 
+#ifdef LDB_HAVE_FALLOCATE
+#  define HAVE_FALLOCATE
+#endif
+
+/* Writing through a shared mapping requires the file to be allocated
+   up front. Otherwise a full disk raises SIGBUS instead of an error. */
+#if defined(HAVE_MMAP) && defined(HAVE_FALLOCATE)
+#  define HAVE_MAPWRITE
+#endif
+
 /*
  * Fixes
  */
@@ -1261,6 +1273,13 @@ struct ldb_wfile_s {
   int fd, manifest;
   unsigned char buf[LDB_WRITE_BUFFER];
   size_t pos;
+#ifdef HAVE_MAPWRITE
+  /* Mapped files write at base + pos instead of buffering. */
+  unsigned char *base;
+  size_t length;
+  size_t synced;
+  int remapped;
+#endif
 };
 
 static void
@@ -1270,6 +1289,13 @@ ldb_wfile_init(ldb_wfile_t *file, const char *filename, int fd) {
   file->manifest = ldb_is_manifest(filename);
   file->pos = 0;
 
+#ifdef HAVE_MAPWRITE
+  file->base = NULL;
+  file->length = 0;
+  file->synced = 0;
+  file->remapped = 0;
+#endif
+
   if (file->manifest) {
     size_t size = strlen(filename) + 2;
 
@@ -1310,6 +1336,112 @@ ldb_wfile_sync_dir(ldb_wfile_t *file) {
   return ldb_sync_dir(file->dirname);
 }
 
+#ifdef HAVE_MAPWRITE
+static size_t
+ldb_page_size(void) {
+  static size_t page_size = 0;
+
+  if (page_size == 0) {
+    long size = sysconf(_SC_PAGESIZE);
+    page_size = size > 0 ? (size_t)size : 4096;
+  }
+
+  return page_size;
+}
+
+/* Allocate the file up to "length" bytes and map all of it. */
+static int
+ldb_wfile_map(ldb_wfile_t *file, size_t length) {
+  size_t page_size = ldb_page_size();
+  void *base;
+  int err;
+
+  length = (length + page_size - 1) & ~(page_size - 1);
+
+  do {
+    err = posix_fallocate(file->fd, 0, length);
+  } while (err == EINTR);
+
+  if (err != 0) {
+    /* posix_fallocate() returns the error rather than setting errno. */
+    errno = err;
+    return ldb_system_error();
+  }
+
+  base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+
+  if (base == MAP_FAILED)
+    return ldb_system_error();
+
+  if (file->base != NULL) {
+    munmap(file->base, file->length);
+    file->remapped = 1;
+  }
+
+  file->base = base;
+  file->length = length;
+
+  return LDB_OK;
+}
+
+/* Unmap the file and give back the unused preallocation. */
+static int
+ldb_wfile_unmap(ldb_wfile_t *file) {
+  int rc = LDB_OK;
+
+  munmap(file->base, file->length);
+
+  if (ftruncate(file->fd, file->pos) != 0)
+    rc = ldb_system_error();
+
+  file->base = NULL;
+  file->length = 0;
+
+  return rc;
+}
+
+static int
+ldb_wfile_map_append(ldb_wfile_t *file, const ldb_slice_t *data) {
+  if (data->size > file->length - file->pos) {
+    size_t length = LDB_MAX(file->length * 2, file->pos + data->size);
+    int rc = ldb_wfile_map(file, length);
+
+    if (rc != LDB_OK)
+      return rc;
+  }
+
+  if (data->size > 0)
+    memcpy(file->base + file->pos, data->data, data->size);
+
+  file->pos += data->size;
+
+  return LDB_OK;
+}
+
+static int
+ldb_wfile_map_sync(ldb_wfile_t *file) {
+  size_t start = file->synced & ~(ldb_page_size() - 1);
+
+  if (file->pos > start) {
+    if (msync(file->base + start, file->pos - start, MS_SYNC) != 0)
+      return ldb_system_error();
+  }
+
+  /* Pages dirtied through an earlier mapping were not
+     covered by the msync above on every platform. */
+  if (file->remapped) {
+    if (ldb_fsync(file->fd) != 0)
+      return ldb_system_error();
+
+    file->remapped = 0;
+  }
+
+  file->synced = file->pos;
+
+  return LDB_OK;
+}
+#endif /* HAVE_MAPWRITE */
+
 static LDB_INLINE int
 ldb_wfile_append0(ldb_wfile_t *file, const ldb_slice_t *data) {
   const unsigned char *write_data = data->data;
@@ -1317,6 +1449,11 @@ ldb_wfile_append0(ldb_wfile_t *file, const ldb_slice_t *data) {
   size_t copy_size;
   int rc;
 
+#ifdef HAVE_MAPWRITE
+  if (file->base != NULL)
+    return ldb_wfile_map_append(file, data);
+#endif
+
   copy_size = LDB_MIN(write_size, LDB_WRITE_BUFFER - file->pos);
 
   if (copy_size > 0) {
@@ -1344,7 +1481,14 @@ ldb_wfile_append0(ldb_wfile_t *file, const ldb_slice_t *data) {
 
 int
 ldb_wfile_flush(ldb_wfile_t *file) {
-  int rc = ldb_wfile_write(file, file->buf, file->pos);
+  int rc;
+
+#ifdef HAVE_MAPWRITE
+  if (file->base != NULL)
+    return LDB_OK;
+#endif
+
+  rc = ldb_wfile_write(file, file->buf, file->pos);
   file->pos = 0;
   return rc;
 }
@@ -1353,6 +1497,11 @@ static LDB_INLINE int
 ldb_wfile_sync0(ldb_wfile_t *file) {
   int rc;
 
+#ifdef HAVE_MAPWRITE
+  if (file->base != NULL)
+    return ldb_wfile_map_sync(file);
+#endif
+
   if ((rc = ldb_wfile_sync_dir(file)))
     return rc;
 
@@ -1369,6 +1518,11 @@ int
 ldb_wfile_close(ldb_wfile_t *file) {
   int rc = ldb_wfile_flush(file);
 
+#ifdef HAVE_MAPWRITE
+  if (file->base != NULL)
+    rc = ldb_wfile_unmap(file);
+#endif
+
   if (close(file->fd) != 0 && rc == LDB_OK)
     rc = ldb_system_error();
 
@@ -1382,6 +1536,11 @@ ldb_wfile_destroy(ldb_wfile_t *file) {
   if (file->dirname != NULL)
     ldb_free(file->dirname);
 
+#ifdef HAVE_MAPWRITE
+  if (file->base != NULL)
+    ldb_wfile_unmap(file);
+#endif
+
   if (file->fd >= 0)
     close(file->fd);
 
@@ -1398,6 +1557,49 @@ ldb_truncfile_create0(const char *filename, ldb_wfile_t **file) {
   return ldb_wfile_create(filename, flags, file);
 }
 
+/*
+ * ReusableFile
+ */
+
+static LDB_INLINE int
+ldb_reusefile_create0(const char *filename, ldb_wfile_t **file) {
+  int flags = O_WRONLY | O_CREAT;
+  return ldb_wfile_create(filename, flags, file);
+}
+
+/*
+ * MappedFile
+ */
+
+static int
+ldb_mmapfile_create0(const char *filename, uint64_t size, ldb_wfile_t **file) {
+#ifdef HAVE_MAPWRITE
+  int flags = O_TRUNC | O_RDWR | O_CREAT;
+  int rc;
+
+  if (size == 0 || size > (SIZE_MAX >> 1))
+    return ldb_truncfile_create0(filename, file);
+
+  rc = ldb_wfile_create(filename, flags, file);
+
+  if (rc != LDB_OK)
+    return rc;
+
+  rc = ldb_wfile_map(*file, size);
+
+  if (rc != LDB_OK) {
+    ldb_wfile_destroy(*file);
+    ldb_remove_file(filename);
+    *file = NULL;
+  }
+
+  return rc;
+#else
+  (void)size;
+  return ldb_truncfile_create0(filename, file);
+#endif
+}
+
 /*
  * AppendableFile
  */
@@ -1433,6 +1635,63 @@ ldb_logger_open(const char *filename, ldb_logger_t **result) {
   return LDB_OK;
 }
 
+/*
+ * Memory
+ */
+
+void *
+ldb_huge_alloc(size_t size) {
+#if defined(HAVE_MMAP) && defined(MAP_ANONYMOUS)
+  int prot = PROT_READ | PROT_WRITE;
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  size_t align = LDB_HUGE_PAGE_SIZE;
+  uint8_t *base, *ptr;
+
+  assert((size & (align - 1)) == 0);
+
+#ifdef MAP_HUGETLB
+  ptr = mmap(NULL, size, prot, flags | MAP_HUGETLB, -1, 0);
+
+  if (ptr != MAP_FAILED)
+    return ptr;
+#endif
+
+  /* No reserved huge pages. Fall back to transparent ones, which
+     require the mapping to be aligned to the huge page size. */
+  base = mmap(NULL, size + align, prot, flags, -1, 0);
+
+  if (base == MAP_FAILED)
+    return NULL;
+
+  ptr = (uint8_t *)(((uintptr_t)base + align - 1) & ~(uintptr_t)(align - 1));
+
+  if (ptr > base)
+    munmap(base, ptr - base);
+
+  munmap(ptr + size, (base + align) - ptr);
+
+#ifdef MADV_HUGEPAGE
+  madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+
+  return ptr;
+#else
+  (void)size;
+  return NULL;
+#endif
+}
+
+void
+ldb_huge_free(void *ptr, size_t size) {
+#if defined(HAVE_MMAP) && defined(MAP_ANONYMOUS)
+  munmap(ptr, size);
+#else
+  (void)ptr;
+  (void)size;
+  abort(); /* LCOV_EXCL_LINE */
+#endif
+}
+
 /*
  * Time
  */
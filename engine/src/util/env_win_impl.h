@@ -1568,6 +1568,41 @@ ldb_truncfile_create0(const char *filename, ldb_wfile_t **file) {
   return LDB_OK;
 }
 
+/*
+ * ReusableFile
+ */
+
+static LDB_INLINE int
+ldb_reusefile_create0(const char *filename, ldb_wfile_t **file) {
+  HANDLE handle = LDBCreateFile(filename,
+                                GENERIC_WRITE,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                NULL,
+                                OPEN_ALWAYS,
+                                FILE_ATTRIBUTE_NORMAL,
+                                NULL);
+
+  if (handle == INVALID_HANDLE_VALUE)
+    return ldb_system_error();
+
+  *file = ldb_malloc(sizeof(ldb_wfile_t));
+
+  ldb_wfile_init(*file, filename, handle);
+
+  return LDB_OK;
+}
+
+/*
+ * MappedFile
+ */
+
+static LDB_INLINE int
+ldb_mmapfile_create0(const char *filename, uint64_t size, ldb_wfile_t **file) {
+  /* Not yet implemented on windows. */
+  (void)size;
+  return ldb_truncfile_create0(filename, file);
+}
+
 /*
  * AppendableFile
  */
@@ -1638,6 +1673,24 @@ ldb_logger_open(const char *filename, ldb_logger_t **result) {
   return LDB_OK;
 }
 
+/*
+ * Memory
+ */
+
+void *
+ldb_huge_alloc(size_t size) {
+  /* Not yet implemented on windows. */
+  (void)size;
+  return NULL;
+}
+
+void
+ldb_huge_free(void *ptr, size_t size) {
+  (void)ptr;
+  (void)size;
+  abort(); /* LCOV_EXCL_LINE */
+}
+
 /*
  * Time
  */
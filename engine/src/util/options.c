@@ -11,6 +11,7 @@
  */
 
 #include <stddef.h>
+#include <stdint.h>
 #include "comparator.h"
 #include "options.h"
 
@@ -33,7 +34,32 @@ static const ldb_dbopt_t db_options = {
   /* .compression = */ LDB_SNAPPY_COMPRESSION,
   /* .reuse_logs = */ 0,
   /* .filter_policy = */ NULL,
-  /* .use_mmap = */ 1
+  /* .use_mmap = */ 1,
+  /* .use_mmap_logs = */ 0,
+  /* .recycle_logs = */ 0,
+  /* .warmup_threads = */ 0,
+  /* .memtable_type = */ LDB_SKIPLIST_MEMTABLE,
+  /* .memtable_prefix = */ 0,
+  /* .arena_block_size = */ 4 * 1024,
+  /* .memtable_huge_pages = */ 0,
+  /* .compaction_filter = */ NULL,
+  /* .merge_operator = */ NULL,
+  /* .min_blob_size = */ 0,
+  /* .blob_file_size = */ 64 * 1024 * 1024,
+  /* .blob_gc_percent = */ 50,
+  /* .compaction_style = */ LDB_LEVEL_COMPACTION,
+  /* .universal_size_ratio = */ 1,
+  /* .universal_min_merge_width = */ 2,
+  /* .universal_max_size_amplification = */ 200,
+  /* .dynamic_level_bytes = */ 0,
+  /* .level0_compaction_trigger = */ 4,
+  /* .level0_slowdown_writes_trigger = */ 8,
+  /* .level0_stop_writes_trigger = */ 12,
+  /* .soft_pending_compaction_bytes = */ UINT64_C(64) << 30,
+  /* .hard_pending_compaction_bytes = */ UINT64_C(256) << 30,
+  /* .delayed_write_rate = */ 16 * 1024 * 1024,
+  /* .deletion_compaction_percent = */ 0,
+  /* .max_file_age = */ 0
 };
 
 /*
@@ -43,7 +69,10 @@ static const ldb_dbopt_t db_options = {
 static const ldb_readopt_t read_options = {
   /* .verify_checksums = */ 0,
   /* .fill_cache = */ 1,
-  /* .snapshot = */ NULL
+  /* .snapshot = */ NULL,
+  /* .readahead_size = */ 0,
+  /* .iterate_lower_bound = */ NULL,
+  /* .iterate_upper_bound = */ NULL
 };
 
 /*
@@ -61,7 +90,10 @@ static const ldb_writeopt_t write_options = {
 static const ldb_readopt_t iter_options = {
   /* .verify_checksums = */ 0,
   /* .fill_cache = */ 0,
-  /* .snapshot = */ NULL
+  /* .snapshot = */ NULL,
+  /* .readahead_size = */ 0,
+  /* .iterate_lower_bound = */ NULL,
+  /* .iterate_upper_bound = */ NULL
 };
 
 /*
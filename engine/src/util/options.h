@@ -14,6 +14,7 @@
 #define LDB_OPTIONS_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include "extern.h"
 
 /*
@@ -24,6 +25,8 @@ struct ldb_bloom_s;
 struct ldb_comparator_s;
 struct ldb_logger_s;
 struct ldb_lru_s;
+struct ldb_merger_s;
+struct ldb_slice_s;
 struct ldb_snapshot_s;
 
 /*
@@ -42,6 +45,73 @@ enum ldb_compression {
   LDB_SNAPPY_COMPRESSION = 0x1
 };
 
+/* In-memory representation of the write buffer. */
+enum ldb_memtable {
+  /* Sorted on insert. Good all-round choice. */
+  LDB_SKIPLIST_MEMTABLE = 0,
+  /* Appended to, and sorted when first read. For bulk loads which
+     do no reads before the buffer is flushed. */
+  LDB_VECTOR_MEMTABLE = 1,
+  /* Skiplists bucketed by a hash of a key prefix. For point lookups
+     and writes; iteration has to merge every bucket. */
+  LDB_HASH_MEMTABLE = 2
+};
+
+/* How tables are organized and merged. */
+enum ldb_compaction {
+  /* Tables are pushed down through levels of increasing size. Reads
+     and space are cheap; each byte is rewritten once per level. */
+  LDB_LEVEL_COMPACTION = 0,
+  /* Sorted runs are kept in level-0 and merged with runs of similar
+     size. Each byte is rewritten far less often, at the cost of more
+     runs to search and of space held by overwritten entries. */
+  LDB_UNIVERSAL_COMPACTION = 1
+};
+
+/* What a compaction filter decided to do with an entry. */
+enum ldb_decision {
+  /* Write the entry out unchanged. */
+  LDB_FILTER_KEEP = 0,
+  /* Delete the entry. */
+  LDB_FILTER_REMOVE = 1,
+  /* Write the entry out with the value stored in *new_value. */
+  LDB_FILTER_CHANGE = 2
+};
+
+/*
+ * Compaction Filter
+ */
+
+/* A compaction filter is called for every value a compaction would
+ * otherwise keep, and can remove or rewrite it as it is rewritten to
+ * disk. This allows data to be expired or garbage collected without
+ * a separate pass over the database.
+ *
+ * Values which are visible to a live snapshot are not passed to the
+ * filter, and a removed value is replaced by a deletion marker, so
+ * snapshots and older versions of the key are unaffected.
+ *
+ * The filter is called from the background compaction thread, and
+ * must be thread-safe if it is shared between databases.
+ */
+typedef struct ldb_cfilter_s {
+  /* The name of the filter, for the info log. */
+  const char *name;
+
+  /* Decide what to do with a key/value pair being compacted out of
+   * "level". On LDB_FILTER_CHANGE, *new_value must point to memory
+   * owned by the filter which stays valid until the next call.
+   */
+  enum ldb_decision (*filter)(const struct ldb_cfilter_s *cf,
+                              int level,
+                              const struct ldb_slice_s *key,
+                              const struct ldb_slice_s *value,
+                              struct ldb_slice_s *new_value);
+
+  /* Extra state. */
+  void *state;
+} ldb_cfilter_t;
+
 /*
  * DB Options
  */
@@ -161,6 +231,168 @@ typedef struct ldb_dbopt_s {
 
   /* Whether to utilize mmap() for random access files. */
   int use_mmap; /* 1 */
+
+  /* Whether to preallocate write-ahead logs to write_buffer_size and
+   * write them through a shared mmap(). Where this is not supported,
+   * logs are written normally.
+   */
+  int use_mmap_logs; /* 0 */
+
+  /* Number of obsolete write-ahead logs to keep and overwrite instead
+   * of creating new ones. Recycled logs are written in a record format
+   * tagged with the log number so that their stale tails are ignored
+   * on recovery. Such logs cannot be read by older versions.
+   */
+  int recycle_logs; /* 0 */
+
+  /* If non-zero, open the table files of every level in this many
+   * background threads once the database has been opened. The first
+   * read against each table then no longer has to open the file and
+   * read its footer, index and filter. No more tables are opened than
+   * fit in the table cache (roughly max_open_files). Progress is
+   * reported by the "leveldb.warmup-progress" property.
+   */
+  int warmup_threads; /* 0 */
+
+  /* Representation of the memtable. See enum ldb_memtable above.
+   *
+   * LDB_HASH_MEMTABLE keeps up to 1024 buckets (one per kilobyte of
+   * write_buffer_size). Each memtable iterator, and so each flush and
+   * each scan, creates and positions a child iterator for every
+   * non-empty bucket, which costs more than a single skiplist.
+   */
+  enum ldb_memtable memtable_type; /* LDB_SKIPLIST_MEMTABLE */
+
+  /* For LDB_HASH_MEMTABLE: hash only this many leading bytes of each
+   * user key, so that keys sharing a prefix share a bucket and stay
+   * in order relative to each other. Zero hashes the whole key.
+   */
+  size_t memtable_prefix; /* 0 */
+
+  /* Size of the blocks the memtable arena carves entries out of.
+   * Larger blocks mean fewer allocations for write-heavy workloads.
+   */
+  size_t arena_block_size; /* 4 * 1024 */
+
+  /* If true, back memtable arena blocks with (transparent) huge pages
+   * to reduce TLB misses on large memtables. Blocks are rounded up to
+   * 2MB, so this is only worthwhile with a large write_buffer_size.
+   * Pages are first touched by the writing thread, placing them on
+   * its NUMA node. Ignored where unsupported.
+   */
+  int memtable_huge_pages; /* 0 */
+
+  /* If non-null, pass every value kept by a compaction through this
+   * filter, which may remove or rewrite it. See ldb_cfilter_t above.
+   * The number of entries removed is reported per level by the
+   * "leveldb.stats" property.
+   */
+  const ldb_cfilter_t *compaction_filter; /* NULL */
+
+  /* Operator used to combine values written with ldb_merge() with
+   * the existing value of their key. Must be set to read keys which
+   * have been merged into. See ldb_merger_t in merge.h.
+   *
+   * REQUIRES: The client must ensure that the operator combines
+   * values in the same way on every open of the same DB.
+   */
+  const struct ldb_merger_s *merge_operator; /* NULL */
+
+  /* If non-zero, values of at least this many bytes are moved out of
+   * the tables into append-only blob files when they are flushed or
+   * compacted, leaving a small reference in their place. Compactions
+   * then rewrite only the references instead of the values, which
+   * greatly reduces write amplification for large values at the cost
+   * of an extra read per lookup.
+   */
+  size_t min_blob_size; /* 0 */
+
+  /* Blob files written by compactions are rolled over once they reach
+   * this size. Files written by a memtable flush hold that memtable's
+   * large values.
+   */
+  size_t blob_file_size; /* 64 * 1024 * 1024 */
+
+  /* Once this percentage of a blob file's bytes belong to values which
+   * have been overwritten or deleted, compactions copy its remaining
+   * values to new blob files so that it can be deleted. Files are
+   * picked for compaction to hasten this when nothing else needs to
+   * be compacted.
+   */
+  int blob_gc_percent; /* 50 */
+
+  /* Compaction strategy. See enum ldb_compaction above. */
+  enum ldb_compaction compaction_style; /* LDB_LEVEL_COMPACTION */
+
+  /* For LDB_UNIVERSAL_COMPACTION: a run is merged with the newer runs
+   * before it if it is at most this percentage larger than all of
+   * them combined.
+   */
+  int universal_size_ratio; /* 1 */
+
+  /* For LDB_UNIVERSAL_COMPACTION: merge at least this many runs when
+   * picking them by size ratio.
+   */
+  int universal_min_merge_width; /* 2 */
+
+  /* For LDB_UNIVERSAL_COMPACTION: once the runs other than the oldest
+   * add up to this percentage of the size of the oldest, every run is
+   * merged into one. Bounds the space taken by overwritten entries.
+   */
+  int universal_max_size_amplification; /* 200 */
+
+  /* If true, size each level from the actual size of the last level
+   * instead of a fixed 10MB for level-1 growing tenfold per level. The
+   * levels above the first one which needs to hold 10MB or more are
+   * left empty: level-0 compactions and memtable flushes go straight
+   * past them. Keeps the space held by overwritten entries to about a
+   * tenth of the database, whatever its size.
+   */
+  int dynamic_level_bytes; /* 0 */
+
+  /* Level-0 compaction is started when we hit this many files. */
+  int level0_compaction_trigger; /* 4 */
+
+  /* Soft limit on number of level-0 files. Writes are slowed down
+   * from this point on, more so as the count nears the hard limit.
+   */
+  int level0_slowdown_writes_trigger; /* 8 */
+
+  /* Maximum number of level-0 files. Writes stop at this point until
+   * a compaction brings the count back down.
+   */
+  int level0_stop_writes_trigger; /* 12 */
+
+  /* Writes are slowed down once compactions are estimated to be this
+   * many bytes behind, more so as they near the hard limit. Zero
+   * disables the limit.
+   */
+  uint64_t soft_pending_compaction_bytes; /* 64GB */
+
+  /* Writes stop once compactions are estimated to be this many bytes
+   * behind. Zero disables the limit.
+   */
+  uint64_t hard_pending_compaction_bytes; /* 256GB */
+
+  /* Rate, in bytes per second, at which writes are let through when
+   * first slowed down. The rate drops in proportion to how close the
+   * database is to stopping writes, down to a sixteenth of this. Time
+   * spent stalled is reported by the "leveldb.stats" property.
+   */
+  size_t delayed_write_rate; /* 16 * 1024 * 1024 */
+
+  /* If non-zero, files in which at least this percentage of entries
+   * are deletion markers are compacted when nothing else needs to be,
+   * so that scans stop having to skip over the markers.
+   */
+  int deletion_compaction_percent; /* 0 */
+
+  /* If non-zero, files older than this many seconds are compacted when
+   * nothing else needs to be, so that obsolete entries in rarely
+   * written key ranges are eventually dropped. Checked whenever the
+   * set of files changes.
+   */
+  int max_file_age; /* 0 */
 } ldb_dbopt_t;
 
 /*
@@ -185,6 +417,25 @@ typedef struct ldb_readopt_s {
    * snapshot of the state at the beginning of this read operation.
    */
   const struct ldb_snapshot_s *snapshot; /* NULL */
+
+  /* If non-zero, iterators read this many bytes at a time from each
+   * table they scan. Otherwise, they start reading ahead once blocks
+   * are read in order, doubling the amount read up to 256KB. Has no
+   * effect when tables are memory-mapped.
+   */
+  size_t readahead_size; /* 0 */
+
+  /* If non-null, iterators yield no keys below this user key. Tables
+   * lying entirely below it are not opened. The slice must outlive
+   * the iterator.
+   */
+  const struct ldb_slice_s *iterate_lower_bound; /* NULL */
+
+  /* If non-null, iterators yield no keys at or above this user key,
+   * and stop as soon as they reach one. Tables lying entirely above
+   * it are not opened. The slice must outlive the iterator.
+   */
+  const struct ldb_slice_s *iterate_upper_bound; /* NULL */
 } ldb_readopt_t;
 
 /*
@@ -12,13 +12,28 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../table/iterator.h"
 
 #include "buffer.h"
 #include "env.h"
+#include "internal.h"
+#include "options.h"
+#include "port.h"
 #include "random.h"
 #include "slice.h"
+#include "status.h"
 #include "testutil.h"
 
+#include "../db_impl.h"
+#include "../dbformat.h"
+#include "../filename.h"
+#include "../snapshot.h"
+#include "../version_edit.h"
+#include "../version_set.h"
+
 /*
  * Test Utils
  */
@@ -100,3 +115,303 @@ ldb_compressible_string(ldb_buffer_t *dst,
 
   return dst;
 }
+
+/*
+ * Test DB
+ */
+
+void
+ldb_testdb_init(ldb_testdb_t *t, const char *name) {
+  ASSERT(ldb_test_filename(t->dbname, sizeof(t->dbname), name));
+
+  ldb_destroy(t->dbname, 0);
+
+  t->options = *ldb_dbopt_default;
+  t->options.create_if_missing = 1;
+  t->db = NULL;
+
+  ldb_buffer_init(&t->value);
+  ldb_buffer_init(&t->contents);
+}
+
+void
+ldb_testdb_clear(ldb_testdb_t *t) {
+  ldb_testdb_close(t);
+
+  ASSERT(ldb_destroy(t->dbname, &t->options) == LDB_OK);
+
+  ldb_buffer_clear(&t->value);
+  ldb_buffer_clear(&t->contents);
+}
+
+void
+ldb_testdb_open(ldb_testdb_t *t) {
+  ASSERT(t->db == NULL);
+  ASSERT(ldb_open(t->dbname, &t->options, &t->db) == LDB_OK);
+}
+
+int
+ldb_testdb_open_families(ldb_testdb_t *t,
+                         const char *const *names,
+                         size_t length,
+                         ldb_family_t **families) {
+  ASSERT(t->db == NULL);
+
+  return ldb_open_families(t->dbname, &t->options, names, NULL,
+                           length, families, &t->db);
+}
+
+void
+ldb_testdb_close(ldb_testdb_t *t) {
+  if (t->db != NULL)
+    ldb_close(t->db);
+
+  t->db = NULL;
+}
+
+void
+ldb_testdb_reopen(ldb_testdb_t *t) {
+  ldb_testdb_close(t);
+  ldb_testdb_open(t);
+}
+
+void
+ldb_testdb_put(ldb_testdb_t *t, const char *k, const char *v) {
+  ldb_testdb_put_cf(t, NULL, k, v);
+}
+
+void
+ldb_testdb_put_cf(ldb_testdb_t *t,
+                  ldb_family_t *fam,
+                  const char *k,
+                  const char *v) {
+  ldb_slice_t key = ldb_string(k);
+  ldb_slice_t val = ldb_string(v);
+
+  ASSERT(ldb_put_cf(t->db, fam, &key, &val, 0) == LDB_OK);
+}
+
+void
+ldb_testdb_del(ldb_testdb_t *t, const char *k) {
+  ldb_slice_t key = ldb_string(k);
+
+  ASSERT(ldb_del(t->db, &key, 0) == LDB_OK);
+}
+
+const char *
+ldb_testdb_get(ldb_testdb_t *t,
+               const char *k,
+               const ldb_snapshot_t *snapshot) {
+  return ldb_testdb_get_cf(t, NULL, k, snapshot);
+}
+
+const char *
+ldb_testdb_get_cf(ldb_testdb_t *t,
+                  ldb_family_t *fam,
+                  const char *k,
+                  const ldb_snapshot_t *snapshot) {
+  ldb_readopt_t options = *ldb_readopt_default;
+  ldb_slice_t key = ldb_string(k);
+  ldb_slice_t val;
+  int rc;
+
+  options.snapshot = snapshot;
+
+  rc = ldb_get_cf(t->db, fam, &key, &val, &options);
+
+  if (rc == LDB_NOTFOUND)
+    return "NOT_FOUND";
+
+  ASSERT(rc == LDB_OK);
+
+  ldb_buffer_set(&t->value, val.data, val.size);
+  ldb_buffer_push(&t->value, 0);
+
+  ldb_free(val.data);
+
+  return (const char *)t->value.data;
+}
+
+const char *
+ldb_testdb_contents(ldb_testdb_t *t, const ldb_snapshot_t *snapshot) {
+  return ldb_testdb_contents_cf(t, NULL, snapshot);
+}
+
+const char *
+ldb_testdb_contents_cf(ldb_testdb_t *t,
+                       ldb_family_t *fam,
+                       const ldb_snapshot_t *snapshot) {
+  ldb_readopt_t options = *ldb_readopt_default;
+  ldb_buffer_t *out = &t->contents;
+  ldb_iter_t *it;
+  size_t n;
+
+  options.snapshot = snapshot;
+
+  it = ldb_iterator_cf(t->db, fam, &options);
+
+  ldb_buffer_reset(out);
+
+  for (ldb_iter_first(it); ldb_iter_valid(it); ldb_iter_next(it)) {
+    ldb_slice_t k = ldb_iter_key(it);
+    ldb_slice_t v = ldb_iter_value(it);
+
+    if (out->size > 0)
+      ldb_buffer_push(out, ',');
+
+    ldb_buffer_concat(out, &k);
+    ldb_buffer_push(out, '=');
+    ldb_buffer_concat(out, &v);
+  }
+
+  /* Match the entries from the end. */
+  n = out->size;
+
+  for (ldb_iter_last(it); ldb_iter_valid(it); ldb_iter_prev(it)) {
+    ldb_slice_t k = ldb_iter_key(it);
+    ldb_slice_t v = ldb_iter_value(it);
+
+    ASSERT(n >= k.size + v.size + 1);
+
+    n -= k.size + v.size + 1;
+
+    ASSERT(memcmp(out->data + n, k.data, k.size) == 0);
+    ASSERT(out->data[n + k.size] == '=');
+    ASSERT(memcmp(out->data + n + k.size + 1, v.data, v.size) == 0);
+
+    if (n > 0)
+      ASSERT(out->data[--n] == ',');
+  }
+
+  ASSERT(n == 0);
+  ASSERT(ldb_iter_status(it) == LDB_OK);
+
+  ldb_iter_destroy(it);
+
+  ldb_buffer_push(out, 0);
+
+  return (const char *)out->data;
+}
+
+void
+ldb_testdb_truncate(ldb_testdb_t *t) {
+  char fname[LDB_PATH_MAX];
+  char **filenames = NULL;
+  uint64_t last = 0;
+  ldb_filetype_t type;
+  uint64_t number;
+  int i, len;
+  FILE *fp;
+
+  len = ldb_get_children(t->dbname, &filenames);
+
+  ASSERT(len >= 0);
+
+  for (i = 0; i < len; i++) {
+    if (ldb_parse_filename(&type, &number, filenames[i])) {
+      if (type == LDB_FILE_TABLE && number > last)
+        last = number;
+    }
+  }
+
+  if (filenames != NULL)
+    ldb_free_children(filenames, len);
+
+  ASSERT(last != 0);
+  ASSERT(ldb_table_filename(fname, sizeof(fname), t->dbname, last));
+
+  fp = fopen(fname, "wb");
+
+  ASSERT(fp != NULL);
+  ASSERT(fclose(fp) == 0);
+}
+
+/*
+ * Test Version Set
+ */
+
+void
+ldb_testvset_init(ldb_testvset_t *t, const char *name) {
+  ASSERT(ldb_test_filename(t->dbname, sizeof(t->dbname), name));
+
+  ldb_destroy(t->dbname, 0);
+
+  t->options = *ldb_dbopt_default;
+  t->vset = NULL;
+  t->sequence = 0;
+
+  ldb_ikc_init(&t->icmp, ldb_bytewise_comparator);
+}
+
+void
+ldb_testvset_clear(ldb_testvset_t *t) {
+  if (t->vset != NULL)
+    ldb_versions_destroy(t->vset);
+
+  t->vset = NULL;
+
+  ASSERT(ldb_destroy(t->dbname, &t->options) == LDB_OK);
+}
+
+void
+ldb_testvset_open(ldb_testvset_t *t) {
+  ldb_dbopt_t options = t->options;
+  int save_manifest = 0;
+  ldb_t *db;
+
+  ASSERT(t->vset == NULL);
+
+  /* Have the database write its first descriptor. */
+  options.create_if_missing = 1;
+
+  ASSERT(ldb_open(t->dbname, &options, &db) == LDB_OK);
+
+  ldb_close(db);
+
+  t->vset = ldb_versions_create(t->dbname, &t->options, NULL, &t->icmp);
+
+  ASSERT(ldb_versions_recover(t->vset, &save_manifest) == LDB_OK);
+
+  t->sequence = t->vset->last_sequence;
+}
+
+uint64_t
+ldb_testvset_add(ldb_testvset_t *t,
+                 int level,
+                 const char *smallest,
+                 const char *largest,
+                 uint64_t size) {
+  ldb_slice_t small_key = ldb_string(smallest);
+  ldb_slice_t large_key = ldb_string(largest);
+  uint64_t number = ldb_versions_new_file_number(t->vset);
+  ldb_ikey_t start, limit;
+  ldb_mutex_t mutex;
+  ldb_edit_t edit;
+
+  ldb_ikey_init(&start);
+  ldb_ikey_init(&limit);
+  ldb_edit_init(&edit);
+  ldb_mutex_init(&mutex);
+
+  t->sequence++;
+
+  ldb_ikey_set(&start, &small_key, t->sequence, LDB_TYPE_VALUE);
+  ldb_ikey_set(&limit, &large_key, t->sequence, LDB_TYPE_VALUE);
+
+  ldb_edit_add_file(&edit, level, number, size, &start, &limit);
+
+  t->vset->last_sequence = t->sequence;
+
+  ldb_mutex_lock(&mutex);
+
+  ASSERT(ldb_versions_apply(t->vset, &edit, &mutex) == LDB_OK);
+
+  ldb_mutex_unlock(&mutex);
+
+  ldb_mutex_destroy(&mutex);
+  ldb_edit_clear(&edit);
+  ldb_ikey_clear(&limit);
+  ldb_ikey_clear(&start);
+
+  return number;
+}
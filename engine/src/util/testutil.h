@@ -16,14 +16,43 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "comparator.h"
+#include "env.h"
 #include "internal.h"
+#include "options.h"
 #include "types.h"
 
 /*
  * Types
  */
 
+struct ldb_family_s;
 struct ldb_rand_s;
+struct ldb_s;
+struct ldb_snapshot_s;
+struct ldb_versions_s;
+
+/* A database opened by a test, along with the buffers which hold
+   the strings returned by the accessors below. Each buffer is
+   overwritten by the next call to the same accessor. */
+typedef struct ldb_testdb_s {
+  char dbname[LDB_PATH_MAX];
+  ldb_dbopt_t options;
+  struct ldb_s *db;
+  ldb_buffer_t value;
+  ldb_buffer_t contents;
+} ldb_testdb_t;
+
+/* A version set over tables which exist only in the manifest, for
+   testing how levels are sized and compactions picked without having
+   to write the data. */
+typedef struct ldb_testvset_s {
+  char dbname[LDB_PATH_MAX];
+  ldb_dbopt_t options;
+  ldb_comparator_t icmp;
+  struct ldb_versions_s *vset;
+  uint64_t sequence;
+} ldb_testvset_t;
 
 /*
  * Assertions
@@ -66,4 +95,98 @@ ldb_compressible_string(ldb_buffer_t *dst,
                         double compressed_fraction,
                         size_t len);
 
+/*
+ * Test DB
+ */
+
+/* Destroy any database left under "name" in the test directory. The
+   options are the defaults, with create_if_missing set, and may be
+   changed before the database is opened. */
+void
+ldb_testdb_init(ldb_testdb_t *t, const char *name);
+
+/* Close and destroy the database. */
+void
+ldb_testdb_clear(ldb_testdb_t *t);
+
+void
+ldb_testdb_open(ldb_testdb_t *t);
+
+/* Open the database with the named column families. */
+int
+ldb_testdb_open_families(ldb_testdb_t *t,
+                         const char *const *names,
+                         size_t length,
+                         struct ldb_family_s **families);
+
+void
+ldb_testdb_close(ldb_testdb_t *t);
+
+void
+ldb_testdb_reopen(ldb_testdb_t *t);
+
+void
+ldb_testdb_put(ldb_testdb_t *t, const char *k, const char *v);
+
+void
+ldb_testdb_put_cf(ldb_testdb_t *t,
+                  struct ldb_family_s *fam,
+                  const char *k,
+                  const char *v);
+
+void
+ldb_testdb_del(ldb_testdb_t *t, const char *k);
+
+/* Return the value of the key, or "NOT_FOUND". */
+const char *
+ldb_testdb_get(ldb_testdb_t *t,
+               const char *k,
+               const struct ldb_snapshot_s *snapshot);
+
+const char *
+ldb_testdb_get_cf(ldb_testdb_t *t,
+                  struct ldb_family_s *fam,
+                  const char *k,
+                  const struct ldb_snapshot_s *snapshot);
+
+/* Return "k1=v1,k2=v2,..." read forwards, after checking
+   that the backwards read yields the same entries. */
+const char *
+ldb_testdb_contents(ldb_testdb_t *t, const struct ldb_snapshot_s *snapshot);
+
+const char *
+ldb_testdb_contents_cf(ldb_testdb_t *t,
+                       struct ldb_family_s *fam,
+                       const struct ldb_snapshot_s *snapshot);
+
+/* Empty the newest table of the database, as a crash or a bad disk
+   might. Reopen the database to have the table read again. */
+void
+ldb_testdb_truncate(ldb_testdb_t *t);
+
+/*
+ * Test Version Set
+ */
+
+/* As ldb_testdb_init(). The options may be changed before opening. */
+void
+ldb_testvset_init(ldb_testvset_t *t, const char *name);
+
+/* Destroy the version set and its directory. */
+void
+ldb_testvset_clear(ldb_testvset_t *t);
+
+void
+ldb_testvset_open(ldb_testvset_t *t);
+
+/* Add a table of "size" bytes spanning [smallest,largest] to a level.
+   Each table is newer than the ones added before it. Returns the file
+   number of the table. */
+uint64_t
+ldb_testvset_add(ldb_testvset_t *t,
+                 int level,
+                 const char *smallest,
+                 const char *largest,
+                 uint64_t size);
+
 #endif /* LDB_TESTUTIL_H */
@@ -38,9 +38,39 @@ enum {
   TAG_DELETED_FILE = 6,
   TAG_NEW_FILE = 7,
   /* 8 was used for large value refs. */
-  TAG_PREV_LOG_NUMBER = 9
+  TAG_PREV_LOG_NUMBER = 9,
+  /* TAG_NEW_FILE followed by a list of optional fields. Only
+     written when a field is needed, so that older versions can
+     still read manifests which do not use any. */
+  TAG_NEW_FILE2 = 10,
+  /* Name of the column family described by the manifest. */
+  TAG_FAMILY = 11,
+  /* Blob files (see blob_file.h), and the records in them which
+     are no longer referenced. */
+  TAG_NEW_BLOB = 12,
+  TAG_BLOB_GARBAGE = 13
 };
 
+/* Fields of TAG_NEW_FILE2. Each is a varint32 field number followed
+   by a length-prefixed value, so that unknown fields may be skipped.
+   The list ends with FIELD_TERMINATE. */
+enum {
+  FIELD_TERMINATE = 0,
+  FIELD_TOMBSTONES = 1,
+  FIELD_OLDEST_BLOB = 2,
+  FIELD_SEQUENCE = 3,
+  FIELD_ENTRIES = 4,
+  FIELD_DELETIONS = 5,
+  FIELD_CREATED = 6
+};
+
+static void
+ldb_field_write(ldb_buffer_t *dst, uint32_t field, uint64_t value) {
+  ldb_buffer_varint32(dst, field);
+  ldb_buffer_varint32(dst, ldb_varint64_size(value));
+  ldb_buffer_varint64(dst, value);
+}
+
 /*
  * InternalKey Pair
  */
@@ -176,6 +206,12 @@ ldb_filemeta_init(ldb_filemeta_t *meta) {
   meta->allowed_seeks = (1 << 30);
   meta->number = 0;
   meta->file_size = 0;
+  meta->tombstones = 0;
+  meta->oldest_blob = 0;
+  meta->sequence = 0;
+  meta->entries = 0;
+  meta->deletions = 0;
+  meta->created = 0;
 
   ldb_ikey_init(&meta->smallest);
   ldb_ikey_init(&meta->largest);
@@ -193,11 +229,61 @@ ldb_filemeta_copy(ldb_filemeta_t *z, const ldb_filemeta_t *x) {
   z->allowed_seeks = x->allowed_seeks;
   z->number = x->number;
   z->file_size = x->file_size;
+  z->tombstones = x->tombstones;
+  z->oldest_blob = x->oldest_blob;
+  z->sequence = x->sequence;
+  z->entries = x->entries;
+  z->deletions = x->deletions;
+  z->created = x->created;
 
   ldb_ikey_copy(&z->smallest, &x->smallest);
   ldb_ikey_copy(&z->largest, &x->largest);
 }
 
+/*
+ * BlobMetaData
+ */
+
+ldb_blobmeta_t *
+ldb_blobmeta_create(uint64_t number, uint64_t count, uint64_t bytes) {
+  ldb_blobmeta_t *meta = ldb_malloc(sizeof(ldb_blobmeta_t));
+
+  meta->refs = 0;
+  meta->number = number;
+  meta->count = count;
+  meta->bytes = bytes;
+  meta->garbage_count = 0;
+  meta->garbage_bytes = 0;
+
+  return meta;
+}
+
+ldb_blobmeta_t *
+ldb_blobmeta_clone(const ldb_blobmeta_t *meta) {
+  ldb_blobmeta_t *out = ldb_malloc(sizeof(ldb_blobmeta_t));
+
+  *out = *meta;
+
+  out->refs = 0;
+
+  return out;
+}
+
+void
+ldb_blobmeta_ref(ldb_blobmeta_t *z) {
+  z->refs++;
+}
+
+void
+ldb_blobmeta_unref(ldb_blobmeta_t *z) {
+  assert(z->refs > 0);
+
+  z->refs--;
+
+  if (z->refs <= 0)
+    ldb_free(z);
+}
+
 /*
  * VersionEdit
  */
@@ -205,12 +291,14 @@ ldb_filemeta_copy(ldb_filemeta_t *z, const ldb_filemeta_t *x) {
 void
 ldb_edit_init(ldb_edit_t *edit) {
   ldb_buffer_init(&edit->comparator);
+  ldb_buffer_init(&edit->family);
 
   edit->log_number = 0;
   edit->prev_log_number = 0;
   edit->last_sequence = 0;
   edit->next_file_number = 0;
   edit->has_comparator = 0;
+  edit->has_family = 0;
   edit->has_log_number = 0;
   edit->has_prev_log_number = 0;
   edit->has_next_file_number = 0;
@@ -219,6 +307,8 @@ ldb_edit_init(ldb_edit_t *edit) {
   ldb_vector_init(&edit->compact_pointers);
   rb_set_init(&edit->deleted_files, file_entry_compare, NULL);
   ldb_vector_init(&edit->new_files);
+  ldb_vector_init(&edit->new_blobs);
+  ldb_vector_init(&edit->blob_garbage);
 }
 
 void
@@ -231,10 +321,19 @@ ldb_edit_clear(ldb_edit_t *edit) {
   for (i = 0; i < edit->new_files.length; i++)
     meta_entry_destroy(edit->new_files.items[i]);
 
+  for (i = 0; i < edit->new_blobs.length; i++)
+    ldb_free(edit->new_blobs.items[i]);
+
+  for (i = 0; i < edit->blob_garbage.length; i++)
+    ldb_free(edit->blob_garbage.items[i]);
+
   ldb_buffer_clear(&edit->comparator);
+  ldb_buffer_clear(&edit->family);
   ldb_vector_clear(&edit->compact_pointers);
   rb_set_clear(&edit->deleted_files, file_entry_destruct);
   ldb_vector_clear(&edit->new_files);
+  ldb_vector_clear(&edit->new_blobs);
+  ldb_vector_clear(&edit->blob_garbage);
 }
 
 void
@@ -249,6 +348,12 @@ ldb_edit_set_comparator_name(ldb_edit_t *edit, const char *name) {
   ldb_buffer_set_str(&edit->comparator, name);
 }
 
+void
+ldb_edit_set_family_name(ldb_edit_t *edit, const char *name) {
+  edit->has_family = 1;
+  ldb_buffer_set_str(&edit->family, name);
+}
+
 void
 ldb_edit_set_log_number(ldb_edit_t *edit, uint64_t num) {
   edit->has_log_number = 1;
@@ -282,7 +387,7 @@ ldb_edit_set_compact_pointer(ldb_edit_t *edit,
   ldb_vector_push(&edit->compact_pointers, entry);
 }
 
-void
+ldb_filemeta_t *
 ldb_edit_add_file(ldb_edit_t *edit,
                   int level,
                   uint64_t number,
@@ -296,6 +401,8 @@ ldb_edit_add_file(ldb_edit_t *edit,
                                           largest);
 
   ldb_vector_push(&edit->new_files, entry);
+
+  return &entry->meta;
 }
 
 void
@@ -306,6 +413,41 @@ ldb_edit_remove_file(ldb_edit_t *edit, int level, uint64_t number) {
     file_entry_destroy(entry);
 }
 
+void
+ldb_edit_add_blob(ldb_edit_t *edit,
+                  uint64_t number,
+                  uint64_t count,
+                  uint64_t bytes) {
+  ldb_blobmeta_t *meta = ldb_blobmeta_create(number, count, bytes);
+
+  ldb_vector_push(&edit->new_blobs, meta);
+}
+
+void
+ldb_edit_add_garbage(ldb_edit_t *edit,
+                     uint64_t number,
+                     uint64_t count,
+                     uint64_t bytes) {
+  ldb_blobmeta_t *meta;
+  size_t i;
+
+  for (i = 0; i < edit->blob_garbage.length; i++) {
+    meta = edit->blob_garbage.items[i];
+
+    if (meta->number == number) {
+      meta->garbage_count += count;
+      meta->garbage_bytes += bytes;
+      return;
+    }
+  }
+
+  meta = ldb_blobmeta_create(number, 0, 0);
+  meta->garbage_count = count;
+  meta->garbage_bytes = bytes;
+
+  ldb_vector_push(&edit->blob_garbage, meta);
+}
+
 void
 ldb_edit_export(ldb_buffer_t *dst, const ldb_edit_t *edit) {
   rb_iter_t it;
@@ -316,6 +458,11 @@ ldb_edit_export(ldb_buffer_t *dst, const ldb_edit_t *edit) {
     ldb_buffer_export(dst, &edit->comparator);
   }
 
+  if (edit->has_family) {
+    ldb_buffer_varint32(dst, TAG_FAMILY);
+    ldb_buffer_export(dst, &edit->family);
+  }
+
   if (edit->has_log_number) {
     ldb_buffer_varint32(dst, TAG_LOG_NUMBER);
     ldb_buffer_varint64(dst, edit->log_number);
@@ -357,12 +504,58 @@ ldb_edit_export(ldb_buffer_t *dst, const ldb_edit_t *edit) {
     const meta_entry_t *entry = edit->new_files.items[i];
     const ldb_filemeta_t *meta = &entry->meta;
 
-    ldb_buffer_varint32(dst, TAG_NEW_FILE);
+    int fields = (meta->tombstones > 0 || meta->oldest_blob > 0 ||
+                  meta->sequence > 0 || meta->entries > 0 ||
+                  meta->created > 0);
+
+    if (fields)
+      ldb_buffer_varint32(dst, TAG_NEW_FILE2);
+    else
+      ldb_buffer_varint32(dst, TAG_NEW_FILE);
+
     ldb_buffer_varint32(dst, entry->level);
     ldb_buffer_varint64(dst, meta->number);
     ldb_buffer_varint64(dst, meta->file_size);
     ldb_ikey_export(dst, &meta->smallest);
     ldb_ikey_export(dst, &meta->largest);
+
+    if (meta->tombstones > 0)
+      ldb_field_write(dst, FIELD_TOMBSTONES, meta->tombstones);
+
+    if (meta->oldest_blob > 0)
+      ldb_field_write(dst, FIELD_OLDEST_BLOB, meta->oldest_blob);
+
+    if (meta->sequence > 0)
+      ldb_field_write(dst, FIELD_SEQUENCE, meta->sequence);
+
+    if (meta->entries > 0) {
+      ldb_field_write(dst, FIELD_ENTRIES, meta->entries);
+      ldb_field_write(dst, FIELD_DELETIONS, meta->deletions);
+    }
+
+    if (meta->created > 0)
+      ldb_field_write(dst, FIELD_CREATED, meta->created);
+
+    if (fields)
+      ldb_buffer_varint32(dst, FIELD_TERMINATE);
+  }
+
+  for (i = 0; i < edit->new_blobs.length; i++) {
+    const ldb_blobmeta_t *meta = edit->new_blobs.items[i];
+
+    ldb_buffer_varint32(dst, TAG_NEW_BLOB);
+    ldb_buffer_varint64(dst, meta->number);
+    ldb_buffer_varint64(dst, meta->count);
+    ldb_buffer_varint64(dst, meta->bytes);
+  }
+
+  for (i = 0; i < edit->blob_garbage.length; i++) {
+    const ldb_blobmeta_t *meta = edit->blob_garbage.items[i];
+
+    ldb_buffer_varint32(dst, TAG_BLOB_GARBAGE);
+    ldb_buffer_varint64(dst, meta->number);
+    ldb_buffer_varint64(dst, meta->garbage_count);
+    ldb_buffer_varint64(dst, meta->garbage_bytes);
   }
 }
 
@@ -381,10 +574,73 @@ ldb_level_slurp(int *level, ldb_slice_t *input) {
   return 1;
 }
 
+static int
+ldb_fields_slurp(ldb_filemeta_t *meta, ldb_slice_t *input) {
+  ldb_slice_t value;
+  uint32_t field;
+
+  for (;;) {
+    if (!ldb_varint32_slurp(&field, input))
+      return 0;
+
+    if (field == FIELD_TERMINATE)
+      break;
+
+    if (!ldb_slice_slurp(&value, input))
+      return 0;
+
+    switch (field) {
+      case FIELD_TOMBSTONES: {
+        if (!ldb_varint64_slurp(&meta->tombstones, &value))
+          return 0;
+        break;
+      }
+
+      case FIELD_OLDEST_BLOB: {
+        if (!ldb_varint64_slurp(&meta->oldest_blob, &value))
+          return 0;
+        break;
+      }
+
+      case FIELD_SEQUENCE: {
+        if (!ldb_varint64_slurp(&meta->sequence, &value))
+          return 0;
+        break;
+      }
+
+      case FIELD_ENTRIES: {
+        if (!ldb_varint64_slurp(&meta->entries, &value))
+          return 0;
+        break;
+      }
+
+      case FIELD_DELETIONS: {
+        if (!ldb_varint64_slurp(&meta->deletions, &value))
+          return 0;
+        break;
+      }
+
+      case FIELD_CREATED: {
+        if (!ldb_varint64_slurp(&meta->created, &value))
+          return 0;
+        break;
+      }
+
+      default: {
+        /* Written by a newer version. Safe to ignore. */
+        break;
+      }
+    }
+  }
+
+  return 1;
+}
+
 int
 ldb_edit_import(ldb_edit_t *edit, const ldb_slice_t *src) {
   ldb_slice_t smallest, largest;
   uint64_t number, file_size;
+  uint64_t count, bytes;
   ldb_slice_t input = *src;
   ldb_slice_t key;
   uint32_t tag;
@@ -406,6 +662,15 @@ ldb_edit_import(ldb_edit_t *edit, const ldb_slice_t *src) {
         break;
       }
 
+      case TAG_FAMILY: {
+        if (!ldb_buffer_slurp(&edit->family, &input))
+          return 0;
+
+        edit->has_family = 1;
+
+        break;
+      }
+
       case TAG_LOG_NUMBER: {
         if (!ldb_varint64_slurp(&edit->log_number, &input))
           return 0;
@@ -469,7 +734,10 @@ ldb_edit_import(ldb_edit_t *edit, const ldb_slice_t *src) {
         break;
       }
 
-      case TAG_NEW_FILE: {
+      case TAG_NEW_FILE:
+      case TAG_NEW_FILE2: {
+        ldb_filemeta_t *meta;
+
         if (!ldb_level_slurp(&level, &input))
           return 0;
 
@@ -488,7 +756,30 @@ ldb_edit_import(ldb_edit_t *edit, const ldb_slice_t *src) {
         if (smallest.size < 8 || largest.size < 8)
           return 0;
 
-        ldb_edit_add_file(edit, level, number, file_size, &smallest, &largest);
+        meta = ldb_edit_add_file(edit, level, number, file_size,
+                                       &smallest, &largest);
+
+        if (tag == TAG_NEW_FILE2 && !ldb_fields_slurp(meta, &input))
+          return 0;
+
+        break;
+      }
+
+      case TAG_NEW_BLOB:
+      case TAG_BLOB_GARBAGE: {
+        if (!ldb_varint64_slurp(&number, &input))
+          return 0;
+
+        if (!ldb_varint64_slurp(&count, &input))
+          return 0;
+
+        if (!ldb_varint64_slurp(&bytes, &input))
+          return 0;
+
+        if (tag == TAG_NEW_BLOB)
+          ldb_edit_add_blob(edit, number, count, bytes);
+        else
+          ldb_edit_add_garbage(edit, number, count, bytes);
 
         break;
       }
@@ -514,6 +805,11 @@ ldb_edit_debug(ldb_buffer_t *z, const ldb_edit_t *edit) {
     ldb_buffer_concat(z, &edit->comparator);
   }
 
+  if (edit->has_family) {
+    ldb_buffer_string(z, "\n  Family: ");
+    ldb_buffer_concat(z, &edit->family);
+  }
+
   if (edit->has_log_number) {
     ldb_buffer_string(z, "\n  LogNumber: ");
     ldb_buffer_number(z, edit->log_number);
@@ -566,6 +862,55 @@ ldb_edit_debug(ldb_buffer_t *z, const ldb_edit_t *edit) {
     ldb_ikey_debug(z, &f->smallest);
     ldb_buffer_string(z, " .. ");
     ldb_ikey_debug(z, &f->largest);
+
+    if (f->tombstones > 0) {
+      ldb_buffer_string(z, " tombstones=");
+      ldb_buffer_number(z, f->tombstones);
+    }
+
+    if (f->oldest_blob > 0) {
+      ldb_buffer_string(z, " oldest_blob=");
+      ldb_buffer_number(z, f->oldest_blob);
+    }
+
+    if (f->sequence > 0) {
+      ldb_buffer_string(z, " sequence=");
+      ldb_buffer_number(z, f->sequence);
+    }
+
+    if (f->entries > 0) {
+      ldb_buffer_string(z, " entries=");
+      ldb_buffer_number(z, f->entries);
+      ldb_buffer_string(z, " deletions=");
+      ldb_buffer_number(z, f->deletions);
+    }
+
+    if (f->created > 0) {
+      ldb_buffer_string(z, " created=");
+      ldb_buffer_number(z, f->created);
+    }
+  }
+
+  for (i = 0; i < edit->new_blobs.length; i++) {
+    const ldb_blobmeta_t *b = edit->new_blobs.items[i];
+
+    ldb_buffer_string(z, "\n  AddBlob: ");
+    ldb_buffer_number(z, b->number);
+    ldb_buffer_string(z, " ");
+    ldb_buffer_number(z, b->count);
+    ldb_buffer_string(z, " ");
+    ldb_buffer_number(z, b->bytes);
+  }
+
+  for (i = 0; i < edit->blob_garbage.length; i++) {
+    const ldb_blobmeta_t *b = edit->blob_garbage.items[i];
+
+    ldb_buffer_string(z, "\n  BlobGarbage: ");
+    ldb_buffer_number(z, b->number);
+    ldb_buffer_string(z, " ");
+    ldb_buffer_number(z, b->garbage_count);
+    ldb_buffer_string(z, " ");
+    ldb_buffer_number(z, b->garbage_bytes);
   }
 
   ldb_buffer_string(z, "\n}\n");
@@ -32,15 +32,32 @@ typedef struct ldb_filemeta_s {
   uint64_t file_size;  /* File size in bytes. */
   ldb_ikey_t smallest; /* Smallest internal key served by table. */
   ldb_ikey_t largest;  /* Largest internal key served by table. */
+  uint64_t tombstones; /* Number of range tombstones in table. */
+  uint64_t oldest_blob; /* Oldest blob file referenced by table (or 0). */
+  ldb_seqnum_t sequence; /* Sequence of every entry of an ingested table. */
+  uint64_t entries;    /* Number of point entries in table (or 0). */
+  uint64_t deletions;  /* Number of those which are deletion markers. */
+  uint64_t created;    /* Creation time in seconds since the epoch (or 0). */
 } ldb_filemeta_t;
 
+typedef struct ldb_blobmeta_s {
+  int refs;
+  uint64_t number;
+  uint64_t count;         /* Number of records in file. */
+  uint64_t bytes;         /* File size in bytes. */
+  uint64_t garbage_count; /* Records no longer referenced by any table. */
+  uint64_t garbage_bytes; /* Size of those records. */
+} ldb_blobmeta_t;
+
 typedef struct ldb_edit_s {
   ldb_buffer_t comparator;
+  ldb_buffer_t family;
   uint64_t log_number;
   uint64_t prev_log_number;
   uint64_t next_file_number;
   ldb_seqnum_t last_sequence;
   int has_comparator;
+  int has_family;
   int has_log_number;
   int has_prev_log_number;
   int has_next_file_number;
@@ -48,6 +65,8 @@ typedef struct ldb_edit_s {
   ldb_vector_t compact_pointers; /* ikey_entry_t */
   rb_set_t deleted_files;        /* file_entry_t */
   ldb_vector_t new_files;        /* meta_entry_t */
+  ldb_vector_t new_blobs;        /* ldb_blobmeta_t */
+  ldb_vector_t blob_garbage;     /* ldb_blobmeta_t */
 } ldb_edit_t;
 
 typedef struct ikey_entry_s {
@@ -93,6 +112,22 @@ ldb_filemeta_clear(ldb_filemeta_t *meta);
 void
 ldb_filemeta_copy(ldb_filemeta_t *z, const ldb_filemeta_t *x);
 
+/*
+ * BlobMetaData
+ */
+
+ldb_blobmeta_t *
+ldb_blobmeta_create(uint64_t number, uint64_t count, uint64_t bytes);
+
+ldb_blobmeta_t *
+ldb_blobmeta_clone(const ldb_blobmeta_t *meta);
+
+void
+ldb_blobmeta_ref(ldb_blobmeta_t *z);
+
+void
+ldb_blobmeta_unref(ldb_blobmeta_t *z);
+
 /*
  * VersionEdit
  */
@@ -109,6 +144,9 @@ ldb_edit_reset(ldb_edit_t *edit);
 void
 ldb_edit_set_comparator_name(ldb_edit_t *edit, const char *name);
 
+void
+ldb_edit_set_family_name(ldb_edit_t *edit, const char *name);
+
 void
 ldb_edit_set_log_number(ldb_edit_t *edit, uint64_t num);
 
@@ -129,7 +167,8 @@ ldb_edit_set_compact_pointer(ldb_edit_t *edit,
 /* Add the specified file at the specified number. */
 /* REQUIRES: This version has not been saved (see vset_save_to). */
 /* REQUIRES: "smallest" and "largest" are smallest and largest keys in file. */
-void
+/* Returns the added entry so that optional fields may be set. */
+ldb_filemeta_t *
 ldb_edit_add_file(ldb_edit_t *edit,
                   int level,
                   uint64_t number,
@@ -141,6 +180,22 @@ ldb_edit_add_file(ldb_edit_t *edit,
 void
 ldb_edit_remove_file(ldb_edit_t *edit, int level, uint64_t number);
 
+/* Add the blob file with the specified number. */
+void
+ldb_edit_add_blob(ldb_edit_t *edit,
+                  uint64_t number,
+                  uint64_t count,
+                  uint64_t bytes);
+
+/* Record that "count" records totalling "bytes" bytes in the specified
+   blob file are no longer referenced. The blob file is deleted once
+   all of its records are. */
+void
+ldb_edit_add_garbage(ldb_edit_t *edit,
+                     uint64_t number,
+                     uint64_t count,
+                     uint64_t bytes);
+
 void
 ldb_edit_export(ldb_buffer_t *dst, const ldb_edit_t *edit);
 
@@ -33,11 +33,14 @@
 #include "util/strutil.h"
 #include "util/vector.h"
 
+#include "blob_file.h"
 #include "dbformat.h"
 #include "filename.h"
 #include "log_format.h"
 #include "log_reader.h"
 #include "log_writer.h"
+#include "merge.h"
+#include "range_del.h"
 #include "table_cache.h"
 #include "version_edit.h"
 #include "version_set.h"
@@ -217,23 +220,30 @@ some_file_overlaps_range(const ldb_comparator_t *icmp,
 
 /* An internal iterator. For a given version/level pair, yields
    information about the files in the level. For a given entry, key()
-   is the largest key that occurs in the file, and value() is an
-   16-byte value containing the file number and file size, both
-   encoded using ldb_fixed64_write. */
+   is the largest key that occurs in the file, and value() is a
+   24-byte value containing the file number, file size and sequence,
+   all encoded using ldb_fixed64_write. Only the files in [begin,end)
+   are yielded. */
 typedef struct ldb_numiter_s {
   ldb_comparator_t icmp;
   const ldb_vector_t *flist; /* ldb_filemeta_t */
+  uint32_t begin;
+  uint32_t end;
   uint32_t index;
-  uint8_t value[16];
+  uint8_t value[24];
 } ldb_numiter_t;
 
 static void
 ldb_numiter_init(ldb_numiter_t *iter,
                  const ldb_comparator_t *icmp,
-                 const ldb_vector_t *flist) {
+                 const ldb_vector_t *flist,
+                 uint32_t begin,
+                 uint32_t end) {
   iter->icmp = *icmp;
   iter->flist = flist;
-  iter->index = flist->length; /* Mark as invalid. */
+  iter->begin = begin;
+  iter->end = end;
+  iter->index = end; /* Mark as invalid. */
 }
 
 static void
@@ -243,22 +253,28 @@ ldb_numiter_clear(ldb_numiter_t *iter) {
 
 static int
 ldb_numiter_valid(const ldb_numiter_t *iter) {
-  return iter->index < iter->flist->length;
+  return iter->index >= iter->begin && iter->index < iter->end;
 }
 
 static void
 ldb_numiter_seek(ldb_numiter_t *iter, const ldb_slice_t *target) {
   iter->index = find_file(&iter->icmp, iter->flist, target);
+
+  if (iter->index < iter->begin)
+    iter->index = iter->begin;
+
+  if (iter->index > iter->end)
+    iter->index = iter->end;
 }
 
 static void
 ldb_numiter_first(ldb_numiter_t *iter) {
-  iter->index = 0;
+  iter->index = iter->begin;
 }
 
 static void
 ldb_numiter_last(ldb_numiter_t *iter) {
-  iter->index = iter->flist->length == 0 ? 0 : iter->flist->length - 1;
+  iter->index = iter->end == iter->begin ? iter->end : iter->end - 1;
 }
 
 static void
@@ -271,8 +287,8 @@ static void
 ldb_numiter_prev(ldb_numiter_t *iter) {
   assert(ldb_numiter_valid(iter));
 
-  if (iter->index == 0)
-    iter->index = iter->flist->length; /* Marks as invalid. */
+  if (iter->index == iter->begin)
+    iter->index = iter->end; /* Marks as invalid. */
   else
     iter->index--;
 }
@@ -299,6 +315,7 @@ ldb_numiter_value(const ldb_numiter_t *iter) {
 
   ldb_fixed64_write(value + 0, file->number);
   ldb_fixed64_write(value + 8, file->file_size);
+  ldb_fixed64_write(value + 16, file->sequence);
 
   return ldb_slice(value, sizeof(iter->value));
 }
@@ -312,10 +329,13 @@ ldb_numiter_status(const ldb_numiter_t *iter) {
 LDB_ITERATOR_FUNCTIONS(ldb_numiter);
 
 static ldb_iter_t *
-ldb_numiter_create(const ldb_comparator_t *icmp, const ldb_vector_t *flist) {
+ldb_numiter_create(const ldb_comparator_t *icmp,
+                   const ldb_vector_t *flist,
+                   uint32_t begin,
+                   uint32_t end) {
   ldb_numiter_t *iter = ldb_malloc(sizeof(ldb_numiter_t));
 
-  ldb_numiter_init(iter, icmp, flist);
+  ldb_numiter_init(iter, icmp, flist, begin, end);
 
   return ldb_iter_create(iter, &ldb_numiter_table, &iter->icmp);
 }
@@ -330,7 +350,7 @@ get_file_iterator(void *arg,
                   const ldb_slice_t *file_value) {
   ldb_tables_t *cache = (ldb_tables_t *)arg;
 
-  if (file_value->size != 16) {
+  if (file_value->size != 24) {
     /* "FileReader invoked with unexpected value" */
     return ldb_emptyiter_create(LDB_CORRUPTION);
   }
@@ -338,14 +358,18 @@ get_file_iterator(void *arg,
   return ldb_tables_iterate(cache, options,
                             ldb_fixed64_decode(file_value->data + 0),
                             ldb_fixed64_decode(file_value->data + 8),
+                            ldb_fixed64_decode(file_value->data + 16),
                             NULL);
 }
 
 static ldb_iter_t *
 ldb_concatiter_create(const ldb_version_t *ver,
                       const ldb_readopt_t *options,
-                      int level) {
-  ldb_iter_t *iter = ldb_numiter_create(&ver->vset->icmp, &ver->files[level]);
+                      int level,
+                      uint32_t begin,
+                      uint32_t end) {
+  ldb_iter_t *iter = ldb_numiter_create(&ver->vset->icmp, &ver->files[level],
+                                        begin, end);
 
   return ldb_twoiter_create(iter,
                             &get_file_iterator,
@@ -367,24 +391,54 @@ typedef struct saver_s {
   const ldb_comparator_t *ucmp;
   ldb_slice_t user_key;
   ldb_buffer_t *value;
+  ldb_slice_t *pinned; /* Points into the block if non-NULL. */
+  ldb_operands_t *operands;
+  int blob; /* Value is a blob reference. */
 } saver_t;
 
-static void
+static int
 save_value(void *arg, const ldb_slice_t *ikey, const ldb_slice_t *v) {
   saver_t *s = (saver_t *)arg;
   ldb_pkey_t pkey;
 
   if (!ldb_pkey_import(&pkey, ikey)) {
     s->state = S_CORRUPT;
-    return;
+    return 0;
   }
 
-  if (ldb_compare(s->ucmp, &pkey.user_key, &s->user_key) == 0) {
-    s->state = (pkey.type == LDB_TYPE_VALUE) ? S_FOUND : S_DELETED;
+  if (ldb_compare(s->ucmp, &pkey.user_key, &s->user_key) != 0)
+    return 0;
+
+  switch (pkey.type) {
+    case LDB_TYPE_VALUE:
+      s->state = S_FOUND;
 
-    if (s->state == S_FOUND && s->value != NULL)
-      ldb_buffer_set(s->value, v->data, v->size);
+      if (s->pinned != NULL)
+        *s->pinned = *v;
+      else if (s->value != NULL)
+        ldb_buffer_set(s->value, v->data, v->size);
+
+      break;
+    case LDB_TYPE_BLOB:
+      s->state = S_FOUND;
+      s->blob = 1;
+
+      if (s->pinned != NULL)
+        *s->pinned = *v;
+      else if (s->value != NULL)
+        ldb_buffer_set(s->value, v->data, v->size);
+
+      break;
+    case LDB_TYPE_MERGE:
+      /* Keep looking for the value beneath. */
+      ldb_operands_push(s->operands, v);
+      return 1;
+    default:
+      s->state = S_DELETED;
+      break;
   }
+
+  return 0;
 }
 
 /*
@@ -399,6 +453,7 @@ typedef struct getstate_s {
   ldb_filemeta_t *last_file_read;
   int last_file_read_level;
   ldb_versions_t *vset;
+  ldb_cleanup_t *pin;
   int status;
   int found;
 } getstate_t;
@@ -422,10 +477,18 @@ getstate_match(void *arg, int level, ldb_filemeta_t *f) {
                                  state->options,
                                  f->number,
                                  f->file_size,
+                                 f->sequence,
                                  &state->ikey,
+                                 state->pin,
                                  &state->saver,
                                  save_value);
 
+  /* Only the block holding a value stays pinned. */
+  if (state->pin != NULL && (state->status != LDB_OK ||
+                             state->saver.state != S_FOUND)) {
+    ldb_cleanup_clear(state->pin);
+  }
+
   if (state->status != LDB_OK) {
     state->found = 1;
     return 0;
@@ -489,11 +552,21 @@ ldb_version_init(ldb_version_t *ver, ldb_versions_t *vset) {
   ver->refs = 0;
   ver->file_to_compact = NULL;
   ver->file_to_compact_level = -1;
+  ver->blob_file_to_compact = NULL;
+  ver->blob_file_to_compact_level = -1;
+  ver->marked_file_to_compact = NULL;
+  ver->marked_file_to_compact_level = -1;
   ver->compaction_score = -1;
   ver->compaction_level = -1;
+  ver->base_level = 1;
+  ver->compaction_bytes = 0;
 
-  for (level = 0; level < LDB_NUM_LEVELS; level++)
+  for (level = 0; level < LDB_NUM_LEVELS; level++) {
     ldb_vector_init(&ver->files[level]);
+    ver->max_bytes[level] = max_bytes_for_level(vset->options, level);
+  }
+
+  ldb_vector_init(&ver->blobs);
 }
 
 static void
@@ -516,6 +589,11 @@ ldb_version_clear(ldb_version_t *ver) {
 
     ldb_vector_clear(&ver->files[level]);
   }
+
+  for (i = 0; i < ver->blobs.length; i++)
+    ldb_blobmeta_unref(ver->blobs.items[i]);
+
+  ldb_vector_clear(&ver->blobs);
 }
 
 ldb_version_t *
@@ -531,36 +609,134 @@ ldb_version_destroy(ldb_version_t *ver) {
   ldb_free(ver);
 }
 
+/* Whether the file lies below the lower bound or at or above the
+   upper bound of an iteration. */
+static int
+out_of_bounds(const ldb_comparator_t *ucmp,
+              const ldb_readopt_t *options,
+              const ldb_filemeta_t *f) {
+  if (after_file(ucmp, options->iterate_lower_bound, f))
+    return 1;
+
+  if (options->iterate_upper_bound != NULL) {
+    ldb_slice_t smallest = ldb_ikey_user_key(&f->smallest);
+
+    if (ldb_compare(ucmp, options->iterate_upper_bound, &smallest) <= 0)
+      return 1;
+  }
+
+  return 0;
+}
+
 void
 ldb_version_add_iterators(ldb_version_t *ver,
                           const ldb_readopt_t *options,
                           ldb_vector_t *iters) {
+  const ldb_comparator_t *icmp = &ver->vset->icmp;
   ldb_tables_t *table_cache = ver->vset->table_cache;
+  const ldb_slice_t *lower = options->iterate_lower_bound;
+  const ldb_slice_t *upper = options->iterate_upper_bound;
+  ldb_ikey_t lower_key;
   int level;
   size_t i;
 
   /* Merge all level zero files together since they may overlap. */
   for (i = 0; i < ver->files[0].length; i++) {
     ldb_filemeta_t *item = ver->files[0].items[i];
-    ldb_iter_t *iter = ldb_tables_iterate(table_cache,
-                                          options,
-                                          item->number,
-                                          item->file_size,
-                                          NULL);
+    ldb_iter_t *iter;
+
+    if (out_of_bounds(icmp->user_comparator, options, item))
+      continue;
+
+    iter = ldb_tables_iterate(table_cache,
+                              options,
+                              item->number,
+                              item->file_size,
+                              item->sequence,
+                              NULL);
 
     ldb_vector_push(iters, iter);
   }
 
+  ldb_ikey_init(&lower_key);
+
+  if (lower != NULL)
+    ldb_ikey_set(&lower_key, lower, LDB_MAX_SEQUENCE, LDB_VALTYPE_SEEK);
+
   /* For levels > 0, we can use a concatenating iterator that sequentially
      walks through the non-overlapping files in the level, opening them
-     lazily. */
+     lazily. Files outside of the iteration bounds are left out. */
   for (level = 1; level < LDB_NUM_LEVELS; level++) {
-    if (ver->files[level].length > 0) {
-      ldb_iter_t *iter = ldb_concatiter_create(ver, options, level);
+    const ldb_vector_t *files = &ver->files[level];
+    uint32_t begin = 0;
+    uint32_t end = files->length;
+
+    if (lower != NULL)
+      begin = find_file(icmp, files, &lower_key);
+
+    if (upper != NULL) {
+      /* Find the first file starting at or after the upper bound. */
+      uint32_t left = begin;
+
+      while (left < end) {
+        uint32_t mid = (left + end) / 2;
+
+        if (out_of_bounds(icmp->user_comparator, options, files->items[mid]))
+          end = mid;
+        else
+          left = mid + 1;
+      }
+    }
+
+    if (begin < end) {
+      ldb_iter_t *iter = ldb_concatiter_create(ver, options, level,
+                                               begin, end);
 
       ldb_vector_push(iters, iter);
     }
   }
+
+  ldb_ikey_clear(&lower_key);
+}
+
+static int
+ldb_files_tombstones(ldb_tables_t *table_cache,
+                     const ldb_vector_t *files,
+                     ldb_rangedel_t *rd) {
+  int rc = LDB_OK;
+  size_t i;
+
+  /* Keep collecting past a failing table; the first error is returned. */
+  for (i = 0; i < files->length; i++) {
+    const ldb_filemeta_t *f = files->items[i];
+    int status;
+
+    if (f->tombstones == 0)
+      continue;
+
+    status = ldb_tables_tombstones(table_cache, f->number, f->file_size, rd);
+
+    if (rc == LDB_OK)
+      rc = status;
+  }
+
+  return rc;
+}
+
+int
+ldb_version_tombstones(ldb_version_t *ver, ldb_rangedel_t *rd) {
+  int rc = LDB_OK;
+  int level;
+
+  for (level = 0; level < LDB_NUM_LEVELS; level++) {
+    int status = ldb_files_tombstones(ver->vset->table_cache,
+                                      &ver->files[level], rd);
+
+    if (rc == LDB_OK)
+      rc = status;
+  }
+
+  return rc;
 }
 
 static int
@@ -640,6 +816,9 @@ ldb_version_get(ldb_version_t *ver,
                 const ldb_readopt_t *options,
                 const ldb_lkey_t *k,
                 ldb_buffer_t *value,
+                ldb_slice_t *pinned,
+                ldb_cleanup_t *pin,
+                ldb_operands_t *operands,
                 ldb_getstats_t *stats) {
   getstate_t state;
 
@@ -655,11 +834,15 @@ ldb_version_get(ldb_version_t *ver,
   state.options = options;
   state.ikey = ldb_lkey_internal_key(k);
   state.vset = ver->vset;
+  state.pin = pin;
 
   state.saver.state = S_NOTFOUND;
   state.saver.ucmp = ver->vset->icmp.user_comparator;
   state.saver.user_key = ldb_lkey_user_key(k);
   state.saver.value = value;
+  state.saver.pinned = pin != NULL ? pinned : NULL;
+  state.saver.operands = operands;
+  state.saver.blob = 0;
 
   ldb_version_for_each_overlapping(ver,
                                    &state.saver.user_key,
@@ -667,7 +850,28 @@ ldb_version_get(ldb_version_t *ver,
                                    &state,
                                    &getstate_match);
 
-  return state.found ? state.status : LDB_NOTFOUND;
+  if (!state.found)
+    return LDB_NOTFOUND;
+
+  if (state.status == LDB_OK && state.saver.blob && value != NULL) {
+    ldb_blobref_t ref;
+    int ok;
+
+    if (pin != NULL) {
+      /* Blob values are read into *value rather than pinned. */
+      ok = ldb_blobref_import(&ref, pinned);
+      ldb_cleanup_clear(pin);
+    } else {
+      ok = ldb_blobref_import(&ref, value);
+    }
+
+    if (ver->vset->blob_cache == NULL || !ok)
+      return LDB_CORRUPTION; /* "bad blob reference" */
+
+    return ldb_blobs_get(ver->vset->blob_cache, options, &ref, value);
+  }
+
+  return state.status;
 }
 
 int
@@ -717,6 +921,43 @@ ldb_version_record_read_sample(ldb_version_t *ver, const ldb_slice_t *ikey) {
   return 0;
 }
 
+int
+ldb_version_record_skipped(ldb_version_t *ver, const ldb_slice_t *ikey) {
+  samplestate_t state;
+  ldb_pkey_t pkey;
+
+  if (ver->file_to_compact != NULL)
+    return 0;
+
+  if (!ldb_pkey_import(&pkey, ikey))
+    return 0;
+
+  state.stats.seek_file = NULL;
+  state.stats.seek_file_level = 0;
+  state.matches = 0;
+
+  ldb_version_for_each_overlapping(ver,
+                                   &pkey.user_key,
+                                   ikey,
+                                   &state,
+                                   &samplestate_match);
+
+  /* Unlike a read sample, a single file is enough: it may hold both
+     the deletions and the entries they hide. Compacting the newest
+     file holding the key merges it with the files beneath it. Files
+     in the last level cannot be compacted any further. */
+  if (state.matches == 0)
+    return 0;
+
+  if (state.stats.seek_file_level == LDB_NUM_LEVELS - 1)
+    return 0;
+
+  ver->file_to_compact = state.stats.seek_file;
+  ver->file_to_compact_level = state.stats.seek_file_level;
+
+  return 1;
+}
+
 void
 ldb_version_ref(ldb_version_t *ver) {
   ++ver->refs;
@@ -749,9 +990,14 @@ int
 ldb_version_pick_level_for_memtable_output(ldb_version_t *ver,
                                            const ldb_slice_t *small_key,
                                            const ldb_slice_t *large_key) {
+  int max_level = LDB_MAX_MEM_COMPACT_LEVEL;
   int level = 0;
   int64_t sum;
 
+  /* Every run is flushed to level-0 under universal compaction. */
+  if (ver->vset->options->compaction_style == LDB_UNIVERSAL_COMPACTION)
+    return 0;
+
   if (!ldb_version_overlap_in_level(ver, 0, small_key, large_key)) {
     /* Push to next level if there is no overlap in next level,
        and the #bytes overlapping in the level after that are limited. */
@@ -765,7 +1011,11 @@ ldb_version_pick_level_for_memtable_output(ldb_version_t *ver,
     ldb_ikey_set(&start, small_key, LDB_MAX_SEQUENCE, LDB_VALTYPE_SEEK);
     ldb_ikey_set(&limit, large_key, 0, (ldb_valtype_t)0);
 
-    while (level < LDB_MAX_MEM_COMPACT_LEVEL) {
+    /* Levels above the base level are empty: skip past them. */
+    if (ver->vset->options->dynamic_level_bytes)
+      max_level = ver->base_level;
+
+    while (level < max_level) {
       if (ldb_version_overlap_in_level(ver, level + 1, small_key, large_key))
         break;
 
@@ -784,6 +1034,11 @@ ldb_version_pick_level_for_memtable_output(ldb_version_t *ver,
       level++;
     }
 
+    /* Short of the base level, the table would only have to be
+       compacted again on its own. Leave it to a level-0 compaction. */
+    if (level < max_level && ver->vset->options->dynamic_level_bytes)
+      level = 0;
+
     ldb_vector_clear(&overlaps);
     ldb_ikey_clear(&start);
     ldb_ikey_clear(&limit);
@@ -846,13 +1101,31 @@ ldb_version_get_overlapping_inputs(ldb_version_t *ver,
   }
 }
 
+/* Whether enough of a blob file is garbage to relocate its values. */
+static int
+blob_needs_relocation(const ldb_dbopt_t *options, const ldb_blobmeta_t *b) {
+  return b->garbage_bytes * 100 >= b->bytes * options->blob_gc_percent;
+}
+
+void
+ldb_version_garbage_blobs(ldb_version_t *ver, rb_set64_t *numbers) {
+  size_t i;
+
+  for (i = 0; i < ver->blobs.length; i++) {
+    const ldb_blobmeta_t *blob = ver->blobs.items[i];
+
+    if (blob_needs_relocation(ver->vset->options, blob))
+      rb_set64_put(numbers, blob->number);
+  }
+}
+
 void
 ldb_version_debug(ldb_buffer_t *z, const ldb_version_t *x) {
+  size_t i;
   int level;
 
   for (level = 0; level < LDB_NUM_LEVELS; level++) {
     const ldb_vector_t *files = &x->files[level];
-    size_t i;
 
     /* E.g.,
      *   --- level 1 ---
@@ -877,6 +1150,25 @@ ldb_version_debug(ldb_buffer_t *z, const ldb_version_t *x) {
       ldb_buffer_string(z, "]\n");
     }
   }
+
+  /* E.g.,
+   *   --- blobs ---
+   *   21:4194304[1024 garbage]
+   */
+  if (x->blobs.length > 0)
+    ldb_buffer_string(z, "--- blobs ---\n");
+
+  for (i = 0; i < x->blobs.length; i++) {
+    const ldb_blobmeta_t *blob = x->blobs.items[i];
+
+    ldb_buffer_push(z, ' ');
+    ldb_buffer_number(z, blob->number);
+    ldb_buffer_push(z, ':');
+    ldb_buffer_number(z, blob->bytes);
+    ldb_buffer_push(z, '[');
+    ldb_buffer_number(z, blob->garbage_bytes);
+    ldb_buffer_string(z, " garbage]\n");
+  }
 }
 
 /*
@@ -895,6 +1187,8 @@ typedef struct builder_s {
   ldb_versions_t *vset;
   ldb_version_t *base;
   level_state_t levels[LDB_NUM_LEVELS];
+  ldb_vector_t added_blobs; /* ldb_blobmeta_t * */
+  ldb_vector_t garbage;     /* ldb_blobmeta_t * (garbage counts only) */
 } builder_t;
 
 static int
@@ -935,11 +1229,15 @@ builder_init(builder_t *b, ldb_versions_t *vset, ldb_version_t *base) {
     rb_set_init(&state->added_files, file_set_compare, &b->vset->icmp);
   }
 
+  ldb_vector_init(&b->added_blobs);
+  ldb_vector_init(&b->garbage);
+
   ldb_version_ref(b->base);
 }
 
 static void
 builder_clear(builder_t *b) {
+  size_t i;
   int level;
 
   for (level = 0; level < LDB_NUM_LEVELS; level++) {
@@ -949,9 +1247,32 @@ builder_clear(builder_t *b) {
     rb_set_clear(&state->added_files, file_set_destruct);
   }
 
+  for (i = 0; i < b->added_blobs.length; i++)
+    ldb_blobmeta_unref(b->added_blobs.items[i]);
+
+  for (i = 0; i < b->garbage.length; i++)
+    ldb_blobmeta_unref(b->garbage.items[i]);
+
+  ldb_vector_clear(&b->added_blobs);
+  ldb_vector_clear(&b->garbage);
+
   ldb_version_unref(b->base);
 }
 
+static ldb_blobmeta_t *
+builder_find_garbage(builder_t *b, uint64_t number) {
+  size_t i;
+
+  for (i = 0; i < b->garbage.length; i++) {
+    ldb_blobmeta_t *blob = b->garbage.items[i];
+
+    if (blob->number == number)
+      return blob;
+  }
+
+  return NULL;
+}
+
 /* Apply all of the edits in *edit to the current state. */
 static void
 builder_apply(builder_t *b, const ldb_edit_t *edit) {
@@ -1006,6 +1327,31 @@ builder_apply(builder_t *b, const ldb_edit_t *edit) {
     rb_set64_del(&state->deleted_files, f->number);
     rb_set_put(&state->added_files, f);
   }
+
+  /* Add new blob files. */
+  for (i = 0; i < edit->new_blobs.length; i++) {
+    ldb_blobmeta_t *blob = ldb_blobmeta_clone(edit->new_blobs.items[i]);
+
+    blob->refs = 1;
+
+    ldb_vector_push(&b->added_blobs, blob);
+  }
+
+  /* Accumulate blob garbage. */
+  for (i = 0; i < edit->blob_garbage.length; i++) {
+    const ldb_blobmeta_t *entry = edit->blob_garbage.items[i];
+    ldb_blobmeta_t *blob = builder_find_garbage(b, entry->number);
+
+    if (blob == NULL) {
+      blob = ldb_blobmeta_clone(entry);
+      blob->refs = 1;
+
+      ldb_vector_push(&b->garbage, blob);
+    } else {
+      blob->garbage_count += entry->garbage_count;
+      blob->garbage_bytes += entry->garbage_bytes;
+    }
+  }
 }
 
 static void
@@ -1034,11 +1380,48 @@ builder_maybe_add_file(builder_t *b,
   }
 }
 
+static void
+builder_maybe_add_blob(builder_t *b, ldb_version_t *v, ldb_blobmeta_t *blob) {
+  const ldb_blobmeta_t *garbage = builder_find_garbage(b, blob->number);
+
+  if (garbage != NULL) {
+    blob = ldb_blobmeta_clone(blob);
+    blob->garbage_count += garbage->garbage_count;
+    blob->garbage_bytes += garbage->garbage_bytes;
+
+    if (blob->garbage_count >= blob->count) {
+      /* No table refers to the file anymore: drop it. */
+      ldb_free(blob);
+      return;
+    }
+  }
+
+  ldb_blobmeta_ref(blob);
+  ldb_vector_push(&v->blobs, blob);
+}
+
+static int
+blob_number_compare(void *x, void *y) {
+  const ldb_blobmeta_t *a = x;
+  const ldb_blobmeta_t *b = y;
+
+  return LDB_CMP(a->number, b->number);
+}
+
 /* Save the current state in *v. */
 static void
 builder_save_to(builder_t *b, ldb_version_t *v) {
+  size_t j;
   int level;
 
+  for (j = 0; j < b->base->blobs.length; j++)
+    builder_maybe_add_blob(b, v, b->base->blobs.items[j]);
+
+  for (j = 0; j < b->added_blobs.length; j++)
+    builder_maybe_add_blob(b, v, b->added_blobs.items[j]);
+
+  ldb_vector_sort(&v->blobs, blob_number_compare);
+
   for (level = 0; level < LDB_NUM_LEVELS; level++) {
     /* Merge the set of added files with the set of pre-existing files. */
     /* Drop any deleted files. Store the result in *v. */
@@ -1123,8 +1506,10 @@ ldb_versions_init(ldb_versions_t *vset,
   int level;
 
   vset->dbname = dbname;
+  vset->family = NULL;
   vset->options = options;
   vset->table_cache = table_cache;
+  vset->blob_cache = NULL;
   vset->icmp = *cmp;
   vset->next_file_number = 2;
   vset->manifest_file_number = 0; /* Filled by recover(). */
@@ -1133,6 +1518,8 @@ ldb_versions_init(ldb_versions_t *vset,
   vset->prev_log_number = 0;
   vset->descriptor_file = NULL;
   vset->descriptor_log = NULL;
+  vset->descriptor_size = 0;
+  vset->snapshot_size = 0;
   vset->current = NULL;
 
   ldb_version_init(&vset->dummy_versions, vset);
@@ -1192,7 +1579,147 @@ ldb_versions_reuse_file_number(ldb_versions_t *vset, uint64_t file_number) {
 int
 ldb_versions_needs_compaction(const ldb_versions_t *vset) {
   ldb_version_t *v = vset->current;
-  return (v->compaction_score >= 1) || (v->file_to_compact != NULL);
+
+  if (vset->options->compaction_style == LDB_UNIVERSAL_COMPACTION)
+    return v->compaction_score >= 1;
+
+  return (v->compaction_score >= 1) ||
+         (v->file_to_compact != NULL) ||
+         (v->blob_file_to_compact != NULL) ||
+         (v->marked_file_to_compact != NULL);
+}
+
+/* Size the levels from the bottom up: the last non-empty level keeps
+   its size, and each level above it is a tenth of the one below. The
+   first level to fall under the level-1 size becomes the base level. */
+static void
+ldb_versions_size_levels(ldb_versions_t *vset, ldb_version_t *v) {
+  double base_bytes = max_bytes_for_level(vset->options, 1);
+  double size;
+  int level;
+
+  v->base_level = 1;
+
+  for (level = 0; level < LDB_NUM_LEVELS; level++)
+    v->max_bytes[level] = max_bytes_for_level(vset->options, level);
+
+  if (!vset->options->dynamic_level_bytes)
+    return;
+
+  level = LDB_NUM_LEVELS - 1;
+
+  while (level > 1 && v->files[level].length == 0)
+    level--;
+
+  if (v->files[level].length == 0)
+    level = LDB_NUM_LEVELS - 1;
+
+  size = (double)total_file_size(&v->files[level]);
+
+  if (size < base_bytes)
+    size = base_bytes;
+
+  v->max_bytes[level] = size;
+
+  while (level > 1 && size / 10 >= base_bytes) {
+    size /= 10;
+    v->max_bytes[--level] = size;
+  }
+
+  v->base_level = level;
+
+  while (--level > 0)
+    v->max_bytes[level] = 0;
+}
+
+/* Estimate the bytes compactions have yet to rewrite. Each level over
+   its limit has its excess merged with (and so rewritten along with)
+   the overlapping part of the level below, and the excess carries down
+   to that level. */
+static void
+ldb_versions_estimate_compaction_bytes(ldb_versions_t *vset,
+                                       ldb_version_t *v) {
+  double total = 0;
+  double carry = 0;
+  int level;
+
+  if ((int)v->files[0].length >= vset->options->level0_compaction_trigger) {
+    carry = total_file_size(&v->files[0]);
+    total += carry + total_file_size(&v->files[v->base_level]);
+  }
+
+  for (level = 1; level < LDB_NUM_LEVELS - 1; level++) {
+    double bytes = total_file_size(&v->files[level]);
+    double excess;
+
+    if (level < v->base_level) {
+      /* Everything in these levels is to be moved down. */
+      total += bytes;
+      continue;
+    }
+
+    excess = bytes + carry - v->max_bytes[level];
+
+    if (excess > 0) {
+      total += excess * (1 + v->max_bytes[level + 1] / v->max_bytes[level]);
+      carry = excess;
+    } else {
+      carry = 0;
+    }
+  }
+
+  v->compaction_bytes = (uint64_t)total;
+}
+
+/* Mark the file with the largest share of deletion markers over
+   deletion_compaction_percent or, failing that, the oldest file past
+   max_file_age. Files in the last level cannot be compacted any
+   further. */
+static void
+ldb_versions_mark_file(ldb_versions_t *vset, ldb_version_t *v) {
+  const ldb_dbopt_t *options = vset->options;
+  uint64_t now = ldb_now_usec() / 1000000;
+  ldb_filemeta_t *oldest = NULL;
+  int oldest_level = -1;
+  double best = 0;
+  int level;
+  size_t i;
+
+  if (options->deletion_compaction_percent == 0 && options->max_file_age == 0)
+    return;
+
+  for (level = 0; level < LDB_NUM_LEVELS - 1; level++) {
+    const ldb_vector_t *files = &v->files[level];
+
+    for (i = 0; i < files->length; i++) {
+      ldb_filemeta_t *f = files->items[i];
+
+      if (options->deletion_compaction_percent > 0 && f->entries > 0 &&
+          f->deletions * 100 >= f->entries *
+                                options->deletion_compaction_percent) {
+        double ratio = (double)f->deletions / f->entries;
+
+        if (ratio > best) {
+          v->marked_file_to_compact = f;
+          v->marked_file_to_compact_level = level;
+          best = ratio;
+        }
+      }
+
+      if (options->max_file_age > 0 && f->created > 0 &&
+          f->created + options->max_file_age <= now) {
+        if (oldest == NULL || f->created < oldest->created) {
+          oldest = f;
+          oldest_level = level;
+        }
+      }
+    }
+  }
+
+  if (v->marked_file_to_compact == NULL) {
+    v->marked_file_to_compact = oldest;
+    v->marked_file_to_compact_level = oldest_level;
+  }
 }
 
 static void
@@ -1201,6 +1728,9 @@ ldb_versions_finalize(ldb_versions_t *vset, ldb_version_t *v) {
   int best_level = -1;
   double best_score = -1;
   int level;
+  size_t i;
+
+  ldb_versions_size_levels(vset, v);
 
   for (level = 0; level < LDB_NUM_LEVELS - 1; level++) {
     double score;
@@ -1218,12 +1748,21 @@ ldb_versions_finalize(ldb_versions_t *vset, ldb_version_t *v) {
        * setting, or very high compression ratios, or lots of
        * overwrites/deletions).
        */
-      score = v->files[level].length / (double)(LDB_L0_COMPACTION_TRIGGER);
+      score = v->files[level].length /
+              (double)vset->options->level0_compaction_trigger;
+    } else if (level < v->base_level) {
+      /* Levels above the base level should be empty. Drain them. */
+      int64_t level_bytes = total_file_size(&v->files[level]);
+
+      if (level_bytes > 0)
+        score = 1.0 + level_bytes / v->max_bytes[v->base_level];
+      else
+        score = 0;
     } else {
       /* Compute the ratio of current size to size limit. */
       int64_t level_bytes = total_file_size(&v->files[level]);
 
-      score = (double)level_bytes / max_bytes_for_level(vset->options, level);
+      score = (double)level_bytes / v->max_bytes[level];
     }
 
     if (score > best_score) {
@@ -1234,18 +1773,60 @@ ldb_versions_finalize(ldb_versions_t *vset, ldb_version_t *v) {
 
   v->compaction_level = best_level;
   v->compaction_score = best_score;
+
+  ldb_versions_estimate_compaction_bytes(vset, v);
+
+  /* Universal compaction only ever merges runs in level-0, and
+     relocates blob values as a side effect of doing so. */
+  if (vset->options->compaction_style == LDB_UNIVERSAL_COMPACTION) {
+    v->compaction_level = 0;
+    v->compaction_score = v->files[0].length /
+                          (double)vset->options->level0_compaction_trigger;
+    return;
+  }
+
+  ldb_versions_mark_file(vset, v);
+
+  /* Pick a file referring to the oldest blob file which is garbage
+     enough, so that compacting it relocates some of the blob file's
+     values. Files in the last level cannot be compacted any further:
+     their values are only relocated when compacted into. */
+  for (i = 0; i < v->blobs.length; i++) {
+    const ldb_blobmeta_t *blob = v->blobs.items[i];
+
+    if (!blob_needs_relocation(vset->options, blob))
+      continue;
+
+    for (level = 0; level < LDB_NUM_LEVELS - 1; level++) {
+      const ldb_vector_t *files = &v->files[level];
+      size_t j;
+
+      for (j = 0; j < files->length; j++) {
+        ldb_filemeta_t *f = files->items[j];
+
+        if (f->oldest_blob == blob->number) {
+          v->blob_file_to_compact = f;
+          v->blob_file_to_compact_level = level;
+          return;
+        }
+      }
+    }
+  }
 }
 
-static int
-ldb_versions_write_snapshot(ldb_versions_t *vset, ldb_writer_t *log) {
-  ldb_buffer_t record;
+static void
+ldb_versions_write_snapshot(ldb_versions_t *vset, ldb_buffer_t *record) {
   ldb_edit_t edit;
-  int level, rc;
+  size_t i;
+  int level;
 
   /* Save metadata. */
   ldb_edit_init(&edit);
   ldb_edit_set_comparator_name(&edit, vset->icmp.user_comparator->name);
 
+  if (vset->family != NULL)
+    ldb_edit_set_family_name(&edit, vset->family);
+
   /* Save compaction pointers. */
   for (level = 0; level < LDB_NUM_LEVELS; level++) {
     if (vset->compact_pointer[level].size > 0) {
@@ -1257,33 +1838,74 @@ ldb_versions_write_snapshot(ldb_versions_t *vset, ldb_writer_t *log) {
   /* Save files. */
   for (level = 0; level < LDB_NUM_LEVELS; level++) {
     const ldb_vector_t *files = &vset->current->files[level];
-    size_t i;
 
     for (i = 0; i < files->length; i++) {
       const ldb_filemeta_t *f = files->items[i];
 
-      ldb_edit_add_file(&edit, level,
-                               f->number,
-                               f->file_size,
-                               &f->smallest,
-                               &f->largest);
+      ldb_filemeta_t *meta = ldb_edit_add_file(&edit, level,
+                                                      f->number,
+                                                      f->file_size,
+                                                      &f->smallest,
+                                                      &f->largest);
+
+      meta->tombstones = f->tombstones;
+      meta->oldest_blob = f->oldest_blob;
+      meta->sequence = f->sequence;
+      meta->entries = f->entries;
+      meta->deletions = f->deletions;
+      meta->created = f->created;
     }
   }
 
-  ldb_buffer_init(&record);
-  ldb_edit_export(&record, &edit);
+  /* Save blob files. */
+  for (i = 0; i < vset->current->blobs.length; i++) {
+    const ldb_blobmeta_t *b = vset->current->blobs.items[i];
+
+    ldb_edit_add_blob(&edit, b->number, b->count, b->bytes);
+
+    if (b->garbage_count > 0)
+      ldb_edit_add_garbage(&edit, b->number, b->garbage_count,
+                                             b->garbage_bytes);
+  }
+
+  ldb_edit_export(record, &edit);
   ldb_edit_clear(&edit);
+}
 
-  rc = ldb_writer_add_record(log, &record);
+/* Once the edits appended to the MANIFEST outweigh both the target
+   file size and a snapshot of the current version, start a new
+   MANIFEST so that recovery time stays proportional to the number
+   of live files rather than to the history of the database. */
+static int
+ldb_versions_needs_checkpoint(const ldb_versions_t *vset) {
+  uint64_t edits = vset->descriptor_size - vset->snapshot_size;
 
-  ldb_buffer_clear(&record);
+  if (vset->descriptor_log == NULL)
+    return 0;
+
+  return edits >= target_file_size(vset->options)
+      && edits >= vset->snapshot_size;
+}
+
+static int
+ldb_versions_add_record(ldb_versions_t *vset, const ldb_slice_t *record) {
+  int rc = ldb_writer_add_record(vset->descriptor_log, record);
+
+  if (rc == LDB_OK)
+    vset->descriptor_size += record->size;
 
   return rc;
 }
 
 int
 ldb_versions_apply(ldb_versions_t *vset, ldb_edit_t *edit, ldb_mutex_t *mu) {
+  ldb_wfile_t *old_file = NULL;
+  ldb_writer_t *old_log = NULL;
+  uint64_t old_number = 0;
+  uint64_t old_size = 0;
   char fname[LDB_PATH_MAX];
+  ldb_buffer_t snapshot;
+  ldb_buffer_t record;
   ldb_version_t *v;
   int rc = LDB_OK;
 
@@ -1299,6 +1921,19 @@ ldb_versions_apply(ldb_versions_t *vset, ldb_edit_t *edit, ldb_mutex_t *mu) {
   if (!edit->has_prev_log_number)
     ldb_edit_set_prev_log_number(edit, vset->prev_log_number);
 
+  /* Set the current descriptor aside if it has grown too large. A new
+     one is started below exactly as on the first call to apply. */
+  if (ldb_versions_needs_checkpoint(vset)) {
+    old_file = vset->descriptor_file;
+    old_log = vset->descriptor_log;
+    old_number = vset->manifest_file_number;
+    old_size = vset->descriptor_size;
+
+    vset->descriptor_file = NULL;
+    vset->descriptor_log = NULL;
+    vset->manifest_file_number = ldb_versions_new_file_number(vset);
+  }
+
   ldb_edit_set_next_file(edit, vset->next_file_number);
   ldb_edit_set_last_sequence(edit, vset->last_sequence);
 
@@ -1315,11 +1950,14 @@ ldb_versions_apply(ldb_versions_t *vset, ldb_edit_t *edit, ldb_mutex_t *mu) {
 
   ldb_versions_finalize(vset, v);
 
+  ldb_buffer_init(&snapshot);
+  ldb_buffer_init(&record);
+
   /* Initialize new descriptor log file if necessary by creating
      a temporary file that contains a snapshot of the current version. */
   if (vset->descriptor_log == NULL) {
-    /* No reason to unlock *mu here since we only hit this path in the
-       first call to apply (when opening the database). */
+    /* The snapshot is encoded while we hold *mu, but written below
+       along with the edit once the lock has been released. */
     assert(vset->descriptor_file == NULL);
 
     if (ldb_desc_filename(fname, sizeof(fname), vset->dbname,
@@ -1331,43 +1969,84 @@ ldb_versions_apply(ldb_versions_t *vset, ldb_edit_t *edit, ldb_mutex_t *mu) {
 
     if (rc == LDB_OK) {
       vset->descriptor_log = ldb_writer_create(vset->descriptor_file, 0);
+      vset->descriptor_size = 0;
+
+      ldb_versions_write_snapshot(vset, &snapshot);
 
-      rc = ldb_versions_write_snapshot(vset, vset->descriptor_log);
+      vset->snapshot_size = snapshot.size;
     }
   }
 
+  ldb_edit_export(&record, edit);
+
   /* Unlock during expensive MANIFEST log write. */
   {
     ldb_mutex_unlock(mu);
 
+    if (rc == LDB_OK && snapshot.size > 0)
+      rc = ldb_versions_add_record(vset, &snapshot);
+
     /* Write new record to MANIFEST log. */
-    if (rc == LDB_OK) {
-      ldb_buffer_t record;
+    if (rc == LDB_OK)
+      rc = ldb_versions_add_record(vset, &record);
 
-      ldb_buffer_init(&record);
-      ldb_edit_export(&record, edit);
+    if (rc == LDB_OK)
+      rc = ldb_wfile_sync(vset->descriptor_file);
 
-      rc = ldb_writer_add_record(vset->descriptor_log, &record);
+    /* If we just created a new descriptor file, install it by writing a
+       new CURRENT file that points to it. */
+    if (rc == LDB_OK && fname[0])
+      rc = ldb_set_current_file(vset->dbname, vset->manifest_file_number);
 
-      if (rc == LDB_OK)
-        rc = ldb_wfile_sync(vset->descriptor_file);
+    if (rc != LDB_OK && old_log != NULL) {
+      /* The checkpoint failed. CURRENT still names the old descriptor,
+         so go back to appending to it. */
+      ldb_log(vset->options->info_log, "MANIFEST checkpoint: %s",
+                                       ldb_strerror(rc));
 
-      if (rc != LDB_OK) {
-        ldb_log(vset->options->info_log, "MANIFEST write: %s",
-                                         ldb_strerror(rc));
+      if (vset->descriptor_log != NULL) {
+        ldb_writer_destroy(vset->descriptor_log);
+        ldb_wfile_destroy(vset->descriptor_file);
+        ldb_remove_file(fname);
       }
 
-      ldb_buffer_clear(&record);
+      vset->descriptor_file = old_file;
+      vset->descriptor_log = old_log;
+      vset->manifest_file_number = old_number;
+      vset->descriptor_size = old_size;
+
+      old_file = NULL;
+      old_log = NULL;
+      fname[0] = '\0';
+
+      rc = ldb_versions_add_record(vset, &record);
+
+      if (rc == LDB_OK)
+        rc = ldb_wfile_sync(vset->descriptor_file);
     }
 
-    /* If we just created a new descriptor file, install it by writing a
-       new CURRENT file that points to it. */
-    if (rc == LDB_OK && fname[0])
-      rc = ldb_set_current_file(vset->dbname, vset->manifest_file_number);
+    if (rc != LDB_OK) {
+      ldb_log(vset->options->info_log, "MANIFEST write: %s",
+                                       ldb_strerror(rc));
+    }
+
+    if (old_log != NULL) {
+      /* The old descriptor is deleted with the other obsolete files. */
+      ldb_log(vset->options->info_log, "MANIFEST checkpoint: #%lu -> #%lu",
+                                       (unsigned long)old_number,
+                                       (unsigned long)vset->manifest_file_number);
+
+      ldb_writer_destroy(old_log);
+      ldb_wfile_close(old_file);
+      ldb_wfile_destroy(old_file);
+    }
 
     ldb_mutex_lock(mu);
   }
 
+  ldb_buffer_clear(&snapshot);
+  ldb_buffer_clear(&record);
+
   /* Install the new version. */
   if (rc == LDB_OK) {
     ldb_versions_append_version(vset, v);
@@ -1430,6 +2109,8 @@ ldb_versions_reuse_manifest(ldb_versions_t *vset, const char *dscname) {
 
   vset->descriptor_log = ldb_writer_create(vset->descriptor_file,
                                            manifest_size);
+  vset->descriptor_size = manifest_size;
+  vset->snapshot_size = 0;
 
   vset->manifest_file_number = manifest_number;
 
@@ -1518,6 +2199,7 @@ ldb_versions_recover(ldb_versions_t *vset, int *save_manifest) {
 
   {
     ldb_slice_t name = ldb_string(ucmp->name);
+    ldb_slice_t family = ldb_string(vset->family != NULL ? vset->family : "");
     ldb_reporter_t reporter;
     ldb_reader_t reader;
     ldb_slice_t record;
@@ -1546,6 +2228,14 @@ ldb_versions_recover(ldb_versions_t *vset, int *save_manifest) {
         }
       }
 
+      if (rc == LDB_OK && edit.has_family) {
+        if (vset->family == NULL ||
+            !ldb_slice_equal(&edit.family, &family)) {
+          rc = LDB_INVALID; /* "[edit.family] does not match
+                                column family [vset.family]" */
+        }
+      }
+
       if (rc == LDB_OK)
         builder_apply(&builder, &edit);
 
@@ -1625,6 +2315,65 @@ ldb_versions_recover(ldb_versions_t *vset, int *save_manifest) {
   return rc;
 }
 
+int
+ldb_versions_family(const char *dbname, ldb_buffer_t *name) {
+  char fname[LDB_PATH_MAX];
+  ldb_reporter_t reporter;
+  ldb_reader_t reader;
+  ldb_slice_t record;
+  ldb_rfile_t *file;
+  ldb_buffer_t buf;
+  ldb_edit_t edit;
+  int found = 0;
+  int rc;
+
+  rc = read_current_filename(fname, sizeof(fname), dbname);
+
+  if (rc != LDB_OK)
+    return rc;
+
+  rc = ldb_seqfile_create(fname, &file);
+
+  if (rc != LDB_OK) {
+    if (rc == LDB_ENOENT)
+      return LDB_CORRUPTION; /* "CURRENT points to a non-existent file" */
+
+    return rc;
+  }
+
+  reporter.status = &rc;
+  reporter.corruption = report_corruption;
+
+  ldb_reader_init(&reader, file, &reporter, 1, 0);
+  ldb_slice_init(&record);
+  ldb_buffer_init(&buf);
+  ldb_edit_init(&edit);
+
+  /* The name is in the first record of every descriptor. */
+  while (!found && ldb_reader_read_record(&reader, &record, &buf)
+                && rc == LDB_OK) {
+    if (!ldb_edit_import(&edit, &record)) {
+      rc = LDB_CORRUPTION;
+      break;
+    }
+
+    if (edit.has_family) {
+      ldb_buffer_copy(name, &edit.family);
+      found = 1;
+    }
+  }
+
+  if (rc == LDB_OK && !found)
+    rc = LDB_CORRUPTION; /* "no column family name in descriptor" */
+
+  ldb_edit_clear(&edit);
+  ldb_buffer_clear(&buf);
+  ldb_reader_clear(&reader);
+  ldb_rfile_destroy(file);
+
+  return rc;
+}
+
 void
 ldb_versions_mark_file_number(ldb_versions_t *vset, uint64_t number) {
   if (vset->next_file_number <= number)
@@ -1692,6 +2441,7 @@ ldb_versions_approximate_offset(ldb_versions_t *vset,
                                   ldb_readopt_default,
                                   file->number,
                                   file->file_size,
+                                  file->sequence,
                                   &tableptr);
 
         if (tableptr != NULL)
@@ -1722,6 +2472,12 @@ ldb_versions_add_files(ldb_versions_t *vset, rb_set64_t *live) {
         rb_set64_put(live, file->number);
       }
     }
+
+    for (i = 0; i < v->blobs.length; i++) {
+      const ldb_blobmeta_t *blob = v->blobs.items[i];
+
+      rb_set64_put(live, blob->number);
+    }
   }
 }
 
@@ -1922,11 +2678,24 @@ add_boundary_inputs(const ldb_comparator_t *icmp,
   }
 }
 
+/* The level a compaction of "level" writes to. Compactions above the
+   base level skip over the empty levels in between. */
+static int
+ldb_version_output_level(const ldb_version_t *v, int level) {
+  int output = level + 1;
+
+  while (output < v->base_level && v->files[output].length == 0)
+    output++;
+
+  return output;
+}
+
 static void
 ldb_versions_setup_other_inputs(ldb_versions_t *vset, ldb_compaction_t *c) {
   ldb_slice_t smallest, largest;
   ldb_slice_t all_start, all_limit;
   const int level = c->level;
+  const int output_level = c->output_level;
 
   add_boundary_inputs(&vset->icmp,
                       &vset->current->files[level],
@@ -1934,12 +2703,12 @@ ldb_versions_setup_other_inputs(ldb_versions_t *vset, ldb_compaction_t *c) {
 
   ldb_versions_get_range(vset, &c->inputs[0], &smallest, &largest);
 
-  ldb_version_get_overlapping_inputs(vset->current, level + 1,
+  ldb_version_get_overlapping_inputs(vset->current, output_level,
                                      &smallest, &largest,
                                      &c->inputs[1]);
 
   add_boundary_inputs(&vset->icmp,
-                      &vset->current->files[level + 1],
+                      &vset->current->files[output_level],
                       &c->inputs[1]);
 
   /* Get entire range covered by compaction. */
@@ -1947,7 +2716,7 @@ ldb_versions_setup_other_inputs(ldb_versions_t *vset, ldb_compaction_t *c) {
                                 &all_start, &all_limit);
 
   /* See if we can grow the number of inputs in "level" without
-     changing the number of "level+1" files we pick up. */
+     changing the number of "output_level" files we pick up. */
   if (c->inputs[1].length > 0) {
     ldb_vector_t expanded0;
     int64_t inputs0_size;
@@ -1977,13 +2746,13 @@ ldb_versions_setup_other_inputs(ldb_versions_t *vset, ldb_compaction_t *c) {
       ldb_versions_get_range(vset, &expanded0, &new_start, &new_limit);
 
       ldb_version_get_overlapping_inputs(vset->current,
-                                         level + 1,
+                                         output_level,
                                          &new_start,
                                          &new_limit,
                                          &expanded1);
 
       add_boundary_inputs(&vset->icmp,
-                          &vset->current->files[level + 1],
+                          &vset->current->files[output_level],
                           &expanded1);
 
       if (expanded1.length == c->inputs[1].length) {
@@ -2016,9 +2785,9 @@ ldb_versions_setup_other_inputs(ldb_versions_t *vset, ldb_compaction_t *c) {
   }
 
   /* Compute the set of grandparent files that overlap this compaction
-     (parent == level+1; grandparent == level+2). */
-  if (level + 2 < LDB_NUM_LEVELS) {
-    ldb_version_get_overlapping_inputs(vset->current, level + 2,
+     (parent == output_level; grandparent == output_level+1). */
+  if (output_level + 1 < LDB_NUM_LEVELS) {
+    ldb_version_get_overlapping_inputs(vset->current, output_level + 1,
                                        &all_start, &all_limit,
                                        &c->grandparents);
   }
@@ -2032,6 +2801,180 @@ ldb_versions_setup_other_inputs(ldb_versions_t *vset, ldb_compaction_t *c) {
   ldb_edit_set_compact_pointer(&c->edit, level, &largest);
 }
 
+/* Universal compaction keeps each sorted run in level-0 as a single
+ * file and merges runs of similar size, rather than pushing data down
+ * through the levels. Runs are always picked starting from the newest
+ * one, so that the output (which takes a new file number) stays ordered
+ * by age relative to the runs left behind.
+ */
+static ldb_compaction_t *
+ldb_versions_pick_universal(ldb_versions_t *vset) {
+  const ldb_dbopt_t *options = vset->options;
+  ldb_version_t *current = vset->current;
+  const ldb_filemeta_t *f;
+  ldb_compaction_t *c;
+  ldb_vector_t runs;
+  int64_t size = 0;
+  int64_t oldest;
+  size_t i, n, k;
+
+  if (current->compaction_score < 1)
+    return NULL;
+
+  ldb_vector_init(&runs);
+  ldb_vector_grow(&runs, current->files[0].length);
+
+  for (i = 0; i < current->files[0].length; i++)
+    ldb_vector_push(&runs, current->files[0].items[i]);
+
+  ldb_vector_sort(&runs, newest_first);
+
+  n = runs.length;
+
+  assert(n >= 2);
+
+  for (i = 0; i < n - 1; i++) {
+    f = runs.items[i];
+    size += f->file_size;
+  }
+
+  f = runs.items[n - 1];
+  oldest = f->file_size;
+
+  if (size * 100 >= oldest * options->universal_max_size_amplification) {
+    /* The newer runs take up too much space next to the oldest one
+       (which holds most of the data). Merge everything. */
+    k = n;
+  } else {
+    /* Take newer runs for as long as the next one is not much larger
+       than all of those before it. */
+    f = runs.items[0];
+    size = f->file_size;
+
+    for (k = 1; k < n; k++) {
+      f = runs.items[k];
+
+      if ((int64_t)f->file_size * 100 >
+          size * (100 + options->universal_size_ratio)) {
+        break;
+      }
+
+      size += f->file_size;
+    }
+
+    if (k < (size_t)options->universal_min_merge_width) {
+      /* Nothing of similar size. Merge just enough of the newest
+         runs to bring the count back under the trigger. */
+      k = n - options->level0_compaction_trigger + 1;
+
+      if (k < 2)
+        k = 2;
+    }
+  }
+
+  c = ldb_compaction_create(options, 0);
+  c->output_level = 0;
+  c->max_output_file_size = UINT64_MAX;
+  c->input_version = current;
+
+  ldb_version_ref(c->input_version);
+
+  for (i = 0; i < k; i++)
+    ldb_vector_push(&c->inputs[0], runs.items[i]);
+
+  ldb_log(options->info_log, "Universal compaction of %d of %d runs",
+          (int)k, (int)n);
+
+  ldb_vector_clear(&runs);
+
+  return c;
+}
+
+/* While level-0 is slowing down writes, a compaction into a large
+ * level-1 may take too long to bring any relief. Merge the newest
+ * level-0 files into a single level-0 file instead, which is cheap
+ * since they are small, and leave the merged file to be compacted
+ * downwards later on. As with universal compaction, files are picked
+ * starting from the newest one so that the output stays ordered by
+ * age relative to the files left behind.
+ */
+static ldb_compaction_t *
+ldb_versions_pick_intra_l0(ldb_versions_t *vset) {
+  const ldb_dbopt_t *options = vset->options;
+  ldb_version_t *current = vset->current;
+  int64_t limit = expanded_compaction_byte_size_limit(options);
+  int64_t room;
+  ldb_vector_t files, parents;
+  ldb_compaction_t *c = NULL;
+  ldb_slice_t smallest, largest;
+  int64_t size = 0;
+  size_t i;
+
+  if (current->files[0].length < (size_t)options->level0_slowdown_writes_trigger)
+    return NULL;
+
+  /* Memtables which can be flushed before writes stop. */
+  room = (int64_t)options->write_buffer_size *
+         (options->level0_stop_writes_trigger - current->files[0].length);
+
+  ldb_vector_init(&files);
+  ldb_vector_init(&parents);
+
+  ldb_versions_get_range(vset, &current->files[0], &smallest, &largest);
+
+  ldb_version_get_overlapping_inputs(current,
+                                     ldb_version_output_level(current, 0),
+                                     &smallest, &largest, &parents);
+
+  /* Compacting into level-1 is fine if it is unlikely to take longer
+     than filling them. */
+  if (total_file_size(&parents) <= room)
+    goto done;
+
+  ldb_vector_grow(&files, current->files[0].length);
+
+  for (i = 0; i < current->files[0].length; i++)
+    ldb_vector_push(&files, current->files[0].items[i]);
+
+  ldb_vector_sort(&files, newest_first);
+
+  /* Stop at the first file which has been merged before. */
+  for (i = 0; i < files.length; i++) {
+    const ldb_filemeta_t *f = files.items[i];
+
+    if (f->file_size > 2 * options->write_buffer_size)
+      break;
+
+    if (size + (int64_t)f->file_size > limit)
+      break;
+
+    size += f->file_size;
+  }
+
+  if (i < (size_t)options->level0_compaction_trigger)
+    goto done;
+
+  c = ldb_compaction_create(options, 0);
+  c->output_level = 0;
+  c->max_output_file_size = UINT64_MAX;
+  c->input_version = current;
+
+  ldb_version_ref(c->input_version);
+
+  ldb_vector_grow(&c->inputs[0], i);
+
+  while (c->inputs[0].length < i)
+    ldb_vector_push(&c->inputs[0], files.items[c->inputs[0].length]);
+
+  ldb_log(options->info_log, "Intra-L0 compaction of %d of %d files",
+          (int)i, (int)files.length);
+
+done:
+  ldb_vector_clear(&files);
+  ldb_vector_clear(&parents);
+  return c;
+}
+
 ldb_compaction_t *
 ldb_versions_pick_compaction(ldb_versions_t *vset) {
   ldb_compaction_t *c;
@@ -2042,6 +2985,18 @@ ldb_versions_pick_compaction(ldb_versions_t *vset) {
      the compactions triggered by seeks. */
   int size_compaction = (vset->current->compaction_score >= 1);
   int seek_compaction = (vset->current->file_to_compact != NULL);
+  int blob_compaction = (vset->current->blob_file_to_compact != NULL);
+  int marked_compaction = (vset->current->marked_file_to_compact != NULL);
+
+  if (vset->options->compaction_style == LDB_UNIVERSAL_COMPACTION)
+    return ldb_versions_pick_universal(vset);
+
+  if (size_compaction && vset->current->compaction_level == 0) {
+    c = ldb_versions_pick_intra_l0(vset);
+
+    if (c != NULL)
+      return c;
+  }
 
   if (size_compaction) {
     level = vset->current->compaction_level;
@@ -2071,11 +3026,22 @@ ldb_versions_pick_compaction(ldb_versions_t *vset) {
     level = vset->current->file_to_compact_level;
     c = ldb_compaction_create(vset->options, level);
     ldb_vector_push(&c->inputs[0], vset->current->file_to_compact);
+  } else if (blob_compaction) {
+    level = vset->current->blob_file_to_compact_level;
+    c = ldb_compaction_create(vset->options, level);
+    c->relocate = 1;
+    ldb_vector_push(&c->inputs[0], vset->current->blob_file_to_compact);
+  } else if (marked_compaction) {
+    level = vset->current->marked_file_to_compact_level;
+    c = ldb_compaction_create(vset->options, level);
+    c->marked = 1;
+    ldb_vector_push(&c->inputs[0], vset->current->marked_file_to_compact);
   } else {
     return NULL;
   }
 
   c->input_version = vset->current;
+  c->output_level = ldb_version_output_level(c->input_version, level);
 
   ldb_version_ref(c->input_version);
 
@@ -2108,6 +3074,7 @@ ldb_versions_compact_range(ldb_versions_t *vset,
                            const ldb_ikey_t *end) {
   ldb_vector_t inputs;
   ldb_compaction_t *c;
+  size_t i;
 
   ldb_vector_init(&inputs);
 
@@ -2118,6 +3085,28 @@ ldb_versions_compact_range(ldb_versions_t *vset,
     return NULL;
   }
 
+  /* Merge every run into one: picking only some of them could leave
+     a newer run behind an older one. */
+  if (level == 0 &&
+      vset->options->compaction_style == LDB_UNIVERSAL_COMPACTION) {
+    ldb_vector_reset(&inputs);
+
+    for (i = 0; i < vset->current->files[0].length; i++)
+      ldb_vector_push(&inputs, vset->current->files[0].items[i]);
+
+    c = ldb_compaction_create(vset->options, 0);
+    c->output_level = 0;
+    c->max_output_file_size = UINT64_MAX;
+    c->input_version = vset->current;
+
+    ldb_version_ref(c->input_version);
+
+    ldb_vector_swap(&c->inputs[0], &inputs);
+    ldb_vector_clear(&inputs);
+
+    return c;
+  }
+
   /* Avoid compacting too much in one shot in case the range is large.
      But we cannot do this for level-0 since level-0 files can overlap
      and we must not pick one file and drop another older file if the
@@ -2125,7 +3114,6 @@ ldb_versions_compact_range(ldb_versions_t *vset,
   if (level > 0) {
     uint64_t limit = max_file_size_for_level(vset->options, level);
     uint64_t total = 0;
-    size_t i;
 
     for (i = 0; i < inputs.length; i++) {
       ldb_filemeta_t *f = inputs.items[i];
@@ -2142,6 +3130,7 @@ ldb_versions_compact_range(ldb_versions_t *vset,
   c = ldb_compaction_create(vset->options, level);
 
   c->input_version = vset->current;
+  c->output_level = ldb_version_output_level(c->input_version, level);
 
   ldb_version_ref(c->input_version);
 
@@ -2177,7 +3166,7 @@ ldb_inputiter_create(ldb_versions_t *vset, ldb_compaction_t *c) {
 
   for (which = 0; which < 2; which++) {
     if (c->inputs[which].length > 0) {
-      if (c->level + which == 0) {
+      if (which == 0 && c->level == 0) {
         const ldb_vector_t *files = &c->inputs[which];
 
         for (i = 0; i < files->length; i++) {
@@ -2187,12 +3176,15 @@ ldb_inputiter_create(ldb_versions_t *vset, ldb_compaction_t *c) {
                                            &options,
                                            file->number,
                                            file->file_size,
+                                           file->sequence,
                                            NULL);
         }
       } else {
         /* Create concatenating iterator for the files from this level. */
         list[num++] = ldb_twoiter_create(ldb_numiter_create(&vset->icmp,
-                                                            &c->inputs[which]),
+                                                            &c->inputs[which],
+                                                            0,
+                                                            c->inputs[which].length),
                                          &get_file_iterator,
                                          vset->table_cache,
                                          &options);
@@ -2220,6 +3212,9 @@ ldb_compaction_init(ldb_compaction_t *c,
   int i;
 
   c->level = level;
+  c->output_level = level + 1;
+  c->relocate = 0;
+  c->marked = 0;
   c->max_output_file_size = max_file_size_for_level(options, level);
   c->input_version = NULL;
   c->grandparent_index = 0;
@@ -2266,7 +3261,8 @@ ldb_compaction_is_trivial_move(const ldb_compaction_t *c) {
   /* Avoid a move if there is lots of overlapping grandparent data.
      Otherwise, the move could create a parent file that will require
      a very expensive merge later on. */
-  return c->inputs[0].length == 1 &&
+  return !c->relocate && !c->marked &&
+         c->inputs[0].length == 1 &&
          c->inputs[1].length == 0 &&
          total_file_size(&c->grandparents) <=
            max_grandparent_overlap_bytes(vset->options);
@@ -2278,14 +3274,24 @@ ldb_compaction_add_input_deletions(ldb_compaction_t *c, ldb_edit_t *edit) {
   size_t i;
 
   for (which = 0; which < 2; which++) {
+    int level = (which == 0 ? c->level : c->output_level);
+
     for (i = 0; i < c->inputs[which].length; i++) {
       const ldb_filemeta_t *file = c->inputs[which].items[i];
 
-      ldb_edit_remove_file(edit, c->level + which, file->number);
+      ldb_edit_remove_file(edit, level, file->number);
     }
   }
 }
 
+/* A universal compaction merges the newest runs in level-0. Any runs
+   it leaves behind are older and may hold anything. */
+static int
+leaves_older_runs(const ldb_compaction_t *c) {
+  return c->output_level == 0 &&
+         c->inputs[0].length < c->input_version->files[0].length;
+}
+
 int
 ldb_compaction_is_base_level_for_key(ldb_compaction_t *c,
                                      const ldb_slice_t *user_key) {
@@ -2294,7 +3300,10 @@ ldb_compaction_is_base_level_for_key(ldb_compaction_t *c,
   const ldb_comparator_t *user_cmp = vset->icmp.user_comparator;
   int lvl;
 
-  for (lvl = c->level + 2; lvl < LDB_NUM_LEVELS; lvl++) {
+  if (leaves_older_runs(c))
+    return 0;
+
+  for (lvl = c->output_level + 1; lvl < LDB_NUM_LEVELS; lvl++) {
     ldb_vector_t *files = &c->input_version->files[lvl];
 
     while (c->level_ptrs[lvl] < files->length) {
@@ -2320,6 +3329,35 @@ ldb_compaction_is_base_level_for_key(ldb_compaction_t *c,
   return 1;
 }
 
+int
+ldb_compaction_is_base_level_for_range(ldb_compaction_t *c,
+                                       const ldb_slice_t *start,
+                                       const ldb_slice_t *limit) {
+  int lvl;
+
+  if (leaves_older_runs(c))
+    return 0;
+
+  for (lvl = c->output_level + 1; lvl < LDB_NUM_LEVELS; lvl++) {
+    if (ldb_version_overlap_in_level(c->input_version, lvl, start, limit))
+      return 0;
+  }
+
+  return 1;
+}
+
+int
+ldb_compaction_tombstones(ldb_compaction_t *c, ldb_rangedel_t *rd) {
+  ldb_tables_t *table_cache = c->input_version->vset->table_cache;
+  int rc = LDB_OK;
+  int which;
+
+  for (which = 0; which < 2 && rc == LDB_OK; which++)
+    rc = ldb_files_tombstones(table_cache, &c->inputs[which], rd);
+
+  return rc;
+}
+
 int
 ldb_compaction_should_stop_before(ldb_compaction_t *c,
                                   const ldb_slice_t *ikey) {
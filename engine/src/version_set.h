@@ -29,7 +29,11 @@
  * Types
  */
 
+struct ldb_blobs_s;
+struct ldb_cleanup_s;
 struct ldb_iter_s;
+struct ldb_operands_s;
+struct ldb_rangedel_s;
 struct ldb_writer_s;
 struct ldb_tables_s;
 struct ldb_wfile_s;
@@ -52,21 +56,47 @@ struct ldb_version_s {
   /* List of files per level. */
   ldb_vector_t files[LDB_NUM_LEVELS]; /* ldb_filemeta_t[] */
 
+  /* Blob files referenced by the tables, sorted by number. */
+  ldb_vector_t blobs; /* ldb_blobmeta_t[] */
+
   /* Next file to compact based on seek stats. */
   ldb_filemeta_t *file_to_compact;
   int file_to_compact_level;
 
+  /* Next file to compact to relocate the values of a blob file which
+     is mostly garbage. Initialized by finalize(). */
+  ldb_filemeta_t *blob_file_to_compact;
+  int blob_file_to_compact_level;
+
+  /* Next file to compact because it is dense with deletion markers or
+     old (see deletion_compaction_percent and max_file_age). Initialized
+     by finalize(). */
+  ldb_filemeta_t *marked_file_to_compact;
+  int marked_file_to_compact_level;
+
   /* Level that should be compacted next and its compaction score.
      Score < 1 means compaction is not strictly needed. These fields
      are initialized by finalize(). */
   double compaction_score;
   int compaction_level;
+
+  /* Size limit of each level, and the first level below level-0 which
+     is in use. Levels in between are kept empty (see the option
+     dynamic_level_bytes). Initialized by finalize(). */
+  double max_bytes[LDB_NUM_LEVELS];
+  int base_level;
+
+  /* Estimated number of bytes compactions have to rewrite to bring
+     every level under its limit. Initialized by finalize(). */
+  uint64_t compaction_bytes;
 };
 
 struct ldb_versions_s {
   const char *dbname;
+  const char *family; /* Column family name (NULL for the default). */
   const ldb_dbopt_t *options;
   struct ldb_tables_s *table_cache;
+  struct ldb_blobs_s *blob_cache; /* Set by the owner, if any. */
   ldb_comparator_t icmp;
   uint64_t next_file_number;
   uint64_t manifest_file_number;
@@ -77,6 +107,8 @@ struct ldb_versions_s {
   /* Opened lazily. */
   struct ldb_wfile_s *descriptor_file;
   struct ldb_writer_s *descriptor_log;
+  uint64_t descriptor_size; /* Approximate bytes in descriptor_log. */
+  uint64_t snapshot_size;   /* Size of the snapshot it starts with. */
   ldb_version_t dummy_versions; /* Circular doubly-linked list of versions. */
   ldb_version_t *current;       /* == dummy_versions.prev */
 
@@ -87,15 +119,18 @@ struct ldb_versions_s {
 
 struct ldb_compaction_s {
   int level;
+  int output_level; /* Usually level + 1 (0 for a universal compaction). */
+  int relocate; /* Picked to relocate blob values (never a move). */
+  int marked;   /* Picked for its deletions or age (never a move). */
   uint64_t max_output_file_size;
   ldb_version_t *input_version;
   ldb_edit_t edit;
 
-  /* Each compaction reads inputs from "level" and "level+1". */
+  /* Each compaction reads inputs from "level" and "output_level". */
   ldb_vector_t inputs[2]; /* The two sets of inputs. */
 
   /* State used to check for number of overlapping grandparent files
-     (parent == level + 1, grandparent == level + 2) */
+     (parent == output_level, grandparent == output_level + 1) */
   ldb_vector_t grandparents;
   size_t grandparent_index;   /* Index in grandparent_starts. */
   int seen_key;               /* Some output key has been seen. */
@@ -107,7 +142,7 @@ struct ldb_compaction_s {
   /* level_ptrs holds indices into input_version->levels: our state
      is that we are positioned at one of the file ranges for each
      higher level than the ones involved in this compaction (i.e. for
-     all L >= level + 2). */
+     all L >= output_level + 1). */
   size_t level_ptrs[LDB_NUM_LEVELS];
 };
 
@@ -157,14 +192,28 @@ ldb_version_add_iterators(ldb_version_t *ver,
                           const ldb_readopt_t *options,
                           ldb_vector_t *iters);
 
+/* Add the range tombstones of every file in this version to *rd. */
+int
+ldb_version_tombstones(ldb_version_t *ver, struct ldb_rangedel_s *rd);
+
 /* Lookup the value for key. If found, store it in *val and
-   return OK. Else return a non-OK status. Fills *stats. */
+   return OK. Else return a non-OK status. Merge operands found
+   above the value are added to *operands. Values in blob files
+   are read from vset->blob_cache. Fills *stats.
+
+   If "pin" is non-NULL, a value found in a table is not copied:
+   *pinned points into its block, which stays alive until "pin"
+   is cleared. A value read from a blob file is still stored in
+   *val, and "pin" is left empty. */
 /* REQUIRES: lock is not held */
 int
 ldb_version_get(ldb_version_t *ver,
                 const ldb_readopt_t *options,
                 const ldb_lkey_t *k,
                 ldb_buffer_t *value,
+                ldb_slice_t *pinned,
+                struct ldb_cleanup_s *pin,
+                struct ldb_operands_s *operands,
                 ldb_getstats_t *stats);
 
 /* Adds "stats" into the current state. Returns true if a new
@@ -180,6 +229,13 @@ ldb_version_update_stats(ldb_version_t *ver, const ldb_getstats_t *stats);
 int
 ldb_version_record_read_sample(ldb_version_t *ver, const ldb_slice_t *ikey);
 
+/* Record that an iterator skipped LDB_ITER_SKIP_PERIOD hidden entries
+   in a row, ending at the specified internal key. Returns true if a
+   new compaction may need to be triggered. */
+/* REQUIRES: lock is held */
+int
+ldb_version_record_skipped(ldb_version_t *ver, const ldb_slice_t *ikey);
+
 /* Reference count management (so Versions do not disappear out from
    under live iterators). */
 void
@@ -212,6 +268,11 @@ ldb_version_get_overlapping_inputs(ldb_version_t *ver,
                                    const ldb_ikey_t *end,
                                    ldb_vector_t *inputs);
 
+/* Add the blob files of this version which are garbage enough for
+   compactions to relocate their values to *numbers. */
+void
+ldb_version_garbage_blobs(ldb_version_t *ver, rb_set64_t *numbers);
+
 void
 ldb_version_debug(ldb_buffer_t *z, const ldb_version_t *x);
 
@@ -254,6 +315,11 @@ ldb_versions_apply(ldb_versions_t *vset, ldb_edit_t *edit, ldb_mutex_t *mu);
 int
 ldb_versions_recover(ldb_versions_t *vset, int *save_manifest);
 
+/* Read the column family name recorded in the descriptor of the
+   database at "dbname", without recovering it. */
+int
+ldb_versions_family(const char *dbname, ldb_buffer_t *name);
+
 /* Mark the specified file number as used. */
 void
 ldb_versions_mark_file_number(ldb_versions_t *vset, uint64_t number);
@@ -341,12 +407,24 @@ void
 ldb_compaction_add_input_deletions(ldb_compaction_t *c, ldb_edit_t *edit);
 
 /* Returns true if the information we have available guarantees that
-   the compaction is producing data in "level+1" for which no data exists
-   in levels greater than "level+1". */
+   the compaction is producing data in "output_level" for which no data
+   exists in levels greater than "output_level" (or, for a universal
+   compaction, in older runs it leaves behind). */
 int
 ldb_compaction_is_base_level_for_key(ldb_compaction_t *c,
                                      const ldb_slice_t *user_key);
 
+/* Like is_base_level_for_key(), but for the user keys in [start, limit).
+   Used to decide whether a range tombstone may be dropped. */
+int
+ldb_compaction_is_base_level_for_range(ldb_compaction_t *c,
+                                       const ldb_slice_t *start,
+                                       const ldb_slice_t *limit);
+
+/* Add the range tombstones of the compaction inputs to *rd. */
+int
+ldb_compaction_tombstones(ldb_compaction_t *c, struct ldb_rangedel_s *rd);
+
 /* Returns true iff we should stop building the current output
    before processing "internal_key". */
 int
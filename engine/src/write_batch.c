@@ -21,6 +21,7 @@
 #include "util/slice.h"
 #include "util/status.h"
 
+#include "db_impl.h"
 #include "dbformat.h"
 #include "memtable.h"
 #include "write_batch.h"
@@ -30,8 +31,14 @@
  *    count: fixed32
  *    data: record[count]
  * record :=
+ *    [LDB_FAMILY_TAG family] entry
+ * entry :=
  *    LDB_TYPE_VALUE varstring varstring |
- *    LDB_TYPE_DELETION varstring
+ *    LDB_TYPE_DELETION varstring |
+ *    LDB_TYPE_RANGE_DELETION varstring varstring |
+ *    LDB_TYPE_MERGE varstring varstring
+ * family :=
+ *    number: varint64 (column family, absent for the default)
  * varstring :=
  *    len: varint32
  *    data: uint8[len]
@@ -44,6 +51,10 @@
 /* Header has an 8-byte sequence number followed by a 4-byte count. */
 #define LDB_HEADER 12
 
+/* Prefix of a record belonging to a column family other than
+   the default. Not counted as a record of its own. */
+#define LDB_FAMILY_TAG 0x10
+
 /*
  * WriteBatch
  */
@@ -100,6 +111,17 @@ ldb_batch_iterate(const ldb_batch_t *batch, ldb_handler_t *handler) {
 
     ldb_slice_eat(&input, 1);
 
+    handler->family = 0;
+
+    if (tag == LDB_FAMILY_TAG) {
+      if (!ldb_varint64_slurp(&handler->family, &input) || input.size == 0)
+        return LDB_CORRUPTION; /* "bad WriteBatch family" */
+
+      tag = input.data[0];
+
+      ldb_slice_eat(&input, 1);
+    }
+
     found++;
 
     switch (tag) {
@@ -124,6 +146,36 @@ ldb_batch_iterate(const ldb_batch_t *batch, ldb_handler_t *handler) {
         break;
       }
 
+      case LDB_TYPE_RANGE_DELETION: {
+        if (!ldb_slice_slurp(&key, &input))
+          return LDB_CORRUPTION; /* "bad WriteBatch DeleteRange" */
+
+        if (!ldb_slice_slurp(&value, &input))
+          return LDB_CORRUPTION; /* "bad WriteBatch DeleteRange" */
+
+        if (handler->del_range == NULL)
+          return LDB_NOSUPPORT; /* "DeleteRange not supported" */
+
+        handler->del_range(handler, &key, &value);
+
+        break;
+      }
+
+      case LDB_TYPE_MERGE: {
+        if (!ldb_slice_slurp(&key, &input))
+          return LDB_CORRUPTION; /* "bad WriteBatch Merge" */
+
+        if (!ldb_slice_slurp(&value, &input))
+          return LDB_CORRUPTION; /* "bad WriteBatch Merge" */
+
+        if (handler->merge == NULL)
+          return LDB_NOSUPPORT; /* "Merge not supported" */
+
+        handler->merge(handler, &key, &value);
+
+        break;
+      }
+
       default: {
         return LDB_CORRUPTION; /* "unknown WriteBatch tag" */
       }
@@ -156,23 +208,84 @@ ldb_batch_set_sequence(ldb_batch_t *batch, ldb_seqnum_t seq) {
   ldb_fixed64_write(batch->rep.data, seq);
 }
 
+static void
+ldb_batch_record(ldb_batch_t *batch, ldb_family_t *family, int type) {
+  uint64_t number = ldb_family_number(family);
+
+  ldb_batch_set_count(batch, ldb_batch_count(batch) + 1);
+
+  if (number != 0) {
+    ldb_buffer_push(&batch->rep, LDB_FAMILY_TAG);
+    ldb_buffer_varint64(&batch->rep, number);
+  }
+
+  ldb_buffer_push(&batch->rep, type);
+}
+
 void
 ldb_batch_put(ldb_batch_t *batch,
               const ldb_slice_t *key,
               const ldb_slice_t *value) {
-  ldb_batch_set_count(batch, ldb_batch_count(batch) + 1);
-  ldb_buffer_push(&batch->rep, LDB_TYPE_VALUE);
+  ldb_batch_put_cf(batch, NULL, key, value);
+}
+
+void
+ldb_batch_put_cf(ldb_batch_t *batch,
+                 ldb_family_t *family,
+                 const ldb_slice_t *key,
+                 const ldb_slice_t *value) {
+  ldb_batch_record(batch, family, LDB_TYPE_VALUE);
   ldb_slice_export(&batch->rep, key);
   ldb_slice_export(&batch->rep, value);
 }
 
 void
 ldb_batch_del(ldb_batch_t *batch, const ldb_slice_t *key) {
-  ldb_batch_set_count(batch, ldb_batch_count(batch) + 1);
-  ldb_buffer_push(&batch->rep, LDB_TYPE_DELETION);
+  ldb_batch_del_cf(batch, NULL, key);
+}
+
+void
+ldb_batch_del_cf(ldb_batch_t *batch,
+                 ldb_family_t *family,
+                 const ldb_slice_t *key) {
+  ldb_batch_record(batch, family, LDB_TYPE_DELETION);
   ldb_slice_export(&batch->rep, key);
 }
 
+void
+ldb_batch_del_range(ldb_batch_t *batch,
+                    const ldb_slice_t *start,
+                    const ldb_slice_t *limit) {
+  ldb_batch_del_range_cf(batch, NULL, start, limit);
+}
+
+void
+ldb_batch_del_range_cf(ldb_batch_t *batch,
+                       ldb_family_t *family,
+                       const ldb_slice_t *start,
+                       const ldb_slice_t *limit) {
+  ldb_batch_record(batch, family, LDB_TYPE_RANGE_DELETION);
+  ldb_slice_export(&batch->rep, start);
+  ldb_slice_export(&batch->rep, limit);
+}
+
+void
+ldb_batch_merge(ldb_batch_t *batch,
+                const ldb_slice_t *key,
+                const ldb_slice_t *value) {
+  ldb_batch_merge_cf(batch, NULL, key, value);
+}
+
+void
+ldb_batch_merge_cf(ldb_batch_t *batch,
+                   ldb_family_t *family,
+                   const ldb_slice_t *key,
+                   const ldb_slice_t *value) {
+  ldb_batch_record(batch, family, LDB_TYPE_MERGE);
+  ldb_slice_export(&batch->rep, key);
+  ldb_slice_export(&batch->rep, value);
+}
+
 void
 ldb_batch_append(ldb_batch_t *dst, const ldb_batch_t *src) {
   assert(src->rep.size >= LDB_HEADER);
@@ -183,14 +296,22 @@ ldb_batch_append(ldb_batch_t *dst, const ldb_batch_t *src) {
                                src->rep.size - LDB_HEADER);
 }
 
+/* Finds the memtable of each record's column family. */
+typedef struct ldb_inserter_s {
+  ldb_memtable_t *(*lookup)(void *arg, uint64_t family);
+  void *arg;
+} ldb_inserter_t;
+
 static void
 memtable_put(ldb_handler_t *handler,
              const ldb_slice_t *key,
              const ldb_slice_t *value) {
-  ldb_memtable_t *table = handler->state;
+  ldb_inserter_t *ins = handler->state;
+  ldb_memtable_t *table = ins->lookup(ins->arg, handler->family);
   ldb_seqnum_t seq = handler->number;
 
-  ldb_memtable_add(table, seq, LDB_TYPE_VALUE, key, value);
+  if (table != NULL)
+    ldb_memtable_add(table, seq, LDB_TYPE_VALUE, key, value);
 
   handler->number++;
 }
@@ -198,22 +319,71 @@ memtable_put(ldb_handler_t *handler,
 static void
 memtable_del(ldb_handler_t *handler, const ldb_slice_t *key) {
   static const ldb_slice_t value = {NULL, 0, 0};
-  ldb_memtable_t *table = handler->state;
+  ldb_inserter_t *ins = handler->state;
+  ldb_memtable_t *table = ins->lookup(ins->arg, handler->family);
   ldb_seqnum_t seq = handler->number;
 
-  ldb_memtable_add(table, seq, LDB_TYPE_DELETION, key, &value);
+  if (table != NULL)
+    ldb_memtable_add(table, seq, LDB_TYPE_DELETION, key, &value);
 
   handler->number++;
 }
 
+static void
+memtable_del_range(ldb_handler_t *handler,
+                   const ldb_slice_t *start,
+                   const ldb_slice_t *limit) {
+  ldb_inserter_t *ins = handler->state;
+  ldb_memtable_t *table = ins->lookup(ins->arg, handler->family);
+  ldb_seqnum_t seq = handler->number;
+
+  if (table != NULL)
+    ldb_memtable_add(table, seq, LDB_TYPE_RANGE_DELETION, start, limit);
+
+  handler->number++;
+}
+
+static void
+memtable_merge(ldb_handler_t *handler,
+               const ldb_slice_t *key,
+               const ldb_slice_t *value) {
+  ldb_inserter_t *ins = handler->state;
+  ldb_memtable_t *table = ins->lookup(ins->arg, handler->family);
+  ldb_seqnum_t seq = handler->number;
+
+  if (table != NULL)
+    ldb_memtable_add(table, seq, LDB_TYPE_MERGE, key, value);
+
+  handler->number++;
+}
+
+static ldb_memtable_t *
+lookup_default(void *arg, uint64_t family) {
+  return family == 0 ? arg : NULL;
+}
+
 int
 ldb_batch_insert_into(const ldb_batch_t *batch, ldb_memtable_t *table) {
+  return ldb_batch_insert_families(batch, lookup_default, table);
+}
+
+int
+ldb_batch_insert_families(const ldb_batch_t *batch,
+                          ldb_memtable_t *(*lookup)(void *, uint64_t),
+                          void *arg) {
   ldb_handler_t handler;
+  ldb_inserter_t ins;
+
+  ins.lookup = lookup;
+  ins.arg = arg;
 
-  handler.state = table;
+  handler.state = &ins;
   handler.number = ldb_batch_sequence(batch);
+  handler.family = 0;
   handler.put = memtable_put;
   handler.del = memtable_del;
+  handler.del_range = memtable_del_range;
+  handler.merge = memtable_merge;
 
   return ldb_batch_iterate(batch, &handler);
 }
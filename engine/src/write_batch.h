@@ -40,6 +40,7 @@
  * Types
  */
 
+struct ldb_family_s;
 struct ldb_memtable_s;
 
 typedef uint64_t ldb__seqnum_t;
@@ -54,6 +55,16 @@ typedef struct ldb_handler_s {
 
   void (*del)(struct ldb_handler_s *handler,
               const ldb_slice_t *key);
+
+  void (*del_range)(struct ldb_handler_s *handler,
+                    const ldb_slice_t *start,
+                    const ldb_slice_t *limit);
+
+  void (*merge)(struct ldb_handler_s *handler,
+                const ldb_slice_t *key,
+                const ldb_slice_t *value);
+
+  uint64_t family; /* Column family of the current record (0 = default). */
 } ldb_handler_t;
 
 typedef struct ldb_batch_s {
@@ -115,10 +126,49 @@ ldb_batch_put(ldb_batch_t *batch,
               const ldb_slice_t *key,
               const ldb_slice_t *value);
 
+/* Store the mapping "key->value" in a column family (NULL
+   for the default). The same applies to the other _cf calls. */
+LDB_EXTERN void
+ldb_batch_put_cf(ldb_batch_t *batch,
+                 struct ldb_family_s *family,
+                 const ldb_slice_t *key,
+                 const ldb_slice_t *value);
+
 /* If the database contains a mapping for "key", erase it. Else do nothing. */
 LDB_EXTERN void
 ldb_batch_del(ldb_batch_t *batch, const ldb_slice_t *key);
 
+LDB_EXTERN void
+ldb_batch_del_cf(ldb_batch_t *batch,
+                 struct ldb_family_s *family,
+                 const ldb_slice_t *key);
+
+/* Erase every key in the range [start, limit). Keys written after
+   this call (in this batch or later) are not affected. */
+LDB_EXTERN void
+ldb_batch_del_range(ldb_batch_t *batch,
+                    const ldb_slice_t *start,
+                    const ldb_slice_t *limit);
+
+LDB_EXTERN void
+ldb_batch_del_range_cf(ldb_batch_t *batch,
+                       struct ldb_family_s *family,
+                       const ldb_slice_t *start,
+                       const ldb_slice_t *limit);
+
+/* Combine "value" with the existing value of "key" using the
+   database's merge operator. */
+LDB_EXTERN void
+ldb_batch_merge(ldb_batch_t *batch,
+                const ldb_slice_t *key,
+                const ldb_slice_t *value);
+
+LDB_EXTERN void
+ldb_batch_merge_cf(ldb_batch_t *batch,
+                   struct ldb_family_s *family,
+                   const ldb_slice_t *key,
+                   const ldb_slice_t *value);
+
 /* Copies the operations in "src" to this batch.
  *
  * This runs in O(source size) time. However, the constant factor is better
@@ -128,9 +178,17 @@ ldb_batch_del(ldb_batch_t *batch, const ldb_slice_t *key);
 LDB_EXTERN void
 ldb_batch_append(ldb_batch_t *dst, const ldb_batch_t *src);
 
+/* Insert the records of the default column family into "table". */
 int
 ldb_batch_insert_into(const ldb_batch_t *batch, struct ldb_memtable_s *table);
 
+/* Insert each record into the memtable returned by "lookup" for
+   its column family. Records for which it returns NULL are skipped. */
+int
+ldb_batch_insert_families(const ldb_batch_t *batch,
+                          struct ldb_memtable_s *(*lookup)(void *, uint64_t),
+                          void *arg);
+
 void
 ldb_batch_set_contents(ldb_batch_t *batch, const ldb_slice_t *contents);
 
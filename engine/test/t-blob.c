@@ -0,0 +1,322 @@
+/*!
+ * t-blob.c - blob file test for lcdb
+ * Copyright (c) 2022, Christopher Jeffrey (MIT License).
+ * https://github.com/chjj/lcdb
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "table/iterator.h"
+
+#include "util/env.h"
+#include "util/internal.h"
+#include "util/options.h"
+#include "util/slice.h"
+#include "util/status.h"
+#include "util/testutil.h"
+
+#include "db_impl.h"
+#include "filename.h"
+
+/*
+ * Helpers
+ */
+
+#define NUM_KEYS 100
+#define VALUE_SIZE 1000
+
+static void
+blob_init(ldb_testdb_t *t) {
+  ldb_testdb_init(t, "blob_test");
+
+  t->options.min_blob_size = 100;
+}
+
+static void
+make_key(char *key, int i) {
+  sprintf(key, "key%03d", i);
+}
+
+/* A value of VALUE_SIZE bytes identifying its key and generation. */
+static void
+make_value(char *value, int i, int gen) {
+  memset(value, 'a' + (i + gen) % 26, VALUE_SIZE);
+  sprintf(value, "%d:%d", i, gen);
+}
+
+static void
+db_put(ldb_t *db, int i, int gen) {
+  char kbuf[16], vbuf[VALUE_SIZE];
+  ldb_slice_t key, val;
+
+  make_key(kbuf, i);
+  make_value(vbuf, i, gen);
+
+  key = ldb_string(kbuf);
+  val = ldb_slice((uint8_t *)vbuf, VALUE_SIZE);
+
+  ASSERT(ldb_put(db, &key, &val, 0) == LDB_OK);
+}
+
+/* Check that key i holds the value of generation gen. */
+static void
+check_value(ldb_t *db, int i, int gen) {
+  char kbuf[16], vbuf[VALUE_SIZE];
+  ldb_slice_t key, val;
+
+  make_key(kbuf, i);
+  make_value(vbuf, i, gen);
+
+  key = ldb_string(kbuf);
+
+  ASSERT(ldb_get(db, &key, &val, 0) == LDB_OK);
+  ASSERT(val.size == VALUE_SIZE);
+  ASSERT(memcmp(val.data, vbuf, VALUE_SIZE) == 0);
+
+  ldb_free(val.data);
+}
+
+/* Check every value through an iterator, in both directions. */
+static void
+check_iterator(ldb_t *db, int gen) {
+  ldb_iter_t *it = ldb_iterator(db, 0);
+  char kbuf[16], vbuf[VALUE_SIZE];
+  int i = 0;
+
+  for (ldb_iter_first(it); ldb_iter_valid(it); ldb_iter_next(it)) {
+    ldb_slice_t k = ldb_iter_key(it);
+    ldb_slice_t v = ldb_iter_value(it);
+
+    make_key(kbuf, i);
+    make_value(vbuf, i, gen);
+
+    ASSERT(k.size == strlen(kbuf) && memcmp(k.data, kbuf, k.size) == 0);
+    ASSERT(v.size == VALUE_SIZE && memcmp(v.data, vbuf, VALUE_SIZE) == 0);
+
+    i++;
+  }
+
+  ASSERT(i == NUM_KEYS);
+
+  for (ldb_iter_last(it); ldb_iter_valid(it); ldb_iter_prev(it)) {
+    ldb_slice_t v = ldb_iter_value(it);
+
+    i--;
+
+    make_value(vbuf, i, gen);
+
+    ASSERT(v.size == VALUE_SIZE && memcmp(v.data, vbuf, VALUE_SIZE) == 0);
+  }
+
+  ASSERT(i == 0);
+  ASSERT(ldb_iter_status(it) == LDB_OK);
+
+  ldb_iter_destroy(it);
+}
+
+/* Return a bitmask of the blob files (numbered below 64) in the database. */
+static uint64_t
+blob_files(const char *dbname) {
+  char **filenames = NULL;
+  ldb_filetype_t type;
+  uint64_t number;
+  uint64_t set = 0;
+  int i, len;
+
+  len = ldb_get_children(dbname, &filenames);
+
+  ASSERT(len >= 0);
+
+  for (i = 0; i < len; i++) {
+    if (ldb_parse_filename(&type, &number, filenames[i])) {
+      if (type == LDB_FILE_BLOB) {
+        ASSERT(number < 64);
+        set |= (uint64_t)1 << number;
+      }
+    }
+  }
+
+  if (filenames != NULL)
+    ldb_free_children(filenames, len);
+
+  return set;
+}
+
+/* Wait for background compactions to relocate the values
+   of the blob files in "set", returning the files left. */
+static uint64_t
+wait_relocated(const char *dbname, uint64_t set) {
+  uint64_t files;
+  int i;
+
+  for (i = 0; ((files = blob_files(dbname)) & set) != 0; i++) {
+    ASSERT(i < 1000);
+    ldb_sleep_usec(10000);
+  }
+
+  return files;
+}
+
+/* Write generation gen of the keys lo..hi-1 and compact everything. */
+static void
+write_range(ldb_t *db, int lo, int hi, int gen) {
+  int i;
+
+  for (i = lo; i < hi; i++)
+    db_put(db, i, gen);
+
+  ldb_compact(db, NULL, NULL);
+}
+
+/*
+ * Blob
+ */
+
+static void
+test_blob_values(void) {
+  ldb_testdb_t t;
+  int i;
+
+  blob_init(&t);
+  ldb_testdb_open(&t);
+
+  ldb_testdb_put(&t, "small", "value");
+
+  for (i = 0; i < NUM_KEYS; i++)
+    db_put(t.db, i, 0);
+
+  /* Read from the memtable. */
+  check_value(t.db, 0, 0);
+
+  ASSERT(blob_files(t.dbname) == 0);
+
+  ldb_compact(t.db, NULL, NULL);
+
+  /* Large values are moved out of the tables. */
+  ASSERT(blob_files(t.dbname) != 0);
+
+  for (i = 0; i < NUM_KEYS; i++)
+    check_value(t.db, i, 0);
+
+  ASSERT_EQ(ldb_testdb_get(&t, "small", NULL), "value");
+
+  ldb_testdb_clear(&t);
+}
+
+static void
+test_blob_iterator(void) {
+  ldb_testdb_t t;
+  int i;
+
+  blob_init(&t);
+  ldb_testdb_open(&t);
+
+  write_range(t.db, 0, NUM_KEYS, 0);
+
+  check_iterator(t.db, 0);
+
+  /* Newer values in the memtable shadow the blobs. */
+  for (i = 0; i < NUM_KEYS; i++)
+    db_put(t.db, i, 1);
+
+  check_iterator(t.db, 1);
+
+  ldb_testdb_clear(&t);
+}
+
+static void
+test_blob_gc(void) {
+  uint64_t before, after;
+  ldb_testdb_t t;
+  int i;
+
+  blob_init(&t);
+
+  /* Half of the file being garbage is not enough. */
+  t.options.blob_gc_percent = 100;
+
+  ldb_testdb_open(&t);
+
+  write_range(t.db, 0, NUM_KEYS, 0);
+
+  before = blob_files(t.dbname);
+
+  write_range(t.db, 0, NUM_KEYS / 2, 1);
+  ldb_compact(t.db, NULL, NULL);
+
+  after = blob_files(t.dbname);
+
+  ASSERT((before & after) == before);
+
+  for (i = 0; i < NUM_KEYS; i++)
+    check_value(t.db, i, i < NUM_KEYS / 2);
+
+  ldb_testdb_clear(&t);
+
+  blob_init(&t);
+
+  /* Past the threshold, the live values are copied out. */
+  t.options.blob_gc_percent = 25;
+
+  ldb_testdb_open(&t);
+
+  write_range(t.db, 0, NUM_KEYS, 0);
+
+  before = blob_files(t.dbname);
+
+  write_range(t.db, 0, NUM_KEYS / 2, 1);
+  ldb_compact(t.db, NULL, NULL);
+
+  after = wait_relocated(t.dbname, before);
+
+  ASSERT(before != 0 && after != 0);
+
+  for (i = 0; i < NUM_KEYS; i++)
+    check_value(t.db, i, i < NUM_KEYS / 2);
+
+  /* The relocated values survive a reopen. */
+  ldb_testdb_reopen(&t);
+
+  ASSERT(blob_files(t.dbname) == after);
+
+  for (i = 0; i < NUM_KEYS; i++)
+    check_value(t.db, i, i < NUM_KEYS / 2);
+
+  /* Deleting every key leaves no blob behind. */
+  for (i = 0; i < NUM_KEYS; i++) {
+    char kbuf[16];
+    ldb_slice_t key;
+
+    make_key(kbuf, i);
+
+    key = ldb_string(kbuf);
+
+    ASSERT(ldb_del(t.db, &key, 0) == LDB_OK);
+  }
+
+  ldb_compact(t.db, NULL, NULL);
+
+  ASSERT(wait_relocated(t.dbname, after) == 0);
+
+  ldb_testdb_reopen(&t);
+
+  ASSERT_EQ(ldb_testdb_get(&t, "key000", NULL), "NOT_FOUND");
+
+  ldb_testdb_clear(&t);
+}
+
+/*
+ * Execute
+ */
+
+int
+main(void) {
+  test_blob_values();
+  test_blob_iterator();
+  test_blob_gc();
+
+  return 0;
+}
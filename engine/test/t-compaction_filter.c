@@ -0,0 +1,316 @@
+/*!
+ * t-compaction_filter.c - compaction filter test for lcdb
+ * Copyright (c) 2022, Christopher Jeffrey (MIT License).
+ * https://github.com/chjj/lcdb
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "table/iterator.h"
+
+#include "util/internal.h"
+#include "util/options.h"
+#include "util/slice.h"
+#include "util/status.h"
+#include "util/testutil.h"
+
+#include "db_impl.h"
+#include "dbformat.h"
+#include "snapshot.h"
+
+/*
+ * Helpers
+ */
+
+typedef struct filter_state_s {
+  int calls;
+  char value[64];
+} filter_state_t;
+
+/* Removes "expired" values and rewrites "old..." as "new...". */
+static enum ldb_decision
+test_filter(const ldb_cfilter_t *cf,
+            int level,
+            const ldb_slice_t *key,
+            const ldb_slice_t *value,
+            ldb_slice_t *new_value) {
+  filter_state_t *state = cf->state;
+
+  (void)level;
+  (void)key;
+
+  state->calls++;
+
+  if (value->size == 7 && memcmp(value->data, "expired", 7) == 0)
+    return LDB_FILTER_REMOVE;
+
+  if (value->size >= 3 && memcmp(value->data, "old", 3) == 0) {
+    ASSERT(value->size < sizeof(state->value));
+
+    memcpy(state->value, value->data, value->size);
+    memcpy(state->value, "new", 3);
+
+    *new_value = ldb_slice((uint8_t *)state->value, value->size);
+
+    return LDB_FILTER_CHANGE;
+  }
+
+  return LDB_FILTER_KEEP;
+}
+
+static filter_state_t filter_state;
+
+static const ldb_cfilter_t filter = {
+  /* .name = */ "test.Filter",
+  /* .filter = */ test_filter,
+  /* .state = */ &filter_state
+};
+
+static void
+db_init(ldb_testdb_t *t) {
+  ldb_testdb_init(t, "compaction_filter_test");
+
+  t->options.compaction_filter = &filter;
+
+  filter_state.calls = 0;
+}
+
+static int
+db_files_at(ldb_t *db, int level) {
+  char name[64];
+  char *value;
+  int files;
+
+  sprintf(name, "leveldb.num-files-at-level%d", level);
+
+  ASSERT(ldb_property(db, name, &value));
+
+  files = atoi(value);
+
+  ldb_free(value);
+
+  return files;
+}
+
+/* Flush the memtable and return the level of the new table. */
+static int
+db_flush(ldb_t *db) {
+  int before[LDB_NUM_LEVELS];
+  int level;
+
+  for (level = 0; level < LDB_NUM_LEVELS; level++)
+    before[level] = db_files_at(db, level);
+
+  ASSERT(ldb_test_compact_memtable(db) == LDB_OK);
+
+  for (level = 0; level < LDB_NUM_LEVELS; level++) {
+    if (db_files_at(db, level) > before[level])
+      return level;
+  }
+
+  ASSERT(0 && "no table written");
+
+  return -1;
+}
+
+/* Return the "Dropped" column of the stats for a level. */
+static long
+db_dropped(ldb_t *db, int level) {
+  long dropped = 0;
+  char *value, *line;
+
+  ASSERT(ldb_property(db, "leveldb.stats", &value));
+
+  for (line = strchr(value, '\n'); line != NULL; line = strchr(line, '\n')) {
+    int lvl, files;
+    double size, time, read, write;
+    long num;
+
+    line++;
+
+    if (sscanf(line, "%d %d %lf %lf %lf %lf %ld", &lvl, &files, &size,
+                     &time, &read, &write, &num) == 7 && lvl == level) {
+      dropped = num;
+      break;
+    }
+  }
+
+  ldb_free(value);
+
+  return dropped;
+}
+
+/* Count the values and deletion markers stored for a key. */
+static void
+db_entries(ldb_t *db, const char *k, int *values, int *deletions) {
+  ldb_iter_t *it = ldb_test_internal_iterator(db);
+  ldb_slice_t key = ldb_string(k);
+
+  *values = 0;
+  *deletions = 0;
+
+  for (ldb_iter_first(it); ldb_iter_valid(it); ldb_iter_next(it)) {
+    ldb_slice_t ikey = ldb_iter_key(it);
+    ldb_pkey_t pkey;
+
+    ASSERT(ldb_pkey_import(&pkey, &ikey));
+
+    if (!ldb_slice_equal(&pkey.user_key, &key))
+      continue;
+
+    if (pkey.type == LDB_TYPE_DELETION)
+      *deletions += 1;
+    else
+      *values += 1;
+  }
+
+  ASSERT(ldb_iter_status(it) == LDB_OK);
+
+  ldb_iter_destroy(it);
+}
+
+/*
+ * Compaction Filter
+ */
+
+static void
+test_filter_decisions(void) {
+  int level, values, deletions;
+  ldb_testdb_t t;
+
+  db_init(&t);
+  ldb_testdb_open(&t);
+
+  ldb_testdb_put(&t, "a", "keep");
+  ldb_testdb_put(&t, "b", "expired");
+  ldb_testdb_put(&t, "c", "old value");
+
+  /* Flushing the memtable does not run the filter. */
+  level = db_flush(t.db);
+
+  ASSERT(filter_state.calls == 0);
+  ASSERT_EQ(ldb_testdb_get(&t, "b", NULL), "expired");
+
+  ldb_test_compact_range(t.db, level, NULL, NULL);
+
+  ASSERT(db_files_at(t.db, level + 1) == 1);
+  ASSERT(filter_state.calls == 3);
+
+  ASSERT_EQ(ldb_testdb_get(&t, "a", NULL), "keep");
+  ASSERT_EQ(ldb_testdb_get(&t, "b", NULL), "NOT_FOUND");
+  ASSERT_EQ(ldb_testdb_get(&t, "c", NULL), "new value");
+  ASSERT_EQ(ldb_testdb_contents(&t, NULL), "a=keep,c=new value");
+
+  /* Nothing lies beneath: no deletion marker is left behind. */
+  db_entries(t.db, "b", &values, &deletions);
+
+  ASSERT(values == 0 && deletions == 0);
+
+  ASSERT(db_dropped(t.db, level + 1) == 1);
+
+  ldb_testdb_reopen(&t);
+
+  ASSERT_EQ(ldb_testdb_contents(&t, NULL), "a=keep,c=new value");
+
+  ldb_testdb_clear(&t);
+}
+
+static void
+test_filter_marker(void) {
+  int level, values, deletions;
+  ldb_testdb_t t;
+
+  db_init(&t);
+  ldb_testdb_open(&t);
+
+  /* An older value two levels down. */
+  ldb_testdb_put(&t, "b", "v1");
+
+  level = db_flush(t.db);
+
+  ldb_test_compact_range(t.db, level, NULL, NULL);
+  ldb_test_compact_range(t.db, level + 1, NULL, NULL);
+
+  ASSERT(db_files_at(t.db, level + 2) == 1);
+
+  /* A newer one which the filter removes. */
+  ldb_testdb_put(&t, "b", "expired");
+
+  ASSERT(db_flush(t.db) == level);
+
+  ldb_test_compact_range(t.db, level, NULL, NULL);
+
+  /* Not the base level for the key: a marker keeps v1 hidden. */
+  ASSERT_EQ(ldb_testdb_get(&t, "b", NULL), "NOT_FOUND");
+  ASSERT_EQ(ldb_testdb_contents(&t, NULL), "");
+
+  db_entries(t.db, "b", &values, &deletions);
+
+  ASSERT(values == 1 && deletions == 1);
+
+  ASSERT(db_dropped(t.db, level + 1) == 1);
+
+  ldb_testdb_reopen(&t);
+
+  ASSERT_EQ(ldb_testdb_get(&t, "b", NULL), "NOT_FOUND");
+
+  /* The marker goes away once it reaches the value. */
+  ldb_test_compact_range(t.db, level + 1, NULL, NULL);
+
+  db_entries(t.db, "b", &values, &deletions);
+
+  ASSERT(values == 0 && deletions == 0);
+  ASSERT_EQ(ldb_testdb_get(&t, "b", NULL), "NOT_FOUND");
+
+  ldb_testdb_clear(&t);
+}
+
+static void
+test_filter_snapshot(void) {
+  const ldb_snapshot_t *snap;
+  ldb_testdb_t t;
+  int level;
+
+  db_init(&t);
+  ldb_testdb_open(&t);
+
+  ldb_testdb_put(&t, "a", "expired");
+  ldb_testdb_put(&t, "b", "old");
+
+  snap = ldb_snapshot(t.db);
+
+  level = db_flush(t.db);
+
+  ldb_test_compact_range(t.db, level, NULL, NULL);
+
+  /* Values visible to a snapshot are not filtered. */
+  ASSERT(filter_state.calls == 0);
+  ASSERT_EQ(ldb_testdb_get(&t, "a", snap), "expired");
+  ASSERT_EQ(ldb_testdb_get(&t, "b", NULL), "old");
+
+  ldb_release(t.db, snap);
+
+  ldb_test_compact_range(t.db, level + 1, NULL, NULL);
+
+  ASSERT(filter_state.calls == 2);
+  ASSERT_EQ(ldb_testdb_contents(&t, NULL), "b=new");
+
+  ldb_testdb_clear(&t);
+}
+
+/*
+ * Execute
+ */
+
+int
+main(void) {
+  test_filter_decisions();
+  test_filter_marker();
+  test_filter_snapshot();
+
+  return 0;
+}
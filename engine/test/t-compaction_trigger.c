@@ -0,0 +1,223 @@
+/*!
+ * t-compaction_trigger.c - compaction trigger test for lcdb
+ * Copyright (c) 2022, Christopher Jeffrey (MIT License).
+ * https://github.com/chjj/lcdb
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "table/iterator.h"
+
+#include "util/env.h"
+#include "util/internal.h"
+#include "util/options.h"
+#include "util/slice.h"
+#include "util/status.h"
+#include "util/testutil.h"
+
+#include "db_impl.h"
+
+/*
+ * Helpers
+ */
+
+static int
+db_files_at(ldb_t *db, int level) {
+  char name[64];
+  char *value;
+  int files;
+
+  sprintf(name, "leveldb.num-files-at-level%d", level);
+
+  ASSERT(ldb_property(db, name, &value));
+
+  files = atoi(value);
+
+  ldb_free(value);
+
+  return files;
+}
+
+/* Wait for background compactions to bring a level to "files" files. */
+static void
+db_wait_files(ldb_t *db, int level, int files) {
+  int i;
+
+  for (i = 0; db_files_at(db, level) != files; i++) {
+    ASSERT(i < 1000);
+    ldb_sleep_usec(10000);
+  }
+}
+
+static void
+db_put_range(ldb_testdb_t *t, int start, int end, const char *v) {
+  char key[16];
+  int i;
+
+  for (i = start; i < end; i++) {
+    sprintf(key, "k%05d", i);
+    ldb_testdb_put(t, key, v);
+  }
+}
+
+static void
+db_del_range(ldb_testdb_t *t, int start, int end) {
+  char key[16];
+  int i;
+
+  for (i = start; i < end; i++) {
+    sprintf(key, "k%05d", i);
+    ldb_testdb_del(t, key);
+  }
+}
+
+/*
+ * Marked Files
+ */
+
+static void
+test_trigger_deletions(void) {
+  ldb_testdb_t t;
+
+  ldb_testdb_init(&t, "compaction_trigger_test");
+
+  t.options.deletion_compaction_percent = 50;
+
+  ldb_testdb_open(&t);
+
+  db_put_range(&t, 0, 100, "v");
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+  ASSERT(db_files_at(t.db, 2) == 1);
+
+  ldb_test_compact_range(t.db, 2, NULL, NULL);
+
+  ASSERT(db_files_at(t.db, 3) == 1);
+
+  /* A quarter of the entries are deletions: not enough. */
+  db_put_range(&t, 0, 30, "w");
+  db_del_range(&t, 30, 40);
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+
+  ldb_sleep_usec(100000);
+
+  ASSERT(db_files_at(t.db, 2) == 1);
+
+  ldb_test_compact_range(t.db, 2, NULL, NULL);
+
+  ASSERT(db_files_at(t.db, 2) == 0);
+
+  /* Only deletions: the file is compacted right away, and
+     the deletions go along with the values they hide. */
+  db_del_range(&t, 0, 100);
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+
+  db_wait_files(t.db, 2, 0);
+
+  ASSERT(db_files_at(t.db, 3) == 0);
+  ASSERT_EQ(ldb_testdb_contents(&t, NULL), "");
+
+  ldb_testdb_clear(&t);
+}
+
+static void
+test_trigger_age(void) {
+  ldb_testdb_t t;
+
+  ldb_testdb_init(&t, "compaction_trigger_test");
+
+  t.options.max_file_age = 1;
+
+  ldb_testdb_open(&t);
+
+  ldb_testdb_put(&t, "a", "1");
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+  ASSERT(db_files_at(t.db, 2) == 1);
+
+  ldb_sleep_usec(2100000);
+
+  /* Age is checked when the set of files changes. */
+  ldb_testdb_put(&t, "b", "2");
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+
+  db_wait_files(t.db, 3, 1);
+
+  ASSERT_EQ(ldb_testdb_contents(&t, NULL), "a=1,b=2");
+
+  ldb_testdb_clear(&t);
+}
+
+/*
+ * Skipped Entries
+ */
+
+static void
+test_trigger_skipped(void) {
+  ldb_slice_t key = ldb_string("k04000");
+  ldb_testdb_t t;
+  ldb_iter_t *it;
+
+  ldb_testdb_init(&t, "compaction_trigger_test");
+  ldb_testdb_open(&t);
+
+  db_put_range(&t, 0, 5000, "v");
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+  ASSERT(db_files_at(t.db, 2) == 1);
+
+  db_del_range(&t, 0, 5000);
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+  ASSERT(db_files_at(t.db, 1) == 1);
+
+  /* A short run of hidden entries is not reported. */
+  it = ldb_iterator(t.db, 0);
+
+  ldb_iter_seek(it, &key);
+
+  ASSERT(!ldb_iter_valid(it));
+  ASSERT(ldb_iter_status(it) == LDB_OK);
+
+  ldb_iter_destroy(it);
+
+  ldb_sleep_usec(100000);
+
+  ASSERT(db_files_at(t.db, 1) == 1);
+
+  /* A scan skipping over every entry has them compacted away. */
+  it = ldb_iterator(t.db, 0);
+
+  ldb_iter_first(it);
+
+  ASSERT(!ldb_iter_valid(it));
+  ASSERT(ldb_iter_status(it) == LDB_OK);
+
+  ldb_iter_destroy(it);
+
+  db_wait_files(t.db, 1, 0);
+
+  ASSERT(db_files_at(t.db, 2) == 0);
+
+  ldb_testdb_clear(&t);
+}
+
+/*
+ * Execute
+ */
+
+int
+main(void) {
+  test_trigger_deletions();
+  test_trigger_age();
+  test_trigger_skipped();
+
+  return 0;
+}
@@ -0,0 +1,251 @@
+/*!
+ * t-family.c - column family test for lcdb
+ * Copyright (c) 2022, Christopher Jeffrey (MIT License).
+ * https://github.com/chjj/lcdb
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "table/iterator.h"
+
+#include "util/env.h"
+#include "util/internal.h"
+#include "util/options.h"
+#include "util/slice.h"
+#include "util/status.h"
+#include "util/testutil.h"
+
+#include "db_impl.h"
+#include "write_batch.h"
+
+/*
+ * Helpers
+ */
+
+/*
+ * Column Family
+ */
+
+static void
+test_family_isolation(void) {
+  static const char *const names[] = {"one", "two"};
+  ldb_testdb_t t;
+  ldb_family_t *fams[2];
+
+  ldb_testdb_init(&t, "family_test");
+
+  ASSERT(ldb_testdb_open_families(&t, names, 2, fams) == LDB_OK);
+
+  ASSERT(ldb_family_name(NULL) == NULL);
+  ASSERT_EQ(ldb_family_name(fams[0]), "one");
+  ASSERT_EQ(ldb_family_name(fams[1]), "two");
+  ASSERT(ldb_family_number(NULL) == 0);
+  ASSERT(ldb_family_number(fams[0]) != ldb_family_number(fams[1]));
+
+  ldb_testdb_put_cf(&t, NULL, "a", "default");
+  ldb_testdb_put_cf(&t, fams[0], "a", "one");
+  ldb_testdb_put_cf(&t, fams[1], "b", "two");
+
+  ASSERT_EQ(ldb_testdb_get_cf(&t, NULL, "a", NULL), "default");
+  ASSERT_EQ(ldb_testdb_get_cf(&t, fams[0], "a", NULL), "one");
+  ASSERT_EQ(ldb_testdb_get_cf(&t, fams[1], "a", NULL), "NOT_FOUND");
+  ASSERT_EQ(ldb_testdb_contents_cf(&t, fams[1], NULL), "b=two");
+
+  /* Compacting one family leaves the others alone. */
+  ldb_compact_cf(t.db, fams[0], NULL, NULL);
+
+  ASSERT_EQ(ldb_testdb_get_cf(&t, fams[0], "a", NULL), "one");
+  ASSERT_EQ(ldb_testdb_contents_cf(&t, NULL, NULL), "a=default");
+  ASSERT_EQ(ldb_testdb_contents_cf(&t, fams[0], NULL), "a=one");
+
+  ldb_testdb_clear(&t);
+}
+
+static void
+test_family_recovery(void) {
+  static const char *const names[] = {"one", "two"};
+  ldb_testdb_t t;
+  ldb_family_t *fams[2];
+  ldb_batch_t batch;
+  ldb_slice_t k, v;
+
+  ldb_testdb_init(&t, "family_test");
+
+  ASSERT(ldb_testdb_open_families(&t, names, 2, fams) == LDB_OK);
+
+  /* In a table. */
+  ldb_testdb_put_cf(&t, fams[0], "t", "table");
+  ldb_compact_cf(t.db, fams[0], NULL, NULL);
+
+  /* In the log, as one batch over several families. */
+  ldb_batch_init(&batch);
+
+  k = ldb_string("x");
+  v = ldb_string("1");
+  ldb_batch_put_cf(&batch, fams[0], &k, &v);
+
+  v = ldb_string("2");
+  ldb_batch_put_cf(&batch, fams[1], &k, &v);
+
+  v = ldb_string("0");
+  ldb_batch_put(&batch, &k, &v);
+
+  k = ldb_string("t");
+  ldb_batch_del_cf(&batch, fams[1], &k);
+
+  ASSERT(ldb_write(t.db, &batch, 0) == LDB_OK);
+
+  ldb_batch_clear(&batch);
+
+  ldb_testdb_close(&t);
+
+  /* The families may be given in any order. */
+  {
+    static const char *const rev[] = {"two", "one"};
+
+    ASSERT(ldb_testdb_open_families(&t, rev, 2, fams) == LDB_OK);
+
+    ASSERT_EQ(ldb_family_name(fams[0]), "two");
+    ASSERT_EQ(ldb_testdb_contents_cf(&t, fams[0], NULL), "x=2");
+    ASSERT_EQ(ldb_testdb_contents_cf(&t, fams[1], NULL), "t=table,x=1");
+    ASSERT_EQ(ldb_testdb_contents_cf(&t, NULL, NULL), "x=0");
+  }
+
+  /* Again, once the log has been written to tables. */
+  ldb_compact_cf(t.db, fams[0], NULL, NULL);
+  ldb_compact_cf(t.db, fams[1], NULL, NULL);
+
+  ldb_testdb_close(&t);
+
+  ASSERT(ldb_testdb_open_families(&t, names, 2, fams) == LDB_OK);
+
+  ASSERT_EQ(ldb_testdb_contents_cf(&t, fams[0], NULL), "t=table,x=1");
+  ASSERT_EQ(ldb_testdb_contents_cf(&t, fams[1], NULL), "x=2");
+  ASSERT_EQ(ldb_testdb_contents_cf(&t, NULL, NULL), "x=0");
+
+  ldb_testdb_clear(&t);
+}
+
+static void
+test_family_open(void) {
+  static const char *const names[] = {"one", "two"};
+  static const char *const dups[] = {"one", "one"};
+  static const char *const empty[] = {""};
+  ldb_testdb_t t;
+  ldb_family_t *fams[2];
+  ldb_family_t *fam;
+
+  ldb_testdb_init(&t, "family_test");
+
+  ASSERT(ldb_testdb_open_families(&t, dups, 2, fams) == LDB_INVALID);
+  ASSERT(ldb_testdb_open_families(&t, empty, 1, fams) == LDB_INVALID);
+
+  ASSERT(ldb_testdb_open_families(&t, names, 1, fams) == LDB_OK);
+
+  /* Names are unique. */
+  ASSERT(ldb_family_create(t.db, "one", &t.options, &fam) == LDB_INVALID);
+  ASSERT(fam == NULL);
+
+  ASSERT(ldb_family_create(t.db, "two", &t.options, &fam) == LDB_OK);
+
+  ldb_testdb_put_cf(&t, fam, "k", "v");
+
+  ldb_testdb_close(&t);
+
+  /* Every existing family must be named. */
+  ASSERT(ldb_open(t.dbname, &t.options, &t.db) == LDB_INVALID);
+
+  ASSERT(ldb_testdb_open_families(&t, names, 1, fams) == LDB_INVALID);
+
+  /* A missing family is only created with create_if_missing. */
+  {
+    static const char *const three[] = {"one", "two", "three"};
+    ldb_family_t *out[3];
+
+    t.options.create_if_missing = 0;
+
+    ASSERT(ldb_testdb_open_families(&t, three, 3, out) == LDB_INVALID);
+    ASSERT(out[0] == NULL && out[2] == NULL);
+
+    t.options.create_if_missing = 1;
+
+    ASSERT(ldb_testdb_open_families(&t, three, 3, out) == LDB_OK);
+    ASSERT_EQ(ldb_testdb_contents_cf(&t, out[1], NULL), "k=v");
+    ASSERT_EQ(ldb_testdb_contents_cf(&t, out[2], NULL), "");
+  }
+
+  ldb_testdb_clear(&t);
+}
+
+static void
+test_family_drop(void) {
+  static const char *const names[] = {"one"};
+  ldb_testdb_t t;
+  ldb_family_t *fam;
+  ldb_iter_t *it;
+
+  ldb_testdb_init(&t, "family_test");
+
+  ASSERT(ldb_testdb_open_families(&t, names, 1, &fam) == LDB_OK);
+
+  ASSERT(ldb_family_drop(t.db, NULL) == LDB_INVALID);
+
+  ldb_testdb_put_cf(&t, NULL, "a", "default");
+  ldb_testdb_put_cf(&t, fam, "a", "old");
+  ldb_testdb_put_cf(&t, fam, "b", "old");
+
+  ldb_compact_cf(t.db, fam, NULL, NULL);
+
+  ldb_testdb_put_cf(&t, fam, "c", "old");
+
+  /* Open iterators outlive the family. */
+  it = ldb_iterator_cf(t.db, fam, 0);
+
+  ASSERT(ldb_family_drop(t.db, fam) == LDB_OK);
+
+  ldb_iter_first(it);
+
+  ASSERT(ldb_iter_valid(it));
+
+  ldb_iter_destroy(it);
+
+  ASSERT_EQ(ldb_testdb_get_cf(&t, NULL, "a", NULL), "default");
+
+  ldb_testdb_close(&t);
+
+  /* A dropped family no longer has to be named... */
+  ASSERT(ldb_open(t.dbname, &t.options, &t.db) == LDB_OK);
+  ASSERT_EQ(ldb_testdb_contents_cf(&t, NULL, NULL), "a=default");
+
+  ldb_testdb_close(&t);
+
+  /* ...and is recreated empty. */
+  ASSERT(ldb_testdb_open_families(&t, names, 1, &fam) == LDB_OK);
+  ASSERT_EQ(ldb_testdb_contents_cf(&t, fam, NULL), "");
+
+  ldb_testdb_put_cf(&t, fam, "d", "new");
+
+  ldb_testdb_close(&t);
+
+  ASSERT(ldb_testdb_open_families(&t, names, 1, &fam) == LDB_OK);
+  ASSERT_EQ(ldb_testdb_contents_cf(&t, fam, NULL), "d=new");
+  ASSERT_EQ(ldb_testdb_contents_cf(&t, NULL, NULL), "a=default");
+
+  ldb_testdb_clear(&t);
+}
+
+/*
+ * Execute
+ */
+
+int
+main(void) {
+  test_family_isolation();
+  test_family_recovery();
+  test_family_open();
+  test_family_drop();
+
+  return 0;
+}
@@ -0,0 +1,272 @@
+/*!
+ * t-get_pinned.c - pinned get test for lcdb
+ * Copyright (c) 2022, Christopher Jeffrey (MIT License).
+ * https://github.com/chjj/lcdb
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "util/cache.h"
+#include "util/internal.h"
+#include "util/options.h"
+#include "util/slice.h"
+#include "util/status.h"
+#include "util/testutil.h"
+
+#include "db_impl.h"
+#include "dbformat.h"
+
+/*
+ * Helpers
+ */
+
+typedef struct pinned_s {
+  ldb_slice_t value;
+  ldb_pinned_t *pin;
+} pinned_t;
+
+static void
+db_get_pinned(ldb_t *db, const char *k, pinned_t *p) {
+  ldb_slice_t key = ldb_string(k);
+
+  ASSERT(ldb_get_pinned(db, &key, &p->value, &p->pin, 0) == LDB_OK);
+  ASSERT(p->pin != NULL);
+}
+
+static int
+pinned_equal(const pinned_t *p, const char *v) {
+  ldb_slice_t value = ldb_string(v);
+  return ldb_slice_equal(&p->value, &value);
+}
+
+/* A value large enough to go to a blob file when those are enabled. */
+static const char *
+big_value(int ch) {
+  static char value[2048 + 1];
+
+  memset(value, ch, sizeof(value) - 1);
+
+  value[sizeof(value) - 1] = '\0';
+
+  return value;
+}
+
+/*
+ * Pinned Get
+ */
+
+static void
+test_pinned_memtable(void) {
+  pinned_t x, y;
+  ldb_testdb_t t;
+
+  ldb_testdb_init(&t, "get_pinned_test");
+  ldb_testdb_open(&t);
+
+  ldb_testdb_put(&t, "a", "1");
+
+  /* Both point at the memtable entry. */
+  db_get_pinned(t.db, "a", &x);
+  db_get_pinned(t.db, "a", &y);
+
+  ASSERT(pinned_equal(&x, "1"));
+  ASSERT(x.value.data == y.value.data);
+
+  ldb_unpin(y.pin);
+
+  /* The memtable outlives the flush for as long as it is pinned. */
+  ldb_testdb_put(&t, "a", "2");
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+
+  ASSERT(pinned_equal(&x, "1"));
+  ASSERT_EQ(ldb_testdb_get(&t, "a", NULL), "2");
+
+  ldb_unpin(x.pin);
+
+  /* Missing keys yield no handle. */
+  {
+    ldb_slice_t key = ldb_string("b");
+
+    ASSERT(ldb_get_pinned(t.db, &key, &x.value, &x.pin, 0) == LDB_NOTFOUND);
+    ASSERT(x.pin == NULL);
+  }
+
+  ldb_testdb_clear(&t);
+}
+
+static void
+test_pinned_cache(void) {
+  ldb_lru_t *cache = ldb_lru_create(1 << 20);
+  pinned_t x, y;
+  ldb_testdb_t t;
+
+  ldb_testdb_init(&t, "get_pinned_test");
+
+  t.options.block_cache = cache;
+  t.options.compression = LDB_NO_COMPRESSION;
+  t.options.use_mmap = 0;
+
+  ldb_testdb_open(&t);
+
+  ldb_testdb_put(&t, "a", big_value('a'));
+  ldb_testdb_put(&t, "b", big_value('b'));
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+
+  /* Both point into the cached block. */
+  db_get_pinned(t.db, "a", &x);
+  db_get_pinned(t.db, "a", &y);
+
+  ASSERT(pinned_equal(&x, big_value('a')));
+  ASSERT(x.value.data == y.value.data);
+
+  ldb_unpin(y.pin);
+
+  /* The block stays in the cache while pinned... */
+  ldb_lru_prune(cache);
+
+  ASSERT(ldb_lru_usage(cache) > 0);
+  ASSERT(pinned_equal(&x, big_value('a')));
+
+  /* ...and goes once unpinned. */
+  ldb_unpin(x.pin);
+  ldb_lru_prune(cache);
+
+  ASSERT(ldb_lru_usage(cache) == 0);
+
+  ldb_testdb_clear(&t);
+
+  ldb_lru_destroy(cache);
+}
+
+static void
+test_pinned_uncached(void) {
+  ldb_readopt_t options = *ldb_readopt_default;
+  ldb_lru_t *cache = ldb_lru_create(1 << 20);
+  ldb_slice_t key = ldb_string("a");
+  pinned_t x, y;
+  ldb_testdb_t t;
+
+  ldb_testdb_init(&t, "get_pinned_test");
+
+  t.options.block_cache = cache;
+  t.options.compression = LDB_NO_COMPRESSION;
+  t.options.use_mmap = 0;
+
+  ldb_testdb_open(&t);
+
+  ldb_testdb_put(&t, "a", big_value('a'));
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+
+  /* Each handle owns the block it read. */
+  options.fill_cache = 0;
+
+  ASSERT(ldb_get_pinned(t.db, &key, &x.value, &x.pin, &options) == LDB_OK);
+  ASSERT(ldb_get_pinned(t.db, &key, &y.value, &y.pin, &options) == LDB_OK);
+
+  ASSERT(x.value.data != y.value.data);
+  ASSERT(ldb_lru_usage(cache) == 0);
+
+  ldb_unpin(x.pin);
+
+  ASSERT(pinned_equal(&y, big_value('a')));
+
+  ldb_unpin(y.pin);
+
+  ldb_testdb_clear(&t);
+
+  ldb_lru_destroy(cache);
+}
+
+static void
+test_pinned_mmap(void) {
+  pinned_t x, y;
+  ldb_testdb_t t;
+  int level;
+
+  ldb_testdb_init(&t, "get_pinned_test");
+
+  t.options.compression = LDB_NO_COMPRESSION;
+  t.options.use_mmap = 1;
+
+  ldb_testdb_open(&t);
+
+  ldb_testdb_put(&t, "a", big_value('a'));
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+
+  /* Both point into the mapped file. */
+  db_get_pinned(t.db, "a", &x);
+  db_get_pinned(t.db, "a", &y);
+
+  ASSERT(pinned_equal(&x, big_value('a')));
+  ASSERT(x.value.data == y.value.data);
+
+  ldb_unpin(y.pin);
+
+  /* The table stays mapped after it is compacted, being part of
+     the version the handle holds. */
+  ldb_testdb_put(&t, "a", big_value('b'));
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+
+  for (level = 0; level < LDB_NUM_LEVELS - 1; level++)
+    ldb_test_compact_range(t.db, level, NULL, NULL);
+
+  ASSERT(pinned_equal(&x, big_value('a')));
+  ASSERT_EQ(ldb_testdb_get(&t, "a", NULL), big_value('b'));
+
+  ldb_unpin(x.pin);
+
+  ldb_testdb_clear(&t);
+}
+
+static void
+test_pinned_blob(void) {
+  pinned_t x, y;
+  ldb_testdb_t t;
+
+  ldb_testdb_init(&t, "get_pinned_test");
+
+  t.options.min_blob_size = 100;
+
+  ldb_testdb_open(&t);
+
+  ldb_testdb_put(&t, "a", big_value('a'));
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+
+  /* Blob values are copied into each handle. */
+  db_get_pinned(t.db, "a", &x);
+  db_get_pinned(t.db, "a", &y);
+
+  ASSERT(x.value.data != y.value.data);
+  ASSERT(pinned_equal(&x, big_value('a')));
+
+  ldb_unpin(x.pin);
+
+  ASSERT(pinned_equal(&y, big_value('a')));
+
+  ldb_unpin(y.pin);
+
+  ldb_testdb_clear(&t);
+}
+
+/*
+ * Execute
+ */
+
+int
+main(void) {
+  test_pinned_memtable();
+  test_pinned_cache();
+  test_pinned_uncached();
+  test_pinned_mmap();
+  test_pinned_blob();
+
+  return 0;
+}
@@ -0,0 +1,391 @@
+/*!
+ * t-ingest.c - table ingestion test for lcdb
+ * Copyright (c) 2022, Christopher Jeffrey (MIT License).
+ * https://github.com/chjj/lcdb
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "util/env.h"
+#include "util/internal.h"
+#include "util/options.h"
+#include "util/slice.h"
+#include "util/status.h"
+#include "util/strutil.h"
+#include "util/testutil.h"
+
+#include "db_impl.h"
+#include "snapshot.h"
+#include "sst_writer.h"
+
+/*
+ * Helpers
+ */
+
+static char tmpdir[LDB_PATH_MAX];
+
+static const char *
+db_files_at(ldb_t *db, int level) {
+  static char result[32];
+  char name[64];
+  char *value;
+
+  sprintf(name, "leveldb.num-files-at-level%d", level);
+
+  ASSERT(ldb_property(db, name, &value));
+  ASSERT(strlen(value) < sizeof(result));
+
+  strcpy(result, value);
+
+  ldb_free(value);
+
+  return result;
+}
+
+static const char *
+sst_path(const char *name) {
+  static char paths[4][LDB_PATH_MAX];
+  static int next = 0;
+  char *path = paths[next++ & 3];
+
+  ASSERT(ldb_join(path, LDB_PATH_MAX, tmpdir, name));
+
+  return path;
+}
+
+/* Write a table from a spec like "a=1,b=2,c". A key without
+   a value is written as a deletion. */
+static void
+sst_write(const char *path, const char *spec) {
+  ldb_sstwriter_t *writer;
+  char buf[256];
+  char *entry;
+
+  ASSERT(strlen(spec) < sizeof(buf));
+
+  strcpy(buf, spec);
+
+  ASSERT(ldb_sstwriter_open(path, 0, &writer) == LDB_OK);
+
+  for (entry = strtok(buf, ","); entry != NULL; entry = strtok(NULL, ",")) {
+    char *eq = strchr(entry, '=');
+    ldb_slice_t key, val;
+
+    if (eq != NULL) {
+      *eq = '\0';
+
+      key = ldb_string(entry);
+      val = ldb_string(eq + 1);
+
+      ASSERT(ldb_sstwriter_put(writer, &key, &val) == LDB_OK);
+    } else {
+      key = ldb_string(entry);
+
+      ASSERT(ldb_sstwriter_del(writer, &key) == LDB_OK);
+    }
+  }
+
+  ASSERT(ldb_sstwriter_finish(writer) == LDB_OK);
+
+  ldb_sstwriter_close(writer);
+}
+
+static int
+db_ingest(ldb_t *db, const char *x, const char *y) {
+  const char *paths[2];
+
+  paths[0] = x;
+  paths[1] = y;
+
+  return ldb_ingest_files(db, paths, y != NULL ? 2 : 1);
+}
+
+/*
+ * SST Writer
+ */
+
+static void
+test_sstwriter(void) {
+  const char *path = sst_path("writer.sst");
+  ldb_sstwriter_t *writer;
+  ldb_slice_t a = ldb_string("a");
+  ldb_slice_t b = ldb_string("b");
+
+  ASSERT(ldb_sstwriter_open(path, 0, &writer) == LDB_OK);
+
+  /* Nothing to write. */
+  ASSERT(ldb_sstwriter_finish(writer) == LDB_INVALID);
+
+  ASSERT(ldb_sstwriter_put(writer, &b, &b) == LDB_OK);
+
+  /* Keys must be strictly increasing. */
+  ASSERT(ldb_sstwriter_put(writer, &b, &b) == LDB_INVALID);
+  ASSERT(ldb_sstwriter_put(writer, &a, &a) == LDB_INVALID);
+  ASSERT(ldb_sstwriter_del(writer, &a) == LDB_INVALID);
+
+  ASSERT(ldb_sstwriter_finish(writer) == LDB_OK);
+  ASSERT(ldb_sstwriter_size(writer) > 0);
+  ASSERT(ldb_sstwriter_finish(writer) == LDB_INVALID);
+  ASSERT(ldb_sstwriter_put(writer, &a, &a) == LDB_INVALID);
+
+  ldb_sstwriter_close(writer);
+
+  ASSERT(ldb_file_exists(path));
+  ASSERT(ldb_remove_file(path) == LDB_OK);
+
+  /* An unfinished table is removed. */
+  ASSERT(ldb_sstwriter_open(path, 0, &writer) == LDB_OK);
+  ASSERT(ldb_sstwriter_put(writer, &a, &a) == LDB_OK);
+
+  ldb_sstwriter_close(writer);
+
+  ASSERT(!ldb_file_exists(path));
+}
+
+/*
+ * Ingest
+ */
+
+static void
+test_ingest_sequence(void) {
+  const char *path = sst_path("seq.sst");
+  ldb_testdb_t t;
+  const ldb_snapshot_t *snap;
+
+  ldb_testdb_init(&t, "ingest_test");
+  ldb_testdb_open(&t);
+
+  ldb_testdb_put(&t, "a", "old");
+  ldb_testdb_put(&t, "b", "old");
+  ldb_testdb_put(&t, "c", "old");
+
+  snap = ldb_snapshot(t.db);
+
+  /* Overlaps the memtable, which is flushed first. */
+  sst_write(path, "a=new,b,d=new");
+
+  ASSERT(db_ingest(t.db, path, NULL) == LDB_OK);
+
+  /* The entries take a sequence number newer than any write before. */
+  ASSERT_EQ(ldb_testdb_get(&t, "a", NULL), "new");
+  ASSERT_EQ(ldb_testdb_get(&t, "b", NULL), "NOT_FOUND");
+  ASSERT_EQ(ldb_testdb_get(&t, "c", NULL), "old");
+  ASSERT_EQ(ldb_testdb_get(&t, "d", NULL), "new");
+
+  ASSERT_EQ(ldb_testdb_get(&t, "a", snap), "old");
+  ASSERT_EQ(ldb_testdb_get(&t, "b", snap), "old");
+  ASSERT_EQ(ldb_testdb_get(&t, "d", snap), "NOT_FOUND");
+
+  ldb_release(t.db, snap);
+
+  /* And older than any write after. */
+  ldb_testdb_put(&t, "a", "later");
+
+  snap = ldb_snapshot(t.db);
+
+  ASSERT_EQ(ldb_testdb_get(&t, "a", snap), "later");
+  ASSERT_EQ(ldb_testdb_get(&t, "d", snap), "new");
+
+  ldb_release(t.db, snap);
+
+  ldb_compact(t.db, NULL, NULL);
+
+  ASSERT_EQ(ldb_testdb_get(&t, "a", NULL), "later");
+  ASSERT_EQ(ldb_testdb_get(&t, "b", NULL), "NOT_FOUND");
+
+  ldb_testdb_reopen(&t);
+
+  ASSERT_EQ(ldb_testdb_get(&t, "a", NULL), "later");
+  ASSERT_EQ(ldb_testdb_get(&t, "b", NULL), "NOT_FOUND");
+  ASSERT_EQ(ldb_testdb_get(&t, "c", NULL), "old");
+  ASSERT_EQ(ldb_testdb_get(&t, "d", NULL), "new");
+
+  ldb_testdb_clear(&t);
+
+  ASSERT(ldb_remove_file(path) == LDB_OK);
+}
+
+static void
+test_ingest_level(void) {
+  const char *path1 = sst_path("level1.sst");
+  const char *path2 = sst_path("level2.sst");
+  const char *path3 = sst_path("level3.sst");
+  ldb_testdb_t t;
+  int last = LDB_NUM_LEVELS - 1;
+
+  ldb_testdb_init(&t, "ingest_test");
+  ldb_testdb_open(&t);
+
+  sst_write(path1, "a=1,b=1");
+  sst_write(path2, "m=2,n=2");
+  sst_write(path3, "b=3,m=3");
+
+  /* Non-overlapping tables go to the last level, in any order. */
+  ASSERT(db_ingest(t.db, path2, path1) == LDB_OK);
+
+  ASSERT_EQ(db_files_at(t.db, last), "2");
+  ASSERT_EQ(db_files_at(t.db, 0), "0");
+
+  /* A table overlapping them goes right above. */
+  ASSERT(db_ingest(t.db, path3, NULL) == LDB_OK);
+
+  ASSERT_EQ(db_files_at(t.db, last), "2");
+  ASSERT_EQ(db_files_at(t.db, last - 1), "1");
+
+  ASSERT_EQ(ldb_testdb_get(&t, "a", NULL), "1");
+  ASSERT_EQ(ldb_testdb_get(&t, "b", NULL), "3");
+  ASSERT_EQ(ldb_testdb_get(&t, "m", NULL), "3");
+  ASSERT_EQ(ldb_testdb_get(&t, "n", NULL), "2");
+
+  ldb_testdb_reopen(&t);
+
+  ASSERT_EQ(db_files_at(t.db, last - 1), "1");
+  ASSERT_EQ(ldb_testdb_get(&t, "b", NULL), "3");
+  ASSERT_EQ(ldb_testdb_get(&t, "n", NULL), "2");
+
+  ldb_testdb_clear(&t);
+
+  ASSERT(ldb_remove_file(path1) == LDB_OK);
+  ASSERT(ldb_remove_file(path2) == LDB_OK);
+  ASSERT(ldb_remove_file(path3) == LDB_OK);
+}
+
+static void
+test_ingest_overlap(void) {
+  const char *path1 = sst_path("overlap1.sst");
+  const char *path2 = sst_path("overlap2.sst");
+  const char *path3 = sst_path("missing.sst");
+  ldb_testdb_t t;
+  int level;
+
+  ldb_testdb_init(&t, "ingest_test");
+  ldb_testdb_open(&t);
+
+  sst_write(path1, "a=1,c=1");
+  sst_write(path2, "b=2,d=2");
+
+  /* The tables must not overlap one another. */
+  ASSERT(db_ingest(t.db, path1, path2) == LDB_INVALID);
+  ASSERT(db_ingest(t.db, path2, path1) == LDB_INVALID);
+  ASSERT(db_ingest(t.db, path1, path1) == LDB_INVALID);
+
+  ASSERT(db_ingest(t.db, path3, NULL) != LDB_OK);
+
+  /* Nothing was added. */
+  for (level = 0; level < LDB_NUM_LEVELS; level++)
+    ASSERT_EQ(db_files_at(t.db, level), "0");
+
+  ASSERT_EQ(ldb_testdb_get(&t, "a", NULL), "NOT_FOUND");
+  ASSERT_EQ(ldb_testdb_get(&t, "b", NULL), "NOT_FOUND");
+
+  /* Either one alone is fine. */
+  ASSERT(db_ingest(t.db, path2, NULL) == LDB_OK);
+
+  ASSERT_EQ(ldb_testdb_get(&t, "b", NULL), "2");
+
+  ldb_testdb_clear(&t);
+
+  ASSERT(ldb_remove_file(path1) == LDB_OK);
+  ASSERT(ldb_remove_file(path2) == LDB_OK);
+}
+
+static void
+test_ingest_universal(void) {
+  const char *path = sst_path("universal.sst");
+  char spec[32], key[16], val[16];
+  int i, last = LDB_NUM_LEVELS - 1;
+  ldb_testdb_t t;
+
+  ldb_testdb_init(&t, "ingest_test");
+
+  t.options.compaction_style = LDB_UNIVERSAL_COMPACTION;
+  t.options.level0_compaction_trigger = 4;
+
+  ldb_testdb_open(&t);
+
+  /* Each table is a run in level-0, however little it overlaps. */
+  for (i = 0; i < 4; i++) {
+    sprintf(spec, "%c=%d", 'a' + i, i);
+    sst_write(path, spec);
+
+    ASSERT(db_ingest(t.db, path, NULL) == LDB_OK);
+    ASSERT(ldb_remove_file(path) == LDB_OK);
+  }
+
+  ASSERT_EQ(db_files_at(t.db, last), "0");
+
+  /* Which makes them eligible for compaction. The next
+     ingestion waits for the one they triggered. */
+  sst_write(path, "z=4");
+
+  ASSERT(db_ingest(t.db, path, NULL) == LDB_OK);
+  ASSERT(ldb_remove_file(path) == LDB_OK);
+
+  ASSERT_EQ(db_files_at(t.db, 0), "2");
+  ASSERT_EQ(db_files_at(t.db, last), "0");
+
+  ldb_testdb_reopen(&t);
+
+  for (i = 0; i < 5; i++) {
+    sprintf(key, "%c", i < 4 ? 'a' + i : 'z');
+    sprintf(val, "%d", i);
+
+    ASSERT_EQ(ldb_testdb_get(&t, key, NULL), val);
+  }
+
+  ldb_testdb_clear(&t);
+}
+
+static void
+test_ingest_tombstone(void) {
+  const char *path = sst_path("tombstone.sst");
+  ldb_testdb_t t;
+  ldb_slice_t a = ldb_string("a");
+  ldb_slice_t z = ldb_string("z");
+
+  ldb_testdb_init(&t, "ingest_test");
+  ldb_testdb_open(&t);
+
+  /* A tombstone in the memtable overlaps the table, which
+     holds no key of the memtable. It is flushed first. */
+  ASSERT(ldb_del_range(t.db, &a, &z, 0) == LDB_OK);
+
+  sst_write(path, "m=new");
+
+  ASSERT(db_ingest(t.db, path, NULL) == LDB_OK);
+
+  ASSERT_EQ(ldb_testdb_get(&t, "m", NULL), "new");
+  ASSERT_EQ(ldb_testdb_contents(&t, NULL), "m=new");
+
+  ldb_testdb_reopen(&t);
+
+  ASSERT_EQ(ldb_testdb_get(&t, "m", NULL), "new");
+
+  ldb_testdb_clear(&t);
+
+  ASSERT(ldb_remove_file(path) == LDB_OK);
+}
+
+/*
+ * Execute
+ */
+
+int
+main(void) {
+  ASSERT(ldb_test_filename(tmpdir, sizeof(tmpdir), "ingest_test_files"));
+
+  ldb_create_dir(tmpdir);
+
+  test_sstwriter();
+  test_ingest_sequence();
+  test_ingest_level();
+  test_ingest_overlap();
+  test_ingest_universal();
+  test_ingest_tombstone();
+
+  ASSERT(ldb_remove_dir(tmpdir) == LDB_OK);
+
+  return 0;
+}
@@ -0,0 +1,303 @@
+/*!
+ * t-iter_bounds.c - iterator bounds test for lcdb
+ * Copyright (c) 2022, Christopher Jeffrey (MIT License).
+ * https://github.com/chjj/lcdb
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "table/iterator.h"
+
+#include "util/buffer.h"
+#include "util/internal.h"
+#include "util/options.h"
+#include "util/slice.h"
+#include "util/status.h"
+#include "util/testutil.h"
+
+#include "db_impl.h"
+
+/*
+ * Helpers
+ */
+
+/* The bounds must outlive the iterator: only one iterator
+   returned by this may be in use at a time. */
+static ldb_iter_t *
+db_iterator(ldb_t *db, const char *lower, const char *upper) {
+  static ldb_slice_t lower_key, upper_key;
+  ldb_readopt_t options = *ldb_readopt_default;
+
+  if (lower != NULL) {
+    lower_key = ldb_string(lower);
+    options.iterate_lower_bound = &lower_key;
+  }
+
+  if (upper != NULL) {
+    upper_key = ldb_string(upper);
+    options.iterate_upper_bound = &upper_key;
+  }
+
+  return ldb_iterator(db, &options);
+}
+
+/* Keys read until the iterator runs out, as "abc". */
+static const char *
+iter_keys(ldb_iter_t *it, int reverse) {
+  static char result[64];
+  size_t n = 0;
+
+  while (ldb_iter_valid(it)) {
+    ldb_slice_t key = ldb_iter_key(it);
+
+    ASSERT(n + key.size < sizeof(result));
+
+    memcpy(result + n, key.data, key.size);
+
+    n += key.size;
+
+    if (reverse)
+      ldb_iter_prev(it);
+    else
+      ldb_iter_next(it);
+  }
+
+  ASSERT(ldb_iter_status(it) == LDB_OK);
+
+  result[n] = '\0';
+
+  return result;
+}
+
+static const char *
+iter_seek(ldb_iter_t *it, const char *target) {
+  ldb_slice_t key = ldb_string(target);
+
+  ldb_iter_seek(it, &key);
+
+  return iter_keys(it, 0);
+}
+
+static void
+db_fill(ldb_testdb_t *t) {
+  static const char *keys[] = {"a", "b", "c", "d", "e", "f", "g", "h"};
+  size_t i;
+
+  for (i = 0; i < lengthof(keys); i++)
+    ldb_testdb_put(t, keys[i], "v");
+}
+
+/*
+ * Iterator Bounds
+ */
+
+static void
+test_bounds_forward(void) {
+  ldb_testdb_t t;
+  ldb_iter_t *it;
+
+  ldb_testdb_init(&t, "iter_bounds_test");
+  ldb_testdb_open(&t);
+
+  db_fill(&t);
+
+  it = db_iterator(t.db, "c", "f");
+
+  ldb_iter_first(it);
+
+  ASSERT_EQ(iter_keys(it, 0), "cde");
+
+  /* Seeks below the lower bound start from it. */
+  ASSERT_EQ(iter_seek(it, "a"), "cde");
+  ASSERT_EQ(iter_seek(it, "d"), "de");
+
+  /* Nothing at or above the upper bound is returned. */
+  ASSERT_EQ(iter_seek(it, "f"), "");
+  ASSERT_EQ(iter_seek(it, "g"), "");
+
+  ldb_iter_destroy(it);
+
+  /* Either bound alone. */
+  it = db_iterator(t.db, "f", NULL);
+
+  ldb_iter_first(it);
+
+  ASSERT_EQ(iter_keys(it, 0), "fgh");
+
+  ldb_iter_destroy(it);
+
+  it = db_iterator(t.db, NULL, "c");
+
+  ldb_iter_first(it);
+
+  ASSERT_EQ(iter_keys(it, 0), "ab");
+
+  ldb_iter_destroy(it);
+
+  ldb_testdb_clear(&t);
+}
+
+static void
+check_reverse(ldb_t *db) {
+  ldb_iter_t *it = db_iterator(db, "c", "f");
+
+  ldb_iter_last(it);
+
+  ASSERT_EQ(iter_keys(it, 1), "edc");
+
+  /* Changing direction at either bound. */
+  ldb_iter_first(it);
+  ldb_iter_prev(it);
+
+  ASSERT(!ldb_iter_valid(it));
+
+  ldb_iter_last(it);
+  ldb_iter_next(it);
+
+  ASSERT(!ldb_iter_valid(it));
+
+  ldb_iter_last(it);
+  ldb_iter_prev(it);
+  ldb_iter_next(it);
+
+  ASSERT_EQ(iter_keys(it, 0), "e");
+
+  ldb_iter_destroy(it);
+
+  /* An upper bound past every key. */
+  it = db_iterator(db, "g", "z");
+
+  ldb_iter_last(it);
+
+  ASSERT_EQ(iter_keys(it, 1), "hg");
+
+  ldb_iter_destroy(it);
+
+  /* Bounds holding no keys at all. */
+  it = db_iterator(db, "cc", "cd");
+
+  ldb_iter_last(it);
+
+  ASSERT(!ldb_iter_valid(it));
+
+  ldb_iter_first(it);
+
+  ASSERT(!ldb_iter_valid(it));
+  ASSERT(ldb_iter_status(it) == LDB_OK);
+
+  ldb_iter_destroy(it);
+}
+
+static void
+test_bounds_reverse(void) {
+  ldb_testdb_t t;
+
+  ldb_testdb_init(&t, "iter_bounds_test");
+  ldb_testdb_open(&t);
+
+  db_fill(&t);
+
+  /* From the memtable, then from a table. */
+  check_reverse(t.db);
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+
+  check_reverse(t.db);
+
+  ldb_testdb_clear(&t);
+}
+
+static void
+test_bounds_pruning(void) {
+  ldb_testdb_t t;
+  ldb_iter_t *it;
+
+  ldb_testdb_init(&t, "iter_bounds_test");
+  ldb_testdb_open(&t);
+
+  /* Level-2: [a,z]. Level-1: [a,b] and [x,y]. Level-0: [x,x]. */
+  ldb_testdb_put(&t, "a", "1");
+  ldb_testdb_put(&t, "z", "1");
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+
+  ldb_testdb_put(&t, "a", "2");
+  ldb_testdb_put(&t, "b", "2");
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+
+  ldb_testdb_put(&t, "x", "2");
+  ldb_testdb_put(&t, "y", "2");
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+
+  ldb_testdb_put(&t, "x", "3");
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+
+  ASSERT_EQ(ldb_testdb_contents(&t, NULL), "a=2,b=2,x=3,y=2,z=1");
+
+  /* Break the level-0 table. */
+  ldb_testdb_truncate(&t);
+  ldb_testdb_reopen(&t);
+
+  it = ldb_iterator(t.db, 0);
+
+  ldb_iter_first(it);
+
+  while (ldb_iter_valid(it))
+    ldb_iter_next(it);
+
+  ASSERT(ldb_iter_status(it) != LDB_OK);
+
+  ldb_iter_destroy(it);
+
+  /* Tables outside of the bounds are never opened. */
+  it = db_iterator(t.db, NULL, "c");
+
+  ldb_iter_first(it);
+
+  ASSERT_EQ(iter_keys(it, 0), "ab");
+
+  ldb_iter_last(it);
+
+  ASSERT_EQ(iter_keys(it, 1), "ba");
+
+  ldb_iter_destroy(it);
+
+  it = db_iterator(t.db, "b", "w");
+
+  ASSERT_EQ(iter_seek(it, "a"), "b");
+
+  ldb_iter_last(it);
+
+  ASSERT_EQ(iter_keys(it, 1), "b");
+
+  ldb_iter_destroy(it);
+
+  /* Reading up to the table fails again. */
+  it = db_iterator(t.db, "b", "xa");
+
+  ldb_iter_last(it);
+
+  ASSERT(ldb_iter_status(it) != LDB_OK);
+
+  ldb_iter_destroy(it);
+
+  ldb_testdb_clear(&t);
+}
+
+/*
+ * Execute
+ */
+
+int
+main(void) {
+  test_bounds_forward();
+  test_bounds_reverse();
+  test_bounds_pruning();
+
+  return 0;
+}
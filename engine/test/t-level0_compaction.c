@@ -0,0 +1,287 @@
+/*!
+ * t-level0_compaction.c - level-0 compaction test for lcdb
+ * Copyright (c) 2022, Christopher Jeffrey (MIT License).
+ * https://github.com/chjj/lcdb
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/env.h"
+#include "util/internal.h"
+#include "util/options.h"
+#include "util/slice.h"
+#include "util/status.h"
+#include "util/testutil.h"
+
+#include "db_impl.h"
+#include "dbformat.h"
+#include "version_edit.h"
+#include "version_set.h"
+
+/*
+ * Helpers
+ */
+
+#define KB (UINT64_C(1) << 10)
+#define MB (UINT64_C(1) << 20)
+
+static void
+vset_init(ldb_testvset_t *t) {
+  ldb_testvset_init(t, "level0_compaction_test");
+
+  /* Room for four 1MB memtables before writes stop. */
+  t->options.write_buffer_size = MB;
+  t->options.level0_compaction_trigger = 4;
+  t->options.level0_slowdown_writes_trigger = 8;
+  t->options.level0_stop_writes_trigger = 12;
+
+  ldb_testvset_open(t);
+}
+
+/* Add "count" small level-0 files. */
+static void
+vset_add_level0(ldb_testvset_t *t, int count) {
+  while (count--)
+    ldb_testvset_add(t, 0, "b", "y", 100 * KB);
+}
+
+/* Whether the inputs of "c" are a level-0 file and all those newer. */
+static int
+newest_inputs(const ldb_compaction_t *c, const ldb_vector_t *files) {
+  uint64_t oldest = UINT64_MAX;
+  size_t newer = 0;
+  size_t i;
+
+  for (i = 0; i < c->inputs[0].length; i++) {
+    const ldb_filemeta_t *f = c->inputs[0].items[i];
+
+    if (f->number < oldest)
+      oldest = f->number;
+  }
+
+  for (i = 0; i < files->length; i++) {
+    const ldb_filemeta_t *f = files->items[i];
+
+    if (f->number >= oldest)
+      newer++;
+  }
+
+  return newer == c->inputs[0].length;
+}
+
+static int
+db_files_at(ldb_t *db, int level) {
+  char name[64];
+  char *value;
+  int files;
+
+  sprintf(name, "leveldb.num-files-at-level%d", level);
+
+  ASSERT(ldb_property(db, name, &value));
+
+  files = atoi(value);
+
+  ldb_free(value);
+
+  return files;
+}
+
+/*
+ * Intra-L0 Compaction
+ */
+
+static void
+test_intra_l0_pick(void) {
+  ldb_compaction_t *c;
+  ldb_testvset_t t;
+
+  vset_init(&t);
+
+  /* Compacting a level-1 this size takes longer than filling
+     the memtables left before writes stop. */
+  ldb_testvset_add(&t, 1, "a", "z", 9 * MB);
+
+  vset_add_level0(&t, 7);
+
+  /* Under the slowdown trigger: a regular compaction. */
+  c = ldb_versions_pick_compaction(t.vset);
+
+  ASSERT(c != NULL);
+  ASSERT(c->level == 0 && c->output_level == 1);
+
+  ldb_compaction_destroy(c);
+
+  vset_add_level0(&t, 1);
+
+  /* At it: the level-0 files are merged in place. */
+  c = ldb_versions_pick_compaction(t.vset);
+
+  ASSERT(c != NULL);
+  ASSERT(c->level == 0 && c->output_level == 0);
+  ASSERT(c->inputs[0].length == 8);
+  ASSERT(c->inputs[1].length == 0);
+
+  ldb_compaction_destroy(c);
+
+  ldb_testvset_clear(&t);
+}
+
+static void
+test_intra_l0_small_parent(void) {
+  ldb_compaction_t *c;
+  ldb_testvset_t t;
+
+  vset_init(&t);
+
+  /* Quick enough to compact into. */
+  ldb_testvset_add(&t, 1, "a", "z", 3 * MB);
+
+  vset_add_level0(&t, 8);
+
+  c = ldb_versions_pick_compaction(t.vset);
+
+  ASSERT(c != NULL);
+  ASSERT(c->output_level == 1);
+
+  ldb_compaction_destroy(c);
+
+  ldb_testvset_clear(&t);
+}
+
+static void
+test_intra_l0_order(void) {
+  ldb_compaction_t *c;
+  ldb_testvset_t t;
+  ldb_version_t *v;
+
+  vset_init(&t);
+
+  ldb_testvset_add(&t, 1, "a", "z", 9 * MB);
+
+  /* A file which has been merged before, between small ones.
+     Only those newer than it may be merged, or the output would
+     be newer than a file holding newer entries. */
+  vset_add_level0(&t, 3);
+  ldb_testvset_add(&t, 0, "b", "y", 3 * MB);
+  vset_add_level0(&t, 5);
+
+  v = t.vset->current;
+  c = ldb_versions_pick_compaction(t.vset);
+
+  ASSERT(c != NULL);
+  ASSERT(c->output_level == 0);
+  ASSERT(c->inputs[0].length == 5);
+  ASSERT(newest_inputs(c, &v->files[0]));
+
+  ldb_compaction_destroy(c);
+
+  ldb_testvset_clear(&t);
+
+  /* Too few newer files to be worth merging. */
+  vset_init(&t);
+
+  ldb_testvset_add(&t, 1, "a", "z", 9 * MB);
+
+  vset_add_level0(&t, 5);
+  ldb_testvset_add(&t, 0, "b", "y", 3 * MB);
+  vset_add_level0(&t, 3);
+
+  c = ldb_versions_pick_compaction(t.vset);
+
+  ASSERT(c != NULL);
+  ASSERT(c->output_level == 1);
+
+  ldb_compaction_destroy(c);
+
+  ldb_testvset_clear(&t);
+}
+
+static void
+test_intra_l0_db(void) {
+  char val[1024 + 1];
+  ldb_testdb_t t;
+  char key[16];
+  int i;
+
+  ldb_testdb_init(&t, "level0_compaction_test");
+
+  t.options.compression = LDB_NO_COMPRESSION;
+
+  ldb_testdb_open(&t);
+
+  /* A level-1 file of about 1MB. */
+  ldb_testdb_put(&t, "k0500", "x");
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+  ASSERT(db_files_at(t.db, 2) == 1);
+
+  memset(val, 'x', sizeof(val) - 1);
+
+  val[sizeof(val) - 1] = '\0';
+
+  for (i = 0; i < 1000; i++) {
+    sprintf(key, "k%04d", i);
+    ldb_testdb_put(&t, key, val);
+  }
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+  ASSERT(db_files_at(t.db, 1) == 1);
+
+  ldb_testdb_close(&t);
+
+  /* Small memtables, which take less time to fill than it does
+     to compact level-0 into level-1. */
+  t.options.write_buffer_size = 64 << 10;
+  t.options.level0_compaction_trigger = 8;
+  t.options.level0_slowdown_writes_trigger = 8;
+  t.options.level0_stop_writes_trigger = 12;
+
+  ldb_testdb_open(&t);
+
+  for (i = 1; i <= 8; i++) {
+    sprintf(val, "v%d", i);
+
+    ldb_testdb_put(&t, "k0500", val);
+
+    ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+  }
+
+  for (i = 0; db_files_at(t.db, 0) != 1; i++) {
+    ASSERT(i < 1000);
+    ldb_sleep_usec(10000);
+  }
+
+  ASSERT(db_files_at(t.db, 1) == 1);
+  ASSERT_EQ(ldb_testdb_get(&t, "k0500", NULL), "v8");
+
+  /* The merged file is older than any flushed after it. */
+  ldb_testdb_put(&t, "k0500", "v9");
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+  ASSERT(db_files_at(t.db, 0) == 2);
+  ASSERT_EQ(ldb_testdb_get(&t, "k0500", NULL), "v9");
+
+  ldb_testdb_reopen(&t);
+
+  ASSERT_EQ(ldb_testdb_get(&t, "k0500", NULL), "v9");
+
+  ldb_testdb_clear(&t);
+}
+
+/*
+ * Execute
+ */
+
+int
+main(void) {
+  test_intra_l0_pick();
+  test_intra_l0_small_parent();
+  test_intra_l0_order();
+  test_intra_l0_db();
+
+  return 0;
+}
@@ -0,0 +1,211 @@
+/*!
+ * t-level_sizing.c - level sizing test for lcdb
+ * Copyright (c) 2022, Christopher Jeffrey (MIT License).
+ * https://github.com/chjj/lcdb
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/internal.h"
+#include "util/slice.h"
+#include "util/status.h"
+#include "util/testutil.h"
+
+#include "db_impl.h"
+#include "dbformat.h"
+#include "version_set.h"
+
+/*
+ * Helpers
+ */
+
+#define MB (UINT64_C(1) << 20)
+#define GB (UINT64_C(1) << 30)
+
+/* Level targets are computed in floating point. */
+static int
+near(double x, uint64_t y) {
+  return x > y * 0.999 && x < y * 1.001;
+}
+
+static int
+db_files_at(ldb_t *db, int level) {
+  char name[64];
+  char *value;
+  int files;
+
+  sprintf(name, "leveldb.num-files-at-level%d", level);
+
+  ASSERT(ldb_property(db, name, &value));
+
+  files = atoi(value);
+
+  ldb_free(value);
+
+  return files;
+}
+
+/* Level a memtable holding [small,large] would be flushed to. */
+static int
+vset_flush_level(ldb_testvset_t *t, const char *small, const char *large) {
+  ldb_slice_t small_key = ldb_string(small);
+  ldb_slice_t large_key = ldb_string(large);
+
+  return ldb_version_pick_level_for_memtable_output(t->vset->current,
+                                                    &small_key,
+                                                    &large_key);
+}
+
+/* Output level of the next compaction, or -1 if none is due. */
+static int
+vset_output_level(ldb_testvset_t *t, int *level) {
+  ldb_compaction_t *c = ldb_versions_pick_compaction(t->vset);
+  int output;
+
+  if (c == NULL)
+    return -1;
+
+  *level = c->level;
+  output = c->output_level;
+
+  ldb_compaction_destroy(c);
+
+  return output;
+}
+
+/*
+ * Level Sizing
+ */
+
+static void
+test_sizing_static(void) {
+  ldb_testvset_t t;
+  ldb_version_t *v;
+
+  ldb_testvset_init(&t, "level_sizing_test");
+  ldb_testvset_open(&t);
+
+  ldb_testvset_add(&t, 6, "a", "z", 50 * GB);
+
+  v = t.vset->current;
+
+  ASSERT(v->base_level == 1);
+  ASSERT(near(v->max_bytes[1], 10 * MB));
+  ASSERT(near(v->max_bytes[2], 100 * MB));
+  ASSERT(near(v->max_bytes[6], 1000000 * MB));
+
+  ASSERT(vset_flush_level(&t, "m", "n") == LDB_MAX_MEM_COMPACT_LEVEL);
+
+  ldb_testvset_clear(&t);
+}
+
+static void
+test_sizing_dynamic(void) {
+  ldb_testvset_t t;
+  ldb_version_t *v;
+  int level;
+
+  ldb_testvset_init(&t, "level_sizing_test");
+
+  t.options.dynamic_level_bytes = 1;
+
+  ldb_testvset_open(&t);
+
+  /* An empty database has everything go to the last level. */
+  v = t.vset->current;
+
+  ASSERT(v->base_level == LDB_NUM_LEVELS - 1);
+  ASSERT(near(v->max_bytes[LDB_NUM_LEVELS - 1], 10 * MB));
+  ASSERT(vset_flush_level(&t, "m", "n") == LDB_NUM_LEVELS - 1);
+
+  /* The last level keeps its size; each level above is a tenth
+     of the one below, down to the level-1 size. */
+  ldb_testvset_add(&t, 6, "a", "z", 50 * GB);
+
+  v = t.vset->current;
+
+  ASSERT(v->base_level == 3);
+  ASSERT(near(v->max_bytes[6], 50 * GB));
+  ASSERT(near(v->max_bytes[5], 5 * GB));
+  ASSERT(near(v->max_bytes[3], 50 * GB / 1000));
+  ASSERT(v->max_bytes[2] == 0);
+  ASSERT(v->max_bytes[1] == 0);
+
+  /* Flushes skip the empty levels above the base level. */
+  ASSERT(vset_flush_level(&t, "m", "n") == 3);
+
+  /* As do level-0 compactions. */
+  ASSERT(vset_output_level(&t, &level) == -1);
+
+  ldb_testvset_add(&t, 0, "b", "c", MB);
+  ldb_testvset_add(&t, 0, "b", "c", MB);
+  ldb_testvset_add(&t, 0, "b", "c", MB);
+  ldb_testvset_add(&t, 0, "b", "c", MB);
+
+  ASSERT(vset_output_level(&t, &level) == 3);
+  ASSERT(level == 0);
+
+  /* The base level moves up as the database grows. */
+  ldb_testvset_add(&t, 6, "za", "zz", 450 * GB);
+
+  v = t.vset->current;
+
+  ASSERT(v->base_level == 2);
+  ASSERT(near(v->max_bytes[6], 500 * GB));
+  ASSERT(near(v->max_bytes[2], 500 * GB / 10000));
+  ASSERT(v->max_bytes[1] == 0);
+
+  ldb_testvset_clear(&t);
+}
+
+static void
+test_sizing_db(void) {
+  ldb_testdb_t t;
+
+  ldb_testdb_init(&t, "level_sizing_test");
+
+  t.options.dynamic_level_bytes = 1;
+
+  ldb_testdb_open(&t);
+
+  /* A flush into an empty database goes straight to the last level. */
+  ldb_testdb_put(&t, "a", "1");
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+  ASSERT(db_files_at(t.db, LDB_NUM_LEVELS - 1) == 1);
+
+  /* One which cannot reach it goes to level-0. */
+  ldb_testdb_put(&t, "a", "2");
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+  ASSERT(db_files_at(t.db, 0) == 1);
+
+  ldb_test_compact_range(t.db, 0, NULL, NULL);
+
+  ASSERT(db_files_at(t.db, 0) == 0);
+  ASSERT(db_files_at(t.db, 1) == 0);
+  ASSERT(db_files_at(t.db, LDB_NUM_LEVELS - 1) == 1);
+
+  ldb_testdb_reopen(&t);
+
+  ASSERT_EQ(ldb_testdb_get(&t, "a", NULL), "2");
+
+  ldb_testdb_clear(&t);
+}
+
+/*
+ * Execute
+ */
+
+int
+main(void) {
+  test_sizing_static();
+  test_sizing_dynamic();
+  test_sizing_db();
+
+  return 0;
+}
@@ -0,0 +1,287 @@
+/*!
+ * t-log.c - log test for lcdb
+ * Copyright (c) 2022, Christopher Jeffrey (MIT License).
+ * https://github.com/chjj/lcdb
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/buffer.h"
+#include "util/slice.h"
+#include "util/status.h"
+#include "util/testutil.h"
+
+#include "log_format.h"
+#include "log_reader.h"
+#include "log_writer.h"
+
+/*
+ * Helpers
+ */
+
+/* Records are described as a letter and a length: "a10,b40000"
+   stands for ten a's followed by forty thousand b's. */
+static void
+log_write(ldb_buffer_t *dst, uint64_t number, const char *spec) {
+  char buf[256];
+  ldb_writer_t lw;
+  ldb_buffer_t rec;
+  char *item;
+
+  ASSERT(strlen(spec) < sizeof(buf));
+
+  strcpy(buf, spec);
+
+  ldb_writer_init(&lw, NULL, dst->size);
+
+  lw.dst = dst;
+
+  if (number != 0)
+    ldb_writer_set_log_number(&lw, number);
+
+  ldb_buffer_init(&rec);
+
+  for (item = strtok(buf, ","); item != NULL; item = strtok(NULL, ",")) {
+    size_t len = strtoul(item + 1, NULL, 10);
+
+    ldb_buffer_reset(&rec);
+    ldb_buffer_pad(&rec, len);
+
+    memset(rec.data, item[0], len);
+
+    ASSERT(ldb_writer_add_record(&lw, &rec) == LDB_OK);
+  }
+
+  ldb_buffer_clear(&rec);
+}
+
+/* Overwrite the start of "old" with "dst", as a recycled file would be. */
+static void
+log_recycle(ldb_buffer_t *dst, const ldb_buffer_t *old) {
+  ASSERT(dst->size <= old->size);
+
+  ldb_buffer_append(dst, old->data + dst->size, old->size - dst->size);
+}
+
+static void
+report_corruption(ldb_reporter_t *reporter, size_t bytes, int status) {
+  reporter->dropped_bytes += bytes;
+  *reporter->status = status;
+}
+
+/* Read every record back, describing them as log_write() takes them. */
+static const char *
+log_read(const ldb_buffer_t *src, uint64_t number, size_t *dropped) {
+  static char result[256];
+  ldb_reporter_t reporter;
+  ldb_buffer_t scratch;
+  ldb_slice_t record;
+  ldb_slice_t data;
+  ldb_reader_t lr;
+  int status = LDB_OK;
+  size_t n = 0;
+
+  reporter.status = &status;
+  reporter.dropped_bytes = 0;
+  reporter.corruption = report_corruption;
+
+  data = ldb_slice(src->data, src->size);
+
+  ldb_reader_init(&lr, NULL, &reporter, 1, 0);
+
+  lr.src = &data;
+
+  if (number != 0)
+    ldb_reader_set_log_number(&lr, number);
+
+  ldb_buffer_init(&scratch);
+
+  while (ldb_reader_read_record(&lr, &record, &scratch)) {
+    size_t i;
+
+    ASSERT(record.size > 0);
+
+    for (i = 1; i < record.size; i++)
+      ASSERT(record.data[i] == record.data[0]);
+
+    ASSERT(n + 32 < sizeof(result));
+
+    n += sprintf(result + n, "%s%c%lu", n > 0 ? "," : "",
+                             (int)record.data[0],
+                             (unsigned long)record.size);
+  }
+
+  result[n] = '\0';
+
+  ldb_buffer_clear(&scratch);
+  ldb_reader_clear(&lr);
+
+  ASSERT((status == LDB_OK) == (reporter.dropped_bytes == 0));
+
+  *dropped = reporter.dropped_bytes;
+
+  return result;
+}
+
+/*
+ * Log
+ */
+
+static void
+test_log_legacy(void) {
+  ldb_buffer_t dst;
+  size_t dropped;
+
+  ldb_buffer_init(&dst);
+
+  log_write(&dst, 0, "a10");
+
+  ASSERT(dst.size == LDB_HEADER_SIZE + 10);
+
+  log_write(&dst, 0, "b40000,c100");
+
+  ASSERT_EQ(log_read(&dst, 0, &dropped), "a10,b40000,c100");
+  ASSERT(dropped == 0);
+
+  /* Corruption is reported. */
+  dst.data[LDB_HEADER_SIZE] ^= 1;
+
+  ASSERT_EQ(log_read(&dst, 0, &dropped), "c100");
+  ASSERT(dropped > 0);
+
+  ldb_buffer_clear(&dst);
+}
+
+static void
+test_log_recyclable(void) {
+  ldb_buffer_t dst;
+  size_t dropped;
+
+  ldb_buffer_init(&dst);
+
+  log_write(&dst, 7, "a10");
+
+  ASSERT(dst.size == LDB_RECYCLABLE_HEADER_SIZE + 10);
+  ASSERT(dst.data[6] == LDB_TYPE_RECYCLABLE_FULL);
+
+  /* Fragmented across blocks: first, middle and last. */
+  log_write(&dst, 7, "b70000,c100");
+
+  ASSERT(dst.data[LDB_RECYCLABLE_HEADER_SIZE + 10 + 6]
+         == LDB_TYPE_RECYCLABLE_FIRST);
+
+  ASSERT_EQ(log_read(&dst, 7, &dropped), "a10,b70000,c100");
+  ASSERT(dropped == 0);
+
+  /* The log number is taken from the first record if unknown. */
+  ASSERT_EQ(log_read(&dst, 0, &dropped), "a10,b70000,c100");
+  ASSERT(dropped == 0);
+
+  /* Corruption before any valid record is still reported. */
+  dst.data[LDB_RECYCLABLE_HEADER_SIZE] ^= 1;
+
+  ASSERT_EQ(log_read(&dst, 7, &dropped), "c100");
+  ASSERT(dropped > 0);
+
+  ldb_buffer_clear(&dst);
+}
+
+static void
+test_log_recycled(void) {
+  ldb_buffer_t old, dst;
+  size_t dropped;
+
+  ldb_buffer_init(&old);
+  ldb_buffer_init(&dst);
+
+  /* The previous life of the file. */
+  log_write(&old, 1, "x1000,y1000,z40000");
+
+  /* Stale records after the new ones mark the end of the log. */
+  log_write(&dst, 2, "a500");
+  log_recycle(&dst, &old);
+
+  ASSERT_EQ(log_read(&dst, 2, &dropped), "a500");
+  ASSERT(dropped == 0);
+
+  ASSERT_EQ(log_read(&dst, 0, &dropped), "a500");
+  ASSERT(dropped == 0);
+
+  /* As does a record torn by the new ones. */
+  ldb_buffer_reset(&dst);
+
+  log_write(&dst, 2, "a500,b1200");
+  log_recycle(&dst, &old);
+
+  ASSERT_EQ(log_read(&dst, 2, &dropped), "a500,b1200");
+  ASSERT(dropped == 0);
+
+  /* Or one ending inside a fragmented record. */
+  ldb_buffer_reset(&dst);
+
+  log_write(&dst, 2, "a3000");
+  log_recycle(&dst, &old);
+
+  ASSERT_EQ(log_read(&dst, 2, &dropped), "a3000");
+  ASSERT(dropped == 0);
+
+  /* Stale records of a file written in the legacy format. */
+  ldb_buffer_reset(&old);
+  ldb_buffer_reset(&dst);
+
+  log_write(&old, 0, "x1000,y1000");
+  log_write(&dst, 2, "a10");
+  log_recycle(&dst, &old);
+
+  ASSERT_EQ(log_read(&dst, 2, &dropped), "a10");
+  ASSERT(dropped == 0);
+
+  ldb_buffer_clear(&old);
+  ldb_buffer_clear(&dst);
+}
+
+static void
+test_log_number_mismatch(void) {
+  ldb_buffer_t dst;
+  size_t dropped;
+
+  ldb_buffer_init(&dst);
+
+  log_write(&dst, 3, "a10,b10");
+
+  /* Records of another log are never returned. */
+  ASSERT_EQ(log_read(&dst, 4, &dropped), "");
+  ASSERT(dropped == 0);
+
+  ASSERT_EQ(log_read(&dst, 3, &dropped), "a10,b10");
+  ASSERT(dropped == 0);
+
+  /* Not even after a record of the right one. */
+  log_write(&dst, 4, "c10");
+  log_write(&dst, 3, "d10");
+
+  ASSERT_EQ(log_read(&dst, 3, &dropped), "a10,b10");
+  ASSERT(dropped == 0);
+
+  ASSERT_EQ(log_read(&dst, 0, &dropped), "a10,b10");
+  ASSERT(dropped == 0);
+
+  ldb_buffer_clear(&dst);
+}
+
+/*
+ * Execute
+ */
+
+int
+main(void) {
+  test_log_legacy();
+  test_log_recyclable();
+  test_log_recycled();
+  test_log_number_mismatch();
+  return 0;
+}
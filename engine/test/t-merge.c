@@ -0,0 +1,296 @@
+/*!
+ * t-merge.c - merge operator test for lcdb
+ * Copyright (c) 2022, Christopher Jeffrey (MIT License).
+ * https://github.com/chjj/lcdb
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "table/iterator.h"
+
+#include "util/buffer.h"
+#include "util/env.h"
+#include "util/internal.h"
+#include "util/options.h"
+#include "util/slice.h"
+#include "util/status.h"
+#include "util/testutil.h"
+
+#include "db_impl.h"
+#include "merge.h"
+#include "snapshot.h"
+
+/*
+ * Helpers
+ */
+
+/* Joins the operands with commas. */
+static int
+append_merge(const ldb_merger_t *op,
+             const ldb_slice_t *key,
+             const ldb_slice_t *existing,
+             const ldb_slice_t *value,
+             ldb_buffer_t *result) {
+  (void)op;
+  (void)key;
+
+  if (existing != NULL) {
+    ldb_merge_append(result, existing->data, existing->size);
+    ldb_merge_append(result, ",", 1);
+  }
+
+  ldb_merge_append(result, value->data, value->size);
+
+  return 1;
+}
+
+static const ldb_merger_t append_operator = {
+  /* .name = */ "test.Append",
+  /* .merge = */ append_merge,
+  /* .state = */ NULL
+};
+
+static void
+db_merge(ldb_t *db, const char *k, const char *v) {
+  ldb_slice_t key = ldb_string(k);
+  ldb_slice_t val = ldb_string(v);
+
+  ASSERT(ldb_merge(db, &key, &val, 0) == LDB_OK);
+}
+
+/*
+ * Operands
+ */
+
+static void
+test_operands(void) {
+  ldb_slice_t key = ldb_string("k");
+  ldb_slice_t base = ldb_string("a");
+  ldb_slice_t b = ldb_string("b");
+  ldb_slice_t c = ldb_string("c");
+  ldb_operands_t ops;
+  ldb_buffer_t out;
+
+  ldb_operands_init(&ops, &append_operator);
+  ldb_buffer_init(&out);
+
+  ASSERT(ldb_operands_combine(&ops, &key, &out) == LDB_INVALID);
+
+  /* Newest first. */
+  ldb_operands_push(&ops, &c);
+  ldb_operands_push(&ops, &b);
+
+  ASSERT(ldb_operands_length(&ops) == 2);
+
+  ASSERT(ldb_operands_merge(&ops, &key, &base, &out) == LDB_OK);
+  ASSERT(out.size == 5 && memcmp(out.data, "a,b,c", 5) == 0);
+
+  ASSERT(ldb_operands_merge(&ops, &key, NULL, &out) == LDB_OK);
+  ASSERT(out.size == 3 && memcmp(out.data, "b,c", 3) == 0);
+
+  ASSERT(ldb_operands_combine(&ops, &key, &out) == LDB_OK);
+  ASSERT(out.size == 3 && memcmp(out.data, "b,c", 3) == 0);
+
+  /* The result may alias the base. */
+  ldb_buffer_set(&out, base.data, base.size);
+
+  ASSERT(ldb_operands_merge(&ops, &key, &out, &out) == LDB_OK);
+  ASSERT(out.size == 5 && memcmp(out.data, "a,b,c", 5) == 0);
+
+  ldb_operands_reset(&ops);
+
+  ASSERT(ldb_operands_length(&ops) == 0);
+
+  ASSERT(ldb_merge_apply(NULL, &key, NULL, &b, &out) == LDB_INVALID);
+
+  ldb_buffer_clear(&out);
+  ldb_operands_clear(&ops);
+}
+
+/*
+ * DB
+ */
+
+static void
+test_db_memtable(void) {
+  ldb_testdb_t t;
+
+  ldb_testdb_init(&t, "merge_test");
+
+  t.options.merge_operator = &append_operator;
+
+  ldb_testdb_open(&t);
+
+  ldb_testdb_put(&t, "a", "1");
+  db_merge(t.db, "a", "2");
+  db_merge(t.db, "a", "3");
+
+  ASSERT_EQ(ldb_testdb_get(&t, "a", NULL), "1,2,3");
+
+  /* No value beneath. */
+  db_merge(t.db, "b", "x");
+
+  ASSERT_EQ(ldb_testdb_get(&t, "b", NULL), "x");
+
+  /* A deletion stops the operands. */
+  db_merge(t.db, "c", "old");
+  ldb_testdb_del(&t, "c");
+  db_merge(t.db, "c", "new");
+
+  ASSERT_EQ(ldb_testdb_get(&t, "c", NULL), "new");
+
+  /* A put replaces them. */
+  ldb_testdb_put(&t, "b", "y");
+
+  ASSERT_EQ(ldb_testdb_get(&t, "b", NULL), "y");
+
+  ldb_testdb_clear(&t);
+}
+
+static void
+test_db_tables(void) {
+  ldb_testdb_t t;
+
+  ldb_testdb_init(&t, "merge_test");
+
+  t.options.merge_operator = &append_operator;
+
+  ldb_testdb_open(&t);
+
+  ldb_testdb_put(&t, "a", "1");
+  db_merge(t.db, "b", "x");
+
+  ldb_compact(t.db, NULL, NULL);
+
+  ASSERT_EQ(ldb_testdb_get(&t, "a", NULL), "1");
+  ASSERT_EQ(ldb_testdb_get(&t, "b", NULL), "x");
+
+  /* Operands in the memtable over values in tables. */
+  db_merge(t.db, "a", "2");
+  db_merge(t.db, "b", "y");
+
+  ASSERT_EQ(ldb_testdb_get(&t, "a", NULL), "1,2");
+  ASSERT_EQ(ldb_testdb_get(&t, "b", NULL), "x,y");
+
+  /* Operands spread over several tables. */
+  ldb_testdb_reopen(&t);
+
+  db_merge(t.db, "a", "3");
+
+  ldb_testdb_reopen(&t);
+
+  ASSERT_EQ(ldb_testdb_get(&t, "a", NULL), "1,2,3");
+  ASSERT_EQ(ldb_testdb_get(&t, "b", NULL), "x,y");
+
+  ldb_compact(t.db, NULL, NULL);
+
+  ASSERT_EQ(ldb_testdb_get(&t, "a", NULL), "1,2,3");
+  ASSERT_EQ(ldb_testdb_get(&t, "b", NULL), "x,y");
+
+  ldb_testdb_clear(&t);
+}
+
+static void
+test_db_iterator(void) {
+  ldb_testdb_t t;
+
+  ldb_testdb_init(&t, "merge_test");
+
+  t.options.merge_operator = &append_operator;
+
+  ldb_testdb_open(&t);
+
+  ldb_testdb_put(&t, "a", "1");
+  db_merge(t.db, "a", "2");
+  db_merge(t.db, "b", "x");
+  ldb_testdb_put(&t, "c", "3");
+  db_merge(t.db, "d", "p");
+  ldb_testdb_del(&t, "d");
+
+  /* Both directions (see ldb_testdb_contents). */
+  ASSERT_EQ(ldb_testdb_contents(&t, NULL), "a=1,2,b=x,c=3");
+
+  ldb_compact(t.db, NULL, NULL);
+
+  db_merge(t.db, "b", "y");
+  db_merge(t.db, "c", "4");
+  db_merge(t.db, "d", "q");
+
+  ASSERT_EQ(ldb_testdb_contents(&t, NULL), "a=1,2,b=x,y,c=3,4,d=q");
+
+  ldb_testdb_clear(&t);
+}
+
+static void
+test_db_snapshot(void) {
+  ldb_testdb_t t;
+  const ldb_snapshot_t *s1, *s2;
+
+  ldb_testdb_init(&t, "merge_test");
+
+  t.options.merge_operator = &append_operator;
+
+  ldb_testdb_open(&t);
+
+  ldb_testdb_put(&t, "a", "1");
+  db_merge(t.db, "a", "2");
+  db_merge(t.db, "b", "x");
+
+  s1 = ldb_snapshot(t.db);
+
+  db_merge(t.db, "a", "3");
+  db_merge(t.db, "b", "y");
+
+  s2 = ldb_snapshot(t.db);
+
+  db_merge(t.db, "a", "4");
+  db_merge(t.db, "b", "z");
+
+  /* Compactions may only combine operands within a snapshot stripe. */
+  ldb_compact(t.db, NULL, NULL);
+
+  ASSERT_EQ(ldb_testdb_get(&t, "a", s1), "1,2");
+  ASSERT_EQ(ldb_testdb_get(&t, "a", s2), "1,2,3");
+  ASSERT_EQ(ldb_testdb_get(&t, "a", NULL), "1,2,3,4");
+
+  ASSERT_EQ(ldb_testdb_get(&t, "b", s1), "x");
+  ASSERT_EQ(ldb_testdb_get(&t, "b", s2), "x,y");
+  ASSERT_EQ(ldb_testdb_get(&t, "b", NULL), "x,y,z");
+
+  ASSERT_EQ(ldb_testdb_contents(&t, s1), "a=1,2,b=x");
+  ASSERT_EQ(ldb_testdb_contents(&t, s2), "a=1,2,3,b=x,y");
+
+  ldb_release(t.db, s1);
+
+  ldb_compact(t.db, NULL, NULL);
+
+  ASSERT_EQ(ldb_testdb_get(&t, "b", s2), "x,y");
+  ASSERT_EQ(ldb_testdb_get(&t, "b", NULL), "x,y,z");
+
+  ldb_release(t.db, s2);
+
+  ldb_compact(t.db, NULL, NULL);
+
+  ldb_testdb_reopen(&t);
+
+  ASSERT_EQ(ldb_testdb_contents(&t, NULL), "a=1,2,3,4,b=x,y,z");
+
+  ldb_testdb_clear(&t);
+}
+
+/*
+ * Execute
+ */
+
+int
+main(void) {
+  test_operands();
+  test_db_memtable();
+  test_db_tables();
+  test_db_iterator();
+  test_db_snapshot();
+
+  return 0;
+}
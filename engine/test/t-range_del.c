@@ -0,0 +1,399 @@
+/*!
+ * t-range_del.c - range deletion test for lcdb
+ * Copyright (c) 2022, Christopher Jeffrey (MIT License).
+ * https://github.com/chjj/lcdb
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "table/iterator.h"
+
+#include "util/buffer.h"
+#include "util/comparator.h"
+#include "util/env.h"
+#include "util/internal.h"
+#include "util/options.h"
+#include "util/slice.h"
+#include "util/status.h"
+#include "util/testutil.h"
+
+#include "db_impl.h"
+#include "dbformat.h"
+#include "range_del.h"
+#include "snapshot.h"
+#include "write_batch.h"
+
+/*
+ * Helpers
+ */
+
+static void
+db_del_range(ldb_t *db, const char *start, const char *limit) {
+  ldb_slice_t x = ldb_string(start);
+  ldb_slice_t y = ldb_string(limit);
+
+  ASSERT(ldb_del_range(db, &x, &y, 0) == LDB_OK);
+}
+
+static void
+db_fill(ldb_testdb_t *t) {
+  ldb_testdb_put(t, "a", "1");
+  ldb_testdb_put(t, "b", "2");
+  ldb_testdb_put(t, "c", "3");
+  ldb_testdb_put(t, "d", "4");
+  ldb_testdb_put(t, "e", "5");
+}
+
+/*
+ * RangeDel
+ */
+
+static void
+test_rangedel_covering(void) {
+  const ldb_comparator_t *ucmp = ldb_bytewise_comparator;
+  ldb_slice_t a = ldb_string("a");
+  ldb_slice_t b = ldb_string("b");
+  ldb_slice_t c = ldb_string("c");
+  ldb_slice_t d = ldb_string("d");
+  ldb_slice_t e = ldb_string("e");
+  ldb_rangedel_t rd;
+
+  ldb_rangedel_init(&rd, ucmp);
+
+  ldb_rangedel_add(&rd, &b, &d, 10);
+  ldb_rangedel_add(&rd, &c, &e, 20);
+  ldb_rangedel_add(&rd, &d, &d, 30); /* Empty. */
+
+  ASSERT(ldb_rangedel_length(&rd) == 2);
+
+  ldb_rangedel_finish(&rd);
+
+  /* The limit is exclusive. */
+  ASSERT(ldb_rangedel_covering(&rd, &a, 100) == 0);
+  ASSERT(ldb_rangedel_covering(&rd, &b, 100) == 10);
+  ASSERT(ldb_rangedel_covering(&rd, &c, 100) == 20);
+  ASSERT(ldb_rangedel_covering(&rd, &d, 100) == 20);
+  ASSERT(ldb_rangedel_covering(&rd, &e, 100) == 0);
+
+  /* Tombstones newer than the snapshot are invisible. */
+  ASSERT(ldb_rangedel_covering(&rd, &c, 15) == 10);
+  ASSERT(ldb_rangedel_covering(&rd, &d, 15) == 0);
+  ASSERT(ldb_rangedel_covering(&rd, &c, 5) == 0);
+
+  ldb_rangedel_clear(&rd);
+}
+
+static void
+test_rangedel_covers(void) {
+  const ldb_comparator_t *ucmp = ldb_bytewise_comparator;
+  ldb_slice_t a = ldb_string("a");
+  ldb_slice_t m = ldb_string("m");
+  ldb_rangedel_t rd;
+  ldb_pkey_t key;
+
+  ldb_rangedel_init(&rd, ucmp);
+  ldb_rangedel_add(&rd, &a, &m, 10);
+  ldb_rangedel_finish(&rd);
+
+  ldb_pkey_init(&key, &a, 9, LDB_TYPE_VALUE);
+
+  ASSERT(ldb_rangedel_covers(&rd, &key, 10));
+  ASSERT(!ldb_rangedel_covers(&rd, &key, 9));
+
+  /* Entries written after the tombstone survive it. */
+  ldb_pkey_init(&key, &a, 11, LDB_TYPE_VALUE);
+
+  ASSERT(!ldb_rangedel_covers(&rd, &key, 20));
+
+  ldb_rangedel_clear(&rd);
+}
+
+static void
+test_tombstone_export(void) {
+  const ldb_comparator_t *ucmp = ldb_bytewise_comparator;
+  ldb_slice_t b = ldb_string("b");
+  ldb_slice_t d = ldb_string("d");
+  const ldb_tombstone_t *t;
+  ldb_rangedel_t rd, rd2;
+  ldb_buffer_t key;
+  ldb_pkey_t pkey;
+
+  ldb_rangedel_init(&rd, ucmp);
+  ldb_rangedel_init(&rd2, ucmp);
+  ldb_buffer_init(&key);
+
+  ldb_rangedel_add(&rd, &b, &d, 7);
+
+  t = ldb_rangedel_get(&rd, 0);
+
+  ldb_tombstone_export(&key, t);
+
+  /* Stored under its start key with the new value type. */
+  ASSERT(ldb_pkey_import(&pkey, &key));
+  ASSERT(ldb_slice_equal(&pkey.user_key, &b));
+  ASSERT(pkey.sequence == 7);
+  ASSERT(pkey.type == LDB_TYPE_RANGE_DELETION);
+
+  ASSERT(ldb_rangedel_add_entry(&rd2, &key, &t->limit));
+  ASSERT(ldb_rangedel_length(&rd2) == 1);
+
+  t = ldb_rangedel_get(&rd2, 0);
+
+  ASSERT(ldb_slice_equal(&t->start, &b));
+  ASSERT(ldb_slice_equal(&t->limit, &d));
+  ASSERT(t->sequence == 7);
+
+  ldb_buffer_clear(&key);
+  ldb_rangedel_clear(&rd2);
+  ldb_rangedel_clear(&rd);
+}
+
+/*
+ * WriteBatch
+ */
+
+static void
+handle_put(ldb_handler_t *h, const ldb_slice_t *k, const ldb_slice_t *v) {
+  ldb_buffer_t *out = h->state;
+  ldb_buffer_string(out, "Put(");
+  ldb_buffer_concat(out, k);
+  ldb_buffer_string(out, ", ");
+  ldb_buffer_concat(out, v);
+  ldb_buffer_string(out, ")");
+}
+
+static void
+handle_del(ldb_handler_t *h, const ldb_slice_t *k) {
+  ldb_buffer_t *out = h->state;
+  ldb_buffer_string(out, "Delete(");
+  ldb_buffer_concat(out, k);
+  ldb_buffer_string(out, ")");
+}
+
+static void
+handle_del_range(ldb_handler_t *h,
+                 const ldb_slice_t *start,
+                 const ldb_slice_t *limit) {
+  ldb_buffer_t *out = h->state;
+  ldb_buffer_string(out, "DeleteRange(");
+  ldb_buffer_concat(out, start);
+  ldb_buffer_string(out, ", ");
+  ldb_buffer_concat(out, limit);
+  ldb_buffer_string(out, ")");
+}
+
+static void
+test_batch_del_range(void) {
+  ldb_slice_t a = ldb_string("a");
+  ldb_slice_t b = ldb_string("b");
+  ldb_slice_t z = ldb_string("z");
+  ldb_handler_t handler;
+  ldb_buffer_t out;
+  ldb_batch_t batch;
+
+  ldb_batch_init(&batch);
+  ldb_buffer_init(&out);
+
+  ldb_batch_put(&batch, &a, &b);
+  ldb_batch_del_range(&batch, &b, &z);
+  ldb_batch_del(&batch, &a);
+
+  ASSERT(ldb_batch_count(&batch) == 3);
+
+  memset(&handler, 0, sizeof(handler));
+
+  handler.state = &out;
+  handler.put = handle_put;
+  handler.del = handle_del;
+  handler.del_range = handle_del_range;
+
+  ASSERT(ldb_batch_iterate(&batch, &handler) == LDB_OK);
+
+  ldb_buffer_push(&out, 0);
+
+  ASSERT_EQ((char *)out.data, "Put(a, b)DeleteRange(b, z)Delete(a)");
+
+  ldb_buffer_clear(&out);
+  ldb_batch_clear(&batch);
+}
+
+/*
+ * DB
+ */
+
+static void
+test_db_del_range(void) {
+  ldb_testdb_t t;
+
+  ldb_testdb_init(&t, "range_del_test");
+  ldb_testdb_open(&t);
+
+  db_fill(&t);
+  db_del_range(t.db, "b", "d");
+
+  ASSERT_EQ(ldb_testdb_get(&t, "a", NULL), "1");
+  ASSERT_EQ(ldb_testdb_get(&t, "b", NULL), "NOT_FOUND");
+  ASSERT_EQ(ldb_testdb_get(&t, "c", NULL), "NOT_FOUND");
+  ASSERT_EQ(ldb_testdb_get(&t, "d", NULL), "4");
+  ASSERT_EQ(ldb_testdb_contents(&t, NULL), "a=1,d=4,e=5");
+
+  /* Newer writes are not hidden. */
+  ldb_testdb_put(&t, "c", "33");
+
+  ASSERT_EQ(ldb_testdb_get(&t, "c", NULL), "33");
+  ASSERT_EQ(ldb_testdb_contents(&t, NULL), "a=1,c=33,d=4,e=5");
+
+  /* The same holds once everything is in tables. */
+  ldb_compact(t.db, NULL, NULL);
+
+  ASSERT_EQ(ldb_testdb_get(&t, "b", NULL), "NOT_FOUND");
+  ASSERT_EQ(ldb_testdb_contents(&t, NULL), "a=1,c=33,d=4,e=5");
+
+  /* A tombstone in the memtable hides values in tables. */
+  db_del_range(t.db, "a", "z");
+
+  ASSERT_EQ(ldb_testdb_get(&t, "e", NULL), "NOT_FOUND");
+  ASSERT_EQ(ldb_testdb_contents(&t, NULL), "");
+
+  ldb_testdb_clear(&t);
+}
+
+static void
+test_db_snapshot(void) {
+  ldb_testdb_t t;
+  const ldb_snapshot_t *snap;
+
+  ldb_testdb_init(&t, "range_del_test");
+  ldb_testdb_open(&t);
+
+  db_fill(&t);
+
+  snap = ldb_snapshot(t.db);
+
+  db_del_range(t.db, "a", "c");
+
+  ASSERT_EQ(ldb_testdb_get(&t, "a", NULL), "NOT_FOUND");
+  ASSERT_EQ(ldb_testdb_get(&t, "a", snap), "1");
+  ASSERT_EQ(ldb_testdb_contents(&t, NULL), "c=3,d=4,e=5");
+  ASSERT_EQ(ldb_testdb_contents(&t, snap), "a=1,b=2,c=3,d=4,e=5");
+
+  /* Compaction must keep what the snapshot sees. */
+  ldb_compact(t.db, NULL, NULL);
+
+  ASSERT_EQ(ldb_testdb_get(&t, "b", NULL), "NOT_FOUND");
+  ASSERT_EQ(ldb_testdb_get(&t, "b", snap), "2");
+  ASSERT_EQ(ldb_testdb_contents(&t, NULL), "c=3,d=4,e=5");
+  ASSERT_EQ(ldb_testdb_contents(&t, snap), "a=1,b=2,c=3,d=4,e=5");
+
+  ldb_release(t.db, snap);
+
+  /* Once the snapshot is gone, the covered entries can be dropped. */
+  ldb_compact(t.db, NULL, NULL);
+
+  ASSERT_EQ(ldb_testdb_get(&t, "a", NULL), "NOT_FOUND");
+  ASSERT_EQ(ldb_testdb_contents(&t, NULL), "c=3,d=4,e=5");
+
+  ldb_testdb_clear(&t);
+}
+
+static void
+test_db_reopen(void) {
+  ldb_testdb_t t;
+
+  ldb_testdb_init(&t, "range_del_test");
+  ldb_testdb_open(&t);
+
+  db_fill(&t);
+  ldb_compact(t.db, NULL, NULL);
+
+  /* Recovered from the log. */
+  db_del_range(t.db, "b", "e");
+
+  ldb_testdb_reopen(&t);
+
+  ASSERT_EQ(ldb_testdb_get(&t, "c", NULL), "NOT_FOUND");
+  ASSERT_EQ(ldb_testdb_contents(&t, NULL), "a=1,e=5");
+
+  /* Recovered from a table holding only the tombstone. */
+  ldb_compact(t.db, NULL, NULL);
+
+  ldb_testdb_reopen(&t);
+
+  ASSERT_EQ(ldb_testdb_get(&t, "d", NULL), "NOT_FOUND");
+  ASSERT_EQ(ldb_testdb_contents(&t, NULL), "a=1,e=5");
+
+  ldb_testdb_put(&t, "b", "22");
+
+  ldb_testdb_reopen(&t);
+
+  ASSERT_EQ(ldb_testdb_contents(&t, NULL), "a=1,b=22,e=5");
+
+  ldb_testdb_clear(&t);
+}
+
+static void
+test_db_missing_table(void) {
+  ldb_testdb_t t;
+  ldb_slice_t lo = ldb_string("l");
+  ldb_slice_t hi = ldb_string("n");
+  ldb_iter_t *it;
+
+  ldb_testdb_init(&t, "range_del_test");
+  ldb_testdb_open(&t);
+
+  /* A value two levels down, below a tombstone covering it. */
+  ldb_testdb_put(&t, "m", "1");
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+
+  ldb_test_compact_range(t.db, 2, &lo, &hi);
+
+  db_del_range(t.db, "l", "n");
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+
+  /* Next to it, a table of tombstones which is about to be lost. */
+  ldb_testdb_put(&t, "b", "2");
+  db_del_range(t.db, "c", "d");
+
+  ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+
+  ASSERT_EQ(ldb_testdb_contents(&t, NULL), "b=2");
+
+  ldb_testdb_truncate(&t);
+
+  ldb_testdb_reopen(&t);
+
+  /* The iterator never touches the broken table itself,
+     but cannot tell what it would have deleted. */
+  it = ldb_iterator(t.db, 0);
+
+  ldb_iter_seek(it, &lo);
+
+  ASSERT(!ldb_iter_valid(it));
+  ASSERT(ldb_iter_status(it) != LDB_OK);
+
+  ldb_iter_destroy(it);
+
+  ldb_testdb_clear(&t);
+}
+
+/*
+ * Execute
+ */
+
+int
+main(void) {
+  test_rangedel_covering();
+  test_rangedel_covers();
+  test_tombstone_export();
+  test_batch_del_range();
+  test_db_del_range();
+  test_db_snapshot();
+  test_db_reopen();
+  test_db_missing_table();
+
+  return 0;
+}
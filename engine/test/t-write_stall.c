@@ -0,0 +1,298 @@
+/*!
+ * t-write_stall.c - write stall test for lcdb
+ * Copyright (c) 2022, Christopher Jeffrey (MIT License).
+ * https://github.com/chjj/lcdb
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/cache.h"
+#include "util/env.h"
+#include "util/internal.h"
+#include "util/options.h"
+#include "util/port.h"
+#include "util/slice.h"
+#include "util/status.h"
+#include "util/testutil.h"
+
+#include "db_impl.h"
+
+/*
+ * Helpers
+ */
+
+/* Holds up compactions until released, so that level-0 files
+   pile up for as long as the test needs them to. */
+typedef struct hold_state_s {
+  ldb_mutex_t mutex;
+  ldb_cond_t cond;
+  int held;
+  int waiting;
+} hold_state_t;
+
+static enum ldb_decision
+hold_filter(const ldb_cfilter_t *cf,
+            int level,
+            const ldb_slice_t *key,
+            const ldb_slice_t *value,
+            ldb_slice_t *new_value) {
+  hold_state_t *state = cf->state;
+
+  (void)level;
+  (void)key;
+  (void)value;
+  (void)new_value;
+
+  ldb_mutex_lock(&state->mutex);
+
+  state->waiting = 1;
+
+  ldb_cond_signal(&state->cond);
+
+  while (state->held)
+    ldb_cond_wait(&state->cond, &state->mutex);
+
+  state->waiting = 0;
+
+  ldb_mutex_unlock(&state->mutex);
+
+  return LDB_FILTER_KEEP;
+}
+
+static hold_state_t hold_state;
+
+static const ldb_cfilter_t hold = {
+  /* .name = */ "test.Hold",
+  /* .filter = */ hold_filter,
+  /* .state = */ &hold_state
+};
+
+static void
+hold_init(void) {
+  ldb_mutex_init(&hold_state.mutex);
+  ldb_cond_init(&hold_state.cond);
+
+  hold_state.held = 1;
+  hold_state.waiting = 0;
+}
+
+static void
+hold_clear(void) {
+  ldb_cond_destroy(&hold_state.cond);
+  ldb_mutex_destroy(&hold_state.mutex);
+}
+
+/* Wait for a compaction to reach the filter. */
+static void
+hold_wait(void) {
+  ldb_mutex_lock(&hold_state.mutex);
+
+  while (!hold_state.waiting)
+    ldb_cond_wait(&hold_state.cond, &hold_state.mutex);
+
+  ldb_mutex_unlock(&hold_state.mutex);
+}
+
+static void
+hold_release(void) {
+  ldb_mutex_lock(&hold_state.mutex);
+
+  hold_state.held = 0;
+
+  ldb_cond_signal(&hold_state.cond);
+  ldb_mutex_unlock(&hold_state.mutex);
+}
+
+static int
+db_files_at(ldb_t *db, int level) {
+  char name[64];
+  char *value;
+  int files;
+
+  sprintf(name, "leveldb.num-files-at-level%d", level);
+
+  ASSERT(ldb_property(db, name, &value));
+
+  files = atoi(value);
+
+  ldb_free(value);
+
+  return files;
+}
+
+/* Seconds writes have spent stalled for a cause. */
+static double
+db_stalled(ldb_t *db, const char *cause) {
+  size_t len = strlen(cause);
+  double seconds = -1;
+  char *value, *line;
+
+  ASSERT(ldb_property(db, "leveldb.stats", &value));
+
+  for (line = value; line != NULL; line = strchr(line, '\n')) {
+    if (*line == '\n')
+      line++;
+
+    if (strncmp(line, cause, len) == 0 && line[len] == ' ') {
+      seconds = strtod(line + len, NULL);
+      break;
+    }
+  }
+
+  ldb_free(value);
+
+  ASSERT(seconds >= 0);
+
+  return seconds;
+}
+
+/* Write "count" values of 1KB and return the time taken in seconds. */
+static double
+db_write(ldb_testdb_t *t, int count) {
+  int64_t start = ldb_now_usec();
+  char val[1024 + 1];
+  char key[16];
+  int i;
+
+  memset(val, 'v', sizeof(val) - 1);
+
+  val[sizeof(val) - 1] = '\0';
+
+  for (i = 0; i < count; i++) {
+    sprintf(key, "k%04d", i);
+    ldb_testdb_put(t, key, val);
+  }
+
+  return (ldb_now_usec() - start) / 1e6;
+}
+
+/*
+ * Write Stall
+ */
+
+static void
+test_stall_options(void) {
+  ldb_dbopt_t src = *ldb_dbopt_default;
+  ldb_dbopt_t opt;
+
+  src.info_log = ldb_logger_create(NULL, NULL);
+  src.block_cache = ldb_lru_create(1 << 20);
+
+  /* Each trigger is at least the one before it. */
+  src.level0_compaction_trigger = 1;
+  src.level0_slowdown_writes_trigger = 0;
+  src.level0_stop_writes_trigger = 1;
+  src.delayed_write_rate = 1;
+  src.soft_pending_compaction_bytes = 300;
+  src.hard_pending_compaction_bytes = 200;
+
+  opt = ldb_sanitize_options("", ldb_bytewise_comparator, NULL, &src);
+
+  ASSERT(opt.level0_compaction_trigger == 2);
+  ASSERT(opt.level0_slowdown_writes_trigger == 2);
+  ASSERT(opt.level0_stop_writes_trigger == 2);
+  ASSERT(opt.delayed_write_rate == 16 << 10);
+  ASSERT(opt.soft_pending_compaction_bytes == 200);
+  ASSERT(opt.hard_pending_compaction_bytes == 200);
+
+  src.level0_compaction_trigger = 4;
+  src.level0_slowdown_writes_trigger = 2000;
+  src.level0_stop_writes_trigger = 12;
+  src.delayed_write_rate = (size_t)-1;
+  src.hard_pending_compaction_bytes = 0;
+
+  opt = ldb_sanitize_options("", ldb_bytewise_comparator, NULL, &src);
+
+  ASSERT(opt.level0_compaction_trigger == 4);
+  ASSERT(opt.level0_slowdown_writes_trigger == 1000);
+  ASSERT(opt.level0_stop_writes_trigger == 1000);
+  ASSERT(opt.delayed_write_rate == 1 << 30);
+
+  /* Without a hard limit, the soft one is left alone. */
+  ASSERT(opt.soft_pending_compaction_bytes == 300);
+
+  ASSERT(opt.info_log == src.info_log);
+  ASSERT(opt.block_cache == src.block_cache);
+
+  ldb_lru_destroy(src.block_cache);
+  ldb_logger_destroy(src.info_log);
+}
+
+static void
+test_stall_level0(void) {
+  double fast, slow;
+  ldb_testdb_t t;
+  int i;
+
+  hold_init();
+
+  ldb_testdb_init(&t, "write_stall_test");
+
+  t.options.compaction_filter = &hold;
+  t.options.level0_compaction_trigger = 2;
+  t.options.level0_slowdown_writes_trigger = 2;
+  t.options.level0_stop_writes_trigger = 6;
+  t.options.delayed_write_rate = 16 << 10;
+
+  ldb_testdb_open(&t);
+
+  fast = db_write(&t, 8);
+
+  /* Overlapping flushes end up in level-0 once the levels
+     below hold the same range. */
+  for (i = 0; db_files_at(t.db, 0) < 2; i++) {
+    ASSERT(i < 10);
+
+    ldb_testdb_put(&t, "a", "x");
+    ldb_testdb_put(&t, "z", "x");
+
+    ASSERT(ldb_test_compact_memtable(t.db) == LDB_OK);
+  }
+
+  /* The level-0 compaction is held up: writes are paced at the
+     delayed write rate, lowered by a fifth (2 of 6 files). */
+  hold_wait();
+
+  ASSERT(db_stalled(t.db, "level0-slowdown") == 0);
+
+  slow = db_write(&t, 8);
+
+  ASSERT(slow >= 0.5);
+  ASSERT(slow > fast);
+  ASSERT(db_stalled(t.db, "level0-slowdown") >= 0.5);
+  ASSERT(db_stalled(t.db, "level0-stop") == 0);
+
+  /* Writes go through at full speed once it is done. */
+  hold_release();
+
+  for (i = 0; db_files_at(t.db, 0) > 0; i++) {
+    ASSERT(i < 1000);
+    ldb_sleep_usec(10000);
+  }
+
+  slow = db_stalled(t.db, "level0-slowdown");
+
+  db_write(&t, 8);
+
+  ASSERT(db_stalled(t.db, "level0-slowdown") == slow);
+
+  ldb_testdb_clear(&t);
+
+  hold_clear();
+}
+
+/*
+ * Execute
+ */
+
+int
+main(void) {
+  test_stall_options();
+  test_stall_level0();
+
+  return 0;
+}